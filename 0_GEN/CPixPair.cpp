@@ -1,6 +1,7 @@
 
 
 #include	"CPixPair.h"
+#include	"CTifReader.h"
 #include	"ImageIO.h"
 #include	"Maths.h"
 #include	"CAffineLens.h"
@@ -166,14 +167,152 @@ static bool HasTissue( const char *path, FILE *flog )
     return nlow < 0.20 * N;
 }
 
+/* --------------------------------------------------------------- */
+/* Box helpers --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// True if box B covers the whole w x h picture.
+//
+static bool IsWhole( const IBox &B, int w, int h )
+{
+    return B.L == 0 && B.B == 0 && B.R == w - 1 && B.T == h - 1;
+}
+
+
+// Set dst to a w x h zero image with box-sized src placed at B.
+//
+template<class T>
+static void PasteBox(
+    vector<T>		&dst,
+    const vector<T>	&src,
+    const IBox		&B,
+    int				w,
+    int				h )
+{
+    int	bw = B.R - B.L + 1,
+        bh = B.T - B.B + 1;
+
+    dst.assign( w * h, 0 );
+
+    for( int y = 0; y < bh; ++y )
+        memcpy( &dst[B.L + w*(B.B + y)], &src[bw*y], bw * sizeof(T) );
+}
+
+
+// Set dst to the contents of box B of w-wide src.
+//
+static void CopyBox(
+    vector<double>			&dst,
+    const vector<double>	&src,
+    const IBox				&B,
+    int						w )
+{
+    int	bw = B.R - B.L + 1,
+        bh = B.T - B.B + 1;
+
+    dst.resize( bw * bh );
+
+    for( int y = 0; y < bh; ++y )
+        memcpy( &dst[bw*y], &src[B.L + w*(B.B + y)], bw * sizeof(double) );
+}
+
+/* --------------------------------------------------------------- */
+/* LoadBox ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Load picture path, or if roi given, just the part of it inside
+// roi (TIFFs only, else the whole picture).
+//
+// On exit (w, h) are the full picture dims and B is the box that
+// the returned raster actually holds.
+//
+static uint8* LoadBox(
+    IBox		&B,
+    uint32		&w,
+    uint32		&h,
+    const char	*path,
+    const IBox	*roi,
+    FILE*		flog,
+    bool		transpose )
+{
+    uint8	*ras;
+
+    if( roi && !transpose ) {
+
+        const char	*p = strstr( path, ".tif" );
+        CTifReader	R;
+
+        if( p && !p[4] && R.Open( path, flog ) ) {
+
+            uint32	bw, bh;
+
+            w = R.w;
+            h = R.h;
+
+            if( ras = R.Read8( bw, bh, roi ) ) {
+
+                B.L	= max( 0, roi->L );
+                B.B	= max( 0, roi->B );
+                B.R	= B.L + bw - 1;
+                B.T	= B.B + bh - 1;
+
+                fprintf( flog,
+                "PixPair: Loaded box [%d %d %d %d] of %d x %d.\n",
+                B.L, B.R, B.B, B.T, w, h );
+
+                return ras;
+            }
+        }
+    }
+
+    ras = Raster8FromAny( path, w, h, flog, transpose );
+
+    B.L	= 0;
+    B.R	= w - 1;
+    B.B	= 0;
+    B.T	= h - 1;
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* Flatten ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Flatten box-sized ras into w x h image vout.
+//
+static void Flatten(
+    vector<double>	&vout,
+    const uint8		*ras,
+    const IBox		&B,
+    int				w,
+    int				h,
+    int				order )
+{
+    if( IsWhole( B, w, h ) )
+        LegPolyFlatten( vout, ras, w, h, order );
+    else {
+
+        vector<double>	vflat;
+
+        LegPolyFlatten( vflat, ras,
+            B.R - B.L + 1, B.T - B.B + 1, order );
+
+        PasteBox( vout, vflat, B, w, h );
+    }
+}
+
 /* --------------------------------------------------------------- */
 /* Lens ---------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+// Flatten box-sized ras and lens-correct it into w x h vout.
+//
 static void Lens(
     vector<double>	&vout,
     CAffineLens		&LN,
     const uint8		*ras,
+    const IBox		&B,
     int				w,
     int				h,
     int				order,
@@ -181,31 +320,119 @@ static void Lens(
 {
 // Flatten and release raster
 
+    int				bw = B.R - B.L + 1,
+                    bh = B.T - B.B + 1;
     vector<double>	vflat;
-    LegPolyFlatten( vflat, ras, w, h, order );
+    LegPolyFlatten( vflat, ras, bw, bh, order );
 
 // Transform into vout
 
     TAffine	T = LN.GetTf( cam );
-    int		np = w * h;
+    int		np = bw * bh;
 
-    vout.resize( np, 0.0 );
+    vout.assign( w * h, 0.0 );
 
     for( int i = 0; i < np; ++i ) {
 
-        int		y = i / w,
-                x = i - w*y;
-        Point	p( x, y );
+        int		y = i / bw,
+                x = i - bw*y;
+        Point	p( x + B.L, y + B.B );
 
         T.Transform( p );
         DistributePixel( p.x, p.y, vflat[i], vout, w, h );
     }
 }
 
+/* --------------------------------------------------------------- */
+/* ResinBox ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Make w x h resin mask from box-sized ras. Pixels outside the
+// box are marked as resin.
+//
+// Return tissue fraction within box.
+//
+static double ResinBox(
+    vector<uint8>	&msk,
+    const uint8		*ras,
+    const IBox		&B,
+    int				w,
+    int				h,
+    bool			samelayer )
+{
+    int	bw = B.R - B.L + 1,
+        bh = B.T - B.B + 1,
+        n  = bw * bh, sum = 0;
+
+    if( IsWhole( B, w, h ) ) {
+
+        ResinMask8( msk, ras, w, h, samelayer );
+
+        for( int i = 0; i < n; ++i )
+            sum += msk[i];
+    }
+    else {
+
+        vector<uint8>	bmsk;
+
+        ResinMask8( bmsk, ras, bw, bh, samelayer );
+
+        for( int i = 0; i < n; ++i )
+            sum += bmsk[i];
+
+        PasteBox( msk, bmsk, B, w, h );
+    }
+
+    return (double)sum / n;
+}
+
+/* --------------------------------------------------------------- */
+/* ConvolveBox --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Convolve and normalize box B of w x h image src into dst.
+//
+static void ConvolveBox(
+    vector<double>			&dst,
+    const vector<double>	&src,
+    const IBox				&B,
+    int						w,
+    int						h,
+    const vector<double>	&K,
+    int						dim,
+    vector<CD>				&kfft,
+    FILE*					flog )
+{
+    if( IsWhole( B, w, h ) ) {
+
+        Convolve( dst, src, w, h,
+            &K[0], dim, dim, true, true, kfft, flog );
+        Normalize( dst );
+    }
+    else {
+
+        vector<double>	bsrc, bdst;
+
+        CopyBox( bsrc, src, B, w );
+
+        Convolve( bdst, bsrc, B.R - B.L + 1, B.T - B.B + 1,
+            &K[0], dim, dim, true, true, kfft, flog );
+        Normalize( bdst );
+
+        PasteBox( dst, bdst, B, w, h );
+    }
+}
+
 /* --------------------------------------------------------------- */
 /* PixPair::Load ------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+// If roia (roib) is given, only that box of picture A (B) is
+// decoded, flattened, lens-corrected and filtered. The vectors
+// keep full picture dims with zeros outside the box, and resin
+// masks mark outside pixels as resin, so downstream geometry is
+// unchanged. Callers must keep all later work inside the boxes.
+//
 bool PixPair::Load(
     const PicSpec	&A,
     const PicSpec	&B,
@@ -217,7 +444,9 @@ bool PixPair::Load(
     int				r1,
     int				r2,
     FILE*			flog,
-    bool			transpose )
+    bool			transpose,
+    const IBox		*roia,
+    const IBox		*roib )
 {
     fprintf( flog, "\n---- Image loading ----\n" );
 
@@ -227,14 +456,15 @@ bool PixPair::Load(
 
     clock_t	t0 = StartTiming();
     uint8	*aras, *bras;
+    IBox	Ba, Bb;
     uint32	wa, ha, wb, hb;
     int		ok = false;
 
-    aras = Raster8FromAny( A.t2i.path.c_str(),
-            wa, ha, flog, transpose );
+    aras = LoadBox( Ba, wa, ha, A.t2i.path.c_str(),
+            roia, flog, transpose );
 
-    bras = Raster8FromAny( B.t2i.path.c_str(),
-            wb, hb, flog, transpose );
+    bras = LoadBox( Bb, wb, hb, B.t2i.path.c_str(),
+            roib, flog, transpose );
 
     if( !aras || !bras ) {
         fprintf( flog,
@@ -286,15 +516,15 @@ bool PixPair::Load(
         if( !LN.ReadIDB( idb, flog ) )
             goto exit;
 
-        Lens( _avf, LN, aras, wf, hf, order, A.t2i.cam );
-        Lens( _bvf, LN, bras, wf, hf, order, B.t2i.cam );
+        Lens( _avf, LN, aras, Ba, wf, hf, order, A.t2i.cam );
+        Lens( _bvf, LN, bras, Bb, wf, hf, order, B.t2i.cam );
         //VectorDblToTif8( "LensA.tif", _avf, wf, hf, flog );
         //VectorDblToTif8( "LensB.tif", _bvf, wf, hf, flog );
     }
     else {
 
-        LegPolyFlatten( _avf, aras, wf, hf, order );
-        LegPolyFlatten( _bvf, bras, wf, hf, order );
+        Flatten( _avf, aras, Ba, wf, hf, order );
+        Flatten( _bvf, bras, Bb, wf, hf, order );
     }
 
 /* ------------- */
@@ -304,20 +534,12 @@ bool PixPair::Load(
     if( resmsk ) {
 
         double	tisfraca, tisfracb;
-        int		n = wf * hf, suma = 0, sumb = 0;
 
         // first make smoothest masks
-        ResinMask8( resmska, aras, wf, hf, false );
-        ResinMask8( resmskb, bras, wf, hf, false );
+        tisfraca = ResinBox( resmska, aras, Ba, wf, hf, false );
+        tisfracb = ResinBox( resmskb, bras, Bb, wf, hf, false );
 
         // reject if no tissue
-        for( int i = 0; i < n; ++i ) {
-            suma += resmska[i];
-            sumb += resmskb[i];
-        }
-
-        tisfraca = (double)suma / n;
-        tisfracb = (double)sumb / n;
 
         fprintf( flog, "Tissue frac: A %.3f B %.3f\n",
         tisfraca, tisfracb );
@@ -331,8 +553,8 @@ bool PixPair::Load(
 
         // remake masks if same layer
         if( A.z == B.z ) {
-            ResinMask8( resmska, aras, wf, hf, true );
-            ResinMask8( resmskb, bras, wf, hf, true );
+            ResinBox( resmska, aras, Ba, wf, hf, true );
+            ResinBox( resmskb, bras, Bb, wf, hf, true );
         }
 
         //Raster8ToTif8( "resinA.tif", &resmska[0], wf, hf, flog );
@@ -371,16 +593,18 @@ bool PixPair::Load(
     if( bDoG ) {
 
         vector<double>	DoG;
-        vector<CD>		kfft;
+        vector<CD>		kfft, kfftb;
         int				dim = MakeDoGKernel( DoG, r1, r2, flog );
 
-        Convolve( _avfflt, _avf, wf, hf,
-            &DoG[0], dim, dim, true, true, kfft, flog );
-        Normalize( _avfflt );
+        // kernel fft is reusable only for equal sizes
+        bool	same =	Ba.R - Ba.L == Bb.R - Bb.L &&
+                        Ba.T - Ba.B == Bb.T - Bb.B;
+
+        ConvolveBox( _avfflt, _avf, Ba, wf, hf,
+            DoG, dim, kfft, flog );
 
-        Convolve( _bvfflt, _bvf, wf, hf,
-            &DoG[0], dim, dim, true, true, kfft, flog );
-        Normalize( _bvfflt );
+        ConvolveBox( _bvfflt, _bvf, Bb, wf, hf,
+            DoG, dim, (same ? kfft : kfftb), flog );
 
         avs_aln = avf_aln = &_avfflt;
         bvs_aln = bvf_aln = &_bvfflt;
@@ -51,7 +51,9 @@ public:
         int				r1,
         int				r2,
         FILE*			flog = stdout,
-        bool			transpose = false );
+        bool			transpose = false,
+        const IBox		*roia = NULL,
+        const IBox		*roib = NULL );
 };
 
 
@@ -3,6 +3,7 @@
 #include	"CThmScan.h"
 #include	"Correlation.h"
 #include	"EZThreads.h"
+#include	"Geometry.h"
 #include	"Maths.h"
 #include	"Timer.h"
 
@@ -10,6 +11,17 @@
 using namespace std;
 
 
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	FMDIM	256		// Fourier-Mellin image edge
+#define	FMNANG	256		// log-polar angle samples over 180 deg
+#define	FMNRAD	128		// log-polar radius samples
+
+#define	PYRRAD	4		// pyramid refine disc radius, pixels
+#define	PYRMIN	64		// pyramid coarsest level min edge
+
 /* --------------------------------------------------------------- */
 /* Statics ------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -60,6 +72,254 @@ static double NewXFromParabola(
     return x1;
 }
 
+/* --------------------------------------------------------------- */
+/* FMBounds ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void FMBounds(
+    double				&x0,
+    double				&y0,
+    double				&x1,
+    double				&y1,
+    const vector<Point>	&pts )
+{
+    int	np = pts.size();
+
+    x0 = y0 = BIGD;
+    x1 = y1 = -BIGD;
+
+    for( int i = 0; i < np; ++i ) {
+
+        const Point&	p = pts[i];
+
+        if( p.x < x0 ) x0 = p.x;
+        if( p.x > x1 ) x1 = p.x;
+        if( p.y < y0 ) y0 = p.y;
+        if( p.y > y1 ) y1 = p.y;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* FMImage ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Bin point list (pts, vals) by bin into FMDIM-square image I,
+// centered, zero mean, Hann-windowed over its own bounds so the
+// image edges don't paint a cross into the spectrum.
+//
+static void FMImage(
+    vector<double>			&I,
+    const vector<Point>		&pts,
+    const vector<double>	&vals,
+    double					bin )
+{
+    const int	N = FMDIM;
+
+    vector<int>	n( N * N, 0 );
+    double		x0, y0, x1, y1, sum = 0.0;
+    int			np = pts.size(), w, h, ox, oy, nset = 0;
+
+    FMBounds( x0, y0, x1, y1, pts );
+
+    w	= min( N, int((x1 - x0) / bin) + 1 );
+    h	= min( N, int((y1 - y0) / bin) + 1 );
+    ox	= (N - w) / 2;
+    oy	= (N - h) / 2;
+
+    I.assign( N * N, 0.0 );
+
+    for( int i = 0; i < np; ++i ) {
+
+        int	x = min( w - 1, int((pts[i].x - x0) / bin) ),
+            y = min( h - 1, int((pts[i].y - y0) / bin) ),
+            k = ox + x + N*(oy + y);
+
+        I[k] += vals[i];
+        ++n[k];
+    }
+
+    for( int i = 0; i < N * N; ++i ) {
+
+        if( n[i] ) {
+            sum += (I[i] /= n[i]);
+            ++nset;
+        }
+    }
+
+    if( !nset )
+        return;
+
+    sum /= nset;
+
+    for( int y = 0; y < h; ++y ) {
+
+        double	wy = 0.5 - 0.5 * cos( 2*PI * (y + 0.5) / h );
+
+        for( int x = 0; x < w; ++x ) {
+
+            int	k = ox + x + N*(oy + y);
+
+            if( n[k] ) {
+                I[k] = (I[k] - sum) * wy *
+                        (0.5 - 0.5 * cos( 2*PI * (x + 0.5) / w ));
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* FMLogPolar ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Resample high-pass filtered magnitude spectrum of FMDIM-square
+// image I onto a log-polar grid L[FMNRAD][FMNANG], angles covering
+// [0,180) since the magnitude is point-symmetric. The rows are
+// zero mean and Hann-windowed along the radius.
+//
+// Return log-radius step.
+//
+static double FMLogPolar(
+    vector<double>			&L,
+    const vector<double>	&I,
+    FILE					*flog )
+{
+    const int		N	= FMDIM,
+                    M	= N/2 + 1;
+    const double	rmin = 2.0,
+                    rmax = N/2 - 2,
+                    dlr	 = log( rmax / rmin ) / (FMNRAD - 1);
+
+    vector<CD>		F;
+    vector<double>	A( M * N );
+
+    FFT_2D( F, I, N, N, false, flog );
+
+// Magnitude with (1-X)(2-X) high-pass emphasis
+
+    for( int v = 0; v < N; ++v ) {
+
+        double	cv = cos( PI * (v < M ? v : v - N) / N );
+
+        for( int u = 0; u < M; ++u ) {
+
+            double	X = cos( PI * u / N ) * cv;
+
+            A[u + M*v] = abs( F[u + M*v] ) * (1.0 - X) * (2.0 - X);
+        }
+    }
+
+// Bilinear resample; fold angles with u < 0 through origin
+
+    L.resize( FMNRAD * FMNANG );
+
+    for( int ir = 0; ir < FMNRAD; ++ir ) {
+
+        double	r	= rmin * exp( ir * dlr ),
+                wr	= 0.5 - 0.5 * cos( 2*PI * (ir + 0.5) / FMNRAD );
+
+        for( int ia = 0; ia < FMNANG; ++ia ) {
+
+            double	t = PI * ia / FMNANG,
+                    u = r * cos( t ),
+                    v = r * sin( t );
+
+            if( u < 0 ) {
+                u = -u;
+                v = -v;
+            }
+
+            if( v < 0 )
+                v += N;
+
+            int		iu = (int)u,
+                    iv = (int)v,
+                    iv1	= (iv + 1) % N;
+            double	fu = u - iu,
+                    fv = v - iv;
+
+            L[ia + FMNANG*ir] = wr * log( 1.0 +
+                (1-fu)*(1-fv) * A[iu   + M*iv] +
+                   fu *(1-fv) * A[iu+1 + M*iv] +
+                (1-fu)*   fv  * A[iu   + M*iv1] +
+                   fu *   fv  * A[iu+1 + M*iv1] );
+        }
+    }
+
+// Zero mean
+
+    double	sum = 0.0;
+    int		nL = FMNRAD * FMNANG;
+
+    for( int i = 0; i < nL; ++i )
+        sum += L[i];
+
+    sum /= nL;
+
+    for( int i = 0; i < nL; ++i )
+        L[i] -= sum;
+
+    return dlr;
+}
+
+/* --------------------------------------------------------------- */
+/* HalvePoints --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Bin 2x2 the point list (ip, iv) into (op, ov), averaging values,
+// and renormalize. Return max coordinate span of the result.
+//
+static int HalvePoints(
+    vector<Point>			&op,
+    vector<double>			&ov,
+    const vector<Point>		&ip,
+    const vector<double>	&iv )
+{
+    DBox	B;
+    int		np = ip.size(), w, h;
+
+    op.clear();
+    ov.clear();
+
+    if( !np )
+        return 0;
+
+    BBoxFromPoints( B, ip );
+
+    w = int((B.R - B.L) / 2) + 1;
+    h = int((B.T - B.B) / 2) + 1;
+
+    vector<double>	sum( w * h, 0.0 );
+    vector<int>		n( w * h, 0 );
+
+    for( int i = 0; i < np; ++i ) {
+
+        int	k = int((ip[i].x - B.L) / 2) + w * int((ip[i].y - B.B) / 2);
+
+        sum[k] += iv[i];
+        ++n[k];
+    }
+
+    int	x0 = int(floor( B.L / 2 )),
+        y0 = int(floor( B.B / 2 ));
+
+    for( int y = 0; y < h; ++y ) {
+
+        for( int x = 0; x < w; ++x ) {
+
+            int	k = x + w * y;
+
+            if( n[k] ) {
+                op.push_back( Point( x0 + x, y0 + y ) );
+                ov.push_back( sum[k] / n[k] );
+            }
+        }
+    }
+
+    Normalize( ov );
+
+    return max( w, h );
+}
+
 /* --------------------------------------------------------------- */
 /* _TCDDo1 ------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -169,6 +429,7 @@ CThmScan::CThmScan()
     swpConstXY	= true;
     swpPretweak	= true;
     swpNThreads	= 1;
+    swpFMellin	= false;
     useCorrR	= false;
     Ox			= 0;
     Oy			= 0;
@@ -757,10 +1018,211 @@ bool CThmScan::UsePriorAngles(
     return true;
 }
 
+/* --------------------------------------------------------------- */
+/* FMellinAngle -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fourier-Mellin estimate of rotation and scale taking A to B.
+//
+// Magnitude spectra are translation invariant; resampled on a
+// log-polar grid, rotation and scale become shifts, recovered by
+// one phase correlation. The angle is known only mod 180 degrees
+// and its resolution is about 180/FMNANG.
+//
+// Return false if either point list is empty.
+//
+bool CThmScan::FMellinAngle( double &deg, double &scl, ThmRec &thm )
+{
+    if( !thm.ap.size() || !thm.bp.size() )
+        return false;
+
+    vector<Point>	pts = thm.ap;
+    TAffine			T = Tdfm * Tptwk;
+
+    T.Apply_R_Part( pts );
+
+// Common bin so both images have the same pixel scale
+
+    double	ax0, ay0, ax1, ay1,
+            bx0, by0, bx1, by1,
+            bin;
+
+    FMBounds( ax0, ay0, ax1, ay1, pts );
+    FMBounds( bx0, by0, bx1, by1, thm.bp );
+
+    bin = max( max( ax1 - ax0, ay1 - ay0 ),
+               max( bx1 - bx0, by1 - by0 ) ) / (FMDIM - 1);
+
+    if( bin < 1.0 )
+        bin = 1.0;
+
+// Log-polar spectra
+
+    vector<double>	IA, IB, LA, LB;
+    double			dlr;
+
+    FMImage( IA, pts, thm.av, bin );
+    FMImage( IB, thm.bp, thm.bv, bin );
+
+    FMLogPolar( LA, IA, flog );
+    dlr = FMLogPolar( LB, IB, flog );
+
+// Phase correlation
+
+    vector<CD>	FA, FB;
+    int			M;
+
+    M = FFT_2D( FA, LA, FMNANG, FMNRAD, false, flog );
+    FFT_2D( FB, LB, FMNANG, FMNRAD, false, flog );
+
+    for( int i = 0; i < M; ++i ) {
+
+        CD		c = FB[i] * conj( FA[i] );
+        double	a = abs( c );
+
+        FA[i] = (a > 1e-12 ? c / a : CD( 0.0, 0.0 ));
+    }
+
+    IFT_2D( LA, FA, FMNANG, FMNRAD, flog );
+
+// Peak
+
+    int		nL = FMNRAD * FMNANG, ipk = 0;
+    double	rms = 0.0;
+
+    for( int i = 0; i < nL; ++i ) {
+
+        rms += LA[i] * LA[i];
+
+        if( LA[i] > LA[ipk] )
+            ipk = i;
+    }
+
+    rms = sqrt( rms / nL );
+
+    int		pr = ipk / FMNANG,
+            pa = ipk - FMNANG * pr;
+    double	y0 = LA[(pa + FMNANG - 1) % FMNANG + FMNANG*pr],
+            y2 = LA[(pa + 1) % FMNANG + FMNANG*pr],
+            da = pa;
+
+    da = NewXFromParabola( da, 1.0, y0, LA[ipk], y2 );
+
+    if( da > FMNANG / 2 )
+        da -= FMNANG;
+
+    if( pr > FMNRAD / 2 )
+        pr -= FMNRAD;
+
+    deg = da * 180.0 / FMNANG;
+    scl = exp( -pr * dlr );
+
+    fprintf( flog,
+    "FMellin: A=%.3f (mod 180), S=%.4f, peak/rms=%.1f, bin=%.2f\n",
+    deg, scl, (rms > 0 ? LA[ipk] / rms : 0.0), bin );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* FMellinBestAngle ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Replace the DenovoBestAngle sweep with a Fourier-Mellin guess:
+// test the guess and its 180 degree alias if they lie within
+// ang0 +/- hfangdn, bracket the better one over the estimator's
+// resolution and hand that to PeakHunt.
+//
+// Return false if no candidate reaches rthresh, so caller can
+// fall back to the full sweep.
+//
+bool CThmScan::FMellinBestAngle(
+    CorRec	&best,
+    double	ang0,
+    double	hfangdn,
+    ThmRec	&thm )
+{
+    clock_t	t0 = StartTiming();
+    double	deg, scl,
+            da = 180.0 / FMNANG;
+
+    if( !FMellinAngle( deg, scl, thm ) )
+        return false;
+
+// Candidates
+
+    TCD.thm = &thm;
+    TCD.vC.clear();
+
+    for( int k = 0; k < 2; ++k ) {
+
+        double	a = deg + 180.0 * k;
+
+        while( a - ang0 > 180.0 )
+            a -= 360.0;
+
+        while( a - ang0 <= -180.0 )
+            a += 360.0;
+
+        if( fabs( a - ang0 ) > hfangdn + da )
+            continue;
+
+        TCD.vC.push_back( CorRec( a - da ) );
+        TCD.vC.push_back( CorRec( a ) );
+        TCD.vC.push_back( CorRec( a + da ) );
+    }
+
+    if( !TCD.vC.size() ) {
+        fprintf( flog, "FMellin: No candidate in range.\n" );
+        return false;
+    }
+
+    TCDGet( swpNThreads );
+
+// Best triplet center, nudged by parabola
+
+    int	nc = TCD.vC.size(), ibest = 0;
+
+    for( int ic = 0; ic < nc; ++ic ) {
+
+        const CorRec&	C = TCD.vC[ic];
+        RecordAngle( flog, "FMScan", C );
+
+        if( C.R > TCD.vC[ibest].R )
+            ibest = ic;
+    }
+
+    best = TCD.vC[ibest];
+
+    if( ibest % 3 == 1 ) {
+
+        best.A = NewXFromParabola( best.A, da,
+                    TCD.vC[ibest-1].R, best.R, TCD.vC[ibest+1].R );
+    }
+
+    TCD.vC.clear();
+
+    StopTiming( flog, "FMellin", t0 );
+
+    if( PeakHunt( best, da, thm ) < rthresh ) {
+
+        fprintf( flog,
+        "FMellin: R=%g below thresh=%g; full sweep.\n",
+        best.R, rthresh );
+
+        return false;
+    }
+
+    return true;
+}
+
 /* --------------------------------------------------------------- */
 /* DenovoBestAngle ----------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+// If swpFMellin set, try FMellinBestAngle first; fall back to
+// the brute force sweep on failure.
+//
 bool CThmScan::DenovoBestAngle(
     CorRec	&best,
     double	ang0,
@@ -769,6 +1231,9 @@ bool CThmScan::DenovoBestAngle(
     ThmRec	&thm,
     bool	failmsg )
 {
+    if( swpFMellin && FMellinBestAngle( best, ang0, hfangdn, thm ) )
+        return true;
+
     if( AngleScanWithTweaks( best, ang0, hfangdn, step, thm )
             < rthresh ||
         AngleScanSel( best, best.A, step*2.0, step*0.05, false, thm )
@@ -789,6 +1254,130 @@ bool CThmScan::DenovoBestAngle(
     return true;
 }
 
+/* --------------------------------------------------------------- */
+/* PyramidBestAngle ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Coarse-to-fine version of DenovoBestAngle.
+//
+// Build up to nlev levels, each binning the previous 2x2, stopping
+// before either point set spans fewer than PYRMIN pixels. Solve
+// de novo at the coarsest level, then at each finer level double
+// the offset, narrow the search disc to PYRRAD pixels about it and
+// PeakHunt the angle over a window halving per level. Only the
+// coarsest level pays for the full angle and translation ranges.
+//
+// Any disc set by caller (SetDisc) is scaled to each level.
+// Angle-dependent discs (SetNewAngProc) are not supported.
+//
+// If pretweak, first do Pretweaks( 0, ang0 ), as callers would
+// before DenovoBestAngle. Tptwk has no translation part, so it is
+// found at the coarsest level and applies unchanged to finer ones.
+// The single-level fallbacks run it at full resolution.
+//
+bool CThmScan::PyramidBestAngle(
+    CorRec	&best,
+    double	ang0,
+    double	hfangdn,
+    double	step,
+    ThmRec	&thm,
+    int		nlev,
+    bool	pretweak,
+    bool	failmsg )
+{
+    if( nlev <= 1 || newAngProc ) {
+
+        if( pretweak )
+            Pretweaks( 0, ang0, thm );
+
+        return DenovoBestAngle( best, ang0, hfangdn, step, thm, failmsg );
+    }
+
+    clock_t	t0 = StartTiming();
+
+// Build levels; vT[0] is caller's
+
+    vector<ThmRec>	vT( nlev );
+    int				L;
+
+    for( L = 1; L < nlev; ++L ) {
+
+        ThmRec	&lo = vT[L];
+        ThmRec	&hi = (L == 1 ? thm : vT[L-1]);
+
+        if( HalvePoints( lo.ap, lo.av, hi.ap, hi.av ) < PYRMIN ||
+            HalvePoints( lo.bp, lo.bv, hi.bp, hi.bv ) < PYRMIN ) {
+
+            break;
+        }
+
+        lo.reqArea	= hi.reqArea / 4;
+        lo.olap1D	= max( 1, hi.olap1D / 2 );
+        lo.scl		= hi.scl;
+    }
+
+    int	top = L - 1;
+
+    fprintf( flog, "Pyramid: %d levels.\n", top + 1 );
+
+    if( !top ) {
+
+        if( pretweak )
+            Pretweaks( 0, ang0, thm );
+
+        return DenovoBestAngle( best, ang0, hfangdn, step, thm, failmsg );
+    }
+
+// Solve coarsest
+
+    int	ox = Ox, oy = Oy, rx = Rx, ry = Ry;
+
+    if( rx > 0 && ry > 0 )
+        SetDisc( ox >> top, oy >> top, max( 1, rx >> top ), max( 1, ry >> top ) );
+
+    if( pretweak )
+        Pretweaks( 0, ang0, vT[top] );
+
+    bool	ok = DenovoBestAngle( best, ang0, hfangdn, step, vT[top], failmsg );
+
+// Refine
+
+    double	hlf = step;
+
+    for( L = top - 1; ok && L >= 0; --L ) {
+
+        ThmRec	&T = (L ? vT[L] : thm);
+
+        SetDisc( ROUND( 2 * best.X ), ROUND( 2 * best.Y ), PYRRAD, PYRRAD );
+
+        fprintf( flog, "Pyramid: Level %d, A=%.3f +/- %.3f\n", L, best.A, hlf );
+
+        // R scores are not comparable across levels
+
+        best.R = -1;
+
+        if( PeakHunt( best, hlf, T ) < rthresh ) {
+
+            if( failmsg ) {
+                fprintf( flog,
+                "FAIL: Approx: Pyramid level %d R=%g below thresh=%g\n",
+                L, best.R, rthresh );
+            }
+
+            err	= errLowRDenov;
+            ok	= false;
+        }
+
+        hlf /= 2;
+    }
+
+    SetDisc( ox, oy, rx, ry );
+
+    StopTiming( flog, "Pyramid", t0 );
+
+    return ok;
+}
+
 /* --------------------------------------------------------------- */
 /* PostTweaks ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
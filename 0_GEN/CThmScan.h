@@ -91,6 +91,7 @@ private:
                     swpConstXY,
                     swpPretweak,
                     swpNThreads,
+                    swpFMellin,
                     useCorrR,
                     Ox, Oy, Rx, Ry,
                     olap1D;
@@ -108,6 +109,14 @@ private:
         double	deg,
         ThmRec	&thm );
 
+    bool FMellinAngle( double &deg, double &scl, ThmRec &thm );
+
+    bool FMellinBestAngle(
+        CorRec	&best,
+        double	ang0,
+        double	hfangdn,
+        ThmRec	&thm );
+
 public:
     CThmScan();
 
@@ -134,6 +143,9 @@ public:
     void SetSweepNThreads( int swpNThreads )
         {this->swpNThreads = swpNThreads;};
 
+    void SetSweepFMellin( int swpFMellin )
+        {this->swpFMellin = swpFMellin;};
+
     void SetUseCorrR( int useCorrR )
         {this->useCorrR = useCorrR;};
 
@@ -217,6 +229,16 @@ public:
         ThmRec	&thm,
         bool	failmsg );
 
+    bool PyramidBestAngle(
+        CorRec	&best,
+        double	ang0,
+        double	hfangdn,
+        double	step,
+        ThmRec	&thm,
+        int		nlev,
+        bool	pretweak,
+        bool	failmsg );
+
     void PostTweaks( CorRec &best, ThmRec &thm );
 
     void FinishAtFullRes( CorRec &best, ThmRec &thm );
@@ -0,0 +1,759 @@
+
+
+#include	"CTifReader.h"
+#include	"EZThreads.h"
+#include	"ImageIO.h"
+
+#include	"tiffio.h"
+
+#include	<stdlib.h>
+#include	<string.h>
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	GENEMEYERSTIFF		1
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Everything a decode thread needs to know
+//
+class CTRCtx {
+public:
+    const char	*name;
+    FILE		*flog;
+    uint8		*dst;
+    IBox		B;
+    vector<int>	vchk;	// strip or tile indices
+    int			w, h, cw, ch, ntx, bpp;
+    bool		tiled, err;
+};
+
+class CTRThrd {
+public:
+    int	k0, klim;
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// mutex_tr guards the thread context
+static pthread_mutex_t	mutex_tr = PTHREAD_MUTEX_INITIALIZER;
+static CTRCtx			*TR;
+static vector<CTRThrd>	vtr;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* CRasterPool --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+CRasterPool::CRasterPool( int maxfree )
+    : bytes(0), maxfree(maxfree)
+{
+    pthread_mutex_init( &mtx, NULL );
+}
+
+
+CRasterPool::~CRasterPool()
+{
+    Clear();
+    pthread_mutex_destroy( &mtx );
+}
+
+
+// Return a raster of given size, recycled if possible.
+// Asking for a new size drops buffers of the old size.
+//
+void* CRasterPool::Get( unsigned long bytes )
+{
+    void	*ras = NULL;
+
+    pthread_mutex_lock( &mtx );
+
+    if( bytes != this->bytes ) {
+
+        for( int i = 0, n = vfree.size(); i < n; ++i )
+            RasterFree( vfree[i] );
+
+        vfree.clear();
+        this->bytes = bytes;
+    }
+    else if( vfree.size() ) {
+
+        ras = vfree.back();
+        vfree.pop_back();
+    }
+
+    pthread_mutex_unlock( &mtx );
+
+    if( !ras )
+        ras = RasterAlloc( bytes );
+
+    return ras;
+}
+
+
+// Return raster to pool, or free it if the pool is full
+// or the raster isn't the current size.
+//
+void CRasterPool::Put( void* ras, unsigned long bytes )
+{
+    if( !ras )
+        return;
+
+    pthread_mutex_lock( &mtx );
+
+    if( bytes == this->bytes && vfree.size() < maxfree ) {
+        vfree.push_back( ras );
+        ras = NULL;
+    }
+
+    pthread_mutex_unlock( &mtx );
+
+    if( ras )
+        RasterFree( ras );
+}
+
+
+void CRasterPool::Clear()
+{
+    pthread_mutex_lock( &mtx );
+
+    for( int i = 0, n = vfree.size(); i < n; ++i )
+        RasterFree( vfree[i] );
+
+    vfree.clear();
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* Bin8 ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Reduce w x h src into dst by averaging iscl x iscl blocks.
+// The last block in each row and column is shifted to end at
+// the image edge, so every block is whole. If the image is
+// smaller than iscl in a dimension, blocks span all of it.
+//
+static void Bin8( uint8 *dst, const uint8 *src, int w, int h, int iscl )
+{
+    int	bw = (w + iscl - 1) / iscl,
+        bh = (h + iscl - 1) / iscl,
+        nx = min( iscl, w ),
+        ny = min( iscl, h ),
+        n  = nx * ny;
+
+    for( int iy = 0; iy < bh; ++iy ) {
+
+        int	y0 = min( iy * iscl, h - ny );
+
+        for( int ix = 0; ix < bw; ++ix ) {
+
+            const uint8	*s = src + min( ix * iscl, w - nx ) + w*y0;
+            int			sum = 0;
+
+            for( int dy = 0; dy < ny; ++dy, s += w ) {
+
+                for( int dx = 0; dx < nx; ++dx )
+                    sum += s[dx];
+            }
+
+            dst[ix + bw*iy] = sum / n;
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* DecodeRange --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Decode chunks X.vchk[k0..klim) with a private libtiff handle,
+// copying the parts inside box X.B to X.dst.
+//
+// A strip lying wholly inside a full-width box is decoded in
+// place; anything else goes through a scratch chunk buffer.
+//
+static void DecodeRange( CTRCtx &X, int k0, int klim )
+{
+    TIFF	*tif = TIFFOpen( X.name, "r" );
+
+    if( !tif ) {
+        X.err = true;
+        return;
+    }
+
+    const IBox	&B = X.B;
+
+    vector<uint8>	scr( X.tiled ? TIFFTileSize( tif ) : TIFFStripSize( tif ) );
+    int				rw		= B.R - B.L + 1;
+    bool			full	= (B.L == 0 && B.R == X.w - 1);
+
+    for( int k = k0; k < klim; ++k ) {
+
+        int	c = X.vchk[k], x0, y0;
+
+        if( X.tiled ) {
+            x0 = (c % X.ntx) * X.cw;
+            y0 = (c / X.ntx) * X.ch;
+        }
+        else {
+            x0 = 0;
+            y0 = c * X.ch;
+        }
+
+        int	x1 = min( x0 + X.cw, X.w ) - 1,
+            y1 = min( y0 + X.ch, X.h ) - 1,
+            L  = max( x0, B.L ),
+            R  = min( x1, B.R ),
+            Y0 = max( y0, B.B ),
+            Y1 = min( y1, B.T );
+
+        if( !X.tiled && full && Y0 == y0 && Y1 == y1 ) {
+
+            if( TIFFReadEncodedStrip( tif, c,
+                    X.dst + (y0 - B.B) * rw * X.bpp,
+                    (tsize_t)-1 ) < 0 ) {
+
+                X.err = true;
+            }
+
+            continue;
+        }
+
+        tsize_t	nb;
+
+        if( X.tiled )
+            nb = TIFFReadEncodedTile( tif, c, &scr[0], scr.size() );
+        else
+            nb = TIFFReadEncodedStrip( tif, c, &scr[0], scr.size() );
+
+        if( nb < 0 ) {
+            X.err = true;
+            continue;
+        }
+
+        int	nrow = (R - L + 1) * X.bpp;
+
+        for( int y = Y0; y <= Y1; ++y ) {
+
+            memcpy(
+                X.dst + ((y - B.B) * rw + L - B.L) * X.bpp,
+                &scr[((y - y0) * X.cw + L - x0) * X.bpp],
+                nrow );
+        }
+    }
+
+    TIFFClose( tif );
+}
+
+
+void* _TRDecode( void* ithr )
+{
+    CTRThrd	&C = vtr[(long)ithr];
+
+    DecodeRange( *TR, C.k0, C.klim );
+
+    return NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* Open ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Read image layout tags.
+//
+// Return true if readable.
+//
+bool CTifReader::Open( const char *name, FILE* flog )
+{
+    TIFF*	tif;
+    uint32	rps;
+
+    this->name	= name;
+    this->flog	= flog;
+
+#if GENEMEYERSTIFF
+// suppress exotic field warnings
+TIFFErrorHandler	oldEH = TIFFSetWarningHandler( NULL );
+#endif
+
+    tif = TIFFOpen( name, "r" );
+
+#if GENEMEYERSTIFF
+TIFFSetWarningHandler( oldEH );
+#endif
+
+    if( !tif ) {
+        fprintf( flog,
+        "CTifReader: Cannot open [%s] for read.\n", name );
+        return false;
+    }
+
+    if( !TIFFGetField( tif, TIFFTAG_IMAGEWIDTH, &w ) ||
+        !TIFFGetField( tif, TIFFTAG_IMAGELENGTH, &h ) ) {
+
+        fprintf( flog,
+        "CTifReader: Missing image dims in [%s].\n", name );
+        TIFFClose( tif );
+        return false;
+    }
+
+    TIFFGetFieldDefaulted( tif, TIFFTAG_BITSPERSAMPLE, &bps );
+    TIFFGetFieldDefaulted( tif, TIFFTAG_SAMPLESPERPIXEL, &spp );
+    TIFFGetFieldDefaulted( tif, TIFFTAG_SAMPLEFORMAT, &fmt );
+
+    if( tiled = TIFFIsTiled( tif ) ) {
+        TIFFGetField( tif, TIFFTAG_TILEWIDTH, &cw );
+        TIFFGetField( tif, TIFFTAG_TILELENGTH, &ch );
+    }
+    else {
+        TIFFGetFieldDefaulted( tif, TIFFTAG_ROWSPERSTRIP, &rps );
+        cw = w;
+        ch = (rps < h ? rps : h);
+    }
+
+    TIFFClose( tif );
+
+    fprintf( flog,
+    "CTifReader: [%s] %d x %d, bps %d, spp %d, %s %d x %d.\n",
+    name, w, h, bps, spp, (tiled ? "tiles" : "strips"), cw, ch );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* Clip ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Set B to roi (inclusive bounds) clipped to the image,
+// or to the whole image if no roi.
+//
+// Return true if non-empty.
+//
+bool CTifReader::Clip( IBox &B, const IBox *roi )
+{
+    B.L	= 0;
+    B.R	= w - 1;
+    B.B	= 0;
+    B.T	= h - 1;
+
+    if( roi ) {
+        B.L	= max( B.L, roi->L );
+        B.R	= min( B.R, roi->R );
+        B.B	= max( B.B, roi->B );
+        B.T	= min( B.T, roi->T );
+    }
+
+    return B.L <= B.R && B.B <= B.T;
+}
+
+/* --------------------------------------------------------------- */
+/* Decode -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Decode box B of an image having bpp bytes per pixel into dst,
+// splitting the strips or tiles that touch B over nthr threads.
+//
+void CTifReader::Decode(
+    void		*dst,
+    int			bpp,
+    const IBox	&B,
+    int			nthr )
+{
+    CTRCtx	X;
+
+    X.name	= name.c_str();
+    X.flog	= flog;
+    X.dst	= (uint8*)dst;
+    X.B		= B;
+    X.w		= w;
+    X.h		= h;
+    X.cw	= cw;
+    X.ch	= ch;
+    X.ntx	= (w + cw - 1) / cw;
+    X.bpp	= bpp;
+    X.tiled	= tiled;
+    X.err	= false;
+
+// List chunks touching B
+
+    for( int ty = B.B / ch; ty <= B.T / ch; ++ty ) {
+
+        if( tiled ) {
+            for( int tx = B.L / cw; tx <= B.R / cw; ++tx )
+                X.vchk.push_back( ty * X.ntx + tx );
+        }
+        else
+            X.vchk.push_back( ty );
+    }
+
+    int	nc = X.vchk.size();
+
+    if( nthr > nc )
+        nthr = nc;
+
+    if( nthr <= 1 )
+        DecodeRange( X, 0, nc );
+    else {
+
+        pthread_mutex_lock( &mutex_tr );
+
+        int	nb = nc / nthr;
+
+        TR = &X;
+        vtr.resize( nthr );
+
+        vtr[0].k0	= 0;
+        vtr[0].klim	= nb;
+
+        for( int i = 1; i < nthr; ++i ) {
+            CTRThrd	&C = vtr[i];
+            C.k0	= vtr[i-1].klim;
+            C.klim	= (i == nthr-1 ? nc : C.k0 + nb);
+        }
+
+        if( !EZThreads( _TRDecode, nthr, 1, "_TRDecode", flog ) )
+            exit( 42 );
+
+        pthread_mutex_unlock( &mutex_tr );
+    }
+
+    if( X.err ) {
+        fprintf( flog,
+        "CTifReader: Decode failed for [%s].\n", name.c_str() );
+        exit( 42 );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* Read8 --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return 8-bit raster of roi, or of whole image if roi NULL,
+// and set (rw, rh) to its dims. The raster comes from pool if
+// given, else from RasterAlloc.
+//
+// Formats needing an intensity remap (16-bit, float, RGBA) are
+// normalized over the whole image as in Raster8FromTif, so they
+// are decoded in full and then cropped.
+//
+// Return NULL if roi misses the image.
+//
+uint8* CTifReader::Read8(
+    uint32			&rw,
+    uint32			&rh,
+    const IBox		*roi,
+    int				nthr,
+    CRasterPool		*pool )
+{
+    IBox	B;
+    uint8	*ras;
+
+    if( !Clip( B, roi ) ) {
+        rw = rh = 0;
+        return NULL;
+    }
+
+    rw	= B.R - B.L + 1;
+    rh	= B.T - B.B + 1;
+    ras	= (uint8*)(pool ? pool->Get( rw * rh ) : RasterAlloc( rw * rh ));
+
+    if( !ras ) {
+        fprintf( flog, "CTifReader: Malloc failed.\n" );
+        exit( 42 );
+    }
+
+    if( (spp == 1 || spp == 0) && bps == 8 )
+        Decode( ras, 1, B, nthr );
+    else {
+
+        uint32	fw, fh;
+        uint8	*full = Raster8FromTif( name.c_str(), fw, fh, flog );
+
+        for( int y = B.B; y <= B.T; ++y )
+            memcpy( ras + (y - B.B) * rw, full + y * fw + B.L, rw );
+
+        RasterFree( full );
+    }
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* Read8Binned --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return whole image reduced by averaging iscl x iscl blocks (as
+// Bin8 does), and set (rw, rh) to its reduced dims. The raster
+// comes from pool if given, else from RasterAlloc.
+//
+// Plain 8-bit strip images are binned as they are decoded, so at
+// most one strip and one row of column sums are held at full size.
+// Other layouts are read in full by Read8 and then binned.
+//
+uint8* CTifReader::Read8Binned(
+    uint32			&rw,
+    uint32			&rh,
+    int				iscl,
+    CRasterPool		*pool )
+{
+    if( iscl <= 1 )
+        return Read8( rw, rh, NULL, 1, pool );
+
+    uint8	*ras;
+
+    rw	= (w + iscl - 1) / iscl;
+    rh	= (h + iscl - 1) / iscl;
+    ras	= (uint8*)(pool ? pool->Get( rw * rh ) : RasterAlloc( rw * rh ));
+
+    if( !ras ) {
+        fprintf( flog, "CTifReader: Malloc failed.\n" );
+        exit( 42 );
+    }
+
+    if( tiled || (spp != 1 && spp != 0) || bps != 8 ) {
+
+        uint32	fw, fh;
+        uint8	*full = Read8( fw, fh );
+
+        Bin8( ras, full, fw, fh, iscl );
+        RasterFree( full );
+
+        return ras;
+    }
+
+    TIFF	*tif = TIFFOpen( name.c_str(), "r" );
+
+    if( !tif ) {
+        fprintf( flog,
+        "CTifReader: Decode failed for [%s].\n", name.c_str() );
+        exit( 42 );
+    }
+
+    vector<uint8>	strip( TIFFStripSize( tif ) );
+    vector<int>		col( w );
+    int				nx	= min( iscl, (int)w ),
+                    ny	= min( iscl, (int)h ),
+                    n	= nx * ny,
+                    cur	= -1;
+
+    for( int iy = 0; iy < (int)rh; ++iy ) {
+
+        int	y0 = min( iy * iscl, (int)h - ny );
+
+        // sum ny rows into columns
+
+        col.assign( w, 0 );
+
+        for( int y = y0; y < y0 + ny; ++y ) {
+
+            int	s = y / ch;
+
+            if( s != cur ) {
+
+                if( TIFFReadEncodedStrip( tif, s,
+                        &strip[0], strip.size() ) < 0 ) {
+
+                    fprintf( flog,
+                    "CTifReader: Decode failed for [%s].\n",
+                    name.c_str() );
+                    exit( 42 );
+                }
+
+                cur = s;
+            }
+
+            const uint8	*row = &strip[(y - s * ch) * w];
+
+            for( int x = 0; x < (int)w; ++x )
+                col[x] += row[x];
+        }
+
+        // sum nx columns into blocks
+
+        uint8	*dst = ras + rw * iy;
+
+        for( int ix = 0; ix < (int)rw; ++ix ) {
+
+            const int	*c = &col[min( ix * iscl, (int)w - nx )];
+            int			sum = 0;
+
+            for( int dx = 0; dx < nx; ++dx )
+                sum += c[dx];
+
+            dst[ix] = sum / n;
+        }
+    }
+
+    TIFFClose( tif );
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* Read16 -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return 16-bit raster of roi, or of whole image if roi NULL,
+// and set (rw, rh) to its dims. The raster comes from pool if
+// given, else from RasterAlloc.
+//
+// Signed data are offset by -SHRT_MIN as in Raster16FromTif16.
+//
+// Return NULL if roi misses the image.
+//
+uint16* CTifReader::Read16(
+    uint32			&rw,
+    uint32			&rh,
+    const IBox		*roi,
+    int				nthr,
+    CRasterPool		*pool )
+{
+    IBox	B;
+    uint16	*ras;
+
+    if( spp != 1 || bps != 16 ) {
+        fprintf( flog, "CTifReader: Unknown format.\n" );
+        exit( 42 );
+    }
+
+    if( !Clip( B, roi ) ) {
+        rw = rh = 0;
+        return NULL;
+    }
+
+    rw	= B.R - B.L + 1;
+    rh	= B.T - B.B + 1;
+    ras	= (uint16*)(pool ?
+            pool->Get( rw * rh * sizeof(uint16) ) :
+            RasterAlloc( rw * rh * sizeof(uint16) ));
+
+    if( !ras ) {
+        fprintf( flog, "CTifReader: Malloc failed.\n" );
+        exit( 42 );
+    }
+
+    Decode( ras, sizeof(uint16), B, nthr );
+
+    if( fmt == SAMPLEFORMAT_INT ) {
+
+        int	n = rw * rh;
+
+        for( int i = 0; i < n; ++i )
+            ras[i] ^= 0x8000;
+    }
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* Raster8FromAnyPooled ------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Like Raster8FromAny, but 8-bit TIFFs are decoded into a raster
+// recycled from pool. Release with pool->Put( ras, w * h ).
+//
+uint8* Raster8FromAnyPooled(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    CRasterPool		*pool,
+    FILE*			flog )
+{
+    const char	*p = strstr( name, ".tif" );
+
+    if( p && !p[4] ) {
+
+        CTifReader	R;
+
+        if( R.Open( name, flog ) )
+            return R.Read8( w, h, NULL, 1, pool );
+    }
+
+    return Raster8FromAny( name, w, h, flog );
+}
+
+/* --------------------------------------------------------------- */
+/* Raster8FromAnyBinned ------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Like Raster8FromAnyPooled, but reduced by averaging iscl x iscl
+// blocks while reading. Set (w, h) to the full image dims and
+// (bw, bh) to the reduced dims. Release with pool->Put( ras, bw*bh ).
+//
+uint8* Raster8FromAnyBinned(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    uint32			&bw,
+    uint32			&bh,
+    int				iscl,
+    CRasterPool		*pool,
+    FILE*			flog )
+{
+    const char	*p = strstr( name, ".tif" );
+
+    if( p && !p[4] ) {
+
+        CTifReader	R;
+
+        if( R.Open( name, flog ) ) {
+            w = R.w;
+            h = R.h;
+            return R.Read8Binned( bw, bh, iscl, pool );
+        }
+    }
+
+    uint8	*full = Raster8FromAny( name, w, h, flog ),
+            *ras;
+
+    if( iscl <= 1 ) {
+        bw = w;
+        bh = h;
+        return full;
+    }
+
+    bw	= (w + iscl - 1) / iscl;
+    bh	= (h + iscl - 1) / iscl;
+    ras	= (uint8*)(pool ? pool->Get( bw * bh ) : RasterAlloc( bw * bh ));
+
+    Bin8( ras, full, w, h, iscl );
+    RasterFree( full );
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* Raster16FromTif16Pooled --------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Like Raster16FromTif16, but decoded over nthr threads into a
+// raster recycled from pool. Release with pool->Put( ras, 2*w*h ).
+//
+uint16* Raster16FromTif16Pooled(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    CRasterPool		*pool,
+    int				nthr,
+    FILE*			flog )
+{
+    CTifReader	R;
+
+    if( !R.Open( name, flog ) )
+        exit( 42 );
+
+    return R.Read16( w, h, NULL, nthr, pool );
+}
+
+
@@ -0,0 +1,126 @@
+#pragma once
+
+
+#include	"GenDefs.h"
+
+#include	<pthread.h>
+#include	<stdio.h>
+
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* class CRasterPool --------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Thread-safe free list of same-sized rasters, so that loops
+// over equal-sized tiles can recycle one buffer per worker
+// rather than allocate and free one per tile.
+//
+// Buffers come from RasterAlloc, so a pooled raster may also
+// simply be released with RasterFree.
+//
+class CRasterPool {
+
+private:
+    pthread_mutex_t	mtx;
+    vector<void*>	vfree;
+    unsigned long	bytes;
+    int				maxfree;
+
+public:
+    CRasterPool( int maxfree = 16 );
+    virtual ~CRasterPool();
+
+    void* Get( unsigned long bytes );
+    void Put( void* ras, unsigned long bytes );
+    void Clear();
+};
+
+/* --------------------------------------------------------------- */
+/* class CTifReader ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Decode single-sample 8-bit or 16-bit TIFFs, optionally just a
+// sub-rectangle, with the strips or tiles split over nthr threads.
+// Each thread opens its own libtiff handle.
+//
+class CTifReader {
+
+private:
+    string	name;
+    FILE	*flog;
+
+public:
+    uint32	w, h,		// image dims
+            cw, ch;		// strip or tile dims
+    uint16	bps, spp, fmt;
+    bool	tiled;
+
+private:
+    void Decode(
+        void		*dst,
+        int			bpp,
+        const IBox	&B,
+        int			nthr );
+
+    bool Clip( IBox &B, const IBox *roi );
+
+public:
+    CTifReader() : flog(stdout), w(0), h(0) {};
+
+    bool Open( const char *name, FILE* flog = stdout );
+
+    uint8* Read8(
+        uint32			&rw,
+        uint32			&rh,
+        const IBox		*roi	= NULL,
+        int				nthr	= 1,
+        CRasterPool		*pool	= NULL );
+
+    uint8* Read8Binned(
+        uint32			&rw,
+        uint32			&rh,
+        int				iscl,
+        CRasterPool		*pool	= NULL );
+
+    uint16* Read16(
+        uint32			&rw,
+        uint32			&rh,
+        const IBox		*roi	= NULL,
+        int				nthr	= 1,
+        CRasterPool		*pool	= NULL );
+};
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+uint8* Raster8FromAnyPooled(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    CRasterPool		*pool,
+    FILE*			flog = stdout );
+
+uint8* Raster8FromAnyBinned(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    uint32			&bw,
+    uint32			&bh,
+    int				iscl,
+    CRasterPool		*pool,
+    FILE*			flog = stdout );
+
+uint16* Raster16FromTif16Pooled(
+    const char*		name,
+    uint32			&w,
+    uint32			&h,
+    CRasterPool		*pool,
+    int				nthr = 1,
+    FILE*			flog = stdout );
+
+
@@ -24,6 +24,8 @@ enum TSConst {
 /* Types --------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+class CTiledScape;
+
 class CUTile {
 
 public:
@@ -160,6 +162,17 @@ private:
     void Scape_PaintTH( int nthr ) const;
 
 public:
+    void ScapeBounds(
+        uint32				&ws,
+        uint32				&hs,
+        double				&x0,
+        double				&y0,
+        const vector<int>	&vid,
+        double				scale,
+        int					szmult ) const;
+
+    void ScapeCacheTiles( bool on ) const;
+
     uint8* Scape(
         uint32				&ws,
         uint32				&hs,
@@ -172,7 +185,23 @@ public:
         int					lgord,
         int					sdnorm,
         bool				resmask,
-        int					nthr ) const;
+        int					nthr,
+        bool				lores = false ) const;
+
+    bool ScapeTiled(
+        CTiledScape			&S,
+        double				&x0,
+        double				&y0,
+        const vector<int>	&vid,
+        double				scale,
+        int					szmult,
+        int					bkval,
+        int					lgord,
+        int					sdnorm,
+        bool				resmask,
+        int					nthr,
+        bool				lores		= false,
+        const char			*spilldir	= NULL ) const;
 };
 
 
@@ -1,6 +1,8 @@
 
 
 #include	"CTileSet.h"
+#include	"CTifReader.h"
+#include	"CTiledScape.h"
 #include	"EZThreads.h"
 #include	"ImageIO.h"
 #include	"Maths.h"
@@ -8,6 +10,15 @@
 #include	<stdlib.h>
 #include	<string.h>
 
+#include	<list>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	BANDH	64	// scape rows per composite lock
 
 /* --------------------------------------------------------------- */
 /* Scape_AdjustBounds -------------------------------------------- */
@@ -83,6 +94,27 @@ void CTileSet::Scape_AdjustBounds(
     }
 }
 
+/* --------------------------------------------------------------- */
+/* ScapeBounds --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return the dims (ws, hs) and top-left (x0, y0) that Scape would
+// give for these arguments, without painting.
+//
+void CTileSet::ScapeBounds(
+    uint32				&ws,
+    uint32				&hs,
+    double				&x0,
+    double				&y0,
+    const vector<int>	&vid,
+    double				scale,
+    int					szmult ) const
+{
+    vector<TAffine>	vTadj;
+
+    Scape_AdjustBounds( ws, hs, x0, y0, vTadj, vid, scale, szmult );
+}
+
 /* --------------------------------------------------------------- */
 /* ScanLims ------------------------------------------------------ */
 /* --------------------------------------------------------------- */
@@ -153,8 +185,8 @@ static void Downsample( uint8 *ras, int &w, int &h, int iscl )
 // (xo,yo) allows the block to line up with the
 // right-bottom edge of the image.
 
-    yr = iscl - h % iscl;
-    xr = iscl - w % iscl;
+    yr = (iscl - h % iscl) % iscl;
+    xr = (iscl - w % iscl) % iscl;
 
     for( int iy = 0; iy < hs; ++iy ) {
 
@@ -233,6 +265,8 @@ public:
     int						lgord;
     int						sdnorm;
     bool					resmask;
+    bool					lores;
+    CTiledScape				*tscp;
 public:
     CPaintPrms(
         uint8					*scp,
@@ -244,49 +278,283 @@ public:
         int						bkval,
         int						lgord,
         int						sdnorm,
-        bool					resmask )
+        bool					resmask,
+        bool					lores,
+        CTiledScape				*tscp )
     : scp(scp), ws(ws), hs(hs),
     vTadj(vTadj), vid(vid), iscl(iscl), bkval(bkval),
-    lgord(lgord), sdnorm(sdnorm), resmask(resmask)
+    lgord(lgord), sdnorm(sdnorm), resmask(resmask), lores(lores),
+    tscp(tscp)
     {};
 };
 
-class CThrdat {
+// A tile prepared for painting: masked, normalized and reduced
+// to scape scale. Kept across Scape calls if ScapeCacheTiles.
+//
+class CScpTile {
 public:
-    int	i0, ilim;
+    vector<uint8>	pix;
+    uint32			w, h;	// full size tile dims
+    int				wi, hi;	// pix dims
+};
+
+// Scape rect [x0,xL); [y0,yL) that a tile paints.
+//
+class CPaintLim {
+public:
+    int	x0, xL, y0, yL;
+};
+
+// The rows of one tile's painted rect lying in one band, held
+// until all lower tiles touching that band are composited.
+//
+class CBandPart {
+public:
+    vector<uint8>	pix;
+    int				i, x0, xL, y0, yL;
+};
+
+// Compositing state for BANDH scape rows.
+//
+class CBand {
+public:
+    pthread_mutex_t		mtx;
+    vector<int>			vi;		// tiles touching band, in order
+    int					next;	// index in vi of next to composite
+    list<CBandPart>		pend;	// parts that arrived early
 };
 
 static const CTileSet	*ME;
 static const CPaintPrms	*GP;
-static vector<CThrdat>	vthr;
+static vector<CScpTile*>	vcache;		// by vtil index, or empty
+static char				cachesig[64];	// prep params of cached tiles
+static CRasterPool		*pool;
+static vector<CPaintLim>	vlim;	// painted rect of each tile
+static vector<CBand>	vbnd;	// one per BANDH rows; if threaded
+static int				nxttile;
+static pthread_mutex_t	mutex_nxt = PTHREAD_MUTEX_INITIALIZER;
+
+// PutRows into tiled scape: a scape tile is only allocated if
+// the rows have data there.
+//
+static void PutRowsTiled(
+    const uint8	*loc,
+    int			x0,
+    int			xL,
+    int			y0,
+    int			r0,
+    int			rL )
+{
+    CTiledScape	&S		= *GP->tscp;
+    int			lw		= xL - x0,
+                bkval	= GP->bkval;
+
+    for( int tx = x0 / TSCPDIM; tx * TSCPDIM < xL; ++tx ) {
+
+        uint8	*T	= NULL;
+        int		ty	= -1,
+                sx0	= max( x0, tx * TSCPDIM ),
+                sxL	= min( xL, (tx + 1) * TSCPDIM );
+
+        for( int iy = r0; iy < rL; ++iy ) {
+
+            const uint8	*L = loc + lw*(iy - y0) - x0;
+            int			r;
+
+            if( iy / TSCPDIM != ty ) {
+                ty	= iy / TSCPDIM;
+                T	= NULL;
+            }
+
+            r = TSCPDIM*(iy - ty*TSCPDIM) - tx*TSCPDIM;
+
+            for( int ix = sx0; ix < sxL; ++ix ) {
+
+                if( L[ix] == bkval )
+                    continue;
+
+                if( !T )
+                    T = S.TileW( tx, ty );
+
+                T[r+ix] = L[ix];
+            }
+        }
+    }
+}
+
+// Copy rows [r0,rL) of rect loc, having origin (x0,y0), into
+// the scape. Background pixels don't overwrite.
+//
+static void PutRows(
+    const uint8	*loc,
+    int			x0,
+    int			xL,
+    int			y0,
+    int			r0,
+    int			rL )
+{
+    if( GP->tscp ) {
+        PutRowsTiled( loc, x0, xL, y0, r0, rL );
+        return;
+    }
 
+    uint8	*scp	= GP->scp;
+    int		ws		= GP->ws,
+            lw		= xL - x0,
+            bkval	= GP->bkval;
+
+    for( int iy = r0; iy < rL; ++iy ) {
+
+        const uint8	*L = loc + lw*(iy - y0) - x0;
+        uint8		*S = scp + ws*iy;
+
+        for( int ix = x0; ix < xL; ++ix ) {
+
+            if( L[ix] != bkval )
+                S[ix] = L[ix];
+        }
+    }
+}
+
+// Composite any held parts of band B that are now next in order.
+// Caller holds B.mtx.
+//
+static void DrainBand( CBand &B )
+{
+    list<CBandPart>::iterator	it = B.pend.begin();
+
+    while( it != B.pend.end() ) {
+
+        if( it->i != B.vi[B.next] ) {
+            ++it;
+            continue;
+        }
+
+        PutRows( &it->pix[0], it->x0, it->xL, it->y0, it->y0, it->yL );
+        ++B.next;
+        B.pend.erase( it );
+        it = B.pend.begin();
+    }
+}
+
+// Composite painted rect loc of tile i into the scape, keeping
+// the in-order result under any thread timing by compositing
+// each band's tiles in list order (see Scape.cpp).
+//
+static void Composite(
+    const uint8	*loc,
+    int			i,
+    int			x0,
+    int			xL,
+    int			y0,
+    int			yL )
+{
+    if( !vbnd.size() ) {
+        PutRows( loc, x0, xL, y0, y0, yL );
+        return;
+    }
+
+    int	lw = xL - x0;
+
+    for( int b0 = y0; b0 < yL; ) {
+
+        int		ib	= b0 / BANDH,
+                bL	= min( yL, (ib + 1) * BANDH );
+        CBand	&B	= vbnd[ib];
+
+        pthread_mutex_lock( &B.mtx );
+
+        if( B.vi[B.next] == i ) {
+
+            PutRows( loc, x0, xL, y0, b0, bL );
+            ++B.next;
+            DrainBand( B );
+        }
+        else {
+
+            B.pend.push_back( CBandPart() );
+
+            CBandPart	&P = B.pend.back();
+
+            P.pix.assign( loc + lw*(b0 - y0), loc + lw*(bL - y0) );
+            P.i		= i;
+            P.x0	= x0;
+            P.xL	= xL;
+            P.y0	= b0;
+            P.yL	= bL;
+        }
+
+        pthread_mutex_unlock( &B.mtx );
+
+        b0 = bL;
+    }
+}
+
+// In lores mode tiles are binned to scape scale while reading,
+// and masked and normalized at that scale.
+//
 void* _Scape_Paint( void *ithr )
 {
-    CThrdat	&me = vthr[(long)ithr];
+    vector<uint8>	loc;
+    int				nt = GP->vid.size();
 
-    for( int i = me.i0; i < me.ilim; ++i ) {
+    for(;;) {
 
         vector<uint8>	msk;
-        uint8*			src;
+        const uint8*	pix;
+        uint8*			src = NULL;
+        CScpTile		*C	= NULL;
         TAffine			inv;
-        uint32			w,  h;
-        int				x0, xL, y0, yL,
+        uint32			w,  h,
+                        bw, bh;
+        int				i,
+                        x0, xL, y0, yL,
                         wL, hL,
                         wi, hi;
 
-        src = Raster8FromAny(
-                ME->vtil[GP->vid[i]].name.c_str(),
-                w, h, ME->flog );
+        pthread_mutex_lock( &mutex_nxt );
+        i = nxttile++;
+        pthread_mutex_unlock( &mutex_nxt );
+
+        if( i >= nt )
+            break;
+
+        // Each tile index appears once per call, so
+        // threads never share a cache slot.
+
+        if( vcache.size() && (C = vcache[GP->vid[i]]) ) {
+            w	= C->w;
+            h	= C->h;
+            wi	= C->wi;
+            hi	= C->hi;
+            pix	= &C->pix[0];
+            goto sample;
+        }
+
+        if( GP->lores ) {
+            src = Raster8FromAnyBinned(
+                    ME->vtil[GP->vid[i]].name.c_str(),
+                    w, h, bw, bh, GP->iscl, pool, ME->flog );
+        }
+        else {
+            src = Raster8FromAnyPooled(
+                    ME->vtil[GP->vid[i]].name.c_str(),
+                    w, h, pool, ME->flog );
+            bw = w;
+            bh = h;
+        }
 
-        if( GP->resmask )
-            ResinMask8( msk, src, w, h, false );
+        if( GP->resmask ) {
+            ResinMask8( msk, src, bw, bh, false,
+                (GP->lores ? GP->iscl : 1) );
+        }
 
         if( GP->sdnorm > 0 )
-            NormRas( src, w, h, GP->lgord, GP->sdnorm );
+            NormRas( src, bw, bh, GP->lgord, GP->sdnorm );
 
         if( GP->resmask ) {
 
-            int	n = w * h;
+            int	n = bw * bh;
 
             for( int j = 0; j < n; ++j ) {
                 if( !msk[j] )
@@ -294,18 +562,41 @@ void* _Scape_Paint( void *ithr )
             }
         }
 
-        ScanLims( x0, xL, y0, yL, GP->ws, GP->hs, GP->vTadj[i], w, h );
-        wi = w;
-        hi = h;
+        wi = bw;
+        hi = bh;
+
+        // actually downsample src image
+        if( GP->iscl > 1 && !GP->lores )
+            Downsample( src, wi, hi, GP->iscl );
+
+        pix = src;
+
+        if( vcache.size() ) {
+
+            C = new CScpTile;
+            C->pix.assign( src, src + wi * hi );
+            C->w	= w;
+            C->h	= h;
+            C->wi	= wi;
+            C->hi	= hi;
+            vcache[GP->vid[i]] = C;
+
+            pool->Put( src, bw * bh );
+            src	= NULL;
+            pix	= &C->pix[0];
+        }
+
+sample:
+        x0	= vlim[i].x0;
+        xL	= vlim[i].xL;
+        y0	= vlim[i].y0;
+        yL	= vlim[i].yL;
 
         inv.InverseOf( GP->vTadj[i] );
 
         if( GP->iscl > 1 ) {	// Scaling down
 
-            // actually downsample src image
-            Downsample( src, wi, hi, GP->iscl );
-
-            // and point at the new pixels
+            // point at the downsampled pixels
             TAffine	A;
             A.NUSetScl( 1.0/GP->iscl );
             inv = A * inv;
@@ -314,6 +605,20 @@ void* _Scape_Paint( void *ithr )
         wL = wi - 1;
         hL = hi - 1;
 
+        if( xL <= x0 || yL <= y0 ) {
+
+            if( src )
+                pool->Put( src, bw * bh );
+
+            continue;
+        }
+
+        // sample into local rect
+
+        int	lw = xL - x0;
+
+        loc.assign( lw * (yL - y0), GP->bkval );
+
         for( int iy = y0; iy < yL; ++iy ) {
 
             for( int ix = x0; ix < xL; ++ix ) {
@@ -325,16 +630,16 @@ void* _Scape_Paint( void *ithr )
                 if( p.x >= 0 && p.x < wL &&
                     p.y >= 0 && p.y < hL ) {
 
-                    int	pix =
-                    (int)SafeInterp( p.x, p.y, src, wi, hi );
-
-                    if( pix != GP->bkval )
-                        GP->scp[ix+GP->ws*iy] = pix;
+                    loc[ix-x0 + lw*(iy-y0)] =
+                    (int)SafeInterp( p.x, p.y, pix, wi, hi );
                 }
             }
         }
 
-        RasterFree( src );
+        if( src )
+            pool->Put( src, bw * bh );
+
+        Composite( &loc[0], i, x0, xL, y0, yL );
     }
 
     return NULL;
@@ -343,29 +648,122 @@ void* _Scape_Paint( void *ithr )
 
 void CTileSet::Scape_PaintTH( int nthr ) const
 {
-    int	nt = GP->vid.size(),	// tiles total
-        nb;						// tiles per thread
+    int	nt = GP->vid.size();	// tiles total
+
+// Cached tiles only valid for same prep params
+
+    if( vcache.size() ) {
+
+        char	sig[64];
+
+        sprintf( sig, "%d %d %d %d %d %d",
+        GP->iscl, GP->bkval, GP->lgord, GP->sdnorm,
+        GP->resmask, GP->lores );
+
+        if( strcmp( sig, cachesig ) ) {
+
+            if( cachesig[0] ) {
+                ScapeCacheTiles( false );
+                ScapeCacheTiles( true );
+            }
+
+            strcpy( cachesig, sig );
+        }
+    }
 
     if( nthr > nt )
         nthr = nt;
 
-    nb = nt / nthr;
+    CRasterPool	P( nthr );
+    pool = &P;
+
+    nxttile = 0;
+
+// Painted rects from nominal tile dims, as bound the scape,
+// so bands know in advance which tiles composite into them.
+
+    vlim.resize( nt );
+
+    for( int i = 0; i < nt; ++i ) {
+
+        CPaintLim	&L = vlim[i];
+
+        ScanLims( L.x0, L.xL, L.y0, L.yL,
+            GP->ws, GP->hs, GP->vTadj[i], gW, gH );
+    }
+
+    if( nthr > 1 ) {
+
+        vbnd.resize( (GP->hs + BANDH - 1) / BANDH );
 
-    vthr.resize( nthr );
+        for( int i = 0, nb = vbnd.size(); i < nb; ++i ) {
+            pthread_mutex_init( &vbnd[i].mtx, NULL );
+            vbnd[i].next = 0;
+        }
+
+        for( int i = 0; i < nt; ++i ) {
+
+            const CPaintLim	&L = vlim[i];
 
-    vthr[0].i0		= 0;
-    vthr[0].ilim	= nb;
+            if( L.xL <= L.x0 || L.yL <= L.y0 )
+                continue;
 
-    for( int i = 1; i < nthr; ++i ) {
-        CThrdat	&C = vthr[i];
-        C.i0	= vthr[i-1].ilim;
-        C.ilim	= (i == nthr-1 ? nt : C.i0 + nb);
+            for( int ib = L.y0 / BANDH; ib * BANDH < L.yL; ++ib )
+                vbnd[ib].vi.push_back( i );
+        }
     }
 
     if( !EZThreads( _Scape_Paint, nthr, 2, "_Scape_Paint", flog ) )
         exit( 42 );
 
-    vthr.clear();
+    for( int i = 0, nb = vbnd.size(); i < nb; ++i )
+        pthread_mutex_destroy( &vbnd[i].mtx );
+
+    vbnd.clear();
+    vlim.clear();
+}
+
+/* --------------------------------------------------------------- */
+/* ScapeCacheTiles ----------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// While on, each tile prepared for painting (read, masked,
+// normalized, downsampled) is kept, so later Scape calls reusing
+// it skip the disk. Used when several scapes share tiles, e.g.
+// neighboring blocks over the same layer. Cost is one scape-scale
+// raster per distinct tile.
+//
+// The cache is indexed by vtil position, so turn it off before
+// refilling or resorting vtil. Off frees all cached tiles.
+//
+void CTileSet::ScapeCacheTiles( bool on ) const
+{
+    int		n = vcache.size();
+
+    if( n ) {
+
+        double	bytes = 0;
+        int		nc = 0;
+
+        for( int i = 0; i < n; ++i ) {
+
+            if( vcache[i] ) {
+                bytes += vcache[i]->pix.size();
+                ++nc;
+                delete vcache[i];
+            }
+        }
+
+        fprintf( flog, "Scape: Tile cache freed %d tiles, %.1f MB.\n",
+        nc, bytes / (1024.0*1024.0) );
+
+        vcache.clear();
+    }
+
+    cachesig[0] = 0;
+
+    if( on )
+        vcache.assign( vtil.size(), (CScpTile*)NULL );
 }
 
 /* --------------------------------------------------------------- */
@@ -385,6 +783,7 @@ void CTileSet::Scape_PaintTH( int nthr ) const
 // sdnorm	- if > 0, image normalized to mean=127, sd=sdnorm.
 // resmask	- mask resin areas.
 // nthr		- thread count.
+// lores	- bin tiles to scape scale while reading.
 //
 // Caller must dispose of scape with ImageIO::RasterFree().
 //
@@ -400,7 +799,8 @@ uint8* CTileSet::Scape(
     int					lgord,
     int					sdnorm,
     bool				resmask,
-    int					nthr ) const
+    int					nthr,
+    bool				lores ) const
 {
     if( !vid.size() ) {
         fprintf( flog, "Scape: Empty tile list.\n" );
@@ -424,7 +824,7 @@ uint8* CTileSet::Scape(
         ME = this;
         GP = new CPaintPrms( scp, ws, hs,
                     vTadj, vid, int(1/scale),
-                    bkval, lgord, sdnorm, resmask );
+                    bkval, lgord, sdnorm, resmask, lores, NULL );
         Scape_PaintTH( nthr );
         delete GP;
     }
@@ -434,4 +834,62 @@ uint8* CTileSet::Scape(
     return scp;
 }
 
+/* --------------------------------------------------------------- */
+/* ScapeTiled ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Like Scape, but paint into tiled scape S, which is initialized
+// here and afterward holds the dims (S.ws, S.hs). Only scape tiles
+// receiving data are allocated, and if spilldir is given they are
+// backed by a memory-mapped file there (see CTiledScape).
+//
+// Return false if unsuccessful.
+//
+bool CTileSet::ScapeTiled(
+    CTiledScape			&S,
+    double				&x0,
+    double				&y0,
+    const vector<int>	&vid,
+    double				scale,
+    int					szmult,
+    int					bkval,
+    int					lgord,
+    int					sdnorm,
+    bool				resmask,
+    int					nthr,
+    bool				lores,
+    const char			*spilldir ) const
+{
+    if( !vid.size() ) {
+        fprintf( flog, "Scape: Empty tile list.\n" );
+        return false;
+    }
+
+    vector<TAffine>	vTadj;
+    uint32			ws, hs;
+
+    Scape_AdjustBounds( ws, hs, x0, y0, vTadj, vid, scale, szmult );
+
+    if( sdnorm > 0 )
+        bkval = 127;
+
+    if( !S.Init( ws, hs, bkval, spilldir, flog ) ) {
+
+        fprintf( flog, "Scape: Empty bounds (%d x %d).\n", ws, hs );
+        return false;
+    }
+
+    ME = this;
+    GP = new CPaintPrms( NULL, ws, hs,
+                vTadj, vid, int(1/scale),
+                bkval, lgord, sdnorm, resmask, lores, &S );
+    Scape_PaintTH( nthr );
+    delete GP;
+
+    fprintf( flog, "Scape: Tiled %d x %d, %.1f MB painted.\n",
+    ws, hs, S.MB() );
+
+    return true;
+}
+
 
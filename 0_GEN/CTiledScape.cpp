@@ -0,0 +1,266 @@
+
+
+#include	"CTiledScape.h"
+#include	"Disk.h"
+#include	"File.h"
+#include	"ImageIO.h"
+
+#include	"png.h"
+
+#include	<fcntl.h>
+#include	<string.h>
+#include	<sys/mman.h>
+#include	<unistd.h>
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	TILEPX	(TSCPDIM * TSCPDIM)
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static int	nspill = 0;		// spill file counter
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* CTiledScape --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+CTiledScape::CTiledScape()
+    : map(NULL), maplen(0), ntl(0),
+      ws(0), hs(0), nx(0), ny(0), bkval(0)
+{
+    pthread_mutex_init( &mtx, NULL );
+}
+
+
+CTiledScape::~CTiledScape()
+{
+    Free();
+    pthread_mutex_destroy( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* Init ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Set dims ws x hs, all pixels bkval, no tiles allocated.
+//
+// If spilldir given, all tiles are backed by
+// a file there, unlinked at once so it can't outlive the process.
+// If the mapping fails we log it and fall back to the heap.
+//
+// Return false if either dim is zero.
+//
+bool CTiledScape::Init(
+    uint32		ws,
+    uint32		hs,
+    int			bkval,
+    const char	*spilldir,
+    FILE*		flog )
+{
+    Free();
+
+    if( !ws || !hs )
+        return false;
+
+    this->ws	= ws;
+    this->hs	= hs;
+    this->bkval	= bkval;
+
+    nx = (ws + TSCPDIM - 1) / TSCPDIM;
+    ny = (hs + TSCPDIM - 1) / TSCPDIM;
+
+    vt.assign( nx * ny, (uint8*)NULL );
+
+    if( !spilldir || !*spilldir )
+        return true;
+
+// Spill file
+
+    char	path[2048];
+    int		fd;
+
+    DskCreateDir( spilldir, flog );
+
+    sprintf( path, "%s/scape_%d_%d.tmp", spilldir, getpid(), nspill++ );
+
+    maplen = (unsigned long)nx * ny * TILEPX;
+
+    if( (fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0666 )) < 0 ) {
+        fprintf( flog, "CTiledScape: Can't create [%s].\n", path );
+        maplen = 0;
+        return true;
+    }
+
+    unlink( path );
+
+    if( !ftruncate( fd, maplen ) ) {
+
+        void	*p = mmap( NULL, maplen,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+        if( p != MAP_FAILED )
+            map = (uint8*)p;
+    }
+
+    close( fd );
+
+    if( map ) {
+        fprintf( flog,
+        "CTiledScape: %d x %d tiles spill to [%s], %.1f MB.\n",
+        nx, ny, spilldir, maplen / (1024.0*1024.0) );
+    }
+    else {
+        fprintf( flog,
+        "CTiledScape: Map failed [%s]; using heap.\n", path );
+        maplen = 0;
+    }
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* Free ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CTiledScape::Free()
+{
+    if( map ) {
+        munmap( map, maplen );
+        map		= NULL;
+        maplen	= 0;
+    }
+    else {
+
+        for( int i = 0, n = vt.size(); i < n; ++i ) {
+            if( vt[i] )
+                RasterFree( vt[i] );
+        }
+    }
+
+    vt.clear();
+    ntl = 0;
+}
+
+/* --------------------------------------------------------------- */
+/* TileW --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return writable tile (ix, iy), allocating it filled with
+// bkval on first request.
+//
+// Thread safe.
+//
+uint8* CTiledScape::TileW( int ix, int iy )
+{
+    int		k = ix + nx*iy;
+    uint8	*T;
+
+    pthread_mutex_lock( &mtx );
+
+    if( !(T = vt[k]) ) {
+
+        if( map )
+            T = map + (unsigned long)k * TILEPX;
+        else if( !(T = (uint8*)RasterAlloc( TILEPX )) ) {
+            printf( "CTiledScape: Alloc failed.\n" );
+            exit( 42 );
+        }
+
+        memset( T, bkval, TILEPX );
+
+        vt[k] = T;
+        ++ntl;
+    }
+
+    pthread_mutex_unlock( &mtx );
+
+    return T;
+}
+
+/* --------------------------------------------------------------- */
+/* GetRow -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Copy scape row y (ws pixels) to dst.
+//
+void CTiledScape::GetRow( uint8 *dst, int y ) const
+{
+    int	iy = y / TSCPDIM,
+        ry = y - iy * TSCPDIM;
+
+    for( int ix = 0; ix < nx; ++ix ) {
+
+        const uint8	*T = vt[ix + nx*iy];
+        int			x0 = ix * TSCPDIM,
+                    n  = min( TSCPDIM, (int)ws - x0 );
+
+        if( T )
+            memcpy( dst + x0, T + TSCPDIM*ry, n );
+        else
+            memset( dst + x0, bkval, n );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* ToPng8 -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Write scape as 8-bit gray png, one row at a time.
+//
+void CTiledScape::ToPng8( const char *name, FILE* flog ) const
+{
+    FILE*			f = FileOpenOrDie( name, "w", flog );
+    png_structp		png_ptr;
+    png_infop		info_ptr;
+    vector<uint8>	row( ws );
+
+// init I/O
+    png_ptr		= png_create_write_struct(
+                    PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+
+    info_ptr	= png_create_info_struct( png_ptr );
+
+    png_init_io( png_ptr, f );
+
+// header
+    png_set_IHDR( png_ptr, info_ptr,
+        ws, hs, 8, PNG_COLOR_TYPE_GRAY,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+        PNG_FILTER_TYPE_BASE );
+
+    png_write_info( png_ptr, info_ptr );
+
+// data
+    for( int y = 0; y < (int)hs; ++y ) {
+        GetRow( &row[0], y );
+        png_write_row( png_ptr, (png_bytep)&row[0] );
+    }
+
+// cleanup
+    png_write_end( png_ptr, NULL );
+    png_destroy_write_struct( &png_ptr, &info_ptr );
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* MB ------------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Return MB of tiles allocated so far.
+//
+double CTiledScape::MB() const
+{
+    return ntl * (TILEPX / (1024.0*1024.0));
+}
+
+
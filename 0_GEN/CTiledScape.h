@@ -0,0 +1,68 @@
+#pragma once
+
+
+#include	"GenDefs.h"
+
+#include	<pthread.h>
+#include	<stdio.h>
+
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	TSCPDIM	256		// tile edge, multiple of painter band height
+
+/* --------------------------------------------------------------- */
+/* class CTiledScape --------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Scape raster held as TSCPDIM-square tiles, each allocated when
+// first written, so regions no image touches cost nothing. Given
+// a spill dir, tiles live in an unlinked memory-mapped file, so
+// resident memory is bounded by the page cache rather than by the
+// section size.
+//
+class CTiledScape {
+
+private:
+    vector<uint8*>	vt;		// pixels; NULL = all bkval
+    pthread_mutex_t	mtx;
+    uint8			*map;	// spill mapping or NULL
+    unsigned long	maplen;
+    int				ntl;	// tiles allocated
+
+public:
+    uint32	ws, hs;
+    int		nx, ny,
+            bkval;
+
+public:
+    CTiledScape();
+    virtual ~CTiledScape();
+
+    bool Init(
+        uint32		ws,
+        uint32		hs,
+        int			bkval,
+        const char	*spilldir	= NULL,
+        FILE*		flog		= stdout );
+
+    void Free();
+
+    const uint8* TileR( int ix, int iy ) const
+        {return vt[ix + nx*iy];};
+
+    uint8* TileW( int ix, int iy );
+
+    void GetRow( uint8 *dst, int y ) const;
+
+    void ToPng8( const char *name, FILE* flog = stdout ) const;
+
+    double MB() const;
+};
+
+
@@ -6,6 +6,7 @@
 
 #include	<stdlib.h>
 #include	<string.h>
+#include	<sys/stat.h>
 
 
 
@@ -37,12 +38,337 @@ static void PrintFoldmapHisto(
     }
 }
 
+/* --------------------------------------------------------------- */
+/* RgnMapPath ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return path of the region map that accompanies foldmask image
+// maskpath: same name with extension replaced by ".rgn".
+//
+string RgnMapPath( const char *maskpath )
+{
+    string		s = maskpath;
+    const char	*dot   = strrchr( maskpath, '.' ),
+                *slash = strrchr( maskpath, '/' );
+
+    if( dot && (!slash || dot > slash) )
+        s.resize( dot - maskpath );
+
+    return s + ".rgn";
+}
+
+/* --------------------------------------------------------------- */
+/* WriteRgnMap --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Write compact region map for foldmask fm. File layout (native
+// binary, as for our other binary tables):
+//
+// char[4]		"RGN1"
+// int32		w, h, nr, nfold (count of 0-valued pixels)
+// RgnMapEntry	[nr], sorted by id
+// int32		nruns
+// uint32		len[nruns]
+// uint8		val[nruns]
+//
+// The runs encode fm in raster order and may span rows. A typical
+// mask has a few regions and fold strips, so the file is tiny and
+// decodes in one memset per run, versus an image decode and pixel
+// scan in every consumer.
+//
+// Return true if written.
+//
+bool WriteRgnMap(
+    const char		*path,
+    const uint8*	fm,
+    int				w,
+    int				h,
+    FILE			*flog )
+{
+    vector<RgnMapEntry>	vr;
+    vector<int>			idx( 256, -1 );
+    vector<uint32>		len;
+    vector<uint8>		val;
+    FILE				*f;
+    int					hdr[4] = {w, h, 0, 0};
+
+// Runs and per-value stats
+
+    for( int y = 0; y < h; ++y ) {
+
+        const uint8	*row = fm + w * y;
+
+        for( int x = 0; x < w; ) {
+
+            int	v  = row[x],
+                x0 = x;
+
+            while( ++x < w && row[x] == v )
+                ;
+
+            if( !val.empty() && val.back() == v && x0 == 0 && y )
+                len.back() += x - x0;
+            else {
+                len.push_back( x - x0 );
+                val.push_back( v );
+            }
+
+            if( !v ) {
+                hdr[3] += x - x0;
+                continue;
+            }
+
+            if( idx[v] < 0 ) {
+
+                RgnMapEntry	E;
+
+                E.B.L	= w;
+                E.B.R	= -1;
+                E.B.B	= h;
+                E.B.T	= -1;
+                E.id	= v;
+                E.area	= 0;
+
+                idx[v] = vr.size();
+                vr.push_back( E );
+            }
+
+            RgnMapEntry	&E = vr[idx[v]];
+
+            E.area += x - x0;
+
+            if( x0 < E.B.L )
+                E.B.L = x0;
+
+            if( x - 1 > E.B.R )
+                E.B.R = x - 1;
+
+            if( y < E.B.B )
+                E.B.B = y;
+
+            E.B.T = y;
+        }
+    }
+
+// Sort entries by id
+
+    {
+        vector<RgnMapEntry>	sr;
+
+        for( int v = 1; v < 256; ++v ) {
+
+            if( idx[v] >= 0 )
+                sr.push_back( vr[idx[v]] );
+        }
+
+        vr.swap( sr );
+    }
+
+// Write
+
+    if( !(f = fopen( path, "wb" )) ) {
+        fprintf( flog, "WriteRgnMap: Can't open [%s].\n", path );
+        return false;
+    }
+
+    int	nruns = len.size();
+
+    hdr[2] = vr.size();
+
+    fwrite( "RGN1", 1, 4, f );
+    fwrite( hdr, sizeof(int), 4, f );
+
+    if( hdr[2] )
+        fwrite( &vr[0], sizeof(RgnMapEntry), hdr[2], f );
+
+    fwrite( &nruns, sizeof(int), 1, f );
+
+    if( nruns ) {
+        fwrite( &len[0], sizeof(uint32), nruns, f );
+        fwrite( &val[0], sizeof(uint8), nruns, f );
+    }
+
+    fclose( f );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* ReadRgnMap ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Decode region map at path into a new raster (free with
+// RasterFree) and optionally fetch its region entries (vr).
+//
+// Return NULL if file missing or malformed.
+//
+uint8* ReadRgnMap(
+    const char			*path,
+    uint32				&w,
+    uint32				&h,
+    vector<RgnMapEntry>	*vr,
+    FILE				*flog,
+    bool				transpose )
+{
+    vector<RgnMapEntry>	ve;
+    vector<uint32>		len;
+    vector<uint8>		val;
+    uint8				*ras = NULL;
+    FILE				*f;
+    char				magic[4];
+    int					hdr[4], nruns;
+    size_t				n, sum = 0;
+
+    if( !(f = fopen( path, "rb" )) )
+        return NULL;
+
+    if( 1 != fread( magic, 4, 1, f ) ||
+        memcmp( magic, "RGN1", 4 ) ||
+        4 != fread( hdr, sizeof(int), 4, f ) ||
+        hdr[0] <= 0 || hdr[1] <= 0 || hdr[2] < 0 ) {
+
+        goto bad;
+    }
+
+    ve.resize( hdr[2] );
+
+    if( hdr[2] &&
+        hdr[2] != fread( &ve[0], sizeof(RgnMapEntry), hdr[2], f ) ) {
+
+        goto bad;
+    }
+
+    if( 1 != fread( &nruns, sizeof(int), 1, f ) || nruns < 0 )
+        goto bad;
+
+    len.resize( nruns );
+    val.resize( nruns );
+
+    if( nruns &&
+        (nruns != fread( &len[0], sizeof(uint32), nruns, f ) ||
+         nruns != fread( &val[0], sizeof(uint8), nruns, f )) ) {
+
+        goto bad;
+    }
+
+    n = (size_t)hdr[0] * hdr[1];
+
+    for( int i = 0; i < nruns; ++i )
+        sum += len[i];
+
+    if( sum != n )
+        goto bad;
+
+    fclose( f );
+
+// Decode
+
+    w	= hdr[0];
+    h	= hdr[1];
+    ras	= (uint8*)RasterAlloc( n );
+
+    if( !transpose ) {
+
+        uint8	*p = ras;
+
+        for( int i = 0; i < nruns; ++i ) {
+            memset( p, val[i], len[i] );
+            p += len[i];
+        }
+    }
+    else {
+
+        uint32	x = 0, y = 0;
+
+        for( int i = 0; i < nruns; ++i ) {
+
+            uint8	v = val[i];
+
+            for( uint32 k = len[i]; k > 0; --k ) {
+
+                ras[y + h * x] = v;
+
+                if( ++x == w ) {
+                    x = 0;
+                    ++y;
+                }
+            }
+        }
+
+        if( vr ) {
+
+            for( int i = 0; i < hdr[2]; ++i ) {
+
+                IBox	&B = ve[i].B;
+                int		t;
+
+                t = B.L, B.L = B.B, B.B = t;
+                t = B.R, B.R = B.T, B.T = t;
+            }
+        }
+
+        w = hdr[1];
+        h = hdr[0];
+    }
+
+    if( vr )
+        vr->swap( ve );
+
+    return ras;
+
+bad:
+    fclose( f );
+    fprintf( flog, "ReadRgnMap: Bad file [%s].\n", path );
+    return NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* LoadFoldMask -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Load foldmask image at path (free with RasterFree), preferring
+// its region map if present and not older than the image.
+//
+// If vr given, it receives the region map entries, or is left
+// empty if the image itself was read.
+//
+uint8* LoadFoldMask(
+    const char			*path,
+    uint32				&w,
+    uint32				&h,
+    FILE				*flog,
+    bool				transpose,
+    vector<RgnMapEntry>	*vr )
+{
+    string		rpath = RgnMapPath( path );
+    struct stat	sr, si;
+
+    if( vr )
+        vr->clear();
+
+    if( !stat( rpath.c_str(), &sr ) &&
+        (stat( path, &si ) || sr.st_mtime >= si.st_mtime) ) {
+
+        uint8	*ras =
+        ReadRgnMap( rpath.c_str(), w, h, vr, flog, transpose );
+
+        if( ras )
+            return ras;
+    }
+
+    return Raster8FromAny( path, w, h, flog, transpose );
+}
+
 /* --------------------------------------------------------------- */
 /* GetFoldMask --------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
 // Load or create a foldmask (always full size).
 //
+// If vr given, it receives the region map entries when the mask
+// came from a current region map and was not altered here (resin,
+// crop, force1rgn); otherwise it is left empty.
+//
 uint8* GetFoldMask(
     const string		&idb,
     const PicSpec		&P,
@@ -54,11 +380,15 @@ uint8* GetFoldMask(
     bool				nofile,
     bool				transpose,
     bool				force1rgn,
-    FILE				*flog )
+    FILE				*flog,
+    vector<RgnMapEntry>	*vr )
 {
     uint8*	mask;
     int		np = wf * hf;
 
+    if( vr )
+        vr->clear();
+
     if( nofile ) {
         mask = (uint8*)RasterAlloc( np );
         memset( mask, 1, np );
@@ -74,7 +404,7 @@ uint8* GetFoldMask(
 
         uint32	_w, _h;
 
-        mask = Raster8FromAny( forcepath, _w, _h, flog, transpose );
+        mask = LoadFoldMask( forcepath, _w, _h, flog, transpose, vr );
 
         if( _w != wf || _h != hf ) {
 
@@ -94,6 +424,9 @@ uint8* GetFoldMask(
                 if( mask[i] )
                     mask[i] = 1;
             }
+
+            if( vr )
+                vr->clear();
         }
     }
 
@@ -106,6 +439,9 @@ uint8* GetFoldMask(
             if( !resmsk[i] )
                 mask[i] = 0;
         }
+
+        if( vr )
+            vr->clear();
     }
 
 // optionally crop mask borders
@@ -130,6 +466,9 @@ uint8* GetFoldMask(
         fprintf( flog,
         "Crop z %d id %d cam %d to x[%d %d) y[%d %d)\n",
         P.z, P.id, P.t2i.cam, B.L, B.R, B.B, B.T );
+
+        if( vr )
+            vr->clear();
     }
 
     return mask;
@@ -172,6 +511,116 @@ void SetWithinSectionBorders( uint8* foldMask, int wf, int hf )
 /* SetBoundsAndColors -------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+// Color into foldMask, with clr, the pixels within D (box metric)
+// of any of pts and that are above thresh in image valid.
+//
+// The union of boxes is the region dilated by D, which we get
+// with separable running-window passes over the region's own
+// bounding box, so cost no longer scales with D^2 per point.
+//
+static void DilateAndColor(
+    uint8*					foldMask,
+    const vector<double>	&valid,
+    const vector<Point>		&pts,
+    int						wf,
+    int						hf,
+    double					thresh,
+    int						D,
+    int						clr )
+{
+    int	np = pts.size();
+
+    if( !np )
+        return;
+
+// Box = point bounds + D, clipped to image
+
+    int	L = wf, R = -1, B = hf, T = -1;
+
+    for( int ip = 0; ip < np; ++ip ) {
+
+        int	x = (int)pts[ip].x,
+            y = (int)pts[ip].y;
+
+        L = min( L, x );
+        R = max( R, x );
+        B = min( B, y );
+        T = max( T, y );
+    }
+
+    L = max(    0, L - D );
+    R = min( wf-1, R + D );
+    B = max(    0, B - D );
+    T = min( hf-1, T + D );
+
+    int	lw = R - L + 1,
+        lh = T - B + 1;
+
+    vector<uint8>	m( lw * lh, 0 ),
+                    t( lw * lh );
+
+    for( int ip = 0; ip < np; ++ip )
+        m[(int)pts[ip].x - L + lw*((int)pts[ip].y - B)] = 1;
+
+// Horizontal pass: t = any set within +-D along row
+
+    for( int y = 0; y < lh; ++y ) {
+
+        const uint8	*src = &m[lw*y];
+        uint8		*dst = &t[lw*y];
+        int			n = 0;
+
+        for( int x = 0; x < D && x < lw; ++x )
+            n += src[x];
+
+        for( int x = 0; x < lw; ++x ) {
+
+            if( x + D < lw )
+                n += src[x + D];
+
+            if( x - D - 1 >= 0 )
+                n -= src[x - D - 1];
+
+            dst[x] = (n != 0);
+        }
+    }
+
+// Vertical pass: m = any set within +-D along column
+
+    for( int x = 0; x < lw; ++x ) {
+
+        int	n = 0;
+
+        for( int y = 0; y < D && y < lh; ++y )
+            n += t[x + lw*y];
+
+        for( int y = 0; y < lh; ++y ) {
+
+            if( y + D < lh )
+                n += t[x + lw*(y + D)];
+
+            if( y - D - 1 >= 0 )
+                n -= t[x + lw*(y - D - 1)];
+
+            m[x + lw*y] = (n != 0);
+        }
+    }
+
+// Color
+
+    for( int y = 0; y < lh; ++y ) {
+
+        int	idx = L + wf*(B + y);
+
+        for( int x = 0; x < lw; ++x, ++idx ) {
+
+            if( m[x + lw*y] && valid[idx] > thresh )
+                foldMask[idx] = clr;
+        }
+    }
+}
+
+
 // Given vector of ConnRegion whose points are determined...
 // (1) Calculate each region's bounds
 // (2) Color the folmask raster with region ids.
@@ -288,9 +737,7 @@ void SetBoundsAndColors(
                 xlo = max(    0, x - D ),
                 xhi = min( wf-1, x + D ),
                 ylo = max(    0, y - D ),
-                yhi = min( hf-1, y + D ),
-                clr = ir + 1,
-                idx;
+                yhi = min( hf-1, y + D );
 
             // update bounds
             if( xlo < C.B.L )
@@ -302,19 +749,12 @@ void SetBoundsAndColors(
                 C.B.B = ylo;
             else if( yhi > C.B.T )
                 C.B.T = yhi;
-
-            // color mask pixels
-
-            for( y = ylo; y <= yhi; ++y ) {
-
-                for( x = xlo; x <= xhi; ++x ) {
-
-                    if( valid[idx = x + wf*y] > thresh )
-                        foldMask[idx] = clr;
-                }
-            }
         }
 
+        // color mask pixels
+        DilateAndColor( foldMask, valid, C.pts,
+            wf, hf, thresh, D, C.id );
+
         // print this region
         fprintf( flog,
             "\tid=%2d, pts=%8d, x=[%4d %4d], y=[%4d %4d].\n",
@@ -333,23 +773,58 @@ void SetBoundsAndColors(
 // We will not create entries for the fold or for any region
 // whose point count is below (minpts).
 //
+// If (vr) holds the region map entries for this very mask, the
+// stored areas replace the counting pass, and the stored boxes
+// bound the point scan. The point lists still need one scan of
+// the mask pixels.
+//
 void ConnRgnsFromFoldMask(
-    vector<ConnRegion>	&cr,
-    const uint8*		foldMask,
-    int					wf,
-    int					hf,
-    int					scale,
-    uint32				minpts,
-    FILE				*flog )
+    vector<ConnRegion>			&cr,
+    const uint8*				foldMask,
+    int							wf,
+    int							hf,
+    int							scale,
+    uint32						minpts,
+    FILE						*flog,
+    const vector<RgnMapEntry>	*vr )
 {
 // Pass 1: gather ids and size info for cr and pts vectors
 
     vector<uint32>	szrgn( 256, 0 );
     int				N = wf * hf;
     int				max_id = 0;
+    bool			usemap = vr && vr->size();
+
+    if( usemap ) {
+
+        double	sum = 0;
+
+        for( int i = 0, n = vr->size(); i < n; ++i ) {
+
+            const RgnMapEntry&	E = (*vr)[i];
+
+            if( E.id < 1 || E.id > 255 || E.area < 0 ) {
+                usemap = false;
+                break;
+            }
+
+            szrgn[E.id] = E.area;
+            sum += E.area;
+        }
+
+        if( usemap && sum <= N )
+            szrgn[0] = N - uint32(sum);
+        else {
+            usemap = false;
+            szrgn.assign( 256, 0 );
+        }
+    }
+
+    if( !usemap ) {
 
-    for( int i = 0; i < N; ++i )
-        ++szrgn[foldMask[i]];
+        for( int i = 0; i < N; ++i )
+            ++szrgn[foldMask[i]];
+    }
 
 // Find the highest occurring region id
 
@@ -413,41 +888,89 @@ void ConnRgnsFromFoldMask(
         C.id = id;
     }
 
-// Pass 2: gather unique scaled points and update BBoxes
+// Pass 2: gather unique scaled points and update BBoxes.
+// Work row by row at the scaled resolution: the scaled x of
+// each column comes from a table, and a whole fully-seen
+// scaled row is skipped with no per-pixel work. Pixels are
+// still visited in raster order so the first region to reach
+// a scaled pixel claims it, as before.
 
     vector<uint32>	pcnt( max_id + 1, 0 );
-    vector<uint8>	seen( N / (scale*scale), 0 );
-    int				ws = wf / scale;
+    int				ws = (wf + scale - 1) / scale,
+                    hs = (hf + scale - 1) / scale;
+    vector<uint8>	seen( ws * hs, 0 );
+    vector<int>		xs( wf );
+    vector<int>		nseen( hs, 0 );
 
-    for( int i = 0; i < N; ++i ) {
+    for( int X = 0; X < wf; ++X )
+        xs[X] = X / scale;
 
-        int	id = foldMask[i];
+// Limit the scan to the union box of the included regions.
 
-        if( !szrgn[id] )
-            continue;
+    int	X0 = 0, XL = wf, Y0 = 0, YL = hf;
+
+    if( usemap ) {
+
+        X0 = wf; XL = 0; Y0 = hf; YL = 0;
+
+        for( int i = 0, n = vr->size(); i < n; ++i ) {
+
+            const RgnMapEntry&	E = (*vr)[i];
 
-        int	Y =  i / wf,
-            y =  Y / scale,
-            x = (i - wf * Y) / scale;
+            if( !szrgn[E.id] )
+                continue;
 
-        if( seen[x + ws*y] )
+            X0 = min( X0, max( E.B.L, 0 ) );
+            XL = max( XL, min( E.B.R + 1, wf ) );
+            Y0 = min( Y0, max( E.B.B, 0 ) );
+            YL = max( YL, min( E.B.T + 1, hf ) );
+        }
+    }
+
+    for( int Y = Y0; Y < YL; ++Y ) {
+
+        int				y = Y / scale;
+
+        if( nseen[y] == ws )
             continue;
 
-        ConnRegion&	C = cr[id - 1];
+        const uint8		*row = foldMask + wf * Y;
+        uint8			*srow = &seen[ws * y];
+
+        for( int X = X0; X < XL; ++X ) {
 
-        seen[x + ws*y] = 1;
+            int	id = row[X];
 
-        if( x < C.B.L )
-            C.B.L = x;
-        else if( x > C.B.R )
-            C.B.R = x;
+            if( !szrgn[id] )
+                continue;
 
-        if( y < C.B.B )
-            C.B.B = y;
-        else if( y > C.B.T )
-            C.B.T = y;
+            int	x = xs[X];
 
-        C.pts[pcnt[id]++] = Point( x, y );
+            if( srow[x] )
+                continue;
+
+            ConnRegion&	C = cr[id - 1];
+
+            srow[x] = 1;
+            ++nseen[y];
+
+            if( x < C.B.L )
+                C.B.L = x;
+            else if( x > C.B.R )
+                C.B.R = x;
+
+            if( y < C.B.B )
+                C.B.B = y;
+            else if( y > C.B.T )
+                C.B.T = y;
+
+            if( pcnt[id] < C.pts.size() )
+                C.pts[pcnt[id]] = Point( x, y );
+            else
+                C.pts.push_back( Point( x, y ) );	// stale map area
+
+            ++pcnt[id];
+        }
     }
 
 // Lastly, remove empty cr, or if keeping, set pts actual size
@@ -459,7 +982,7 @@ void ConnRgnsFromFoldMask(
         if( np )
             cr[i].pts.resize( np );
         else
-            cr.erase( cr.begin() + i );
+            cr.erase( cr.begin() + i-- );
     }
 }
 
@@ -25,10 +25,50 @@ public:
     ConnRegion()	{B.L = B.B = BIG; B.R = B.T = -BIG;};
 };
 
+/* --------------------------------------------------------------- */
+/* RgnMap -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Region descriptor entry, one per nonzero mask value, as stored
+// in the compact region map (.rgn) that tiny writes beside each
+// foldmask image. All coordinates are full size, inclusive.
+//
+typedef struct {
+    IBox	B;		// bounding box
+    int		id,		// mask value
+            area;	// pixel count
+} RgnMapEntry;
+
 /* --------------------------------------------------------------- */
 /* Functions ----------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+string RgnMapPath( const char *maskpath );
+
+bool WriteRgnMap(
+    const char		*path,
+    const uint8*	fm,
+    int				w,
+    int				h,
+    FILE			*flog = stdout );
+
+uint8* ReadRgnMap(
+    const char			*path,
+    uint32				&w,
+    uint32				&h,
+    vector<RgnMapEntry>	*vr,
+    FILE				*flog = stdout,
+    bool				transpose = false );
+
+uint8* LoadFoldMask(
+    const char			*path,
+    uint32				&w,
+    uint32				&h,
+    FILE				*flog = stdout,
+    bool				transpose = false,
+    vector<RgnMapEntry>	*vr = NULL );
+
+
 uint8* GetFoldMask(
     const string		&idb,
     const PicSpec		&P,
@@ -40,7 +80,8 @@ uint8* GetFoldMask(
     bool				nofile,
     bool				transpose,
     bool				force1rgn,
-    FILE				*flog = stdout );
+    FILE				*flog = stdout,
+    vector<RgnMapEntry>	*vr = NULL );
 
 void SetWithinSectionBorders( uint8* foldMask, int wf, int hf );
 
@@ -62,13 +103,14 @@ void SetBoundsAndColors(
     FILE					*flog = stdout );
 
 void ConnRgnsFromFoldMask(
-    vector<ConnRegion>	&cr,
-    const uint8*		foldMask,
-    int					wf,
-    int					hf,
-    int					scale,
-    uint32				minpts,
-    FILE				*flog = stdout );
+    vector<ConnRegion>			&cr,
+    const uint8*				foldMask,
+    int							wf,
+    int							hf,
+    int							scale,
+    uint32						minpts,
+    FILE						*flog = stdout,
+    const vector<RgnMapEntry>	*vr = NULL );
 
 void ConnRgnForce1( vector<ConnRegion> &cr, int ws, int hs );
 
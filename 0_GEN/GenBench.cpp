@@ -0,0 +1,784 @@
+//
+// Microbenchmarks for the libgen hot kernels, so changes to them
+// can be measured in isolation. Not part of genlib.a; build with
+// 'make genbench' in 0_GEN.
+//
+// > genbench [options]
+//
+// Options:
+// -only=Corr			;run kernels whose name contains this
+// -sizes=thumb,tile	;subset of thumb, scape, tile (default all)
+// -thumb=256,256		;override size w,h
+// -scape=1024,1024		;override size w,h
+// -tile=2048,2048		;override size w,h
+// -reps=7				;timed repetitions per case
+// -mintime=0.25		;min seconds per repetition
+// -save=base.txt		;write results as a baseline file
+// -base=base.txt		;compare against saved baseline
+// -tol=10				;percent slower than baseline that fails
+//
+// Each case is a kernel at one size. After a warmup call (which
+// also fills caches like Convolve's kfft) calls are batched so a
+// repetition lasts at least mintime. Reported per case:
+//
+//	ns/op	median over repetitions, also min.
+//	cv%		repetition stdev / mean; compare deltas to this.
+//	M/s		items per second at the median: pixels for image
+//			kernels, FFT grid points, points transformed, or
+//			systems solved.
+//
+// Image kernels run on a synthetic 8-bit texture of size w x h.
+// FFT_2D and IFT_2D use the grid CorrPatches would pad that to.
+// Correlation cases find the offset between two overlapping w x h
+// crops and recompute both FFTs every call (no fft2 cache). The
+// transforms map w x h points one at a time, as the tools do.
+// Solve_Quick instead uses n = 4, 6, 8 for thumb, scape, tile
+// (the rigid, affine and homography systems of lsqw/dmesh); its
+// op includes copying the packed system, which it overwrites.
+//
+// With -base, exit status is 1 if any case is slower than its
+// baseline by more than tol percent.
+//
+
+
+#include	"Cmdline.h"
+#include	"File.h"
+#include	"Correlation.h"
+#include	"LinEqu.h"
+#include	"Maths.h"
+#include	"TAffine.h"
+#include	"THmgphy.h"
+#include	"Timer.h"
+
+#include	<math.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+
+#include	<algorithm>
+#include	<map>
+#include	<string>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Constants ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+enum { eThumb, eScape, eTile, nSizes };
+
+enum { ePix, eFFT, eOne };	// what an item is
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+typedef void (*OpFun)();
+
+
+class Kern {
+public:
+    const char	*name,
+                *unit;
+    int			items;
+    OpFun		prep,
+                op;
+    const char	*lbl[nSizes];	// size labels; NULL = size names
+};
+
+
+// Inputs for the current size; prep functions fill only the
+// work vectors their kernel needs.
+
+class Data {
+public:
+    int				w, h, Nx, Ny, n, isz;
+    vector<uint8>	tx8;	// texture (w+pad) x (h+pad)
+    int				tw, th;
+    vector<uint8>	img8;
+    vector<uint16>	img16;
+    vector<double>	imgd, K, work;
+    vector<Point>	ip1, ip2, pts, dst;
+    vector<double>	iv1, iv2;
+    vector<CD>		fft, fft2, kfft;
+    TAffine			A;
+    THmgphy			H;
+    double			LHS0[64], RHS0[8], LHS[64], RHS[8];
+public:
+    void Texture( int w, int h );
+    void Free();
+};
+
+
+class Result {
+public:
+    string	key;	// "kernel size"
+    double	ns, nsmin, cv, mps;
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_gbn ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_gbn {
+
+public:
+    int			dim[nSizes][2];
+    bool		use[nSizes];
+    const char	*only,
+                *save,
+                *base;
+    double		mintime,
+                tol;
+    int			reps;
+
+public:
+    CArgs_gbn()
+    : only(NULL), save(NULL), base(NULL),
+      mintime(0.25), tol(10), reps(7)
+    {
+        dim[eThumb][0] = 256;	dim[eThumb][1] = 256;
+        dim[eScape][0] = 1024;	dim[eScape][1] = 1024;
+        dim[eTile][0]  = 2048;	dim[eTile][1]  = 2048;
+
+        for( int i = 0; i < nSizes; ++i )
+            use[i] = true;
+    };
+
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static const char	*sizeName[nSizes] = {"thumb", "scape", "tile"};
+
+static CArgs_gbn			gArgs;
+static Data					D;
+static vector<Result>		vR;
+static map<string,double>	mBase;
+static FILE*				fnul	= NULL;	// quiets kernel logging
+static volatile double		sink	= 0;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_gbn::SetCmdLine( int argc, char* argv[] )
+{
+// parse command line args
+
+    const char	*sizes = NULL;
+    vector<int>	vi;
+
+    for( int i = 1; i < argc; ++i ) {
+
+        if( GetArgStr( only, "-only=", argv[i] ) )
+            ;
+        else if( GetArgStr( sizes, "-sizes=", argv[i] ) )
+            ;
+        else if( GetArgStr( save, "-save=", argv[i] ) )
+            ;
+        else if( GetArgStr( base, "-base=", argv[i] ) )
+            ;
+        else if( GetArg( &reps, "-reps=%d", argv[i] ) )
+            ;
+        else if( GetArg( &mintime, "-mintime=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &tol, "-tol=%lf", argv[i] ) )
+            ;
+        else if( GetArgList( vi, "-thumb=", argv[i] ) && vi.size() == 2 )
+            {dim[eThumb][0] = vi[0]; dim[eThumb][1] = vi[1];}
+        else if( GetArgList( vi, "-scape=", argv[i] ) && vi.size() == 2 )
+            {dim[eScape][0] = vi[0]; dim[eScape][1] = vi[1];}
+        else if( GetArgList( vi, "-tile=", argv[i] ) && vi.size() == 2 )
+            {dim[eTile][0] = vi[0]; dim[eTile][1] = vi[1];}
+        else {
+            printf( "Did not understand option [%s].\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    if( sizes ) {
+
+        for( int i = 0; i < nSizes; ++i )
+            use[i] = (NULL != strstr( sizes, sizeName[i] ));
+    }
+
+    if( reps < 2 )
+        reps = 2;
+}
+
+/* --------------------------------------------------------------- */
+/* Data ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Smooth sum-of-waves texture plus pixel noise, so
+// correlation has a single well defined peak.
+//
+void Data::Texture( int w, int h )
+{
+    this->w	= w;
+    this->h	= h;
+    tw		= w + w / 4;
+    th		= h + h / 4;
+
+    srand( 1234 );
+
+    double	fx[6], fy[6], ph[6];
+
+    for( int k = 0; k < 6; ++k ) {
+        fx[k] = 0.02 + 0.15 * rand() / RAND_MAX;
+        fy[k] = 0.02 + 0.15 * rand() / RAND_MAX;
+        ph[k] = 6.28 * rand() / RAND_MAX;
+    }
+
+    tx8.resize( tw * th );
+
+    for( int y = 0; y < th; ++y ) {
+
+        for( int x = 0; x < tw; ++x ) {
+
+            double	v = 0;
+
+            for( int k = 0; k < 6; ++k )
+                v += sin( fx[k]*x + ph[k] ) * cos( fy[k]*y - ph[k] );
+
+            v = 128 + 16 * v + 24.0 * rand() / RAND_MAX - 12;
+
+            tx8[x + tw*y] = (v < 0 ? 0 : (v > 255 ? 255 : uint8(v)));
+        }
+    }
+
+    img8.resize( w * h );
+
+    for( int y = 0; y < h; ++y )
+        memcpy( &img8[w*y], &tx8[tw*y], w );
+}
+
+
+// Release work vectors between kernels to bound memory.
+//
+void Data::Free()
+{
+    vector<uint16>().swap( img16 );
+    vector<double>().swap( imgd );
+    vector<double>().swap( work );
+    vector<Point>().swap( ip1 );
+    vector<Point>().swap( ip2 );
+    vector<Point>().swap( pts );
+    vector<Point>().swap( dst );
+    vector<double>().swap( iv1 );
+    vector<double>().swap( iv2 );
+    vector<CD>().swap( fft );
+    vector<CD>().swap( fft2 );
+    vector<CD>().swap( kfft );
+}
+
+/* --------------------------------------------------------------- */
+/* Kernels ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static bool Always( int, int, void* )
+{
+    return true;
+}
+
+
+// Crop of texture at (x0,y0) as point list and normalized values.
+//
+static void Crop(
+    vector<Point>	&ip,
+    vector<double>	&iv,
+    int				x0,
+    int				y0 )
+{
+    ip.clear();
+    iv.clear();
+
+    for( int y = 0; y < D.h; ++y ) {
+
+        for( int x = 0; x < D.w; ++x ) {
+
+            ip.push_back( Point( x, y ) );
+            iv.push_back( D.tx8[x+x0 + D.tw*(y+y0)] );
+        }
+    }
+
+    Normalize( iv );
+}
+
+
+static void PrepFFT()
+{
+    D.Nx = FFTSize( D.w, D.w );
+    D.Ny = FFTSize( D.h, D.h );
+    D.imgd.assign( D.Nx * D.Ny, 0.0 );
+
+    for( int y = 0; y < D.h; ++y ) {
+
+        for( int x = 0; x < D.w; ++x )
+            D.imgd[x + D.Nx*y] = D.img8[x + D.w*y];
+    }
+}
+
+
+static void OpFFT()
+{
+    FFT_2D( D.fft, D.imgd, D.Nx, D.Ny, false, fnul );
+}
+
+
+static void PrepIFT()
+{
+    PrepFFT();
+    OpFFT();
+}
+
+
+static void OpIFT()
+{
+    IFT_2D( D.work, D.fft, D.Nx, D.Ny, fnul );
+}
+
+
+static void PrepCorr()
+{
+    Crop( D.ip1, D.iv1, 0, 0 );
+    Crop( D.ip2, D.iv2, D.w / 8, D.h / 16 );
+}
+
+
+static void OpCorrImagesF()
+{
+    double	dx, dy;
+
+    D.fft2.clear();
+
+    sink += CorrImagesF(
+        fnul, false, dx, dy,
+        D.ip1, D.iv1, D.ip2, D.iv2,
+        Always, NULL, Always, NULL,
+        0.0, 0.75, 0, 0, -1, -1, D.fft2 );
+}
+
+
+static void OpCorrPatches()
+{
+    double	dx, dy;
+
+    D.fft2.clear();
+
+    sink += CorrPatches(
+        fnul, false, dx, dy,
+        D.ip1, D.iv1, D.ip2, D.iv2,
+        0, 0, max( D.w, D.h ) / 4,
+        Always, NULL, Always, NULL, D.fft2 );
+}
+
+
+// 21x21 gaussian, sigma 3.
+//
+static void PrepConvolve()
+{
+    D.K.resize( 21 * 21 );
+
+    for( int y = -10; y <= 10; ++y ) {
+
+        for( int x = -10; x <= 10; ++x )
+            D.K[x+10 + 21*(y+10)] = exp( -(x*x + y*y) / 18.0 );
+    }
+
+    D.imgd.resize( D.w * D.h );
+
+    for( int i = 0, n = D.w * D.h; i < n; ++i )
+        D.imgd[i] = D.img8[i];
+}
+
+
+static void OpConvolve()
+{
+    Convolve( D.work, D.imgd, D.w, D.h,
+        &D.K[0], 21, 21, true, true, D.kfft, fnul );
+}
+
+
+static void PrepNone()
+{
+}
+
+
+static void OpSafeInterp()
+{
+    double	s = 0;
+
+    for( int y = 0; y < D.h; ++y ) {
+
+        for( int x = 0; x < D.w; ++x ) {
+
+            s += SafeInterp( 0.97*x + 0.31, 0.97*y + 0.53,
+                    &D.img8[0], D.w, D.h );
+        }
+    }
+
+    sink += s;
+}
+
+
+static void OpLegPolyFlatten()
+{
+    LegPolyFlatten( D.work, &D.img8[0], D.w, D.h, 1 );
+}
+
+
+static void OpLegPolyFlattenFast()
+{
+    LegPolyFlattenFast( D.work, &D.img8[0], D.w, D.h, 1, 4 );
+}
+
+
+// 12-bit camera data.
+//
+static void PrepHistogram()
+{
+    D.img16.resize( D.w * D.h );
+
+    for( int i = 0, n = D.w * D.h; i < n; ++i )
+        D.img16[i] = D.img8[i] * 16 + (i & 15);
+
+    D.work.resize( 256 );
+}
+
+
+static void OpHistogram()
+{
+    double	uflo, oflo;
+
+    Histogram( uflo, oflo, &D.work[0], 256,
+        0.0, 4096.0, &D.img16[0], D.w * D.h, true );
+}
+
+
+// Normal equations of a random well conditioned system.
+//
+static void PrepSolve()
+{
+    int		n = 4 + 2 * D.isz;
+    double	M[64];
+
+    D.n = n;
+    srand( 99 );
+
+    for( int i = 0; i < n*n; ++i )
+        M[i] = 2.0 * rand() / RAND_MAX - 1;
+
+    for( int i = 0; i < n; ++i ) {
+
+        for( int j = 0; j < n; ++j ) {
+
+            double	s = (i == j ? n : 0);
+
+            for( int k = 0; k < n; ++k )
+                s += M[i*n+k] * M[j*n+k];
+
+            D.LHS0[i*n+j] = s;
+        }
+
+        D.RHS0[i] = i + 1;
+    }
+}
+
+
+static void OpSolve()
+{
+    int	n = D.n;
+
+    memcpy( D.LHS, D.LHS0, n*n*sizeof(double) );
+    memcpy( D.RHS, D.RHS0, n*sizeof(double) );
+    Solve_Quick( D.LHS, D.RHS, n );
+    sink += D.RHS[0];
+}
+
+
+static void PrepXfm()
+{
+    D.pts.resize( D.w * D.h );
+    D.dst.resize( D.w * D.h );
+
+    for( int y = 0; y < D.h; ++y ) {
+
+        for( int x = 0; x < D.w; ++x )
+            D.pts[x + D.w*y] = Point( x, y );
+    }
+
+    D.A = TAffine( 0.998, -0.052, 31.5, 0.052, 0.998, -17.25 );
+    D.H = THmgphy( 0.998, -0.052, 31.5, 0.052, 0.998, -17.25,
+            1.3e-6, -2.1e-6 );
+}
+
+
+static void OpAffine()
+{
+    for( int i = 0, n = D.pts.size(); i < n; ++i ) {
+        Point	p = D.pts[i];
+        D.A.Transform( p );
+        D.dst[i] = p;
+    }
+}
+
+
+static void OpHmgphy()
+{
+    for( int i = 0, n = D.pts.size(); i < n; ++i ) {
+        Point	p = D.pts[i];
+        D.H.Transform( p );
+        D.dst[i] = p;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* Kernel table -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static const Kern	kerns[] = {
+    {"FFT_2D",				"px",	eFFT,	PrepFFT,		OpFFT,
+        {NULL}},
+    {"IFT_2D",				"px",	eFFT,	PrepIFT,		OpIFT,
+        {NULL}},
+    {"CorrImagesF",			"px",	ePix,	PrepCorr,		OpCorrImagesF,
+        {NULL}},
+    {"CorrPatches",			"px",	ePix,	PrepCorr,		OpCorrPatches,
+        {NULL}},
+    {"Convolve",			"px",	ePix,	PrepConvolve,	OpConvolve,
+        {NULL}},
+    {"SafeInterp",			"px",	ePix,	PrepNone,		OpSafeInterp,
+        {NULL}},
+    {"LegPolyFlatten",		"px",	ePix,	PrepNone,		OpLegPolyFlatten,
+        {NULL}},
+    {"LegPolyFlattenFast",	"px",	ePix,	PrepNone,		OpLegPolyFlattenFast,
+        {NULL}},
+    {"Histogram",			"px",	ePix,	PrepHistogram,	OpHistogram,
+        {NULL}},
+    {"Solve_Quick",			"sys",	eOne,	PrepSolve,		OpSolve,
+        {"n4", "n6", "n8"}},
+    {"TAffine",				"pt",	ePix,	PrepXfm,		OpAffine,
+        {NULL}},
+    {"THmgphy",				"pt",	ePix,	PrepXfm,		OpHmgphy,
+        {NULL}}
+};
+
+/* --------------------------------------------------------------- */
+/* Baseline ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void LoadBase()
+{
+    FILE	*f = FileOpenOrDie( gArgs.base, "r" );
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        char	kern[128], size[32];
+        double	ns;
+
+        if( LS.line[0] == '#' ) {
+            printf( "Baseline:%s", LS.line + 1 );
+            continue;
+        }
+
+        if( 3 == sscanf( LS.line, "%127s%31s%lf", kern, size, &ns ) )
+            mBase[string( kern ) + " " + size] = ns;
+    }
+
+    fclose( f );
+}
+
+
+static void SaveBase()
+{
+    FILE	*f = FileOpenOrDie( gArgs.save, "w" );
+    char	host[128] = "";
+
+    gethostname( host, sizeof(host) );
+
+    fprintf( f, "# host %s reps %d mintime %g\n",
+        host, gArgs.reps, gArgs.mintime );
+
+    for( int i = 0, n = vR.size(); i < n; ++i ) {
+
+        const Result	&R = vR[i];
+
+        fprintf( f, "%s\t%.1f\t%.2f\n", R.key.c_str(), R.ns, R.cv );
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* Timing -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static double Batch( OpFun op, int niter )
+{
+    double	t0 = WallSec();
+
+    for( int i = 0; i < niter; ++i )
+        op();
+
+    return WallSec() - t0;
+}
+
+
+// Time one kernel at current size and print its row.
+//
+// Return true if slower than baseline beyond tol.
+//
+static bool Run( const Kern &K )
+{
+    Result	R;
+    char	buf[64], unit[16];
+
+    sprintf( buf, " %s",
+        (K.lbl[0] ? K.lbl[D.isz] : sizeName[D.isz]) );
+
+    R.key = string( K.name ) + buf;
+
+    D.Free();
+    K.prep();
+
+// Warmup, then grow batch to about mintime
+
+    int		niter	= 1;
+    double	dt		= Batch( K.op, 1 );
+
+    while( dt < gArgs.mintime / 8 ) {
+        niter *= 2;
+        dt = Batch( K.op, niter );
+    }
+
+    niter = max( 1, int(niter * gArgs.mintime / dt) );
+
+// Repetitions
+
+    vector<double>	ns( gArgs.reps );
+    double			sum = 0, sum2 = 0;
+
+    for( int i = 0; i < gArgs.reps; ++i ) {
+
+        ns[i]	= Batch( K.op, niter ) * 1e9 / niter;
+        sum		+= ns[i];
+        sum2	+= ns[i] * ns[i];
+    }
+
+    double	mean = sum / gArgs.reps,
+            var  = (sum2 - sum * mean) / (gArgs.reps - 1);
+
+    sort( ns.begin(), ns.end() );
+
+    R.ns	= ns[gArgs.reps / 2];
+    R.nsmin	= ns[0];
+    R.cv	= (var > 0 ? 100 * sqrt( var ) / mean : 0);
+
+    double	items;
+
+    if( K.items == eFFT )
+        items = double(D.Nx) * D.Ny;
+    else if( K.items == ePix )
+        items = double(D.w) * D.h;
+    else
+        items = 1;
+
+    R.mps = items * 1e3 / R.ns;
+
+    vR.push_back( R );
+
+// Report
+
+    bool	slow = false;
+
+    sprintf( unit, "M%s/s", K.unit );
+
+    printf( "%-26s %14.1f %14.1f %6.2f %10.3f %-7s",
+        R.key.c_str(), R.ns, R.nsmin, R.cv, R.mps, unit );
+
+    map<string,double>::iterator	it = mBase.find( R.key );
+
+    if( it != mBase.end() ) {
+
+        double	pct = 100 * (R.ns - it->second) / it->second;
+
+        slow = (pct > gArgs.tol);
+
+        printf( " %14.1f %+7.1f%%%s", it->second, pct,
+            (slow ? "  SLOWER" : (pct < -gArgs.tol ? "  faster" : "")) );
+    }
+
+    printf( "\n" );
+    fflush( stdout );
+
+    return slow;
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+    gArgs.SetCmdLine( argc, argv );
+
+    fnul = FileOpenOrDie( "/dev/null", "w" );
+
+    if( gArgs.base )
+        LoadBase();
+
+    printf( "%-26s %14s %14s %6s %18s",
+        "kernel size", "ns/op", "min ns/op", "cv%", "throughput" );
+
+    if( gArgs.base )
+        printf( " %14s %8s", "base ns/op", "delta" );
+
+    printf( "\n" );
+
+    int	nslow	= 0,
+        nkern	= sizeof(kerns) / sizeof(Kern);
+
+    for( int is = 0; is < nSizes; ++is ) {
+
+        if( !gArgs.use[is] )
+            continue;
+
+        D.isz = is;
+        D.Texture( gArgs.dim[is][0], gArgs.dim[is][1] );
+
+        for( int ik = 0; ik < nkern; ++ik ) {
+
+            if( gArgs.only && !strstr( kerns[ik].name, gArgs.only ) )
+                continue;
+
+            nslow += Run( kerns[ik] );
+        }
+
+        D.Free();
+    }
+
+    fclose( fnul );
+
+    if( gArgs.save )
+        SaveBase();
+
+    if( gArgs.base ) {
+        printf( "%d of %d cases slower than baseline by > %g%%.\n",
+            nslow, int(vR.size()), gArgs.tol );
+    }
+
+    return (nslow ? 1 : 0);
+}
+
+
@@ -1,9 +1,11 @@
 
 
 #include	"Geometry.h"
+#include	"EZThreads.h"
 #include	"Maths.h"
 #include	"TAffine.h"
 
+#include	<stdlib.h>
 #include	<string.h>
 
 
@@ -530,6 +532,308 @@ int MapBlobVar(
     return cnt;
 }
 
+/* --------------------------------------------------------------- */
+/* LabelConnected ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// A horizontal run [x0, x1] of set pixels in row y.
+//
+class CLblRun {
+public:
+    int	y, x0, x1;
+public:
+    CLblRun( int y, int x0, int x1 ) : y(y), x0(x0), x1(x1) {};
+};
+
+class CLblThrd {
+public:
+    vector<CLblRun>	vrun;	// pass 1 runs of this stripe
+    int				y0, ylim,
+                    r0, rlim;	// global run index range
+};
+
+static const uint8		*LBmsk;
+static vector<int>		*LBlbl;
+static vector<CLblRun>	LBrun;
+static vector<int>		LBrow,	// first run of row y
+                        LBpar;	// union-find parent
+static vector<CLblThrd>	vlbl;
+static int				LBw;
+
+
+// Return root of run r, compressing the path as we go.
+//
+static int LBFind( int r )
+{
+    int	root = r;
+
+    while( LBpar[root] != root )
+        root = LBpar[root];
+
+    while( LBpar[r] != root ) {
+
+        int	next = LBpar[r];
+        LBpar[r] = root;
+        r = next;
+    }
+
+    return root;
+}
+
+
+// Join sets of runs a and b; the smaller index remains root
+// so that a set's root is its first run in raster order.
+//
+static void LBUnion( int a, int b )
+{
+    a = LBFind( a );
+    b = LBFind( b );
+
+    if( a < b )
+        LBpar[b] = a;
+    else if( b < a )
+        LBpar[a] = b;
+}
+
+
+// Union every run in row y with the 4-connected (x-overlapping)
+// runs of row y-1.
+//
+static void LBJoinRows( int y )
+{
+    int	a    = LBrow[y-1],
+        alim = LBrow[y],
+        b    = alim,
+        blim = LBrow[y+1];
+
+    while( a < alim && b < blim ) {
+
+        const CLblRun	&A = LBrun[a];
+        const CLblRun	&B = LBrun[b];
+
+        if( A.x0 <= B.x1 && B.x0 <= A.x1 )
+            LBUnion( a, b );
+
+        if( A.x1 < B.x1 )
+            ++a;
+        else
+            ++b;
+    }
+}
+
+
+// Pass 1: run-length encode this stripe's rows. Eight mask bytes
+// are tested at once so empty and full stretches cost little.
+//
+void* _LBRuns( void *ithr )
+{
+    CLblThrd	&me = vlbl[(long)ithr];
+    int			w = LBw;
+
+    for( int y = me.y0; y < me.ylim; ++y ) {
+
+        const uint8	*row = LBmsk + (size_t)w * y;
+        int			x = 0;
+
+        LBrow[y] = me.vrun.size();
+
+        while( x < w ) {
+
+            // skip background
+
+            for( unsigned long long q; x + 8 <= w; x += 8 ) {
+                memcpy( &q, row + x, 8 );
+                if( q )
+                    break;
+            }
+
+            while( x < w && !row[x] )
+                ++x;
+
+            if( x >= w )
+                break;
+
+            // measure run
+
+            int	x0 = x;
+
+            while( x < w && row[x] )
+                ++x;
+
+            me.vrun.push_back( CLblRun( y, x0, x - 1 ) );
+        }
+    }
+
+    return NULL;
+}
+
+
+// Pass 2: union runs within this stripe. Stripes own disjoint
+// run index ranges, so no locking is needed.
+//
+void* _LBJoin( void *ithr )
+{
+    CLblThrd	&me = vlbl[(long)ithr];
+
+    for( int y = me.y0 + 1; y < me.ylim; ++y )
+        LBJoinRows( y );
+
+    return NULL;
+}
+
+
+// Pass 3: paint run labels (held in LBpar) into the output.
+//
+void* _LBPaint( void *ithr )
+{
+    CLblThrd	&me = vlbl[(long)ithr];
+    int			*L  = &(*LBlbl)[0];
+    int			w   = LBw;
+
+    memset( L + (size_t)w * me.y0, 0,
+        (size_t)w * (me.ylim - me.y0) * sizeof(int) );
+
+    for( int r = me.r0; r < me.rlim; ++r ) {
+
+        const CLblRun	&R = LBrun[r];
+        int				*p = L + (size_t)w * R.y,
+                        id = LBpar[r];
+
+        for( int x = R.x0; x <= R.x1; ++x )
+            p[x] = id;
+    }
+
+    return NULL;
+}
+
+
+static void LBThreads( EZThreadproc proc, int nthr, const char *name )
+{
+    if( nthr == 1 )
+        proc( 0 );
+    else if( !EZThreads( proc, nthr, 1, name ) )
+        exit( 42 );
+}
+
+
+// Label the 4-connected regions of nonzero pixels in mask msk.
+//
+// On exit, lbl[i] is 0 for background pixels and otherwise the
+// 1-based id of the pixel's region. Ids are assigned in raster
+// order of each region's first pixel, so the labelling matches
+// that of a row-major scan driving a flood fill.
+//
+// The mask is run-length encoded by row, runs of adjacent rows
+// are merged with union-find, and the encode, merge and paint
+// passes are each split over nthr horizontal stripes.
+//
+// Return region count.
+//
+int LabelConnected(
+    vector<int>		&lbl,
+    const uint8		*msk,
+    int				w,
+    int				h,
+    int				nthr )
+{
+    lbl.resize( w * h );
+
+    if( w <= 0 || h <= 0 )
+        return 0;
+
+    if( nthr > h )
+        nthr = h;
+
+    if( nthr < 1 )
+        nthr = 1;
+
+    LBmsk	= msk;
+    LBlbl	= &lbl;
+    LBw		= w;
+
+    LBrow.resize( h + 1 );
+    vlbl.resize( nthr );
+
+// Stripes
+
+    int	nb = h / nthr;
+
+    vlbl[0].y0		= 0;
+    vlbl[0].ylim	= nb;
+
+    for( int i = 1; i < nthr; ++i ) {
+        CLblThrd	&C = vlbl[i];
+        C.y0	= vlbl[i-1].ylim;
+        C.ylim	= (i == nthr-1 ? h : C.y0 + nb);
+    }
+
+// Pass 1: runs; then concatenate in stripe order
+
+    LBThreads( _LBRuns, nthr, "_LBRuns" );
+
+    int	nrun = 0;
+
+    for( int i = 0; i < nthr; ++i ) {
+
+        CLblThrd	&C = vlbl[i];
+
+        C.r0	= nrun;
+        nrun	+= C.vrun.size();
+        C.rlim	= nrun;
+    }
+
+    LBrun.clear();
+    LBrun.reserve( nrun );
+
+    for( int i = 0; i < nthr; ++i ) {
+
+        CLblThrd	&C = vlbl[i];
+
+        for( int y = C.y0; y < C.ylim; ++y )
+            LBrow[y] += C.r0;
+
+        LBrun.insert( LBrun.end(), C.vrun.begin(), C.vrun.end() );
+        vector<CLblRun>().swap( C.vrun );
+    }
+
+    LBrow[h] = nrun;
+
+// Pass 2: union within stripes, then across stripe seams
+
+    LBpar.resize( nrun );
+
+    for( int r = 0; r < nrun; ++r )
+        LBpar[r] = r;
+
+    LBThreads( _LBJoin, nthr, "_LBJoin" );
+
+    for( int i = 1; i < nthr; ++i )
+        LBJoinRows( vlbl[i].y0 );
+
+// Resolve ids: a parent always precedes its child, so it
+// already holds the set's id when we get to the child.
+
+    int	nrgn = 0;
+
+    for( int r = 0; r < nrun; ++r ) {
+
+        int	p = LBpar[r];
+
+        LBpar[r] = (p == r ? ++nrgn : LBpar[p]);
+    }
+
+// Pass 3: paint
+
+    LBThreads( _LBPaint, nthr, "_LBPaint" );
+
+    vlbl.clear();
+    LBrun.clear();
+    LBrow.clear();
+    LBpar.clear();
+
+    return nrgn;
+}
+
 /* --------------------------------------------------------------- */
 /* DilateMap1Pix ------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -91,6 +91,13 @@ int MapBlobVar(
     int				size,
     int				tol );
 
+int LabelConnected(
+    vector<int>		&lbl,
+    const uint8		*msk,
+    int				w,
+    int				h,
+    int				nthr = 1 );
+
 void DilateMap1Pix( vector<uint8> &map, int w, int h );
 void ErodeMap1Pix( vector<uint8> &map, int w, int h );
 
@@ -1,6 +1,7 @@
 
 
 #include	"ImageIO.h"
+#include	"EZThreads.h"
 #include	"File.h"
 #include	"mrc.h"
 #include	"Maths.h"
@@ -9,7 +10,13 @@
 #include	"tiffio.h"
 
 #include	<limits.h>
+#include	<math.h>
+#include	<pthread.h>
 #include	<string.h>
+#include	<sys/stat.h>
+
+#include	<string>
+using namespace std;
 
 
 /* --------------------------------------------------------------- */
@@ -19,6 +26,26 @@
 #define	USE_TIF_DEFLATE		0
 #define	GENEMEYERSTIFF		1
 
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CRasCacheEntry {
+public:
+    string	name;
+    time_t	mtime;
+    uint8	*ras;
+    uint32	w, h;
+    long	stamp;		// last use, for LRU eviction
+    bool	transpose;
+};
+
+class CT16Thrd {	// Raster8FromTif16Bit stripe
+public:
+    int		j0, jlim;
+    uint32	*hst;
+};
+
 /* --------------------------------------------------------------- */
 /* Statics ------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -26,6 +53,20 @@
 // write out converted images as 1.tif, 2.tif, etc.
 static int num = 1;
 
+// mutex_ras guards the decoded raster cache
+static pthread_mutex_t			mutex_ras = PTHREAD_MUTEX_INITIALIZER;
+static vector<CRasCacheEntry>	rascache;
+static double					rascache_max	= 0,
+                                rascache_bytes	= 0;
+static long						rascache_clock	= 0;
+
+// mutex_t16 guards the 16-bit conversion thread context
+static pthread_mutex_t			mutex_t16 = PTHREAD_MUTEX_INITIALIZER;
+static vector<CT16Thrd>			vt16;
+static const uint16				*T16raw;
+static const uint8				*T16lut;
+static uint8					*T16ras;
+
 
 
 
@@ -52,16 +93,189 @@ void _RasterFree( void** praster )
     }
 }
 
+/* --------------------------------------------------------------- */
+/* RasterCacheSetMB ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Long-running workers (ptest -spool) read the same few tiles and
+// foldmasks over and over. Setting maxMB > 0 makes Raster8FromAny
+// keep up to maxMB of decoded rasters, keyed by path, transpose
+// flag and file modification time. Callers still get their own
+// copy, which they free with RasterFree as usual.
+//
+// maxMB <= 0 disables and empties the cache (the default).
+//
+void RasterCacheSetMB( int maxMB, FILE* flog )
+{
+    pthread_mutex_lock( &mutex_ras );
+
+    rascache_max = (maxMB > 0 ? maxMB * 1024.0 * 1024.0 : 0);
+
+    if( !rascache_max ) {
+
+        for( int i = 0, n = rascache.size(); i < n; ++i )
+            RasterFree( rascache[i].ras );
+
+        rascache.clear();
+        rascache_bytes = 0;
+    }
+
+    pthread_mutex_unlock( &mutex_ras );
+
+    fprintf( flog, "RasterCache: Limit %d MB.\n", (maxMB > 0 ? maxMB : 0) );
+}
+
+/* --------------------------------------------------------------- */
+/* RasterCacheGet ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Return copy of cached raster, or NULL if none.
+//
+static uint8* RasterCacheGet(
+    const char*	name,
+    time_t		mtime,
+    uint32		&w,
+    uint32		&h,
+    bool		transpose )
+{
+    uint8	*ras = NULL;
+
+    pthread_mutex_lock( &mutex_ras );
+
+    for( int i = 0, n = rascache.size(); i < n; ++i ) {
+
+        CRasCacheEntry	&E = rascache[i];
+
+        if( E.mtime == mtime &&
+            E.transpose == transpose &&
+            E.name == name ) {
+
+            w		= E.w;
+            h		= E.h;
+            E.stamp	= ++rascache_clock;
+
+            if( ras = (uint8*)RasterAlloc( w * h ) )
+                memcpy( ras, E.ras, w * h );
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &mutex_ras );
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* RasterCachePut ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Store a copy of ras, evicting least recently used entries.
+//
+static void RasterCachePut(
+    const char*		name,
+    time_t			mtime,
+    const uint8*	ras,
+    uint32			w,
+    uint32			h,
+    bool			transpose )
+{
+    double	bytes = double(w) * h;
+
+    pthread_mutex_lock( &mutex_ras );
+
+    if( bytes > rascache_max )
+        goto exit;
+
+    while( rascache_bytes + bytes > rascache_max ) {
+
+        int	iold = 0;
+
+        for( int i = 1, n = rascache.size(); i < n; ++i ) {
+
+            if( rascache[i].stamp < rascache[iold].stamp )
+                iold = i;
+        }
+
+        rascache_bytes -= double(rascache[iold].w) * rascache[iold].h;
+        RasterFree( rascache[iold].ras );
+        rascache.erase( rascache.begin() + iold );
+    }
+
+    {
+        CRasCacheEntry	E;
+
+        E.name		= name;
+        E.mtime		= mtime;
+        E.w			= w;
+        E.h			= h;
+        E.stamp		= ++rascache_clock;
+        E.transpose	= transpose;
+
+        if( !(E.ras = (uint8*)RasterAlloc( w * h )) )
+            goto exit;
+
+        memcpy( E.ras, ras, w * h );
+
+        rascache.push_back( E );
+        rascache_bytes += bytes;
+    }
+
+exit:
+    pthread_mutex_unlock( &mutex_ras );
+}
+
 /* --------------------------------------------------------------- */
 /* Raster8FromAny ------------------------------------------------ */
 /* --------------------------------------------------------------- */
 
+static uint8* Raster8FromAnyDecode(
+    const char*	name,
+    uint32		&w,
+    uint32		&h,
+    FILE*		flog,
+    bool		transpose );
+
+
 uint8* Raster8FromAny(
     const char*	name,
     uint32		&w,
     uint32		&h,
     FILE*		flog,
     bool		transpose )
+{
+    if( !rascache_max )
+        return Raster8FromAnyDecode( name, w, h, flog, transpose );
+
+    struct stat	info;
+    uint8		*ras;
+
+    if( stat( name, &info ) )
+        info.st_mtime = 0;
+
+    if( ras = RasterCacheGet( name, info.st_mtime, w, h, transpose ) ) {
+
+        fprintf( flog,
+        "Raster8FromAny: Cached [%s] %d x %d.\n", name, w, h );
+
+        return ras;
+    }
+
+    ras = Raster8FromAnyDecode( name, w, h, flog, transpose );
+
+    if( ras )
+        RasterCachePut( name, info.st_mtime, ras, w, h, transpose );
+
+    return ras;
+}
+
+
+static uint8* Raster8FromAnyDecode(
+    const char*	name,
+    uint32		&w,
+    uint32		&h,
+    FILE*		flog,
+    bool		transpose )
 {
     const char*	p;
 
@@ -165,6 +379,112 @@ static void Raster8FromTifFloat(
     ++num;
 }
 
+/* --------------------------------------------------------------- */
+/* T16Convert ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Accumulate stripe histogram of raw 16-bit samples.
+//
+static void Hst16( uint32 *hst, const uint16 *raw, int j0, int jlim )
+{
+    memset( hst, 0, 65536 * sizeof(uint32) );
+
+    for( int j = j0; j < jlim; ++j )
+        ++hst[raw[j]];
+}
+
+
+// Map stripe through 16->8 lookup table.
+//
+static void Map16( uint8 *ras, const uint16 *raw, const uint8 *lut, int j0, int jlim )
+{
+    for( int j = j0; j < jlim; ++j )
+        ras[j] = lut[raw[j]];
+}
+
+
+void* _T16Hist( void* ithr )
+{
+    CT16Thrd	&C = vt16[(long)ithr];
+
+    Hst16( C.hst, T16raw, C.j0, C.jlim );
+
+    return NULL;
+}
+
+
+void* _T16Map( void* ithr )
+{
+    CT16Thrd	&C = vt16[(long)ithr];
+
+    Map16( T16ras, T16raw, T16lut, C.j0, C.jlim );
+
+    return NULL;
+}
+
+
+// Histogram raw samples into hst[65536], using nthr row
+// stripes when nthr > 1. Caller holds mutex_t16 if so.
+//
+static void T16Hist( uint32 *hst, const uint16 *raw, int w, int h, int nthr )
+{
+    int	npixels = w * h;
+
+    if( nthr <= 1 ) {
+        Hst16( hst, raw, 0, npixels );
+        return;
+    }
+
+    vector<uint32>	H( (nthr - 1) * 65536 );
+    int				nb = h / nthr;
+
+    vt16.resize( nthr );
+    T16raw = raw;
+
+    for( int i = 0; i < nthr; ++i ) {
+
+        CT16Thrd	&C = vt16[i];
+
+        C.j0	= i * nb * w;
+        C.jlim	= (i == nthr-1 ? npixels : C.j0 + nb * w);
+        C.hst	= (i ? &H[(i - 1) * 65536] : hst);
+    }
+
+    if( !EZThreads( _T16Hist, nthr, 1, "_T16Hist" ) )
+        exit( 42 );
+
+    for( int i = 1; i < nthr; ++i ) {
+
+        const uint32	*src = vt16[i].hst;
+
+        for( int k = 0; k < 65536; ++k )
+            hst[k] += src[k];
+    }
+}
+
+
+// Convert all raw samples through lut, using the stripes
+// set up by T16Hist.
+//
+static void T16Map(
+    uint8			*ras,
+    const uint16	*raw,
+    const uint8		*lut,
+    int				npixels,
+    int				nthr )
+{
+    if( nthr <= 1 ) {
+        Map16( ras, raw, lut, 0, npixels );
+        return;
+    }
+
+    T16ras = ras;
+    T16lut = lut;
+
+    if( !EZThreads( _T16Map, nthr, 1, "_T16Map" ) )
+        exit( 42 );
+}
+
 /* --------------------------------------------------------------- */
 /* Raster8FromTif16Bit ------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -174,6 +494,13 @@ static void Raster8FromTifFloat(
 //
 // Remap to {u=127.5, sd=25}.
 //
+// Each output pixel depends only upon its raw sample value, so
+// mean and std dev are taken from a 65536-bin histogram, and the
+// samples are mapped through a uint16->uint8 table built once.
+// The results match normalizing a vector of doubles and scaling
+// each element. Environment Convert16BitThreads > 1 splits the
+// histogram and mapping passes over that many row stripes.
+//
 static void Raster8FromTif16Bit(
     TIFF	*tif,
     int		w,
@@ -184,13 +511,18 @@ static void Raster8FromTif16Bit(
 {
     int				npixels = w * h;
     uint16			*raw;
-    vector<double>	v( npixels );
-    int				NB, nb, j;
+    vector<uint32>	hst( 65536 );
+    vector<uint8>	lut( 65536 );
+    int				NB, nb, j, off;
     uint16			fmt;
 
 // Check for signed data if 16-bit
     TIFFGetFieldDefaulted( tif, TIFFTAG_SAMPLEFORMAT, &fmt );
 
+// Signed samples are offset by -SHRT_MIN, which for a raw
+// bit pattern r is just the value r ^ 0x8000.
+    off = (fmt == SAMPLEFORMAT_INT ? 0x8000 : 0);
+
 // Read encoded strips
     raw = (uint16*)malloc( npixels * sizeof(uint16) );
 
@@ -203,25 +535,6 @@ static void Raster8FromTif16Bit(
     fprintf( flog,
     "TIF(16): Last Encoded strip had %d bytes.\n", nb );
 
-// Pixels -> doubles vector
-
-    if( fmt == SAMPLEFORMAT_INT ) {
-
-        for( j = 0; j < npixels; ++j )
-            v[j] = ((int16*)raw)[j] - (int)SHRT_MIN;
-    }
-    else {
-
-        for( j = 0; j < npixels; ++j )
-            v[j] = raw[j];
-    }
-
-    free( raw );
-
-// Normalize vector
-    Normalize( v );
-
-// Copy vector -> raster.
 // Apply optional background subtraction
 // Change mean to 127, std dev to 25 (or other as specified)
 
@@ -230,23 +543,65 @@ static void Raster8FromTif16Bit(
                  p  = getenv( "Convert16BitStdDev" );
     double		std	= (p == NULL ? 25.0 : atof( p )),
                 mn	= 127.5 - bkg;
+                 p  = getenv( "Convert16BitThreads" );
+    int			nthr = (p == NULL ? 1 : atoi( p ));
+
+    if( nthr > h )
+        nthr = h;
+
+    if( nthr > 1 )
+        pthread_mutex_lock( &mutex_t16 );
 
     fprintf( flog,
     "TIF(16): Converting intensity using bkg %f, stddev %f\n",
     bkg, std );
 
-    for( j = 0; j < npixels; ++j ) {
+// Histogram -> stats. Integer sums are exact.
+
+    T16Hist( &hst[0], raw, w, h, nthr );
+
+    unsigned long long	s1 = 0, s2 = 0;
+
+    for( j = 0; j < 65536; ++j ) {
+
+        unsigned long long	n = hst[j], v = j ^ off;
+
+        s1 += n * v;
+        s2 += n * v * v;
+    }
+
+    double	avg = s1, sd = 0.0;
 
-        int pix	= int(mn + v[j]*std);
+    if( npixels > 1 ) {
+        avg /= npixels;
+#ifdef TINYSTAT
+        sd   = sqrt( fmax( s2 - npixels*avg*avg, 0.0 ) / npixels );
+#else
+        sd   = sqrt( fmax( s2 - npixels*avg*avg, 0.0 ) / (npixels - 1.0) );
+#endif
+    }
+
+// Build table, indexed by raw bit pattern
+
+    for( j = 0; j < 65536; ++j ) {
+
+        int pix	= int(mn + ((j ^ off) - avg) / sd * std);
 
         if( pix < 0 )
             pix = 0;
         else if( pix > 255 )
             pix = 255;
 
-        raster[j] = pix;
+        lut[j] = pix;
     }
 
+    T16Map( raster, raw, &lut[0], npixels, nthr );
+
+    if( nthr > 1 )
+        pthread_mutex_unlock( &mutex_t16 );
+
+    free( raw );
+
 // Write in GIMP format?
     if( writeDebug ) {
 
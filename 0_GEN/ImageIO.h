@@ -18,6 +18,8 @@ void* RasterAlloc( unsigned long bytes );
 #define	RasterFree( a )	_RasterFree( (void**)&(a) )
 void _RasterFree( void** praster );
 
+void RasterCacheSetMB( int maxMB, FILE* flog = stdout );
+
 uint8* Raster8FromAny(
     const char*	name,
     uint32		&w,
@@ -0,0 +1,232 @@
+
+
+#include	"IntensOps.h"
+#include	"ImageIO.h"
+#include	"Maths.h"
+
+#include	<math.h>
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* CFlatField::~CFlatField --------------------------------------- */
+/* --------------------------------------------------------------- */
+
+CFlatField::~CFlatField()
+{
+    RasterFree( ras );
+}
+
+/* --------------------------------------------------------------- */
+/* CFlatField::Set ----------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Spec is either:
+//
+// LEG:order:offset:mean:std	;Legendre flattening
+// path							;external flatfield tif
+//
+// For an external file, w and h are set to its dims, its pixels
+// are pedestal-subtracted (min 1), and their average is taken.
+//
+// Return true if spec understood.
+//
+bool CFlatField::Set(
+    const char	*spec,
+    int			ped,
+    uint32		&w,
+    uint32		&h,
+    FILE*		flog )
+{
+    if( 4 == sscanf( spec, "LEG:%d:%d:%lf:%lf",
+        &ord, &off, &ave, &std ) ) {
+
+        fprintf( flog, "FF using LEG [%d,%d,%f,%f].\n",
+        ord, off, ave, std );
+
+        return true;
+    }
+
+    if( !(ras = Raster16FromTif16( spec, w, h, flog )) )
+        return false;
+
+    int	np = w * h;
+
+    ave = 0.0;
+
+    for( int i = 0; i < np; ++i ) {
+
+        if( ras[i] >= ped )
+            ras[i] -= ped;
+
+        if( ras[i] == 0 )
+            ras[i] = 1;
+
+        ave += ras[i];
+    }
+
+    ave /= np;
+
+    fprintf( flog, "FF using file [%s] ave %f.\n", spec, ave );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* CFlatField::Apply --------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Subtract pedestal and flatten img in place.
+//
+// Safe to call concurrently on different images.
+//
+void CFlatField::Apply( uint16* img, int w, int h, int ped ) const
+{
+    int	np = w * h;
+
+    if( ras ) {
+
+        // external file
+
+        for( int i = 0; i < np; ++i ) {
+
+            if( img[i] >= ped )
+                img[i] -= ped;
+
+            img[i] = uint16(img[i]*ave/ras[i]);
+        }
+    }
+    else {
+
+        // ped subtract
+
+        for( int i = 0; i < np; ++i ) {
+
+            if( img[i] >= ped )
+                img[i] -= ped;
+        }
+
+        // Legendre polys
+
+        vector<double>	V;
+
+        LegPolyFlatten( V, img, w, h, ord, off );
+
+        // rescale to given mean, stddev
+
+        for( int i = 0; i < np; ++i ) {
+
+            int	pix = int(ave + V[i] * std);
+
+            if( pix < 0 )
+                pix = 0;
+            else if( pix > 65535 )
+                pix = 65535;
+
+            img[i] = pix;
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* IntensScaleFromHist ------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Choose display range [mn, mx] for 16-bit data from its 65536-bin
+// histogram. This is the rule shared by GraRan1Lyr, HEQ1Lyr and
+// RGBM1Lyr; pct is the percent of foreground counts below mx.
+//
+void IntensScaleFromHist(
+    int				&mn,
+    int				&mx,
+    const double	*bins,
+    double			pct )
+{
+    const int	nbins = 65536;	// also max val
+    int			T, imin;
+
+// mn is between lowest val and 2 sdev below mode
+// Omit highest bins to avoid detector saturation
+
+    imin = IndexOfMaxVal( bins, nbins - 100 );
+    T	 = int(2.0 * sqrt( imin ));
+    mx   = imin - T;
+    mn   = FirstNonzero( bins, nbins );
+
+    if( mx < 0 )
+        mx = 0;
+
+    if( mn < 0 )
+        mn = 0;
+
+    mn = (mn + mx) / 2;
+
+// Get threshold for bkg-frg segmentation using Otsu method,
+// but exclude values lower than imin + 2 sdev or higher than
+// 98% of the object intensities.
+
+    imin += T;
+    mx = imin + PercentileBin( &bins[imin], nbins - imin, 0.98 );
+
+    T = int(OtsuThresh( &bins[imin], mx - imin, imin, mx ));
+
+// Now, we aren't going to find objects with the Otsu threshold,
+// however, we are going to set the scale maximum as pct% of the
+// foreground counts.
+
+    if( pct < 100.0 )
+        mx = T + PercentileBin( &bins[T], nbins - T, pct/100.0 );
+    else
+        mx = T + int((nbins - T) * pct/100.0);
+}
+
+/* --------------------------------------------------------------- */
+/* IntensLinLUT -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fill lut[65536] mapping [mn, mx] linearly onto [0, 255].
+//
+void IntensLinLUT( uint8 *lut, int mn, int mx )
+{
+    for( int pix = 0; pix < 65536; ++pix ) {
+
+        if( pix <= mn )
+            lut[pix] = 0;
+        else if( pix >= mx )
+            lut[pix] = 255;
+        else
+            lut[pix] = (pix - mn)*255/(mx - mn);
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* IntensHEQLUT -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fill lut[65536] with the HEQ1Lyr log mapping: values at or below
+// smin go to zero, log(smax - smin) goes to 255.
+//
+void IntensHEQLUT( uint8 *lut, int smin, int smax )
+{
+    double	scale = 255.0 / log((double)smax - smin);
+
+    for( int v = 0; v < 65536; ++v ) {
+
+        if( v <= smin )
+            lut[v] = 0;
+        else {
+
+            double	pix = log(v - (double)smin) * scale;
+
+            if( pix > 255 )
+                pix = 255;
+
+            lut[v] = (uint8)pix;
+        }
+    }
+}
+
+
@@ -0,0 +1,54 @@
+#pragma once
+
+
+#include	"GenDefs.h"
+
+#include	<stdio.h>
+
+
+/* --------------------------------------------------------------- */
+/* class CFlatField ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// One channel's flatfield correction, either division by an
+// external 16-bit flatfield image, or removal of low-order
+// Legendre components followed by rescaling to (ave, std).
+//
+class CFlatField {
+
+public:
+    uint16	*ras;		// external flatfield, or NULL
+    double	ave,
+            std;
+    int		ord,		// leg poly order
+            off;		// use vals <= mode+offset
+
+public:
+    CFlatField() : ras(NULL), ave(0), std(0), ord(0), off(0) {};
+    virtual ~CFlatField();
+
+    bool Set(
+        const char	*spec,
+        int			ped,
+        uint32		&w,
+        uint32		&h,
+        FILE*		flog = stdout );
+
+    void Apply( uint16* img, int w, int h, int ped ) const;
+};
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void IntensScaleFromHist(
+    int				&mn,
+    int				&mx,
+    const double	*bins,
+    double			pct );
+
+void IntensLinLUT( uint8 *lut, int mn, int mx );
+
+void IntensHEQLUT( uint8 *lut, int smin, int smax );
+
+
@@ -19,6 +19,14 @@ using namespace std;
 
 #define	BINVAL( i )	(datamin + (i) * bwid)
 
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static int		legsub	= 0;		// fast flatten fit stride; 0=off
+static bool		legrpt	= false;	// log fast vs exact error
+static FILE*	legflog	= stdout;
+
 
 
 
@@ -1003,7 +1011,7 @@ void LegPolyCreate(
 // Project all src pixels onto low order Legendre polynomials
 // and remove those components. Place results in vals.
 //
-void LegPolyFlatten(
+static void LegPolyFlattenExact(
     vector<double>		&vals,
     const uint8*		src,
     int					w,
@@ -1084,6 +1092,276 @@ void LegPolyFlatten(
     Normalize( vals );
 }
 
+/* --------------------------------------------------------------- */
+/* LegPolySetFast ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Choose how the 8-bit whole-image LegPolyFlatten works:
+//
+// sub = 0: exact per-pixel projections (the default).
+// sub > 0: LegPolyFlattenFast, fitting every sub'th row and column.
+//
+// If report, each fast call also does the exact fit and logs the
+// difference (in units of the normalized result) to flog.
+//
+// Set from -legfast/-legerr by ptest, scapeops, cross_thisblock.
+// tiny has no flatten step (it just normalizes by mean and std).
+//
+void LegPolySetFast( int sub, bool report, FILE* flog )
+{
+    legsub	= max( 0, sub );
+    legrpt	= report && legsub > 0;
+    legflog	= flog;
+
+    if( legsub ) {
+        fprintf( flog,
+        "LegPolyFlatten: Fast, fit stride %d%s.\n",
+        legsub, (legrpt ? ", reporting error" : "") );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* LegPolyFlattenFast -------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Same result as the exact whole-image flatten (for sub = 1, up to
+// rounding), but using separability of the basis F = X(x)Y(y).
+//
+// The exact version removes each component in turn, its coefficient
+// taken against the residual so far. Since the residual is src less
+// earlier components, and inner products of products factor, i.e.,
+// <Fk,Fj> = <Xk,Xj><Yk,Yj>, all coefficients follow from the src
+// moments <Fk,src> and two tiny Gram tables.
+//
+// Only the moments are estimated from a centered grid of every
+// sub'th row and column. The mean is split off first and its share
+// added back exactly, else it leaks into the odd terms (which are
+// orthogonal to a constant only over the full grid). The correction
+// is then applied to every pixel, one row at a time as a sum of
+// scaled x-polys, in loops the compiler can vectorize.
+//
+void LegPolyFlattenFast(
+    vector<double>		&vals,
+    const uint8*		src,
+    int					w,
+    int					h,
+    int					maxOrder,
+    int					sub )
+{
+    int	npts = w * h;
+
+    vals.resize( npts );
+
+    if( maxOrder <= 0 ) {
+
+        for( int i = 0; i < npts; ++i )
+            vals[i] = src[i];
+
+        Normalize( vals );
+        return;
+    }
+
+    if( sub < 1 )
+        sub = 1;
+
+// Create Legendre basis polynomials
+
+    vector<vector<double> > xpolys;
+    vector<vector<double> > ypolys;
+
+    LegPolyCreate( xpolys, maxOrder, w );
+    LegPolyCreate( ypolys, maxOrder, h );
+
+    int	no = maxOrder + 1;
+
+// Gram tables and poly sums over full grid
+
+    vector<double>	GX( no * no, 0.0 ), SX( no, 0.0 ),
+                    GY( no * no, 0.0 ), SY( no, 0.0 );
+
+    for( int a = 0; a < no; ++a ) {
+
+        for( int x = 0; x < w; ++x )
+            SX[a] += xpolys[a][x];
+
+        for( int y = 0; y < h; ++y )
+            SY[a] += ypolys[a][y];
+
+        for( int b = 0; b < no; ++b ) {
+
+            for( int x = 0; x < w; ++x )
+                GX[a*no+b] += xpolys[a][x] * xpolys[b][x];
+
+            for( int y = 0; y < h; ++y )
+                GY[a*no+b] += ypolys[a][y] * ypolys[b][y];
+        }
+    }
+
+// Sample grid, centered
+
+    int	x0 = ((w - 1) % sub) / 2,
+        y0 = ((h - 1) % sub) / 2,
+        nx = (w - 1 - x0) / sub + 1,
+        ny = (h - 1 - y0) / sub + 1;
+
+// Sample mean
+
+    double	mean = 0.0;
+
+    for( int y = y0; y < h; y += sub ) {
+
+        const uint8	*S = src + w * y;
+
+        for( int x = x0; x < w; x += sub )
+            mean += S[x];
+    }
+
+    mean /= nx * ny;
+
+// Moments M[xo][yo] = <X(xo)Y(yo), src>
+
+    vector<double>	M( no * no, 0.0 ),
+                    R( no );
+    double			scl = (double(w) / nx) * (double(h) / ny);
+
+    for( int y = y0; y < h; y += sub ) {
+
+        const uint8	*S = src + w * y;
+
+        for( int xo = 0; xo < no; ++xo ) {
+
+            const double	*XP = &xpolys[xo][0];
+            double			sum = 0.0;
+
+            for( int x = x0; x < w; x += sub )
+                sum += XP[x] * (S[x] - mean);
+
+            R[xo] = sum;
+        }
+
+        for( int xo = 0; xo < no; ++xo ) {
+
+            for( int yo = 0; yo < no; ++yo )
+                M[xo*no+yo] += R[xo] * ypolys[yo][y];
+        }
+    }
+
+    for( int xo = 0; xo < no; ++xo ) {
+
+        for( int yo = 0; yo < no; ++yo ) {
+
+            M[xo*no+yo] = scl * M[xo*no+yo]
+                            + mean * SX[xo] * SY[yo];
+        }
+    }
+
+// Coefficients, in the exact version's order
+
+    vector<double>	C( no * no, 0.0 );
+
+    for( int k = 1; k < no * no; ++k ) {
+
+        int		xk = k / no,
+                yk = k - no * xk;
+        double	coef = M[k];
+
+        for( int j = 1; j < k; ++j ) {
+
+            int	xj = j / no,
+                yj = j - no * xj;
+
+            coef -= C[j] * GX[xk*no+xj] * GY[yk*no+yj];
+        }
+
+        C[k] = coef / (GX[xk*no+xk] * GY[yk*no+yk]);
+    }
+
+// Remove correction row by row
+
+    vector<double>	A( no );
+
+    for( int y = 0; y < h; ++y ) {
+
+        const uint8	*S = src + w * y;
+        double		*V = &vals[w * y];
+
+        for( int xo = 0; xo < no; ++xo ) {
+
+            double	a = 0.0;
+
+            for( int yo = 0; yo < no; ++yo )
+                a += C[xo*no+yo] * ypolys[yo][y];
+
+            A[xo] = a;
+        }
+
+        for( int x = 0; x < w; ++x )
+            V[x] = S[x];
+
+        for( int xo = 0; xo < no; ++xo ) {
+
+            const double	*XP = &xpolys[xo][0];
+            double			a	= A[xo];
+
+            for( int x = 0; x < w; ++x )
+                V[x] -= a * XP[x];
+        }
+    }
+
+// Final normalization
+
+    Normalize( vals );
+}
+
+/* --------------------------------------------------------------- */
+/* LegPolyFlatten ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Project all src pixels onto low order Legendre polynomials
+// and remove those components. Place results in vals.
+//
+// Uses LegPolyFlattenFast if selected by LegPolySetFast.
+//
+void LegPolyFlatten(
+    vector<double>		&vals,
+    const uint8*		src,
+    int					w,
+    int					h,
+    int					maxOrder )
+{
+    if( !legsub || maxOrder <= 0 ) {
+        LegPolyFlattenExact( vals, src, w, h, maxOrder );
+        return;
+    }
+
+    LegPolyFlattenFast( vals, src, w, h, maxOrder, legsub );
+
+    if( !legrpt )
+        return;
+
+// Error versus exact fit
+
+    vector<double>	E;
+    double			sum = 0.0, big = 0.0;
+    int				npts = w * h;
+
+    LegPolyFlattenExact( E, src, w, h, maxOrder );
+
+    for( int i = 0; i < npts; ++i ) {
+
+        double	d = fabs( vals[i] - E[i] );
+
+        sum += d * d;
+
+        if( d > big )
+            big = d;
+    }
+
+    fprintf( legflog,
+    "LegPolyFlatten: %dx%d ord %d stride %d: rms err %.3e max %.3e.\n",
+    w, h, maxOrder, legsub, sqrt( sum / npts ), big );
+}
+
 /* --------------------------------------------------------------- */
 /* LegPolyFlatten ------------------------------------------------ */
 /* --------------------------------------------------------------- */
@@ -2084,19 +2362,28 @@ void Median8(
 // Given 8-bit EM src image, make mask image msk
 // with values: {0, 1} = {resin, tissue}.
 //
+// If src has already been reduced by prescl, the work is done at
+// about the same 1/8 scale, and the smoothing radius is adjusted
+// to cover the same full-size area.
+//
 void ResinMask8(
     vector<uint8>	&msk,
     const uint8		*src,
     int				w,
     int				h,
-    bool			samelayer )
+    bool			samelayer,
+    int				prescl )
 {
     vector<uint8>	tmp;
-    int				ws = w, hs = h;
+    int				ws = w, hs = h,
+                    crunch = max( 1, 8 / prescl ),
+                    radius = (samelayer ? 5 : 20);
 
 // Crunch down
 
-    Downsample8( tmp, src, ws, hs, 8 );
+    Downsample8( tmp, src, ws, hs, crunch );
+
+    radius = max( 1, radius * crunch * prescl / 8 );
 
 // Fatten all object edges
 
@@ -2110,7 +2397,7 @@ void ResinMask8(
 // to appear in both layers, and a larger kernel will
 // help wash them out.
 
-    Median8( &tmp[0], &tmp[0], ws, hs, (samelayer ? 5 : 20) );
+    Median8( &tmp[0], &tmp[0], ws, hs, radius );
 
 // Threshold
 
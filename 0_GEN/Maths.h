@@ -150,6 +150,16 @@ void LegPolyCreate(
     int						maxOrder,
     int						nSamples );
 
+void LegPolySetFast( int sub, bool report, FILE* flog = stdout );
+
+void LegPolyFlattenFast(
+    vector<double>		&vals,
+    const uint8*		src,
+    int					w,
+    int					h,
+    int					maxOrder,
+    int					sub );
+
 void LegPolyFlatten(
     vector<double>		&vals,
     const uint8*		src,
@@ -338,6 +348,7 @@ void ResinMask8(
     const uint8		*src,
     int				w,
     int				h,
-    bool			samelayer );
+    bool			samelayer,
+    int				prescl = 1 );
 
 
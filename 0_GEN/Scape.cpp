@@ -1,6 +1,7 @@
 
 
 #include	"Scape.h"
+#include	"CTifReader.h"
 #include	"EZThreads.h"
 #include	"ImageIO.h"
 #include	"Maths.h"
@@ -8,6 +9,15 @@
 #include	<stdlib.h>
 #include	<string.h>
 
+#include	<list>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	BANDH	64	// scape rows per composite lock
 
 /* --------------------------------------------------------------- */
 /* AdjustBounds -------------------------------------------------- */
@@ -153,8 +163,8 @@ static void Downsample( uint8 *ras, int &w, int &h, int iscl )
 // (xo,yo) allows the block to line up with the
 // right-bottom edge of the image.
 
-    yr = iscl - h % iscl;
-    xr = iscl - w % iscl;
+    yr = (iscl - h % iscl) % iscl;
+    xr = (iscl - w % iscl) % iscl;
 
     for( int iy = 0; iy < hs; ++iy ) {
 
@@ -232,6 +242,7 @@ public:
     int						lgord;
     int						sdnorm;
     bool					resmask;
+    bool					lores;
     FILE					*flog;
 public:
     CPaintPrms(
@@ -244,49 +255,214 @@ public:
         int						lgord,
         int						sdnorm,
         bool					resmask,
+        bool					lores,
         FILE					*flog )
     : scp(scp), ws(ws), hs(hs),
     vTile(vTile), iscl(iscl), bkval(bkval),
     lgord(lgord), sdnorm(sdnorm),
-    resmask(resmask), flog(flog)
+    resmask(resmask), lores(lores), flog(flog)
     {};
 };
 
-class CThrdat {
+// Scape rect [x0,xL); [y0,yL) that a tile paints.
+//
+class CPaintLim {
 public:
-    int	i0, ilim;
+    int	x0, xL, y0, yL;
+};
+
+// The rows of one tile's painted rect lying in one band, held
+// until all lower tiles touching that band are composited.
+//
+class CBandPart {
+public:
+    vector<uint8>	pix;
+    int				i, x0, xL, y0, yL;
+};
+
+// Compositing state for BANDH scape rows.
+//
+class CBand {
+public:
+    pthread_mutex_t		mtx;
+    vector<int>			vi;		// tiles touching band, in order
+    int					next;	// index in vi of next to composite
+    list<CBandPart>		pend;	// parts that arrived early
 };
 
 static const CPaintPrms	*GP;
-static vector<CThrdat>	vthr;
+static CRasterPool		*pool;
+static vector<CPaintLim>	vlim;	// painted rect of each tile
+static vector<CBand>	vbnd;	// one per BANDH rows; if threaded
+static int				nxttile;
+static pthread_mutex_t	mutex_nxt = PTHREAD_MUTEX_INITIALIZER;
+
+// Copy rows [r0,rL) of rect loc, having origin (x0,y0), into
+// the scape. Background pixels don't overwrite.
+//
+static void PutRows(
+    const uint8	*loc,
+    int			x0,
+    int			xL,
+    int			y0,
+    int			r0,
+    int			rL )
+{
+    uint8	*scp	= GP->scp;
+    int		ws		= GP->ws,
+            lw		= xL - x0,
+            bkval	= GP->bkval;
+
+    for( int iy = r0; iy < rL; ++iy ) {
+
+        const uint8	*L = loc + lw*(iy - y0) - x0;
+        uint8		*S = scp + ws*iy;
+
+        for( int ix = x0; ix < xL; ++ix ) {
+
+            if( L[ix] != bkval )
+                S[ix] = L[ix];
+        }
+    }
+}
+
+// Composite any held parts of band B that are now next in order.
+// Caller holds B.mtx.
+//
+static void DrainBand( CBand &B )
+{
+    list<CBandPart>::iterator	it = B.pend.begin();
+
+    while( it != B.pend.end() ) {
+
+        if( it->i != B.vi[B.next] ) {
+            ++it;
+            continue;
+        }
+
+        PutRows( &it->pix[0], it->x0, it->xL, it->y0, it->y0, it->yL );
+        ++B.next;
+        B.pend.erase( it );
+        it = B.pend.begin();
+    }
+}
+
+// Composite painted rect loc of tile i into the scape.
+//
+// Single-threaded, tiles arrive in list order and simply overwrite.
+// Otherwise, arrival order is arbitrary, so each band of BANDH rows
+// composites its tiles strictly in list order: a tile whose turn
+// has not come in a band leaves a copy of those rows with the band,
+// to be composited when the lower tiles have been. The result is
+// exactly the in-order composite regardless of thread timing, and
+// held memory is only the rows of tiles running ahead, not a
+// per-pixel record over the whole scape.
+//
+static void Composite(
+    const uint8	*loc,
+    int			i,
+    int			x0,
+    int			xL,
+    int			y0,
+    int			yL )
+{
+    if( !vbnd.size() ) {
+        PutRows( loc, x0, xL, y0, y0, yL );
+        return;
+    }
+
+    int	lw = xL - x0;
+
+    for( int b0 = y0; b0 < yL; ) {
+
+        int		ib	= b0 / BANDH,
+                bL	= min( yL, (ib + 1) * BANDH );
+        CBand	&B	= vbnd[ib];
+
+        pthread_mutex_lock( &B.mtx );
 
+        if( B.vi[B.next] == i ) {
+
+            PutRows( loc, x0, xL, y0, b0, bL );
+            ++B.next;
+            DrainBand( B );
+        }
+        else {
+
+            B.pend.push_back( CBandPart() );
+
+            CBandPart	&P = B.pend.back();
+
+            P.pix.assign( loc + lw*(b0 - y0), loc + lw*(bL - y0) );
+            P.i		= i;
+            P.x0	= x0;
+            P.xL	= xL;
+            P.y0	= b0;
+            P.yL	= bL;
+        }
+
+        pthread_mutex_unlock( &B.mtx );
+
+        b0 = bL;
+    }
+}
+
+// Threads take the next unpainted tile from the shared counter,
+// so slow tiles don't leave other threads idle.
+//
+// In lores mode each tile is binned down to painting scale as it
+// is decoded, and the resin mask and normalization run on the
+// reduced pixels. Otherwise they run at full size and the result
+// is then downsampled.
+//
 void* _Paint( void *ithr )
 {
-    CThrdat	&me = vthr[(long)ithr];
+    vector<uint8>	loc;
+    int				nt = GP->vTile.size();
 
-    for( int i = me.i0; i < me.ilim; ++i ) {
+    for(;;) {
 
         vector<uint8>	msk;
         uint8*			src;
         TAffine			inv;
-        uint32			w,  h;
-        int				x0, xL, y0, yL,
+        uint32			w,  h,
+                        bw, bh;
+        int				i,
+                        x0, xL, y0, yL,
                         wL, hL,
                         wi, hi;
 
-        src = Raster8FromAny(
-                GP->vTile[i].name.c_str(),
-                w, h, GP->flog );
+        pthread_mutex_lock( &mutex_nxt );
+        i = nxttile++;
+        pthread_mutex_unlock( &mutex_nxt );
+
+        if( i >= nt )
+            break;
+
+        if( GP->lores ) {
+            src = Raster8FromAnyBinned(
+                    GP->vTile[i].name.c_str(),
+                    w, h, bw, bh, GP->iscl, pool, GP->flog );
+        }
+        else {
+            src = Raster8FromAnyPooled(
+                    GP->vTile[i].name.c_str(),
+                    w, h, pool, GP->flog );
+            bw = w;
+            bh = h;
+        }
 
-        if( GP->resmask )
-            ResinMask8( msk, src, w, h, false );
+        if( GP->resmask ) {
+            ResinMask8( msk, src, bw, bh, false,
+                (GP->lores ? GP->iscl : 1) );
+        }
 
         if( GP->sdnorm > 0 )
-            NormRas( src, w, h, GP->lgord, GP->sdnorm );
+            NormRas( src, bw, bh, GP->lgord, GP->sdnorm );
 
         if( GP->resmask ) {
 
-            int	n = w * h;
+            int	n = bw * bh;
 
             for( int j = 0; j < n; ++j ) {
                 if( !msk[j] )
@@ -294,17 +470,20 @@ void* _Paint( void *ithr )
             }
         }
 
-        ScanLims( x0, xL, y0, yL,
-            GP->ws, GP->hs, GP->vTile[i].t2g, w, h );
-        wi = w;
-        hi = h;
+        x0	= vlim[i].x0;
+        xL	= vlim[i].xL;
+        y0	= vlim[i].y0;
+        yL	= vlim[i].yL;
+        wi	= bw;
+        hi = bh;
 
         inv.InverseOf( GP->vTile[i].t2g );
 
         if( GP->iscl > 1 ) {	// Scaling down
 
             // actually downsample src image
-            Downsample( src, wi, hi, GP->iscl );
+            if( !GP->lores )
+                Downsample( src, wi, hi, GP->iscl );
 
             // and point at the new pixels
             TAffine	A;
@@ -315,6 +494,17 @@ void* _Paint( void *ithr )
         wL = wi - 1;
         hL = hi - 1;
 
+        if( xL <= x0 || yL <= y0 ) {
+            pool->Put( src, bw * bh );
+            continue;
+        }
+
+        // sample into local rect
+
+        int	lw = xL - x0;
+
+        loc.assign( lw * (yL - y0), GP->bkval );
+
         for( int iy = y0; iy < yL; ++iy ) {
 
             for( int ix = x0; ix < xL; ++ix ) {
@@ -326,47 +516,76 @@ void* _Paint( void *ithr )
                 if( p.x >= 0 && p.x < wL &&
                     p.y >= 0 && p.y < hL ) {
 
-                    int	pix =
+                    loc[ix-x0 + lw*(iy-y0)] =
                     (int)SafeInterp( p.x, p.y, src, wi, hi );
-
-                    if( pix != GP->bkval )
-                        GP->scp[ix+GP->ws*iy] = pix;
                 }
             }
         }
 
-        RasterFree( src );
+        pool->Put( src, bw * bh );
+
+        Composite( &loc[0], i, x0, xL, y0, yL );
     }
 
     return NULL;
 }
 
 
-static void PaintTH( int nthr )
+// Each tile's painted rect comes from the nominal tile size
+// (wi, hi), the same one that bounds the scape, so that bands
+// know in advance which tiles will composite into them.
+//
+static void PaintTH( int nthr, int wi, int hi )
 {
-    int	nt = GP->vTile.size(),	// tiles total
-        nb;						// tiles per thread
+    int	nt = GP->vTile.size();	// tiles total
 
     if( nthr > nt )
         nthr = nt;
 
-    nb = nt / nthr;
+    CRasterPool	P( nthr );
+    pool = &P;
+
+    nxttile = 0;
+
+    vlim.resize( nt );
+
+    for( int i = 0; i < nt; ++i ) {
+
+        CPaintLim	&L = vlim[i];
+
+        ScanLims( L.x0, L.xL, L.y0, L.yL,
+            GP->ws, GP->hs, GP->vTile[i].t2g, wi, hi );
+    }
+
+    if( nthr > 1 ) {
+
+        vbnd.resize( (GP->hs + BANDH - 1) / BANDH );
 
-    vthr.resize( nthr );
+        for( int i = 0, nb = vbnd.size(); i < nb; ++i ) {
+            pthread_mutex_init( &vbnd[i].mtx, NULL );
+            vbnd[i].next = 0;
+        }
+
+        for( int i = 0; i < nt; ++i ) {
+
+            const CPaintLim	&L = vlim[i];
 
-    vthr[0].i0		= 0;
-    vthr[0].ilim	= nb;
+            if( L.xL <= L.x0 || L.yL <= L.y0 )
+                continue;
 
-    for( int i = 1; i < nthr; ++i ) {
-        CThrdat	&C = vthr[i];
-        C.i0	= vthr[i-1].ilim;
-        C.ilim	= (i == nthr-1 ? nt : C.i0 + nb);
+            for( int ib = L.y0 / BANDH; ib * BANDH < L.yL; ++ib )
+                vbnd[ib].vi.push_back( i );
+        }
     }
 
     if( !EZThreads( _Paint, nthr, 2, "_Paint", GP->flog ) )
         exit( 42 );
 
-    vthr.clear();
+    for( int i = 0, nb = vbnd.size(); i < nb; ++i )
+        pthread_mutex_destroy( &vbnd[i].mtx );
+
+    vbnd.clear();
+    vlim.clear();
 }
 
 /* --------------------------------------------------------------- */
@@ -387,6 +606,7 @@ static void PaintTH( int nthr )
 // sdnorm	- if > 0, image normalized to mean=127, sd=sdnorm.
 // resmask	- mask resin areas.
 // nthr		- thread count.
+// lores	- bin tiles to scape scale while reading (see _Paint).
 //
 // Caller must dispose of scape with ImageIO::RasterFree().
 //
@@ -405,7 +625,8 @@ uint8* Scape(
     int				sdnorm,
     bool			resmask,
     int				nthr,
-    FILE*			flog )
+    FILE*			flog,
+    bool			lores )
 {
     if( !vTile.size() ) {
         fprintf( flog, "Scape: Empty tile list.\n" );
@@ -426,8 +647,8 @@ uint8* Scape(
 
         GP = new CPaintPrms( scp, ws, hs,
                     vTile, int(1/scale), bkval,
-                    lgord, sdnorm, resmask, flog );
-        PaintTH( nthr );
+                    lgord, sdnorm, resmask, lores, flog );
+        PaintTH( nthr, wi, hi );
         delete GP;
     }
     else
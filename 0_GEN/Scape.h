@@ -46,6 +46,7 @@ uint8* Scape(
     int				sdnorm,
     bool			resmask,
     int				nthr,
-    FILE*			flog );
+    FILE*			flog,
+    bool			lores = false );
 
 
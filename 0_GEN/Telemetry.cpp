@@ -0,0 +1,463 @@
+
+
+#include	"Telemetry.h"
+#include	"Timer.h"
+
+#include	<fcntl.h>
+#include	<pthread.h>
+#include	<stdarg.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/resource.h>
+#include	<sys/stat.h>
+#include	<time.h>
+#include	<unistd.h>
+
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class TStage {
+public:
+    string	name;
+    double	n, wall, cpu, rd, wr;
+    bool	hascpu;
+public:
+    TStage( const char *name )
+    : name(name), n(0), wall(0), cpu(0), rd(0), wr(0),
+      hascpu(false) {};
+};
+
+
+class TKeyVal {
+public:
+    string	key, sval;
+    double	dval;
+public:
+    TKeyVal( const char *key ) : key(key), dval(0) {};
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static pthread_mutex_t	mtx		= PTHREAD_MUTEX_INITIALIZER;
+static string			tool,
+                        args;
+static vector<TKeyVal>	vtag,
+                        vcnt;
+static vector<TStage>	vstg;
+static double			w0, c0, r0, x0;
+static time_t			tstart;
+static bool				isopen	= false,
+                        hooked	= false;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* Probes -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Process cpu seconds, all threads, user + system.
+//
+static double CpuSec()
+{
+    struct rusage	u;
+
+    getrusage( RUSAGE_SELF, &u );
+
+    return u.ru_utime.tv_sec + u.ru_utime.tv_usec * 1e-6 +
+           u.ru_stime.tv_sec + u.ru_stime.tv_usec * 1e-6;
+}
+
+
+// Bytes passed through read and write calls so far (page cache
+// hits included), from /proc/self/io; zero if not available.
+//
+static void IOBytes( double &rd, double &wr )
+{
+    FILE	*f = fopen( "/proc/self/io", "r" );
+
+    rd = 0;
+    wr = 0;
+
+    if( f ) {
+
+        char	key[64];
+        double	v;
+
+        while( 2 == fscanf( f, "%63s %lf", key, &v ) ) {
+
+            if( !strcmp( key, "rchar:" ) )
+                rd = v;
+            else if( !strcmp( key, "wchar:" ) )
+                wr = v;
+        }
+
+        fclose( f );
+    }
+}
+
+
+static double PeakRSSMB()
+{
+    struct rusage	u;
+
+    getrusage( RUSAGE_SELF, &u );
+
+    return u.ru_maxrss / 1024.0;	// KB on Linux
+}
+
+/* --------------------------------------------------------------- */
+/* JSON helpers -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void JStr( string &s, const string &v )
+{
+    s += '"';
+
+    for( int i = 0, n = v.size(); i < n; ++i ) {
+
+        char	c = v[i];
+
+        if( c == '"' || c == '\\' ) {
+            s += '\\';
+            s += c;
+        }
+        else if( (unsigned char)c < 0x20 )
+            s += ' ';
+        else
+            s += c;
+    }
+
+    s += '"';
+}
+
+
+static void JNum( string &s, const char *key, double v, bool comma = true )
+{
+    char	buf[96];
+
+    sprintf( buf, "%s\"%s\":%.6g", (comma ? "," : ""), key, v );
+    s += buf;
+}
+
+
+static TKeyVal& Entry( vector<TKeyVal> &v, const char *key )
+{
+    for( int i = 0, n = v.size(); i < n; ++i ) {
+
+        if( v[i].key == key )
+            return v[i];
+    }
+
+    v.push_back( TKeyVal( key ) );
+
+    return v.back();
+}
+
+/* --------------------------------------------------------------- */
+/* Write --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Append the open record as one JSON line, only if $ALN_TELEM is
+// set (and not 0 or off). If it names a directory, each process
+// writes its own 'telem.<host>.<pid>.jsonl' there, which is safe
+// on NFS; otherwise it names one shared file, which is only safe
+// on a local disk, since O_APPEND writes from different clients
+// can overlap. Nothing is ever written into job dirs or the idb.
+//
+// Caller holds mtx.
+//
+static void Write( const char *status )
+{
+    isopen = false;
+
+    const char	*dst = getenv( "ALN_TELEM" );
+
+    if( !dst || !*dst || !strcmp( dst, "0" ) || !strcmp( dst, "off" ) )
+        return;
+
+    char		host[128] = "", cwd[2048] = "", buf[64], own[2304];
+    double		rd, wr;
+    string		s;
+    struct stat	st;
+
+    gethostname( host, sizeof(host) );
+
+    if( !stat( dst, &st ) && S_ISDIR( st.st_mode ) ) {
+        snprintf( own, sizeof(own), "%s/telem.%s.%d.jsonl",
+            dst, host, getpid() );
+        dst = own;
+    }
+
+    if( !getcwd( cwd, sizeof(cwd) ) )
+        cwd[0] = 0;
+
+    IOBytes( rd, wr );
+
+    s = "{\"tool\":";
+    JStr( s, tool );
+    s += ",\"host\":";
+    JStr( s, host );
+    sprintf( buf, ",\"pid\":%d", getpid() );
+    s += buf;
+    s += ",\"dir\":";
+    JStr( s, cwd );
+    s += ",\"args\":";
+    JStr( s, args );
+    sprintf( buf, ",\"start\":%ld", (long)tstart );
+    s += buf;
+    s += ",\"status\":";
+    JStr( s, status );
+    JNum( s, "wall", WallSec() - w0 );
+    JNum( s, "cpu", CpuSec() - c0 );
+    JNum( s, "maxrss_mb", PeakRSSMB() );
+    JNum( s, "rd_mb", (rd - r0) / (1024*1024) );
+    JNum( s, "wr_mb", (wr - x0) / (1024*1024) );
+
+    s += ",\"tags\":{";
+
+    for( int i = 0, n = vtag.size(); i < n; ++i ) {
+
+        if( i )
+            s += ',';
+
+        JStr( s, vtag[i].key );
+        s += ':';
+        JStr( s, vtag[i].sval );
+    }
+
+    s += "},\"counts\":{";
+
+    for( int i = 0, n = vcnt.size(); i < n; ++i ) {
+
+        if( i )
+            s += ',';
+
+        JStr( s, vcnt[i].key );
+        sprintf( buf, ":%.6g", vcnt[i].dval );
+        s += buf;
+    }
+
+    s += "},\"stages\":{";
+
+    for( int i = 0, n = vstg.size(); i < n; ++i ) {
+
+        const TStage	&S = vstg[i];
+
+        if( i )
+            s += ',';
+
+        JStr( s, S.name );
+        s += ":{";
+        JNum( s, "n", S.n, false );
+        JNum( s, "wall", S.wall );
+
+        if( S.hascpu ) {
+            JNum( s, "cpu", S.cpu );
+            JNum( s, "rd_mb", S.rd / (1024*1024) );
+            JNum( s, "wr_mb", S.wr / (1024*1024) );
+        }
+
+        s += '}';
+    }
+
+    s += "}}\n";
+
+    int	fd = open( dst, O_WRONLY | O_APPEND | O_CREAT, 0666 );
+
+    if( fd >= 0 ) {
+
+        if( write( fd, s.c_str(), s.size() ) < 0 )
+            ;
+
+        close( fd );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* AtExit -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Tools often exit(42) from deep inside; still record the job.
+//
+static void AtExit()
+{
+    pthread_mutex_lock( &mtx );
+
+    if( isopen )
+        Write( "exit" );
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* TelemBegin ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Start a job record for tool, closing (as ok) any open one.
+//
+void TelemBegin( const char *tool, int argc, char* argv[] )
+{
+    pthread_mutex_lock( &mtx );
+
+    if( isopen )
+        Write( "ok" );
+
+    if( !hooked ) {
+        atexit( AtExit );
+        hooked = true;
+    }
+
+    ::tool = tool;
+    args.clear();
+
+    for( int i = 1; i < argc; ++i ) {
+
+        if( i > 1 )
+            args += ' ';
+
+        args += argv[i];
+    }
+
+    vtag.clear();
+    vcnt.clear();
+    vstg.clear();
+
+    tstart	= time( NULL );
+    w0		= WallSec();
+    c0		= CpuSec();
+    IOBytes( r0, x0 );
+    isopen	= true;
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* TelemTag ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Attach printf-formatted string value to key, e.g. layer/block.
+//
+void TelemTag( const char *key, const char *fmt, ... )
+{
+    char	buf[1024];
+    va_list	ap;
+
+    va_start( ap, fmt );
+    vsnprintf( buf, sizeof(buf), fmt, ap );
+    va_end( ap );
+
+    pthread_mutex_lock( &mtx );
+
+    if( isopen )
+        Entry( vtag, key ).sval = buf;
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* TelemCount ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add n to named counter. Thread safe.
+//
+void TelemCount( const char *name, double n )
+{
+    pthread_mutex_lock( &mtx );
+
+    if( isopen )
+        Entry( vcnt, name ).dval += n;
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* TelemStage ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add measurements to named stage; cpu < 0 means wall only
+// (as from StopTiming). Thread safe.
+//
+void TelemStage(
+    const char	*name,
+    double		wall,
+    double		cpu,
+    double		rd,
+    double		wr )
+{
+    pthread_mutex_lock( &mtx );
+
+    if( isopen ) {
+
+        int	i = 0, n = vstg.size();
+
+        while( i < n && vstg[i].name != name )
+            ++i;
+
+        if( i == n )
+            vstg.push_back( TStage( name ) );
+
+        TStage	&S = vstg[i];
+
+        S.n		+= 1;
+        S.wall	+= wall;
+
+        if( cpu >= 0 ) {
+            S.cpu	+= cpu;
+            S.rd	+= rd;
+            S.wr	+= wr;
+            S.hascpu = true;
+        }
+    }
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* TelemEnd ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Write the job record, if open.
+//
+void TelemEnd( bool ok )
+{
+    pthread_mutex_lock( &mtx );
+
+    if( isopen )
+        Write( ok ? "ok" : "fail" );
+
+    pthread_mutex_unlock( &mtx );
+}
+
+/* --------------------------------------------------------------- */
+/* CTelemStage --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+CTelemStage::CTelemStage( const char *name ) : name(name)
+{
+    w0 = WallSec();
+    c0 = CpuSec();
+    IOBytes( r0, x0 );
+}
+
+
+CTelemStage::~CTelemStage()
+{
+    double	rd, wr;
+
+    IOBytes( rd, wr );
+
+    TelemStage( name, WallSec() - w0, CpuSec() - c0, rd - r0, wr - x0 );
+}
+
+
@@ -0,0 +1,43 @@
+#pragma once
+
+
+#include	<stdio.h>
+
+
+/* --------------------------------------------------------------- */
+/* class CTelemStage --------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Scoped stage timer: wall, cpu and bytes read/written from
+// construction to destruction are added to the named stage
+// of the current job record.
+//
+class CTelemStage {
+
+private:
+    const char	*name;
+    double		w0, c0, r0, x0;
+
+public:
+    CTelemStage( const char *name );
+    virtual ~CTelemStage();
+};
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void TelemBegin( const char *tool, int argc, char* argv[] );
+void TelemTag( const char *key, const char *fmt, ... );
+void TelemCount( const char *name, double n = 1 );
+
+void TelemStage(
+    const char	*name,
+    double		wall,
+    double		cpu	= -1,
+    double		rd	= 0,
+    double		wr	= 0 );
+
+void TelemEnd( bool ok = true );
+
+
@@ -0,0 +1,274 @@
+
+
+#include	"TileHist.h"
+#include	"CTifReader.h"
+#include	"Disk.h"
+#include	"ImageIO.h"
+#include	"Maths.h"
+
+#include	<string.h>
+#include	<sys/stat.h>
+#include	<unistd.h>
+
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	NBINS	65536
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static string	hdir;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* TileHistSetDir ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Intensity tools (Hist1, GraRan1Lyr, HEQ1Lyr, RGBM1Lyr) all need
+// the 16-bit histogram of every tile in a layer before they can
+// choose a scaling. Setting a cache dir lets the first tool to
+// decode a tile leave its histogram there, so later tools make
+// their scaling decisions with no pixel I/O.
+//
+// Entries are keyed by image path, size and mtime. NULL or empty
+// dir disables the cache (the default).
+//
+void TileHistSetDir( const char *dir, FILE* flog )
+{
+    if( dir && *dir ) {
+
+        DskCreateDir( dir, flog );
+        hdir = dir;
+
+        fprintf( flog, "TileHist: Cache [%s].\n", dir );
+    }
+    else
+        hdir.clear();
+}
+
+/* --------------------------------------------------------------- */
+/* EntryPath ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static string EntryPath( const char *img )
+{
+    char	buf[2048];
+
+    sprintf( buf, "%s/%08x.hst",
+        hdir.c_str(), SuperFastHash( img, strlen( img ) ) );
+
+    return buf;
+}
+
+/* --------------------------------------------------------------- */
+/* TileHistRead -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add the cached histogram of 16-bit image img to bins[65536].
+//
+// File layout (native binary):
+//
+// char[4]		"HST1"
+// int64		image size, image mtime
+// int32		pathlen, lo, hi
+// char			path[pathlen]
+// uint32		count[hi - lo + 1]
+//
+// Return true if a current entry exists.
+//
+bool TileHistRead( double *bins, const char *img, FILE* flog )
+{
+    if( hdir.empty() )
+        return false;
+
+    struct stat	info;
+
+    if( stat( img, &info ) )
+        return false;
+
+    string	path = EntryPath( img );
+    FILE	*f;
+    char	magic[4];
+    long long	key[2];
+    int		hdr[3];
+    bool	ok = false;
+
+    if( !(f = fopen( path.c_str(), "rb" )) )
+        return false;
+
+    if( 1 != fread( magic, 4, 1, f ) || memcmp( magic, "HST1", 4 ) ||
+        1 != fread( key, sizeof(key), 1, f ) ||
+        key[0] != info.st_size || key[1] != info.st_mtime ||
+        1 != fread( hdr, sizeof(hdr), 1, f ) ||
+        hdr[0] != (int)strlen( img ) ||
+        hdr[1] < 0 || hdr[2] >= NBINS || hdr[1] > hdr[2] + 1 ) {
+
+        goto exit;
+    }
+
+    {
+        vector<char>	name( hdr[0] );
+        vector<uint32>	cnt( hdr[2] - hdr[1] + 1 );
+
+        if( hdr[0] && 1 != fread( &name[0], hdr[0], 1, f ) )
+            goto exit;
+
+        if( memcmp( &name[0], img, hdr[0] ) )
+            goto exit;
+
+        if( cnt.size() &&
+            cnt.size() != fread( &cnt[0], sizeof(uint32), cnt.size(), f ) ) {
+
+            goto exit;
+        }
+
+        for( int i = 0, n = cnt.size(); i < n; ++i )
+            bins[hdr[1] + i] += cnt[i];
+
+        ok = true;
+    }
+
+exit:
+    fclose( f );
+
+    return ok;
+}
+
+/* --------------------------------------------------------------- */
+/* TileHistWrite ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Store histogram bins[65536] of 16-bit image img.
+//
+// Written to a temp file and renamed, so concurrent jobs never
+// see a partial entry.
+//
+void TileHistWrite( const char *img, const double *bins, FILE* flog )
+{
+    if( hdir.empty() )
+        return;
+
+    struct stat	info;
+
+    if( stat( img, &info ) )
+        return;
+
+// Nonzero range
+
+    int	lo = 0, hi = NBINS - 1;
+
+    while( lo < NBINS && !bins[lo] )
+        ++lo;
+
+    while( hi >= lo && !bins[hi] )
+        --hi;
+
+    if( lo == NBINS ) {
+        lo = 0;
+        hi = -1;
+    }
+
+// Write
+
+    string	path = EntryPath( img );
+    char	tmp[2048];
+    FILE	*f;
+    long long	key[2]	= {info.st_size, info.st_mtime};
+    int		hdr[3]	= {(int)strlen( img ), lo, hi};
+
+    sprintf( tmp, "%s.%d", path.c_str(), getpid() );
+
+    if( !(f = fopen( tmp, "wb" )) ) {
+        fprintf( flog, "TileHist: Can't write [%s].\n", tmp );
+        return;
+    }
+
+    vector<uint32>	cnt;
+
+    for( int i = lo; i <= hi; ++i )
+        cnt.push_back( uint32(bins[i]) );
+
+    fwrite( "HST1", 4, 1, f );
+    fwrite( key, sizeof(key), 1, f );
+    fwrite( hdr, sizeof(hdr), 1, f );
+    fwrite( img, hdr[0], 1, f );
+
+    if( cnt.size() )
+        fwrite( &cnt[0], sizeof(uint32), cnt.size(), f );
+
+    fclose( f );
+
+    rename( tmp, path.c_str() );
+}
+
+/* --------------------------------------------------------------- */
+/* TileHistAccum ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add histogram of 16-bit image img to bins[65536], from cache if
+// possible, else by decoding img (and caching the result).
+//
+// pool may be NULL.
+//
+// Return false (logged) if img is missing or can't be read as a
+// 16-bit image; bins are then unchanged.
+//
+bool TileHistAccum(
+    double		*bins,
+    const char	*img,
+    CRasterPool	*pool,
+    int			nthr,
+    FILE*		flog )
+{
+    if( TileHistRead( bins, img, flog ) )
+        return true;
+
+    if( !DskExists( img ) ) {
+        fprintf( flog, "TileHist: Skipping missing [%s].\n", img );
+        return false;
+    }
+
+    CTifReader		R;
+    vector<double>	h( NBINS, 0.0 );
+    double			uflo = 0.0,
+                    oflo = 0.0;
+    uint32			w, hh;
+    uint16*			ras = NULL;
+
+    if( R.Open( img, flog ) && R.spp == 1 && R.bps == 16 )
+        ras = R.Read16( w, hh, NULL, nthr, pool );
+
+    if( !ras ) {
+        fprintf( flog, "TileHist: Skipping unreadable [%s].\n", img );
+        return false;
+    }
+
+    Histogram( uflo, oflo, &h[0], NBINS,
+        0.0, NBINS, ras, w * hh, false );
+
+    if( pool )
+        pool->Put( ras, w * hh * sizeof(uint16) );
+    else
+        RasterFree( ras );
+
+    TileHistWrite( img, &h[0], flog );
+
+    for( int i = 0; i < NBINS; ++i )
+        bins[i] += h[i];
+
+    return true;
+}
+
+
@@ -0,0 +1,34 @@
+#pragma once
+
+
+#include	"GenDefs.h"
+
+#include	<stdio.h>
+
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CRasterPool;
+
+void TileHistSetDir( const char *dir, FILE* flog = stdout );
+
+bool TileHistRead(
+    double		*bins,
+    const char	*img,
+    FILE*		flog = stdout );
+
+void TileHistWrite(
+    const char		*img,
+    const double	*bins,
+    FILE*			flog = stdout );
+
+bool TileHistAccum(
+    double		*bins,
+    const char	*img,
+    CRasterPool	*pool,
+    int			nthr = 1,
+    FILE*		flog = stdout );
+
+
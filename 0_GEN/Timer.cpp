@@ -1,7 +1,9 @@
 
 
 #include	"Timer.h"
+#include	"Telemetry.h"
 
+#include	<sys/time.h>
 #include	<unistd.h>
 
 
@@ -18,6 +20,21 @@ void Yield_usec( int microsec )
     usleep( microsec );
 }
 
+/* --------------------------------------------------------------- */
+/* WallSec ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Wall clock seconds, microsecond resolution.
+//
+double WallSec()
+{
+    timeval	tv;
+
+    gettimeofday( &tv, NULL );
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
 /* --------------------------------------------------------------- */
 /* StartTiming --------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -43,10 +60,15 @@ double DeltaSeconds( clock_t start )
 /* StopTiming ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+// Also adds the interval to the telemetry stage named msg.
+//
 clock_t StopTiming( FILE *flog, const char *msg, clock_t start )
 {
-    fprintf( flog, "Timer: %s took %.3f seconds.\n",
-    msg, DeltaSeconds( start ) );
+    double	dt = DeltaSeconds( start );
+
+    fprintf( flog, "Timer: %s took %.3f seconds.\n", msg, dt );
+
+    TelemStage( msg, dt );
 
     return StartTiming();
 }
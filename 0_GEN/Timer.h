@@ -13,6 +13,8 @@
 
 void    Yield_usec( int microsec );
 
+double  WallSec();
+
 clock_t StartTiming();
 double  DeltaSeconds( clock_t start );
 clock_t	StopTiming( FILE *flog, const char *msg, clock_t start );
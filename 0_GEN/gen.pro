@@ -18,6 +18,8 @@ HEADERS += \
     $$PWD/CRigid.h \
     $$PWD/CTemplate.h \
     $$PWD/CThmScan.h \
+    $$PWD/CTifReader.h \
+    $$PWD/CTiledScape.h \
     $$PWD/CTileSet.h \
     $$PWD/Debug.h \
     $$PWD/Disk.h \
@@ -29,6 +31,7 @@ HEADERS += \
     $$PWD/Geometry.h \
     $$PWD/ImageIO.h \
     $$PWD/Inspect.h \
+    $$PWD/IntensOps.h \
     $$PWD/LinEqu.h \
     $$PWD/Maths.h \
     $$PWD/Memory.h \
@@ -36,8 +39,10 @@ HEADERS += \
     $$PWD/PipeFiles.h \
     $$PWD/Scape.h \
     $$PWD/TAffine.h \
+    $$PWD/Telemetry.h \
     $$PWD/Tform_Array.h \
     $$PWD/THmgphy.h \
+    $$PWD/TileHist.h \
     $$PWD/Timer.h \
     $$PWD/TrakEM2_UTL.h
 
@@ -56,6 +61,8 @@ SOURCES += \
     $$PWD/CRigid.cpp \
     $$PWD/CTemplate.cpp \
     $$PWD/CThmScan.cpp \
+    $$PWD/CTifReader.cpp \
+    $$PWD/CTiledScape.cpp \
     $$PWD/CTileSet.cpp \
     $$PWD/CTileSet_Scape.cpp \
     $$PWD/Debug.cpp \
@@ -67,6 +74,7 @@ SOURCES += \
     $$PWD/Geometry.cpp \
     $$PWD/ImageIO.cpp \
     $$PWD/Inspect.cpp \
+    $$PWD/IntensOps.cpp \
     $$PWD/LinEqu.cpp \
     $$PWD/Maths.cpp \
     $$PWD/Memory.cpp \
@@ -75,8 +83,10 @@ SOURCES += \
     $$PWD/PipeFiles_Rgns.cpp \
     $$PWD/Scape.cpp \
     $$PWD/TAffine.cpp \
+    $$PWD/Telemetry.cpp \
     $$PWD/Tform_Array.cpp \
     $$PWD/THmgphy.cpp \
+    $$PWD/TileHist.cpp \
     $$PWD/Timer.cpp \
     $$PWD/TrakEM2_UTL.cpp
 
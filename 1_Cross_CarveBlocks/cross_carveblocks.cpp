@@ -1,5 +1,5 @@
 //
-// Carve cross layer work into blocks; write bsub.sht.
+// Carve cross layer work into blocks; write bsub.sht, bsubl.sht.
 //
 
 
@@ -163,6 +163,15 @@ static void WriteTestblockFile()
     fprintf( f, "# -abdbg\t\t\t;make diagnostic images and exit (Z^Z-1)\n" );
     fprintf( f, "# -abdbg=k\t\t\t;make diagnostic images and exit (Z^k)\n" );
     fprintf( f, "# -abctr=0\t\t\t;debug at this a-to-b angle\n" );
+    fprintf( f, "# -jobs\t\t\t\t;write jobs.down spool list, not make.down\n" );
+    fprintf( f, "# -lores\t\t\t;read tiles binned to scape scale\n" );
+    fprintf( f, "# -legfast=4\t\t;fast Legendre flatten, fit stride\n" );
+    fprintf( f, "# -legerr\t\t\t;log fast flatten error vs exact\n" );
+    fprintf( f, "# -tiled\t\t\t;paint sparse tiled scapes\n" );
+    fprintf( f, "# -spill=dir\t\t;tiled, backed by mapped file in dir\n" );
+    fprintf( f, "# -maxpix=n\t\t;bin correlator points to n Mpix at most\n" );
+    fprintf( f, "# -fmellin\t\t\t;Fourier-Mellin angle guess before sweep\n" );
+    fprintf( f, "# -pyr=3\t\t\t;block align coarse-to-fine over n levels\n" );
     fprintf( f, "\n" );
     fprintf( f, "\n" );
     fprintf( f, "export MRC_TRIM=12\n" );
@@ -201,6 +210,15 @@ static void WriteBSubFile()
     fprintf( f, "# -abdbg\t\t\t;make diagnostic images and exit (Z^Z-1)\n" );
     fprintf( f, "# -abdbg=k\t\t\t;make diagnostic images and exit (Z^k)\n" );
     fprintf( f, "# -abctr=0\t\t\t;debug at this a-to-b angle\n" );
+    fprintf( f, "# -jobs\t\t\t\t;write jobs.down spool list, not make.down\n" );
+    fprintf( f, "# -lores\t\t\t;read tiles binned to scape scale\n" );
+    fprintf( f, "# -legfast=4\t\t;fast Legendre flatten, fit stride\n" );
+    fprintf( f, "# -legerr\t\t\t;log fast flatten error vs exact\n" );
+    fprintf( f, "# -tiled\t\t\t;paint sparse tiled scapes\n" );
+    fprintf( f, "# -spill=dir\t\t;tiled, backed by mapped file in dir\n" );
+    fprintf( f, "# -maxpix=n\t\t;bin correlator points to n Mpix at most\n" );
+    fprintf( f, "# -fmellin\t\t\t;Fourier-Mellin angle guess before sweep\n" );
+    fprintf( f, "# -pyr=3\t\t\t;block align coarse-to-fine over n levels\n" );
     fprintf( f, "\n" );
     fprintf( f, "\n" );
     fprintf( f, "export MRC_TRIM=12\n" );
@@ -238,6 +256,69 @@ static void WriteBSubFile()
     FileScriptPerms( buf );
 }
 
+/* --------------------------------------------------------------- */
+/* WriteBSubLyrFile ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void WriteBSubLyrFile()
+{
+    char	buf[2048];
+    FILE	*f;
+
+    sprintf( buf, "bsubl.sht" );
+    f = FileOpenOrDie( buf, "w", flog );
+
+    fprintf( f, "#!/bin/sh\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "# Purpose:\n" );
+    fprintf( f, "# Fifth step in cross-layer alignment (alternative to bsub.sht).\n" );
+    fprintf( f, "#\n" );
+    fprintf( f, "# > cross_thisblock -script=scriptpath -blocks\n" );
+    fprintf( f, "#\n" );
+    fprintf( f, "# One job per layer does all of its Dx_y blocks, reading the\n" );
+    fprintf( f, "# shared tiles once. Outputs are the same as from bsub.sht.\n" );
+    fprintf( f, "#\n" );
+    fprintf( f, "# Options:\n" );
+    fprintf( f, "# -evalalldz\t\t;force evaluation of all maxdz layers\n" );
+    fprintf( f, "# -jobs\t\t\t\t;write jobs.down spool list, not make.down\n" );
+    fprintf( f, "# -lores\t\t\t;read tiles binned to scape scale\n" );
+    fprintf( f, "# -legfast=4\t\t;fast Legendre flatten, fit stride\n" );
+    fprintf( f, "# -legerr\t\t\t;log fast flatten error vs exact\n" );
+    fprintf( f, "# -tiled\t\t\t;paint sparse tiled scapes\n" );
+    fprintf( f, "# -spill=dir\t\t;tiled, backed by mapped file in dir\n" );
+    fprintf( f, "# -maxpix=n\t\t;bin correlator points to n Mpix at most\n" );
+    fprintf( f, "# -fmellin\t\t\t;Fourier-Mellin angle guess before sweep\n" );
+    fprintf( f, "# -pyr=3\t\t\t;block align coarse-to-fine over n levels\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "export MRC_TRIM=12\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "if (($# == 1))\n" );
+    fprintf( f, "then\n" );
+    fprintf( f, "\tlast=$1\n" );
+    fprintf( f, "else\n" );
+    fprintf( f, "\tlast=$2\n" );
+    fprintf( f, "fi\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "cd ..\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "for lyr in $(seq $1 $last)\n" );
+    fprintf( f, "do\n" );
+    fprintf( f, "\techo $lyr\n" );
+    fprintf( f, "\tif [ -d \"$lyr\" ]\n" );
+    fprintf( f, "\tthen\n" );
+    fprintf( f, "\t\tcd $lyr\n" );
+    fprintf( f, "\t\tQSUB_1NODE.sht 11 \"xl-$lyr\" \"\" 1 %d \"cross_thisblock -script=%s -blocks\"\n",
+    scr.blockslots, gArgs.script );
+    fprintf( f, "\t\tcd ..\n" );
+    fprintf( f, "\tfi\n" );
+    fprintf( f, "done\n" );
+    fprintf( f, "\n" );
+
+    fclose( f );
+    FileScriptPerms( buf );
+}
+
 /* --------------------------------------------------------------- */
 /* WriteCountdowndirsFile ---------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -763,6 +844,7 @@ int main( int argc, char* argv[] )
 
     WriteTestblockFile();
     WriteBSubFile();
+    WriteBSubLyrFile();
     WriteCountdowndirsFile();
     WriteReportFiles();
 
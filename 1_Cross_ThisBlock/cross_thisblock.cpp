@@ -7,15 +7,19 @@
 #include	"File.h"
 #include	"PipeFiles.h"
 #include	"CTileSet.h"
+#include	"CTiledScape.h"
 #include	"CThmScan.h"
 #include	"Geometry.h"
 #include	"Maths.h"
 #include	"ImageIO.h"
 #include	"Memory.h"
+#include	"Telemetry.h"
 #include	"Timer.h"
 #include	"Debug.h"
 
+#include	<dirent.h>
 #include	<string.h>
+#include	<unistd.h>
 
 #include	<algorithm>
 #include	<set>
@@ -71,12 +75,13 @@ public:
     Point	Opts;		// origin of aligned point list
     double	x0, y0;		// scape corner in oriented system
     uint8	*ras;		// scape pixels
+    CTiledScape	*tsc;	// or tiled scape pixels
     uint32	ws, hs;		// scape dims
     int		is0, isN;	// layer index range
     int		clbl, rsvd;	// 'A' or 'B'
 
 public:
-    CSuperscape() : ras(NULL) {};
+    CSuperscape() : ras(NULL), tsc(NULL) {};
 
     virtual ~CSuperscape()
         {KillRas();};
@@ -90,19 +95,26 @@ public:
                 RasterFree( ras );
                 ras = NULL;
             }
+
+            if( tsc ) {
+                delete tsc;
+                tsc = NULL;
+            }
         };
 
     int  FindLayerIndices( int next_isN );
     void vID_From_sID();
     void CalcBBox();
 
+    bool Paint( const vector<int> &vid );
     bool MakeRasA();
     bool MakeRasB( const DBox &Abb );
 
     void DrawRas();
     bool Load( FILE* flog );
 
-    bool MakePoints( vector<double> &v, vector<Point> &p );
+    int  PointsBin() const;
+    bool MakePoints( vector<double> &v, vector<Point> &p, int bin );
     void WriteMeta();
 };
 
@@ -128,14 +140,27 @@ class CArgs_scp {
 
 public:
     double		abctr;
-    const char	*script;
-    int			dbgz;
+    const char	*script,
+                *spill;
+    int			dbgz,
+                legfast,
+                pyr,
+                maxpix;
     bool		evalalldz,
-                abdbg;
+                abdbg,
+                jobs,
+                lores,
+                legerr,
+                tiled,
+                fmellin,
+                blocks;
 public:
     CArgs_scp()
-    : abctr(0), script(NULL),
-      dbgz(-1), evalalldz(false), abdbg(false) {};
+    : abctr(0), script(NULL), spill(NULL),
+      dbgz(-1), legfast(0), pyr(0), maxpix(0),
+      evalalldz(false), abdbg(false), jobs(false),
+      lores(false), legerr(false), tiled(false), fmellin(false),
+      blocks(false) {};
 
     void SetCmdLine( int argc, char* argv[] );
 };
@@ -201,6 +226,26 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
             evalalldz = true;
         else if( IsArg( "-abdbg", argv[i] ) )
             abdbg = true;
+        else if( IsArg( "-jobs", argv[i] ) )
+            jobs = true;
+        else if( IsArg( "-lores", argv[i] ) )
+            lores = true;
+        else if( GetArg( &legfast, "-legfast=%d", argv[i] ) )
+            ;
+        else if( IsArg( "-legerr", argv[i] ) )
+            legerr = true;
+        else if( IsArg( "-fmellin", argv[i] ) )
+            fmellin = true;
+        else if( GetArg( &pyr, "-pyr=%d", argv[i] ) )
+            ;
+        else if( GetArg( &maxpix, "-maxpix=%d", argv[i] ) )
+            ;
+        else if( IsArg( "-blocks", argv[i] ) )
+            blocks = true;
+        else if( IsArg( "-tiled", argv[i] ) )
+            tiled = true;
+        else if( GetArgStr( spill, "-spill=", argv[i] ) )
+            tiled = true;
         else {
             printf( "Did not understand option [%s].\n", argv[i] );
             exit( 42 );
@@ -208,6 +253,15 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
     }
 
     fprintf( flog, "\n" );
+
+    if( blocks && abdbg ) {
+        printf( "Option -blocks can't be used with -abdbg.\n" );
+        exit( 42 );
+    }
+
+    if( legfast > 0 )
+        LegPolySetFast( legfast, legerr, flog );
+
     fflush( flog );
 }
 
@@ -323,17 +377,48 @@ void CSuperscape::CalcBBox()
 }
 
 /* --------------------------------------------------------------- */
-/* MakeRasA ------------------------------------------------------ */
+/* Paint --------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-bool CSuperscape::MakeRasA()
+// Paint listed tiles into ras, or with -tiled, into tsc.
+//
+bool CSuperscape::Paint( const vector<int> &vid )
 {
-    ras = TS.Scape( ws, hs, x0, y0,
-            vID, inv_scl, 1, 0,
+    if( !gArgs.tiled ) {
+
+        ras = TS.Scape( ws, hs, x0, y0,
+                vid, inv_scl, 1, 0,
+                scr.legendremaxorder, scr.rendersdevcnts,
+                scr.maskoutresin, scr.blockslots, gArgs.lores );
+
+        return (ras != NULL);
+    }
+
+    tsc = new CTiledScape;
+
+    if( !TS.ScapeTiled( *tsc, x0, y0,
+            vid, inv_scl, 1, 0,
             scr.legendremaxorder, scr.rendersdevcnts,
-            scr.maskoutresin, scr.blockslots );
+            scr.maskoutresin, scr.blockslots, gArgs.lores,
+            gArgs.spill ) ) {
 
-    return (ras != NULL);
+        KillRas();
+        return false;
+    }
+
+    ws = tsc->ws;
+    hs = tsc->hs;
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeRasA ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+bool CSuperscape::MakeRasA()
+{
+    return Paint( vID );
 }
 
 /* --------------------------------------------------------------- */
@@ -367,12 +452,7 @@ bool CSuperscape::MakeRasB( const DBox &Abb )
         return false;
     }
 
-    ras = TS.Scape( ws, hs, x0, y0,
-            vid, inv_scl, 1, 0,
-            scr.legendremaxorder, scr.rendersdevcnts,
-            scr.maskoutresin, scr.blockslots );
-
-    if( !ras ) {
+    if( !Paint( vid ) ) {
 
         fprintf( flog, "Empty B scape for z=%d.\n",
         TS.vtil[is0].z );
@@ -380,7 +460,7 @@ bool CSuperscape::MakeRasB( const DBox &Abb )
         return false;
     }
 
-    return (ras != NULL);
+    return true;
 }
 
 /* --------------------------------------------------------------- */
@@ -389,11 +469,14 @@ bool CSuperscape::MakeRasB( const DBox &Abb )
 
 void CSuperscape::DrawRas()
 {
-    if( ras ) {
-        char	name[128];
-        sprintf( name, "Ras_%c_%d.png", clbl, TS.vtil[is0].z );
+    char	name[128];
+
+    sprintf( name, "Ras_%c_%d.png", clbl, TS.vtil[is0].z );
+
+    if( ras )
         Raster8ToPng8( name, ras, ws, hs );
-    }
+    else if( tsc )
+        tsc->ToPng8( name, flog );
 }
 
 /* --------------------------------------------------------------- */
@@ -412,28 +495,88 @@ bool CSuperscape::Load( FILE* flog )
     return (ras != NULL);
 }
 
+/* --------------------------------------------------------------- */
+/* PointsBin ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return the smallest power of 2 binning that brings this scape
+// within -maxpix megapixels, or 1 if there is no cap. A's value
+// is used for all its B layers.
+//
+int CSuperscape::PointsBin() const
+{
+    int	bin = 1;
+
+    if( gArgs.maxpix <= 0 )
+        return bin;
+
+    while( double((ws + bin - 1) / bin) * ((hs + bin - 1) / bin) >
+            gArgs.maxpix * 1e6 ) {
+
+        bin *= 2;
+    }
+
+    fprintf( flog, "Points: Binning scapes by %d.\n", bin );
+
+    return bin;
+}
+
 /* --------------------------------------------------------------- */
 /* MakePoints ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-bool CSuperscape::MakePoints( vector<double> &v, vector<Point> &p )
+// Collect the nonzero pixels as correlator points, averaged over
+// bin x bin blocks (bin = 1 keeps every pixel). Rows are visited
+// in order, so a tiled scape is read one row at a time and never
+// flattened. Opts is in scape pixels; point coords are in bins.
+//
+bool CSuperscape::MakePoints( vector<double> &v, vector<Point> &p, int bin )
 {
 // collect point and value lists
 
-    int	np = ws * hs, ok = true;
+    int				bw = (ws + bin - 1) / bin,
+                    bh = (hs + bin - 1) / bin,
+                    np, ok = true;
+    vector<uint8>	row( ws );
+    vector<double>	sum( bw );
+    vector<int>		cnt( bw );
 
     v.clear();
     p.clear();
 
-    for( int i = 0; i < np; ++i ) {
+    for( int by = 0; by < bh; ++by ) {
+
+        int	yL = min( (int)hs, (by + 1) * bin );
 
-        if( ras[i] ) {
+        sum.assign( bw, 0.0 );
+        cnt.assign( bw, 0 );
 
-            int	iy = i / ws,
-                ix = i - ws * iy;
+        for( int iy = by * bin; iy < yL; ++iy ) {
 
-            v.push_back( ras[i] );
-            p.push_back( Point( ix, iy ) );
+            const uint8	*R;
+
+            if( tsc ) {
+                tsc->GetRow( &row[0], iy );
+                R = &row[0];
+            }
+            else
+                R = ras + ws * iy;
+
+            for( int ix = 0; ix < (int)ws; ++ix ) {
+
+                if( R[ix] ) {
+                    sum[ix / bin] += R[ix];
+                    ++cnt[ix / bin];
+                }
+            }
+        }
+
+        for( int bx = 0; bx < bw; ++bx ) {
+
+            if( cnt[bx] ) {
+                v.push_back( sum[bx] / cnt[bx] );
+                p.push_back( Point( bx, by ) );
+            }
         }
     }
 
@@ -447,14 +590,18 @@ bool CSuperscape::MakePoints( vector<double> &v, vector<Point> &p )
     DBox	ptsbb;
 
     BBoxFromPoints( ptsbb, p );
-    Opts = Point( ptsbb.L, ptsbb.B );
 
     for( int i = 0; i < np; ++i ) {
 
-        p[i].x -= Opts.x;
-        p[i].y -= Opts.y;
+        p[i].x -= ptsbb.L;
+        p[i].y -= ptsbb.B;
     }
 
+    // bin centers in scape pixels
+
+    Opts = Point( bin * ptsbb.L + (bin - 1) / 2.0,
+                  bin * ptsbb.B + (bin - 1) / 2.0 );
+
 // normalize values
 
     if( !Normalize( v ) )
@@ -550,7 +697,7 @@ static bool ThisBZ(
 
     B.DrawRas();
 
-    if( !B.MakePoints( thm.bv, thm.bp ) ) {
+    if( !B.MakePoints( thm.bv, thm.bp, thm.scl ) ) {
         fprintf( flog, "No B points for z=%d.\n", TS.vtil[B.is0].z );
         return false;
     }
@@ -558,15 +705,16 @@ static bool ThisBZ(
     B.WriteMeta();
     t0 = StopTiming( flog, "MakeRasB", t0 );
 
+    // thm.scl was set with A's points
+
     thm.ftc.clear();
-    thm.reqArea	= int(kPairMinOlap * A.ws * A.hs);
+    thm.reqArea	= int(kPairMinOlap * A.ws * A.hs / (thm.scl * thm.scl));
     thm.olap1D	= 4;
-    thm.scl		= 1;
 
-    int	Ox	= int(A.x0 - B.x0),
-        Oy	= int(A.y0 - B.y0),
-        Rx	= int((1.0 - scr.blockxyconf) * A.ws),
-        Ry	= int((1.0 - scr.blockxyconf) * A.hs);
+    int	Ox	= int(A.x0 - B.x0) / thm.scl,
+        Oy	= int(A.y0 - B.y0) / thm.scl,
+        Rx	= int((1.0 - scr.blockxyconf) * A.ws) / thm.scl,
+        Ry	= int((1.0 - scr.blockxyconf) * A.hs) / thm.scl;
 
     S.Initialize( flog, best );
     S.SetRThresh( scr.blockmincorr );
@@ -574,6 +722,7 @@ static bool ThisBZ(
     S.SetSweepConstXY( false );
     S.SetSweepPretweak( true );
     S.SetSweepNThreads( scr.blockslots );
+    S.SetSweepFMellin( gArgs.fmellin );
     S.SetUseCorrR( true );
     S.SetDisc( Ox, Oy, Rx, Ry );
 
@@ -585,11 +734,12 @@ static bool ThisBZ(
     }
     else {
 
-        S.Pretweaks( 0, 0, thm );
+        // Pretweaks( 0, 0 ) are done inside, at the
+        // coarsest pyramid level if any.
 
-        if( !S.DenovoBestAngle( best,
+        if( !S.PyramidBestAngle( best,
                 0, scr.blocksweepspan / 2, scr.blocksweepstep,
-                thm, false ) ) {
+                thm, gArgs.pyr, true, false ) ) {
 
             fprintf( flog, "Low corr [%g] for z=%d.\n",
             best.R, TS.vtil[B.is0].z );
@@ -599,6 +749,9 @@ static bool ThisBZ(
 
         Point	Aorigin = A.Opts;
 
+        best.X *= thm.scl;
+        best.Y *= thm.scl;
+
         best.T.Apply_R_Part( Aorigin );
 
         best.X += B.Opts.x - Aorigin.x;
@@ -832,6 +985,54 @@ static void KeepBest(
     }
 }
 
+/* --------------------------------------------------------------- */
+/* WriteJobsFile ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Like make.down, but as a spool job list for ptest workers
+// (ptest -spool=dir): this dir followed by one pair per line.
+// The EXTRA of make.down is replaced by options given on the
+// worker command line, which are appended to every pair.
+//
+static void WriteJobsFile(
+    const CSuperscape			&A,
+    const vector<BlkZ>			&vZ,
+    const vector<vector<Pair> >	&P )
+{
+    char	dir[2048];
+    FILE	*f = FileOpenOrDie( "jobs.down", "w", flog );
+
+    getcwd( dir, sizeof(dir) );
+    fprintf( f, "DIR=%s\n", dir );
+
+    const char	*option_nf = (scr.usingfoldmasks ? "" : " -nf");
+
+    for( int ia = 0; ia < gDat.ntil; ++ia ) {
+
+        const CUTile&		a  = TS.vtil[A.vID[ia]];
+        const vector<Pair>	&p = P[ia];
+        int					nb = p.size();
+
+        for( int ib = 0; ib < nb; ++ib ) {
+
+            const CUTile&	b = TS.vtil[p[ib].id];
+            TAffine			T;
+
+            T = vZ[p[ib].iz].T * a.T;
+            T.FromAToB( T, b.T );
+
+            fprintf( f,
+            "%d.%d^%d.%d"
+            " -Tab=%f,%f,%f,%f,%f,%f%s\n",
+            a.z, a.id, b.z, b.id,
+            T.t[0], T.t[1], T.t[2], T.t[3], T.t[4], T.t[5],
+            option_nf );
+        }
+    }
+
+    fclose( f );
+}
+
 /* --------------------------------------------------------------- */
 /* WriteMakeFile ------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -857,6 +1058,13 @@ static void WriteMakeFile(
         return;
     }
 
+// spool job list instead?
+
+    if( gArgs.jobs ) {
+        WriteJobsFile( A, vZ, P );
+        return;
+    }
+
 // open the file
 
     f = FileOpenOrDie( "make.down", "w", flog );
@@ -1014,7 +1222,8 @@ static void LayerLoop()
     A.CalcBBox();
     A.MakeRasA();
     A.DrawRas();
-    A.MakePoints( thm.av, thm.ap );
+    thm.scl = A.PointsBin();
+    A.MakePoints( thm.av, thm.ap, thm.scl );
     A.WriteMeta();
     t0 = StopTiming( flog, "MakeRasA", t0 );
 
@@ -1074,6 +1283,153 @@ static void LayerLoop()
     WriteThumbFiles( vZ );
 }
 
+/* --------------------------------------------------------------- */
+/* LoadTiles ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fill TS with layers [zmin, za] of gDat.scaf, sorted by z.
+//
+// Return false if no tiles.
+//
+static bool LoadTiles()
+{
+    string	idb;
+
+    IDBFromTemp( idb, "../..", flog );
+
+    if( idb.empty() )
+        exit( 42 );
+
+    TS.vtil.clear();
+    TS.FillFromRgns( gDat.scaf, idb, gDat.zmin, gDat.za );
+
+    fprintf( flog, "Got %d images.\n", (int)TS.vtil.size() );
+
+    if( !TS.vtil.size() )
+        return false;
+
+    TS.SetTileDimsFromImageFile();
+    TS.GetTileDims( gW, gH );
+
+    TS.SortAll_z();
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* ForEachBlock -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// With -blocks, run from a layer dir, do every Dx_y block there
+// in this one process. Each block gets the same log, make.down
+// and ThmPair files in its own dir as a separate job would write,
+// but the idb and tile list are read once, and tiles shared by
+// neighboring blocks (most of each B layer) are read and prepared
+// once (ScapeCacheTiles).
+//
+// Blocks run in turn, each using all blockslots threads for its
+// painting and angle sweeps, which is where the time goes.
+//
+// Telemetry: the job's own record is closed here, holding just
+// the setup (args, idb), and each block then writes a record of
+// its own, tagged with its dir, as a separate job would. So the
+// -blocks job total is the sum of its setup and block records;
+// telemreport's hour totals already sum that way.
+//
+static void ForEachBlock()
+{
+    FILE	*flay = flog;
+
+// List block dirs
+
+    vector<string>	vdir;
+    DIR				*d = opendir( "." );
+
+    if( d ) {
+
+        dirent	*e;
+
+        while( e = readdir( d ) ) {
+
+            int		ix, iy;
+            char	c;
+
+            if( 2 == sscanf( e->d_name, "D%d_%d%c", &ix, &iy, &c ) )
+                vdir.push_back( e->d_name );
+        }
+
+        closedir( d );
+    }
+
+    sort( vdir.begin(), vdir.end() );
+
+    fprintf( flay, "Blocks: %d.\n", (int)vdir.size() );
+
+// Close the setup record; each block gets its own record
+
+    TelemTag( "part", "setup of %d blocks", (int)vdir.size() );
+    TelemEnd();
+
+// Do each
+
+    char	scaf[2048] = "";
+    int		za = -1, zmin = -1, nb = vdir.size();
+    bool	loaded = false;
+
+    for( int ib = 0; ib < nb; ++ib ) {
+
+        clock_t	t0 = StartTiming();
+
+        if( chdir( vdir[ib].c_str() ) ) {
+            fprintf( flay, "Can't enter [%s].\n", vdir[ib].c_str() );
+            continue;
+        }
+
+        flog = FileOpenOrDie( "cross_thisblock.log", "w" );
+        TS.SetLogFile( flog );
+
+        fprintf( flog, "Align this block: [%s] of -blocks job.\n",
+        vdir[ib].c_str() );
+
+        TelemBegin( "cross_thisblock", 0, NULL );
+        TelemTag( "block", "%s", vdir[ib].c_str() );
+        TelemTag( "part", "block" );
+
+        gDat = CBlockDat();
+        gDat.ReadFile();
+
+        if( !loaded || strcmp( scaf, gDat.scaf ) ||
+            za != gDat.za || zmin != gDat.zmin ) {
+
+            TS.ScapeCacheTiles( false );
+
+            if( loaded = LoadTiles() )
+                TS.ScapeCacheTiles( true );
+
+            strcpy( scaf, gDat.scaf );
+            za		= gDat.za;
+            zmin	= gDat.zmin;
+        }
+
+        if( loaded )
+            LayerLoop();
+
+        fprintf( flog, "\n" );
+        VMStats( flog );
+        fclose( flog );
+        TelemEnd( loaded );
+
+        flog = flay;
+        TS.SetLogFile( flog );
+
+        chdir( ".." );
+
+        StopTiming( flog, vdir[ib].c_str(), t0 );
+    }
+
+    TS.ScapeCacheTiles( false );
+}
+
 /* --------------------------------------------------------------- */
 /* main ---------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -1088,6 +1444,8 @@ int main( int argc, char* argv[] )
 
     gArgs.SetCmdLine( argc, argv );
 
+    TelemBegin( "cross_thisblock", argc, argv );
+
     TS.SetLogFile( flog );
 
     if( !ReadScriptParams( scr, gArgs.script, flog ) )
@@ -1100,6 +1458,15 @@ int main( int argc, char* argv[] )
 
     inv_scl = 1.0 / scr.crossscale;
 
+/* ---------------------- */
+/* All blocks of a layer? */
+/* ---------------------- */
+
+    if( gArgs.blocks ) {
+        ForEachBlock();
+        goto exit;
+    }
+
 /* --------------- */
 /* Read block data */
 /* --------------- */
@@ -1118,31 +1485,11 @@ int main( int argc, char* argv[] )
 /* Read source data */
 /* ---------------- */
 
-    string	idb;
-
-    IDBFromTemp( idb, "../..", flog );
-
-    if( idb.empty() )
-        exit( 42 );
-
-    TS.FillFromRgns( gDat.scaf, idb, gDat.zmin, gDat.za );
-
-    fprintf( flog, "Got %d images.\n", (int)TS.vtil.size() );
-
-    if( !TS.vtil.size() )
+    if( !LoadTiles() )
         goto exit;
 
-    TS.SetTileDimsFromImageFile();
-    TS.GetTileDims( gW, gH );
-
     t0 = StopTiming( flog, "ReadFile", t0 );
 
-/* ------------- */
-/* Sort by layer */
-/* ------------- */
-
-    TS.SortAll_z();
-
 /* ----- */
 /* Stuff */
 /* ----- */
@@ -1157,6 +1504,7 @@ exit:
     fprintf( flog, "\n" );
     VMStats( flog );
     fclose( flog );
+    TelemEnd();		// no-op after -blocks, see ForEachBlock
 
     return 0;
 }
@@ -28,7 +28,9 @@ public:
     char		srcmons[2048];
     const char	*script;
     int			zmin,
-                zmax;
+                zmax,
+                scprun;
+    bool		lores;
 
 public:
     CArgs_cross()
@@ -36,6 +38,8 @@ public:
         script	= NULL;
         zmin	= 0;
         zmax	= 32768;
+        scprun	= 1;
+        lores	= false;
 
         strcpy( srcmons, "X_A_BIN_mons" );
     };
@@ -112,6 +116,10 @@ void CArgs_cross::SetCmdLine( int argc, char* argv[] )
                 exit( 42 );
             }
         }
+        else if( IsArg( "-lores", argv[i] ) )
+            lores = true;
+        else if( GetArg( &scprun, "-scprun=%d", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -189,8 +197,9 @@ static void WriteSubscapes( vector<int> &zlist )
     char	sopt[2048];
 
     sprintf( sopt,
-    "'%s' -script=%s -idb=%s -mb",
-    gArgs.srcmons, gArgs.script, idb.c_str() );
+    "'%s' -script=%s -idb=%s -mb%s",
+    gArgs.srcmons, gArgs.script, idb.c_str(),
+    (gArgs.lores ? " -lores" : "") );
 
 // open file
 
@@ -224,20 +233,38 @@ static void WriteSubscapes( vector<int> &zlist )
     fprintf( f, "#\n" );
     fprintf( f, "#\t-ab -za=%%d -zb=%%d\n" );
     fprintf( f, "#\n" );
+    fprintf( f, "# If aligning all consecutive pairs in a layer range...\n" );
+    fprintf( f, "#\n" );
+    fprintf( f, "#\t-mb -ab -zrun=%%d,%%d\n" );
+    fprintf( f, "#\n" );
     fprintf( f, "# Options:\n" );
     fprintf( f, "# -mb\t\t\t;make montage for layer zb\n" );
     fprintf( f, "# -ab\t\t\t;align layer za to zb\n" );
     fprintf( f, "# -za\t\t\t;layer za used only with -ab option\n" );
     fprintf( f, "# -zb\t\t\t;required layer zb\n" );
+    fprintf( f, "# -zrun=i,j\t\t;instead of za,zb: all pairs in [i,j]\n" );
+    fprintf( f, "# -scache=dir\t;keep whole-layer scapes in dir for reuse\n" );
     fprintf( f, "# -abdbg\t\t;make diagnostic strip images and exit\n" );
     fprintf( f, "# -abdbgfull\t;make diagnostic full images and exit\n" );
     fprintf( f, "# -abctr=0\t\t;debug at this a-to-b angle\n" );
+    fprintf( f, "# -lores\t\t;read tiles binned to scape scale\n" );
+    fprintf( f, "# -legfast=4\t;fast Legendre flatten, fit stride\n" );
+    fprintf( f, "# -legerr\t\t;log fast flatten error vs exact\n" );
+    fprintf( f, "# -tiled\t\t;paint sparse tiled scapes\n" );
+    fprintf( f, "# -spill=dir\t;tiled, backed by mapped file in dir\n" );
+    fprintf( f, "# -maxpix=n\t;bin correlator points to n Mpix at most\n" );
+    fprintf( f, "# -fmellin\t\t;Fourier-Mellin angle guess before sweep\n" );
+    fprintf( f, "# -pyr=3\t\t;full-scape align coarse-to-fine over n levels\n" );
     fprintf( f, "\n" );
     fprintf( f, "\n" );
     fprintf( f, "# Create output subdirs\n" );
     fprintf( f, "mkdir -p strips\n" );
     fprintf( f, "mkdir -p montages\n" );
     fprintf( f, "mkdir -p scplogs\n" );
+
+    if( gArgs.scprun > 1 )
+        fprintf( f, "mkdir -p scapecache\n" );
+
     fprintf( f, "\n" );
     fprintf( f, "# Submit layer pairs\n" );
 
@@ -245,13 +272,32 @@ static void WriteSubscapes( vector<int> &zlist )
 
     int	nz = zlist.size();
 
-    for( int iz = 1; iz < nz; ++iz ) {
+    if( gArgs.scprun > 1 ) {
+
+        // runs of scprun pairs; adjacent runs share a layer,
+        // whose scape the cache dir passes from one to the next
+
+        for( int iz = 1; iz < nz; iz += gArgs.scprun ) {
 
-        fprintf( f,
-        "QSUB_1NODE.sht 5 \"sc-%d\" \"subscapes.out\" 0 %d"
-        " \"scapeops %s -ab -za=%d -zb=%d\"\n",
-        zlist[iz - 1], scr.stripslots,
-        sopt, zlist[iz], zlist[iz - 1] );
+            int	jz = min( iz + gArgs.scprun - 1, nz - 1 );
+
+            fprintf( f,
+            "QSUB_1NODE.sht 5 \"sc-%d\" \"subscapes.out\" 0 %d"
+            " \"scapeops %s -ab -zrun=%d,%d -scache=scapecache\"\n",
+            zlist[iz - 1], scr.stripslots,
+            sopt, zlist[iz - 1], zlist[jz] );
+        }
+    }
+    else {
+
+        for( int iz = 1; iz < nz; ++iz ) {
+
+            fprintf( f,
+            "QSUB_1NODE.sht 5 \"sc-%d\" \"subscapes.out\" 0 %d"
+            " \"scapeops %s -ab -za=%d -zb=%d\"\n",
+            zlist[iz - 1], scr.stripslots,
+            sopt, zlist[iz], zlist[iz - 1] );
+        }
     }
 
 // last layer
@@ -261,9 +307,10 @@ static void WriteSubscapes( vector<int> &zlist )
 
     fprintf( f,
     "QSUB_1NODE.sht 6 \"sc-%d\" \"subscapes.out\" 0 %d"
-    " \"scapeops %s -zb=%d\"\n",
+    " \"scapeops %s -zb=%d%s\"\n",
     zlist[nz - 1], scr.stripslots,
-    sopt, zlist[nz - 1] );
+    sopt, zlist[nz - 1],
+    (gArgs.scprun > 1 ? " -scache=scapecache" : "") );
 
     fprintf( f, "\n" );
 
@@ -389,7 +436,7 @@ static void WriteCarvego()
     fprintf( f, "#\n" );
     fprintf( f, "# Carve each scaffold layer into blocks of size crossblocksize\n" );
     fprintf( f, "# and create new script 'bsub.sht' to distribute block-block\n" );
-    fprintf( f, "# alignment jobs to cluster.\n" );
+    fprintf( f, "# alignment jobs to cluster ('bsubl.sht': one job per layer).\n" );
     fprintf( f, "#\n" );
     fprintf( f, "# > cross_carveblocks srcscaf -script=scriptpath -z=i,j\n" );
     fprintf( f, "#\n" );
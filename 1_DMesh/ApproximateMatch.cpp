@@ -150,6 +150,7 @@ bool ApproximateMatch(
     S.SetNbMaxHt( GBL.ctx.NBMXHT );
     S.SetSweepConstXY( true );
     S.SetSweepPretweak( GBL.mch.PRETWEAK );
+    S.SetSweepFMellin( GBL.arg.FMellin );
     S.SetUseCorrR( true );
     S.SetDisc( 0, 0, -1, -1 );
 
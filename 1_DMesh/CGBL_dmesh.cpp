@@ -6,6 +6,7 @@
 #include	"janelia.h"
 #include	"File.h"
 #include	"CAffineLens.h"
+#include	"Maths.h"
 #include	"Debug.h"
 
 
@@ -82,8 +83,13 @@ static void PrintUsage()
     "      -v\n"
     "      -comp_png=<path to comp.png>\n"
     "      -registered_png=<path to registered.png>\n"
+    "      -pcache=<pair cache dir>\n"
     "      -heatmap\n"
+    "      -olaproi\n"
     "      -dbgcor\n"
+    "      -legfast=<fit stride>\n"
+    "      -legerr\n"
+    "      -fmellin\n"
     "\n"
     );
 }
@@ -109,12 +115,18 @@ CGBL_dmesh::CGBL_dmesh()
     arg.fmb				= NULL;
     arg.comp_png		= NULL;
     arg.registered_png	= NULL;
+    arg.pcache			= NULL;
+    arg.LegFast			= 0;
+    arg.LegErr			= false;
+    arg.FMellin			= false;
     arg.Transpose		= false;
     arg.WithinSection	= false;
     arg.SingleFold		= false;
     arg.JSON			= false;
     arg.Verbose			= false;
     arg.Heatmap			= false;
+    arg.OlapROI			= false;
+    arg.IDBCache		= false;
 
     A.z		= 0;
     A.id	= ID_UNSET;
@@ -206,6 +218,8 @@ bool CGBL_dmesh::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgStr( arg.registered_png, "-registered_png=", argv[i] ) )
             ;
+        else if( GetArgStr( arg.pcache, "-pcache=", argv[i] ) )
+            ;
         else if( IsArg( "-tr", argv[i] ) )
             arg.Transpose = true;
         else if( IsArg( "-ws", argv[i] ) )
@@ -220,8 +234,16 @@ bool CGBL_dmesh::SetCmdLine( int argc, char* argv[] )
             arg.Verbose = true;
         else if( IsArg( "-heatmap", argv[i] ) )
             arg.Heatmap = true;
+        else if( IsArg( "-olaproi", argv[i] ) )
+            arg.OlapROI = true;
         else if( IsArg( "-dbgcor", argv[i] ) )
             dbgCor = true;
+        else if( GetArg( &arg.LegFast, "-legfast=%d", argv[i] ) )
+            ;
+        else if( IsArg( "-legerr", argv[i] ) )
+            arg.LegErr = true;
+        else if( IsArg( "-fmellin", argv[i] ) )
+            arg.FMellin = true;
         else if( GetArgList( vD, "-Tmsh=", argv[i] ) ) {
 
             if( 6 == vD.size() )
@@ -287,6 +309,11 @@ bool CGBL_dmesh::SetCmdLine( int argc, char* argv[] )
     time_t	t0 = time( NULL );
     fprintf( stderr, "main: Start: %s\n", ctime(&t0) );
 
+// Legendre flattening mode
+
+    if( arg.LegFast > 0 )
+        LegPolySetFast( arg.LegFast, arg.LegErr, stderr );
+
 // Get default parameters
 
     if( !ReadMatchParams( mch, A.z, B.z, _arg.matchparams, stderr ) )
@@ -353,21 +380,41 @@ bool CGBL_dmesh::SetCmdLine( int argc, char* argv[] )
     if( A.id >= 0 || B.id >= 0 )
         IDBFromTemp( idb, "../../", stderr );
 
-    if( A.id >= 0 ) {
+    if( arg.IDBCache && A.id >= 0 && B.id >= 0
+        && !_arg.ima && !_arg.imb ) {
+
+        // A spooled worker keeps both layers' TileToImage
+        // tables in memory rather than rescanning the files.
+
+        const Til2Img	*pa, *pb;
+
+        if( !IDBT2ICacheNGet2( pa, pb, idb,
+                A.z, A.id, B.z, B.id, stderr ) ) {
 
-        if( !IDBT2IGet1( A.t2i, idb, A.z, A.id, _arg.ima, stderr ) )
             return false;
+        }
+
+        A.t2i = *pa;
+        B.t2i = *pb;
     }
-    else if( _arg.ima )
-        A.t2i.path = _arg.ima;
+    else {
 
-    if( B.id >= 0 ) {
+        if( A.id >= 0 ) {
 
-        if( !IDBT2IGet1( B.t2i, idb, B.z, B.id, _arg.imb, stderr ) )
-            return false;
+            if( !IDBT2IGet1( A.t2i, idb, A.z, A.id, _arg.ima, stderr ) )
+                return false;
+        }
+        else if( _arg.ima )
+            A.t2i.path = _arg.ima;
+
+        if( B.id >= 0 ) {
+
+            if( !IDBT2IGet1( B.t2i, idb, B.z, B.id, _arg.imb, stderr ) )
+                return false;
+        }
+        else if( _arg.imb )
+            B.t2i.path = _arg.imb;
     }
-    else if( _arg.imb )
-        B.t2i.path = _arg.imb;
 
     PrintTil2Img( stderr, 'A', A.t2i );
     PrintTil2Img( stderr, 'B', B.t2i );
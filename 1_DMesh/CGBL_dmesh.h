@@ -39,13 +39,19 @@ public:
         const char	*fma,				// override idb paths
                     *fmb,
                     *comp_png,			// override comp.png path
-                    *registered_png;	// override registered.png path
-        bool		Transpose,			// transpose all images
+                    *registered_png,	// override registered.png path
+                    *pcache;			// pair cache dir
+        int			LegFast;			// fast flatten fit stride; 0=off
+        bool		LegErr,				// log fast flatten error
+                    FMellin,			// Fourier-Mellin angle guess
+                    Transpose,			// transpose all images
                     WithinSection,		// overlap within a section
                     SingleFold,			// assign id=1 to all non-fold rgns
                     JSON,				// output JSON format
                     Verbose,			// run inspect diagnostics
-                    Heatmap;			// run CorrView
+                    Heatmap,			// run CorrView
+                    OlapROI,			// load only overlap boxes
+                    IDBCache;			// keep idb tables (spool mode)
     } DriverArgs;
 
     typedef struct {
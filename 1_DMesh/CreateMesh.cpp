@@ -6,6 +6,7 @@
 #include	"ImageIO.h"
 #include	"Timer.h"
 
+#include	<algorithm>
 #include	<queue>
 using namespace std;
 
@@ -1555,16 +1556,18 @@ int MeshCreateX(
 /* Create ctl */
 /* ---------- */
 
-    for( int iy = 0; iy <= Ny; ++iy ) {
+    vector<int>	xs( Nx + 1 ), ys( Ny + 1 );
 
-        int	y = (iy < Ny ? B.B + int(iy*Dy) : B.T);
+    for( int ix = 0; ix <= Nx; ++ix )
+        xs[ix] = (ix < Nx ? B.L + int(ix*Dx) : B.R);
 
-        for( int ix = 0; ix <= Nx; ++ix ) {
+    for( int iy = 0; iy <= Ny; ++iy )
+        ys[iy] = (iy < Ny ? B.B + int(iy*Dy) : B.T);
 
-            int	x = (ix < Nx ? B.L + int(ix*Dx) : B.R);
+    for( int iy = 0; iy <= Ny; ++iy ) {
 
-            ctl.push_back( vertex( x, y ) );
-        }
+        for( int ix = 0; ix <= Nx; ++ix )
+            ctl.push_back( vertex( xs[ix], ys[iy] ) );
     }
 
 /* ---------- */
@@ -1599,75 +1602,112 @@ int MeshCreateX(
     int	ntri = tri.size(),
         npnt = pts.size();
 
-// map pts into their triangles
+// Fast path: if the points fill their bounding box, and cells
+// are not tiny, every triangle holds far more than occ of its
+// area in interior pixels, so all are kept.
+
+    if( npnt == (Lx + 1) * (Ly + 1) && Dx >= 8 && Dy >= 8 ) {
 
-    vector<int>	in( ntri, 0 );
+        fprintf( flog, "Full rectangle: keeping all triangles.\n" );
+        goto final_report;
+    }
 
-    for( int i = 0; i < npnt; ++i ) {
+    {
+        vector<int>	in( ntri, 0 );
 
-        vertex	v( int(pts[i].x), int(pts[i].y) );
+        // Map pts into their triangles.
+        //
+        // InTriangle() is strict, so a point can only be in a
+        // triangle of the cell whose open bounds contain it, and
+        // in at most one of that cell's two triangles. Points on
+        // grid lines are in none. Look up the cell directly
+        // rather than testing every triangle.
 
-        for( int j = 0; j < ntri; ++j ) {
+        for( int i = 0; i < npnt; ++i ) {
 
-            const triangle& T = tri[j];
+            vertex	v( int(pts[i].x), int(pts[i].y) );
 
-            if( InTriangle(
-                ctl[T.v[0]], ctl[T.v[1]], ctl[T.v[2]], v ) ) {
+            int	ix = upper_bound( xs.begin(), xs.end(), v.x )
+                        - xs.begin() - 1,
+                iy = upper_bound( ys.begin(), ys.end(), v.y )
+                        - ys.begin() - 1;
 
-                ++in[j];
-                break;
+            if( ix < 0 || ix >= Nx || iy < 0 || iy >= Ny ||
+                v.x == xs[ix] || v.y == ys[iy] ) {
+
+                continue;
+            }
+
+            int	j = 2 * (ix + Nx * iy);
+
+            for( int k = j; k < j + 2; ++k ) {
+
+                const triangle& T = tri[k];
+
+                if( InTriangle(
+                    ctl[T.v[0]], ctl[T.v[1]], ctl[T.v[2]], v ) ) {
+
+                    ++in[k];
+                    break;
+                }
             }
         }
-    }
 
-// remove tri with low occupancy
+        // remove tri with low occupancy
 
-    for( int i = ntri - 1; i >= 0; --i ) {
+        for( int i = ntri - 1; i >= 0; --i ) {
 
-        const triangle&	T = tri[i];
+            const triangle&	T = tri[i];
 
-        if( !in[i] ||
-            in[i] <= occ * AreaOfTriangle(
-            ctl[T.v[0]], ctl[T.v[1]], ctl[T.v[2]] ) ) {
+            if( !in[i] ||
+                in[i] <= occ * AreaOfTriangle(
+                ctl[T.v[0]], ctl[T.v[1]], ctl[T.v[2]] ) ) {
 
-            tri.erase( tri.begin() + i );
-            --ntri;
+                tri.erase( tri.begin() + i );
+                --ntri;
+            }
         }
-    }
 
-/* ----------------------- */
-/* Remove unreferenced ctl */
-/* ----------------------- */
+        /* ----------------------- */
+        /* Remove unreferenced ctl */
+        /* ----------------------- */
 
-    if( ntri < in.size() ) {
+        if( ntri < in.size() ) {
 
-        fprintf( flog,
-        "\nOf %ld triangles, %d were above %3d%% occupancy.\n",
-        in.size(), ntri, int(occ*100.0) );
+            fprintf( flog,
+            "\nOf %ld triangles, %d were above %3d%% occupancy.\n",
+            in.size(), ntri, int(occ*100.0) );
 
-        for( int i = ctl.size() - 1; i >= 0; --i ) {
+            // Renumber referenced ctl in original order.
+
+            int			nc = ctl.size(), nkeep = 0;
+            vector<int>	newi( nc, -1 );
 
             for( int j = 0; j < ntri; ++j ) {
 
                 const triangle&	T = tri[j];
 
-                if( T.v[0] == i || T.v[1] == i || T.v[2] == i )
-                    goto next_i;
+                newi[T.v[0]] = newi[T.v[1]] = newi[T.v[2]] = 0;
             }
 
-            // not ref'd
+            for( int i = 0; i < nc; ++i ) {
 
-            ctl.erase( ctl.begin() + i );
+                if( !newi[i] ) {
+                    ctl[nkeep]	= ctl[i];
+                    newi[i]		= nkeep++;
+                }
+            }
+
+            ctl.resize( nkeep );
 
             for( int j = 0; j < ntri; ++j ) {
 
                 triangle&	T = tri[j];
 
-                if( T.v[0] > i ) --T.v[0];
-                if( T.v[1] > i ) --T.v[1];
-                if( T.v[2] > i ) --T.v[2];
+                T.v[0] = newi[T.v[0]];
+                T.v[1] = newi[T.v[1]];
+                T.v[2] = newi[T.v[2]];
             }
-next_i:;
         }
     }
 
@@ -1675,6 +1715,7 @@ next_i:;
 /* Final report */
 /* ------------ */
 
+final_report:
     fprintf( flog,
     "\nSTAT: From %ld pts, got %ld triangles, %ld control points.\n",
     pts.size(), tri.size(), ctl.size() );
@@ -0,0 +1,681 @@
+// Pair cache lets a re-run skip pairs whose inputs are unchanged.
+//
+// Enabled per pair with ptest option -pcache=<dir>. Before doing
+// any work, ptest builds a key from its effective inputs:
+//
+//	- ptest binary (mtime, size) and cache format version
+//	- job dir and command line
+//	- idb, tile ids, Til2Img paths and transforms
+//	- image and foldmask files (mtime, size)
+//	- idb crop, lens and imageparams files (mtime, size)
+//	- all MatchParams fields and starting transforms
+//
+// The entry for a key lives at <dir>/hh/<hash>.pc and holds the
+// full key text (verified on load), the ThmPair rows the pair
+// appended, and everything the pair wrote to stdout (the point
+// pairs). On a hit those are replayed to the usual destinations
+// and the pair returns at once. On a miss, stdout is captured to
+// a temp file while the pair runs; after a normal completion the
+// entry is stored and the output is passed through.
+//
+// Runs that write extra files or diagnostics (WMT, WTT, -v, -ws)
+// bypass the cache.
+//
+// Each lookup appends 'hit' or 'miss' and the pair label to the
+// job dir's pcache.txt. Use 'ptest -pcstats [dir ...]' to print
+// per-block hit rates.
+//
+
+
+#include	"PairCache.h"
+#include	"CGBL_dmesh.h"
+
+#include	"Disk.h"
+#include	"File.h"
+#include	"FoldMask.h"
+#include	"Maths.h"
+#include	"PipeFiles.h"
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/stat.h>
+#include	<unistd.h>
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	PCVERSION	"PAIRCACHE1"
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CThmRow {
+public:
+    ThmPair	tpr;
+    int		atl, acr, btl, bcr;
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static string	key,		// current pair's key text
+                entry;		// current pair's cache file
+static FILE		*ftmp	= NULL;	// stdout capture
+static int		fdout	= -1;	// saved stdout
+static long		thmoff	= 0;	// ThmPair file size at start
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* KeyAddFile ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void KeyAddFile( const char *path )
+{
+    struct stat	st;
+    char		buf[64];
+
+    if( stat( path, &st ) )
+        strcpy( buf, " -\n" );
+    else {
+        sprintf( buf, " %ld %ld\n",
+            (long)st.st_mtime, (long)st.st_size );
+    }
+
+    key += "F ";
+    key += path;
+    key += buf;
+}
+
+/* --------------------------------------------------------------- */
+/* KeyAddDbls ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void KeyAddDbls( const char *tag, const double *v, int n )
+{
+    char	buf[32];
+
+    key += tag;
+
+    for( int i = 0; i < n; ++i ) {
+        sprintf( buf, " %.17g", v[i] );
+        key += buf;
+    }
+
+    key += "\n";
+}
+
+/* --------------------------------------------------------------- */
+/* KeyAddInts ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void KeyAddInts( const char *tag, const int *v, int n )
+{
+    char	buf[32];
+
+    key += tag;
+
+    for( int i = 0; i < n; ++i ) {
+        sprintf( buf, " %d", v[i] );
+        key += buf;
+    }
+
+    key += "\n";
+}
+
+/* --------------------------------------------------------------- */
+/* KeyAddPic ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void KeyAddPic( const PicSpec &P, const char *fmforce )
+{
+    int	v[3] = {P.z, P.id, P.t2i.cam};
+
+    KeyAddInts( "P", v, 3 );
+    KeyAddDbls( "T", P.t2i.T.t, 6 );
+    KeyAddFile( P.t2i.path.c_str() );
+
+    if( GBL.ctx.FLD == 'N' )
+        return;
+
+    Til2FM	t2f;
+
+    if( !fmforce ) {
+
+        if( !IDBTil2FM( t2f, GBL.idb, P.z, P.id, stderr ) )
+            return;
+
+        fmforce = t2f.path.c_str();
+    }
+
+    KeyAddFile( fmforce );
+    KeyAddFile( RgnMapPath( fmforce ).c_str() );
+}
+
+/* --------------------------------------------------------------- */
+/* MakeKey ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void MakeKey( int argc, char* argv[] )
+{
+    char	buf[2048];
+
+    key = PCVERSION "\n";
+
+    KeyAddFile( "/proc/self/exe" );
+
+// Job dir and command line
+
+    if( getcwd( buf, sizeof(buf) ) ) {
+        key += "D ";
+        key += buf;
+        key += "\n";
+    }
+
+    key += "A";
+
+    for( int i = 1; i < argc; ++i ) {
+        key += " ";
+        key += argv[i];
+    }
+
+    key += "\n";
+
+// Tiles
+
+    key += "I ";
+    key += GBL.idb;
+    key += "\n";
+
+    KeyAddPic( GBL.A, GBL.arg.fma );
+    KeyAddPic( GBL.B, GBL.arg.fmb );
+
+    if( !GBL.idb.empty() ) {
+
+        const char	*name[3] = {"crop.txt", "lens.txt", "imageparams.txt"};
+
+        for( int i = 0; i < 3; ++i ) {
+            sprintf( buf, "%s/%s", GBL.idb.c_str(), name[i] );
+            KeyAddFile( buf );
+        }
+    }
+
+// Parameters
+
+    const MatchParams	&M = GBL.mch;
+
+    const double	vd[] = {
+        M.SCALE, M.XSCALE, M.YSCALE, M.SKEW,
+        M.XYCONF_SL, M.XYCONF_XL, M.NBMXHT_SL, M.NBMXHT_XL,
+        M.HFANGDN_SL, M.HFANGDN_XL, M.HFANGPR_SL, M.HFANGPR_XL,
+        M.RTRSH_SL, M.RTRSH_XL, M.RIT_SL, M.RIT_XL,
+        M.RFA_SL, M.RFA_XL, M.RFT_SL, M.RFT_XL,
+        M.TMC, M.TSC, M.IFM, M.FFM, M.FYL, M.CPD, M.EMT,
+        M.LDA, M.LDR, M.LDC, M.DXY };
+
+    const int		vi[] = {
+        M.PXBRO, M.PXLENS, M.PXRESMSK, M.PXDOG,
+        M.PXDOG_R1, M.PXDOG_R2, M.FLD, M.PRETWEAK,
+        M.MODE_SL, M.MODE_XL, M.TAB2DFM_SL, M.TAB2DFM_XL,
+        M.THMDEC_SL, M.THMDEC_XL, M.OLAP1D_SL, M.OLAP1D_XL,
+        M.OLAP2D_SL, M.OLAP2D_XL, M.TWEAKS, M.LIMXY_SL,
+        M.LIMXY_XL, M.WTHMPR, M.OPT_SL, M.MNL, M.MTA, M.MMA,
+        M.ONE, M.EMM, M.WDI, M.WMT, M.WTT };
+
+    KeyAddDbls( "MD", vd, sizeof(vd) / sizeof(double) );
+    KeyAddInts( "MI", vi, sizeof(vi) / sizeof(int) );
+
+    const CGBL_dmesh::CntxtDep	&C = GBL.ctx;
+
+    const double	cd[] = {
+        C.XYCONF, C.NBMXHT, C.HFANGDN, C.HFANGPR,
+        C.RTRSH, C.RIT, C.RFA, C.RFT, (double)C.OLAP2D };
+
+    const int		ci[] = {
+        C.FLD, C.MODE, C.THMDEC, C.OLAP1D, C.LIMXY, C.OPT };
+
+    KeyAddDbls( "CD", cd, sizeof(cd) / sizeof(double) );
+    KeyAddInts( "CI", ci, sizeof(ci) / sizeof(int) );
+    KeyAddDbls( "Tdfm", C.Tdfm.t, 6 );
+    KeyAddDbls( "Tab", GBL.Tab.t, 6 );
+
+    for( int i = 0; i < GBL.Tmsh.size(); ++i )
+        KeyAddDbls( "Tmsh", GBL.Tmsh[i].t, 6 );
+
+    for( int i = 0; i < GBL.XYexp.size(); ++i )
+        KeyAddDbls( "XYexp", &GBL.XYexp[i].x, 2 );
+}
+
+/* --------------------------------------------------------------- */
+/* ThmName ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static const char* ThmName( char *buf )
+{
+    sprintf( buf, "ThmPair_%d^%d.txt", GBL.A.z, GBL.B.z );
+    return buf;
+}
+
+/* --------------------------------------------------------------- */
+/* PutStdout ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Append text to stdout under the same mutex Matches uses for
+// its point output.
+//
+static void PutStdout( const string &s )
+{
+    if( s.empty() )
+        return;
+
+    const char	*sud;
+    CMutex		M;
+    char		name[256];
+
+    if( GBL.A.z < GBL.B.z )
+        sud = "up";
+    else if( GBL.A.z == GBL.B.z )
+        sud = "same";
+    else
+        sud = "down";
+
+    sprintf( name, "%s_%d_P", sud, GBL.A.z );
+
+    if( M.Get( name ) ) {
+        fwrite( s.c_str(), 1, s.size(), stdout );
+        fflush( stdout );
+    }
+
+    M.Release();
+}
+
+/* --------------------------------------------------------------- */
+/* LogLookup ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void LogLookup( bool hit )
+{
+    FILE	*f = fopen( "pcache.txt", "a" );
+
+    if( f ) {
+        fprintf( f, "%s %d.%d^%d.%d\n", (hit ? "hit" : "miss"),
+            GBL.A.z, GBL.A.id, GBL.B.z, GBL.B.id );
+        fclose( f );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* ReadEntry ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Load cache entry; true if present and its key matches.
+//
+static bool ReadEntry( vector<CThmRow> &vr, string &pts )
+{
+    FILE	*f = fopen( entry.c_str(), "r" );
+
+    if( !f )
+        return false;
+
+    vector<char>	buf;
+    long			n;
+    int				nr;
+    bool			ok = false;
+
+    if( 1 != fscanf( f, PCVERSION " KEY %ld", &n ) || n != key.size() )
+        goto exit;
+
+    fgetc( f );
+    buf.resize( n + 1 );
+
+    if( n != fread( &buf[0], 1, n, f ) || memcmp( &buf[0], key.c_str(), n ) )
+        goto exit;
+
+    if( 1 != fscanf( f, " THM %d", &nr ) )
+        goto exit;
+
+    vr.resize( nr );
+
+    for( int i = 0; i < nr; ++i ) {
+
+        CThmRow	&R = vr[i];
+
+        if( 13 != fscanf( f, "%d%d%d%d%d%lf%lf%lf%lf%lf%lf%lf%lf",
+                    &R.atl, &R.acr, &R.btl, &R.bcr, &R.tpr.err,
+                    &R.tpr.A, &R.tpr.R,
+                    &R.tpr.T.t[0], &R.tpr.T.t[1], &R.tpr.T.t[2],
+                    &R.tpr.T.t[3], &R.tpr.T.t[4], &R.tpr.T.t[5] ) ) {
+
+            goto exit;
+        }
+    }
+
+    if( 1 != fscanf( f, " PTS %ld", &n ) )
+        goto exit;
+
+    fgetc( f );
+    pts.resize( n );
+
+    if( n && n != fread( &pts[0], 1, n, f ) )
+        goto exit;
+
+    ok = true;
+
+exit:
+    fclose( f );
+
+    return ok;
+}
+
+/* --------------------------------------------------------------- */
+/* WriteEntry ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Store entry via temp file and rename so readers on other
+// nodes never see a partial entry.
+//
+static void WriteEntry( const vector<CThmRow> &vr, const string &pts )
+{
+    string	tmp;
+    char	buf[64];
+    FILE	*f;
+
+    sprintf( buf, ".%d.tmp", getpid() );
+    tmp = entry + buf;
+
+    if( !(f = fopen( tmp.c_str(), "w" )) ) {
+        fprintf( stderr, "PairCache: Can't write [%s].\n", tmp.c_str() );
+        return;
+    }
+
+    fprintf( f, PCVERSION " KEY %ld\n", (long)key.size() );
+    fwrite( key.c_str(), 1, key.size(), f );
+    fprintf( f, "THM %d\n", (int)vr.size() );
+
+    for( int i = 0; i < vr.size(); ++i ) {
+
+        const CThmRow	&R = vr[i];
+
+        fprintf( f,
+            "%d\t%d\t%d\t%d\t%d"
+            "\t%f\t%f"
+            "\t%f\t%f\t%f\t%f\t%f\t%f\n",
+            R.atl, R.acr, R.btl, R.bcr, R.tpr.err,
+            R.tpr.A, R.tpr.R,
+            R.tpr.T.t[0], R.tpr.T.t[1], R.tpr.T.t[2],
+            R.tpr.T.t[3], R.tpr.T.t[4], R.tpr.T.t[5] );
+    }
+
+    fprintf( f, "PTS %ld\n", (long)pts.size() );
+    fwrite( pts.c_str(), 1, pts.size(), f );
+    fclose( f );
+
+    if( rename( tmp.c_str(), entry.c_str() ) )
+        remove( tmp.c_str() );
+}
+
+/* --------------------------------------------------------------- */
+/* NewThmRows ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Collect this pair's rows from what was appended to the ThmPair
+// file since the pair started (other pairs may append too).
+//
+static void NewThmRows( vector<CThmRow> &vr )
+{
+    char	name[256];
+    FILE	*f = fopen( ThmName( name ), "r" );
+
+    if( !f )
+        return;
+
+    fseek( f, thmoff, SEEK_SET );
+
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        CThmRow	R;
+
+        if( 13 == sscanf( LS.line,
+                    "%d%d%d%d%d%lf%lf%lf%lf%lf%lf%lf%lf",
+                    &R.atl, &R.acr, &R.btl, &R.bcr, &R.tpr.err,
+                    &R.tpr.A, &R.tpr.R,
+                    &R.tpr.T.t[0], &R.tpr.T.t[1], &R.tpr.T.t[2],
+                    &R.tpr.T.t[3], &R.tpr.T.t[4], &R.tpr.T.t[5] )
+            && R.atl == GBL.A.id && R.btl == GBL.B.id ) {
+
+            vr.push_back( R );
+        }
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* StopCapture --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Restore stdout and return what was captured.
+//
+static void StopCapture( string &pts )
+{
+    pts.clear();
+
+    if( !ftmp )
+        return;
+
+    fflush( stdout );
+    dup2( fdout, fileno( stdout ) );
+    close( fdout );
+    fdout = -1;
+
+    long	n = ftell( ftmp );
+
+    if( n > 0 ) {
+        pts.resize( n );
+        rewind( ftmp );
+        pts.resize( fread( &pts[0], 1, n, ftmp ) );
+    }
+
+    fclose( ftmp );
+    ftmp = NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* AtExit -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// If the pipeline exits mid-pair, still pass its output along.
+//
+static void AtExit()
+{
+    string	pts;
+
+    StopCapture( pts );
+    PutStdout( pts );
+}
+
+/* --------------------------------------------------------------- */
+/* PairCacheBegin ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Call after GBL is set from the command line. On a cache hit,
+// replay the stored results and return true: caller is done.
+// Otherwise start capturing results and return false.
+//
+bool PairCacheBegin( int argc, char* argv[] )
+{
+    static bool	atexit_set = false;
+
+    entry.clear();
+
+    if( !GBL.arg.pcache ||
+        GBL.mch.WMT || GBL.mch.WTT ||
+        GBL.arg.Verbose || GBL.arg.WithinSection ) {
+
+        return false;
+    }
+
+// Key and entry path
+
+    char	buf[2048];
+    uint32	h;
+
+    MakeKey( argc, argv );
+    h = SuperFastHash( key.c_str(), key.size() );
+
+    DskCreateDir( GBL.arg.pcache, stderr );
+    sprintf( buf, "%s/%02x", GBL.arg.pcache, h & 0xFF );
+    DskCreateDir( buf, stderr );
+
+    sprintf( buf + strlen( buf ), "/%08x_%d.pc", h, (int)key.size() );
+    entry = buf;
+
+// Hit?
+
+    vector<CThmRow>	vr;
+    string			pts;
+
+    if( ReadEntry( vr, pts ) ) {
+
+        for( int i = 0; i < vr.size(); ++i ) {
+
+            const CThmRow	&R = vr[i];
+
+            WriteThmPair( R.tpr,
+                GBL.A.z, R.atl, R.acr,
+                GBL.B.z, R.btl, R.bcr );
+        }
+
+        PutStdout( pts );
+        LogLookup( true );
+
+        fprintf( stderr,
+        "PairCache: Hit [%s]: %d ThmPair rows, %ld pts bytes.\n",
+        entry.c_str(), (int)vr.size(), (long)pts.size() );
+
+        entry.clear();
+        return true;
+    }
+
+    LogLookup( false );
+
+    fprintf( stderr, "PairCache: Miss [%s].\n", entry.c_str() );
+
+// Miss: note ThmPair size and capture stdout
+
+    struct stat	st;
+
+    thmoff = (stat( ThmName( buf ), &st ) ? 0 : st.st_size);
+
+    fflush( stdout );
+
+    if( (ftmp = tmpfile()) ) {
+
+        fdout = dup( fileno( stdout ) );
+        dup2( fileno( ftmp ), fileno( stdout ) );
+
+        if( !atexit_set ) {
+            atexit( AtExit );
+            atexit_set = true;
+        }
+    }
+    else
+        entry.clear();
+
+    return false;
+}
+
+/* --------------------------------------------------------------- */
+/* PairCacheEnd -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Pass captured output along and, if the pair ran to completion,
+// store the entry.
+//
+void PairCacheEnd( bool completed )
+{
+    if( entry.empty() )
+        return;
+
+    string	pts;
+
+    StopCapture( pts );
+    PutStdout( pts );
+
+    if( completed ) {
+
+        vector<CThmRow>	vr;
+
+        NewThmRows( vr );
+        WriteEntry( vr, pts );
+    }
+
+    entry.clear();
+}
+
+/* --------------------------------------------------------------- */
+/* PairCacheStats ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Print hit rate from pcache.txt in each given block dir, or in
+// the current dir if none given.
+//
+int PairCacheStats( int ndir, char* dirs[] )
+{
+    char	cur[] = ".";
+    char	*one[1] = {cur};
+    long	th = 0, tn = 0;
+
+    if( !ndir ) {
+        ndir = 1;
+        dirs = one;
+    }
+
+    for( int i = 0; i < ndir; ++i ) {
+
+        char	name[2048];
+        FILE	*f;
+        long	nh = 0, nn = 0;
+
+        sprintf( name, "%s/pcache.txt", dirs[i] );
+
+        if( !(f = fopen( name, "r" )) )
+            continue;
+
+        CLineScan	LS;
+
+        while( LS.Get( f ) > 0 ) {
+
+            ++nn;
+
+            if( !strncmp( LS.line, "hit", 3 ) )
+                ++nh;
+        }
+
+        fclose( f );
+
+        printf( "%s\thits %ld/%ld\t%.1f%%\n",
+            dirs[i], nh, nn, (nn ? 100.0 * nh / nn : 0.0) );
+
+        th += nh;
+        tn += nn;
+    }
+
+    if( ndir > 1 ) {
+        printf( "All\thits %ld/%ld\t%.1f%%\n",
+            th, tn, (tn ? 100.0 * th / tn : 0.0) );
+    }
+
+    return 0;
+}
+
+
@@ -0,0 +1,15 @@
+
+
+#pragma once
+
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+bool PairCacheBegin( int argc, char* argv[] );
+void PairCacheEnd( bool completed );
+
+int PairCacheStats( int ndir, char* dirs[] );
+
+
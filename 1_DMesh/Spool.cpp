@@ -0,0 +1,510 @@
+// Spool mode lets one long-lived ptest process run many pairs.
+//
+// A spool is a directory with subdirs:
+//
+//	new/	job files waiting to be claimed
+//	cur/	job files being run (name.pid) + progress (name.pid.at)
+//	done/	finished job files
+//	fail/	lines that crashed a worker (with DIR= header)
+//	log/	one log per worker process
+//
+// and an optional file 'STOP' that tells workers to exit.
+//
+// A job file looks like:
+//
+//	DIR=/abs/path/to/temp/z/S0_0
+//	za.ia^zb.ib [ptest options]
+//	...
+//
+// That is, the same pairs as a make.same or make.down file, but
+// without the redirections; a worker appends points to the usual
+// pts.same/pts.down and writes the usual pair_a^b.log files.
+//
+// Each ptest that is started with -spool=<dir> forks a worker
+// child and supervises it. The child claims job files (atomic
+// rename into cur/), runs the pairs in-process, and keeps its
+// image and idb caches warm across pairs. If the child dies,
+// e.g. by exit(42) deep in the pipeline, the supervisor moves
+// the offending line to fail/, requeues the rest of that job,
+// and starts a fresh child. The child exits normally once it
+// has been idle for idlesec or the STOP file appears.
+//
+// Any extra options given to SpoolRun are appended to every
+// pair line, like the EXTRA variable of the make.same/make.down
+// rules, so one set of workers can run all jobs with, e.g.,
+// -dbgcor or a parameter override. Later options win, so these
+// take precedence over options in the job lines.
+//
+
+
+#include	"Spool.h"
+
+#include	"Disk.h"
+#include	"File.h"
+#include	"PipeFiles.h"
+#include	"Timer.h"
+
+#include	<dirent.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/wait.h>
+#include	<unistd.h>
+
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static string			gSpool;
+static vector<string>	gExtra;
+static FILE*			flog = NULL;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* ReadJob ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Read job file into its DIR and its pair lines.
+//
+static bool ReadJob(
+    string			&dir,
+    vector<string>	&lines,
+    const char		*path )
+{
+    FILE	*f = fopen( path, "r" );
+
+    dir.clear();
+    lines.clear();
+
+    if( !f ) {
+        fprintf( flog, "Spool: Can't open [%s].\n", path );
+        return false;
+    }
+
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        char	*s = LS.line,
+                *e = s + strlen( s );
+
+        while( e > s && (e[-1] == '\n' || e[-1] == '\r' || e[-1] == ' ') )
+            *--e = 0;
+
+        if( !*s || *s == '#' )
+            continue;
+
+        if( !strncmp( s, "DIR=", 4 ) )
+            dir = s + 4;
+        else
+            lines.push_back( s );
+    }
+
+    fclose( f );
+
+    if( dir.empty() ) {
+        fprintf( flog, "Spool: No DIR= line in [%s].\n", path );
+        return false;
+    }
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* WriteJob ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Write DIR header and lines [i0,iLim) to path using given mode.
+//
+static void WriteJob(
+    const char				*path,
+    const char				*mode,
+    const string			&dir,
+    const vector<string>	&lines,
+    int						i0,
+    int						iLim )
+{
+    FILE	*f = FileOpenOrDie( path, mode, flog );
+
+    fprintf( f, "DIR=%s\n", dir.c_str() );
+
+    for( int i = i0; i < iLim; ++i )
+        fprintf( f, "%s\n", lines[i].c_str() );
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* FirstJob ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Return lexicographically first file name in new/, or empty.
+//
+static string FirstJob()
+{
+    string	first,
+            nd = gSpool + "/new";
+    DIR		*d = opendir( nd.c_str() );
+
+    if( !d )
+        return first;
+
+    dirent	*e;
+
+    while( e = readdir( d ) ) {
+
+        if( e->d_name[0] == '.' )
+            continue;
+
+        if( first.empty() || first > e->d_name )
+            first = e->d_name;
+    }
+
+    closedir( d );
+
+    return first;
+}
+
+/* --------------------------------------------------------------- */
+/* RunLine ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Run one pair line in the job's dir with stdout/stderr
+// redirected as the make rules would do it, and with the
+// worker's extra options appended.
+//
+static int RunLine( const string &line, SpoolPairProc proc )
+{
+    int	az, aid, bz, bid;
+
+    if( 4 != sscanf( line.c_str(), "%d.%d^%d.%d",
+                &az, &aid, &bz, &bid ) ) {
+
+        fprintf( flog, "Spool: Bad pair line [%s].\n", line.c_str() );
+        return 42;
+    }
+
+// Redirect
+
+    char	buf[256];
+
+    fflush( stdout );
+    fflush( stderr );
+
+    if( !freopen( NamePtsFile( buf, az, bz ), "a", stdout ) ||
+        !freopen( NameLogFile( buf, az, aid, bz, bid ), "w", stderr ) ) {
+
+        fprintf( flog, "Spool: Can't redirect for [%s].\n", buf );
+        return 42;
+    }
+
+// Tokenize into argv
+
+    vector<char>	cpy( line.begin(), line.end() );
+    vector<char*>	argv;
+    char			*s;
+
+    cpy.push_back( 0 );
+    argv.push_back( (char*)"ptest" );
+
+    for( s = strtok( &cpy[0], " \t" ); s; s = strtok( NULL, " \t" ) )
+        argv.push_back( s );
+
+    for( int i = 0, n = gExtra.size(); i < n; ++i )
+        argv.push_back( (char*)gExtra[i].c_str() );
+
+    argv.push_back( NULL );
+
+// Run
+
+    int	err = proc( argv.size() - 1, &argv[0] );
+
+    fflush( stdout );
+    fflush( stderr );
+    freopen( "/dev/null", "a", stdout );
+    freopen( "/dev/null", "a", stderr );
+
+    return err;
+}
+
+/* --------------------------------------------------------------- */
+/* RunJob -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Run all lines of claimed job file curpath.
+// Progress is kept in curpath.at so the supervisor
+// can identify the crashing line if we die.
+//
+static void RunJob(
+    const string	&name,
+    const string	&curpath,
+    SpoolPairProc	proc,
+    int				&npairs,
+    int				&nerr )
+{
+    string			dir, at = curpath + ".at";
+    vector<string>	lines;
+
+    if( !ReadJob( dir, lines, curpath.c_str() ) || chdir( dir.c_str() ) ) {
+
+        fprintf( flog, "Spool: Job [%s] rejected.\n", name.c_str() );
+        rename( curpath.c_str(), (gSpool + "/fail/" + name).c_str() );
+        return;
+    }
+
+    fprintf( flog, "Spool: Job [%s] %ld pairs in [%s].\n",
+    name.c_str(), lines.size(), dir.c_str() );
+    fflush( flog );
+
+    for( int i = 0, n = lines.size(); i < n; ++i ) {
+
+        FILE	*f = FileOpenOrDie( at.c_str(), "w", flog );
+        fprintf( f, "%d\n", i );
+        fclose( f );
+
+        double	t0	= WallSec();
+        int		err	= RunLine( lines[i], proc );
+
+        ++npairs;
+
+        if( err )
+            ++nerr;
+
+        fprintf( flog, "Pair [%s] %.3f sec%s.\n",
+        lines[i].c_str(), WallSec() - t0, (err ? " ERROR" : "") );
+        fflush( flog );
+    }
+
+    remove( at.c_str() );
+    rename( curpath.c_str(), (gSpool + "/done/" + name).c_str() );
+}
+
+/* --------------------------------------------------------------- */
+/* Worker -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Claim and run jobs until idle too long or STOP appears.
+//
+static int Worker( int idlesec, SpoolPairProc proc )
+{
+    char	suffix[32];
+    string	stop = gSpool + "/STOP";
+    double	t0 = WallSec(), tidle = t0;
+    int		npairs = 0, nerr = 0;
+
+    sprintf( suffix, ".%d", getpid() );
+
+    fprintf( flog, "Spool: Worker %d started.\n", getpid() );
+    fflush( flog );
+
+    for(;;) {
+
+        if( DskExists( stop.c_str() ) ) {
+            fprintf( flog, "Spool: STOP file seen.\n" );
+            break;
+        }
+
+        string	name = FirstJob();
+
+        if( name.empty() ) {
+
+            if( WallSec() - tidle >= idlesec ) {
+                fprintf( flog, "Spool: Idle %d sec.\n", idlesec );
+                break;
+            }
+
+            Yield_usec( 1000000 );
+            continue;
+        }
+
+        // claim it; lose race gracefully
+
+        string	src = gSpool + "/new/" + name,
+                cur = gSpool + "/cur/" + name + suffix;
+
+        if( rename( src.c_str(), cur.c_str() ) )
+            continue;
+
+        RunJob( name, cur, proc, npairs, nerr );
+
+        tidle = WallSec();
+    }
+
+    double	dt = WallSec() - t0;
+
+    fprintf( flog,
+    "Spool: Worker %d: %d pairs (%d errors) in %.1f sec,"
+    " %.2f pairs/sec.\n",
+    getpid(), npairs, nerr, dt, (dt > 0 ? npairs / dt : 0) );
+    fflush( flog );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------- */
+/* Recover ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// After a worker child exits, look for a job it still held.
+// Put the line it was on into fail/, requeue the remainder
+// into new/, and return true if anything was found.
+//
+static bool Recover( int pid )
+{
+    char	suffix[32];
+    string	cd = gSpool + "/cur";
+    DIR		*d = opendir( cd.c_str() );
+    bool	found = false;
+
+    if( !d )
+        return false;
+
+    sprintf( suffix, ".%d", pid );
+
+    int		ns = strlen( suffix );
+    dirent	*e;
+
+    while( e = readdir( d ) ) {
+
+        int	nn = strlen( e->d_name );
+
+        if( nn <= ns || strcmp( e->d_name + nn - ns, suffix ) )
+            continue;
+
+        string			name( e->d_name, nn - ns ),
+                        cur	= cd + "/" + e->d_name,
+                        at	= cur + ".at",
+                        dir;
+        vector<string>	lines;
+        int				k = 0;
+
+        found = true;
+
+        if( FILE *f = fopen( at.c_str(), "r" ) ) {
+            fscanf( f, "%d", &k );
+            fclose( f );
+        }
+
+        if( ReadJob( dir, lines, cur.c_str() ) && k < lines.size() ) {
+
+            fprintf( flog, "Spool: Worker %d died on [%s] line %d [%s].\n",
+            pid, name.c_str(), k, lines[k].c_str() );
+
+            WriteJob( (gSpool + "/fail/" + name).c_str(), "a",
+                dir, lines, k, k + 1 );
+
+            if( k + 1 < lines.size() ) {
+
+                char	rq[32];
+
+                sprintf( rq, "_r%d", k + 1 );
+
+                string	tmp = cd + "/" + name + rq + ".tmp";
+
+                WriteJob( tmp.c_str(), "w", dir, lines, k + 1, lines.size() );
+                rename( tmp.c_str(), (gSpool + "/new/" + name + rq).c_str() );
+            }
+        }
+
+        remove( at.c_str() );
+        remove( cur.c_str() );
+    }
+
+    closedir( d );
+    fflush( flog );
+
+    return found;
+}
+
+/* --------------------------------------------------------------- */
+/* SpoolRun ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Supervise a sequence of worker children on given spool.
+// The nextra options in extra[] are appended to every pair.
+//
+int SpoolRun(
+    const char		*spooldir,
+    int				idlesec,
+    SpoolPairProc	proc,
+    int				nextra,
+    char*			extra[] )
+{
+    for( int i = 0; i < nextra; ++i )
+        gExtra.push_back( extra[i] );
+
+// Absolute paths (workers chdir to job dirs)
+
+    char	buf[2048];
+
+    DskAbsPath( buf, sizeof(buf), spooldir, stderr );
+    gSpool = buf;
+
+    DskCreateDir( buf, stderr );
+    DskCreateDir( (gSpool + "/new").c_str(), stderr );
+    DskCreateDir( (gSpool + "/cur").c_str(), stderr );
+    DskCreateDir( (gSpool + "/done").c_str(), stderr );
+    DskCreateDir( (gSpool + "/fail").c_str(), stderr );
+    DskCreateDir( (gSpool + "/log").c_str(), stderr );
+
+// Worker log
+
+    char	host[256] = "host";
+
+    gethostname( host, sizeof(host) );
+    host[sizeof(host)-1] = 0;
+
+    sprintf( buf, "%s/log/%s_%d.log", gSpool.c_str(), host, getpid() );
+    flog = FileOpenOrDie( buf, "a", stderr );
+
+    fprintf( flog, "Spool: [%s] idle=%d sec.\n", gSpool.c_str(), idlesec );
+
+    for( int i = 0; i < nextra; ++i )
+        fprintf( flog, "Spool: Extra option [%s].\n", extra[i] );
+    fflush( flog );
+
+// Supervise
+
+    for(;;) {
+
+        fflush( stdout );
+        fflush( stderr );
+
+        pid_t	pid = fork();
+
+        if( pid < 0 ) {
+            fprintf( flog, "Spool: fork error %d.\n", errno );
+            break;
+        }
+
+        if( !pid )
+            _exit( Worker( idlesec, proc ) );
+
+        int	status = 0;
+
+        waitpid( pid, &status, 0 );
+
+        // Restart only if child died holding a job
+
+        if( !Recover( pid ) )
+            break;
+
+        fprintf( flog, "Spool: Restarting worker (status 0x%x).\n", status );
+        fflush( flog );
+    }
+
+    fclose( flog );
+
+    return 0;
+}
+
+
@@ -0,0 +1,28 @@
+#pragma once
+
+
+#include	<stdio.h>
+
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Run one ptest pair given a conventional argv, e.g.
+// {"ptest", "za.ia^zb.ib", "-Tab=...", ...}.
+// Return 0 on success.
+//
+typedef	int (*SpoolPairProc)( int argc, char* argv[] );
+
+/* --------------------------------------------------------------- */
+/* Functions ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int SpoolRun(
+    const char		*spooldir,
+    int				idlesec,
+    SpoolPairProc	proc,
+    int				nextra = 0,
+    char*			extra[] = NULL );
+
+
@@ -89,6 +89,22 @@ private:
         FILE			*flog );
 };
 
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// RoughMatch calls NoCR at most once per pair. Possible states
+// are {0=never called, 1=failed, 2=success}. These are reset by
+// PipelineDeformableMap so a spooled worker can run many pairs.
+
+static vector<TAffine>	NoCR_T;
+static int				NoCR_state = 0;
+
+
+
+
+
+
 /* --------------------------------------------------------------- */
 /* Class Matches ------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -707,27 +723,23 @@ static bool RoughMatch(
         && !GBL.mch.PXRESMSK
         && !CM.IsFile( GBL.idb ) ) {
 
-        // Call NoCR at most once. Possible states
-        // are {0=never called, 1=failed, 2=success}.
-
-        static vector<TAffine>	T;
-        static int				state = 0;
+        // Call NoCR at most once.
 
         int	calledthistime = false;
 
-        if( !state ) {
-            state = 1 + ApproximateMatch_NoCR( T, px, flog );
+        if( !NoCR_state ) {
+            NoCR_state = 1 + ApproximateMatch_NoCR( NoCR_T, px, flog );
             calledthistime = true;
         }
 
-        if( state == 2 ) {
+        if( NoCR_state == 2 ) {
 
             if( !calledthistime ) {
                 fprintf( flog, "\n---- Thumbnail matching ----\n" );
-                T[0].TPrint( flog, "Reuse Approx: Best transform " );
+                NoCR_T[0].TPrint( flog, "Reuse Approx: Best transform " );
             }
 
-            guesses.push_back( T[0] );
+            guesses.push_back( NoCR_T[0] );
             return true;
         }
 
@@ -774,16 +786,20 @@ static void UpscaleCoords( ffmap &maps, int scale )
 // px			- a and b image pixels
 // fold_mask_a	- 0=fold, 1,2,3...=region #
 // fold_mask_b	- 0=fold, 1,2,3...=region #
+// rgn_a		- fold_mask_a region map entries, or empty
+// rgn_b		- fold_mask_b region map entries, or empty
 // flog			- detailed output
 //
 void PipelineDeformableMap(
-    int				&Ntrans,
-    double*			&tr_array,
-    uint16*			map_mask,
-    const PixPair	&px,
-    const uint8*	fold_mask_a,
-    const uint8*	fold_mask_b,
-    FILE*			flog )
+    int							&Ntrans,
+    double*						&tr_array,
+    uint16*						map_mask,
+    const PixPair				&px,
+    const uint8*				fold_mask_a,
+    const uint8*				fold_mask_b,
+    const vector<RgnMapEntry>	&rgn_a,
+    const vector<RgnMapEntry>	&rgn_b,
+    FILE*						flog )
 {
     int	wf = px.wf, hf = px.hf;
 
@@ -794,6 +810,9 @@ void PipelineDeformableMap(
     Ntrans		= 0;
     tr_array	= NULL;
 
+    NoCR_T.clear();
+    NoCR_state	= 0;
+
     memset( map_mask, 0, wf * hf * sizeof(uint16) );
 
 /* --------------------------------- */
@@ -820,10 +839,10 @@ void PipelineDeformableMap(
     else {
 
         ConnRgnsFromFoldMask( Acr, fold_mask_a,
-            wf, hf, px.scl, uint32(0.9 * GBL.mch.MMA), flog );
+            wf, hf, px.scl, uint32(0.9 * GBL.mch.MMA), flog, &rgn_a );
 
         ConnRgnsFromFoldMask( Bcr, fold_mask_b,
-            wf, hf, px.scl, uint32(0.9 * GBL.mch.MMA), flog );
+            wf, hf, px.scl, uint32(0.9 * GBL.mch.MMA), flog, &rgn_b );
     }
 
 /* ----------------------------------------- */
@@ -5,6 +5,7 @@
 
 #include	"GenDefs.h"
 #include	"CPixPair.h"
+#include	"FoldMask.h"
 
 
 /* --------------------------------------------------------------- */
@@ -12,12 +13,14 @@
 /* --------------------------------------------------------------- */
 
 void PipelineDeformableMap(
-    int				&Ntrans,
-    double*			&tr_array,
-    uint16*			map_mask,
-    const PixPair	&px,
-    const uint8*	fold_mask_a,
-    const uint8*	fold_mask_b,
-    FILE*			flog );
+    int							&Ntrans,
+    double*						&tr_array,
+    uint16*						map_mask,
+    const PixPair				&px,
+    const uint8*				fold_mask_a,
+    const uint8*				fold_mask_b,
+    const vector<RgnMapEntry>	&rgn_a,
+    const vector<RgnMapEntry>	&rgn_b,
+    FILE*						flog );
 
 
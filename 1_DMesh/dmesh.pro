@@ -13,7 +13,9 @@ HEADERS += \
     $$PWD/ImproveMesh.h \
     $$PWD/InSectionOverlap.h \
     $$PWD/janelia.h \
-    $$PWD/RegionToRegionMap.h
+    $$PWD/PairCache.h \
+    $$PWD/RegionToRegionMap.h \
+    $$PWD/Spool.h
 
 SOURCES += \
     $$PWD/ApproximateMatch.cpp \
@@ -27,5 +29,7 @@ SOURCES += \
     $$PWD/ImproveMesh.cpp \
     $$PWD/InSectionOverlap.cpp \
     $$PWD/janelia.cpp \
-    $$PWD/RegionToRegionMap.cpp
+    $$PWD/PairCache.cpp \
+    $$PWD/RegionToRegionMap.cpp \
+    $$PWD/Spool.cpp
 
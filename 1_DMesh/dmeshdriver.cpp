@@ -4,15 +4,31 @@
 #include	"FoldMask.h"
 #include	"dmesh.h"
 #include	"InSectionOverlap.h"
+#include	"PairCache.h"
+#include	"Spool.h"
 
+#include	"Cmdline.h"
+#include	"CTifReader.h"
+#include	"Debug.h"
+#include	"Geometry.h"
 #include	"ImageIO.h"
 #include	"Inspect.h"
+#include	"Telemetry.h"
 #include	"Timer.h"
 #include	"Memory.h"
+#include	"PipeFiles.h"
 
 #include	<stdlib.h>
+#include	<unistd.h>
 
 
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Extra border around -olaproi boxes for mesh optimization
+#define	OLAPROIPAD	64
+
 /* --------------------------------------------------------------- */
 /* Types --------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -60,6 +76,7 @@ static void CalcTransforms(
     FILE*		f = NULL;
     uint8		*fold_mask_a,
                 *fold_mask_b;
+    vector<RgnMapEntry>	rgn_a, rgn_b;
     double*		tr_array = NULL;
     clock_t		t0;
     int			wf, hf;
@@ -88,14 +105,14 @@ static void CalcTransforms(
                         px.resmska, pCM,
                         wf, hf, (GBL.ctx.FLD == 'N'),
                         GBL.arg.Transpose, GBL.arg.SingleFold,
-                        stderr );
+                        stderr, &rgn_a );
 
         fold_mask_b = GetFoldMask(
                         GBL.idb, GBL.B, GBL.arg.fmb,
                         px.resmskb, pCM,
                         wf, hf, (GBL.ctx.FLD == 'N'),
                         GBL.arg.Transpose, GBL.arg.SingleFold,
-                        stderr );
+                        stderr, &rgn_b );
     }
 
 /* ------------- */
@@ -106,7 +123,7 @@ static void CalcTransforms(
 
     PipelineDeformableMap(
         Ntrans, tr_array, rmap,
-        px, fold_mask_a, fold_mask_b, stderr );
+        px, fold_mask_a, fold_mask_b, rgn_a, rgn_b, stderr );
 
     StopTiming( stderr, "Alignment", t0 );
 
@@ -224,10 +241,132 @@ static void ReportAveTAffine( int Ntrans, const TAffine* tfs )
 }
 
 /* --------------------------------------------------------------- */
-/* main ---------------------------------------------------------- */
+/* GetLoadBoxes -------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-int main( int argc, char* argv[] )
+// With -olaproi, same-layer pairs need only the overlap region of
+// each picture. Get the GetOlapBoxes boxes for XYCONF and for full
+// confidence, take their union and pad that for the angle sweep,
+// the DoG kernel and the mesh optimizer.
+//
+// Each -Tmsh transform is tried by the mesh stage before the thumb
+// results, so its overlap (and its rotation) is covered as well.
+//
+// Return false if whole pictures should be loaded, including the
+// cases where thumbnail matching would fall back to them anyway.
+//
+static bool GetLoadBoxes( IBox &Ba, IBox &Bb )
+{
+    if( !GBL.arg.OlapROI ||
+        GBL.A.z != GBL.B.z ||
+        !GBL.ctx.XYCONF ||
+        GBL.ctx.MODE == 'Y' ||
+        GBL.arg.Transpose ||
+        GBL.arg.WithinSection ) {
+
+        return false;
+    }
+
+// Picture dims
+
+    CTifReader	R;
+
+    if( !R.Open( GBL.A.t2i.path.c_str(), stderr ) )
+        return false;
+
+    int	w = R.w,
+        h = R.h;
+
+// Overlaps as CThmUtil::GetOlapBoxes sees them
+
+    IBox	a1, b1, a2, b2;
+    Point	XY;
+
+    GBL.Tab.Transform( XY );
+
+    BoxesFromShifts( a1, b1, w, h, w, h,
+        int(GBL.ctx.XYCONF * XY.x), int(GBL.ctx.XYCONF * XY.y) );
+
+    BoxesFromShifts( a2, b2, w, h, w, h, int(XY.x), int(XY.y) );
+
+    int	min1d = max( GBL.ctx.OLAP1D, 8 );
+
+    if( a1.R - a1.L + 1 < min1d || a1.T - a1.B + 1 < min1d )
+        return false;
+
+// Fold in the -Tmsh overlaps
+
+    double	angmsh = 0.0;
+
+    for( int i = 0, n = GBL.Tmsh.size(); i < n; ++i ) {
+
+        IBox	am, bm;
+        Point	XYm;
+
+        GBL.Tmsh[i].Transform( XYm );
+        BoxesFromShifts( am, bm, w, h, w, h, int(XYm.x), int(XYm.y) );
+
+        if( am.R < am.L || am.T < am.B )
+            return false;
+
+        a2.L = min( a2.L, am.L );
+        a2.R = max( a2.R, am.R );
+        a2.B = min( a2.B, am.B );
+        a2.T = max( a2.T, am.T );
+
+        b2.L = min( b2.L, bm.L );
+        b2.R = max( b2.R, bm.R );
+        b2.B = min( b2.B, bm.B );
+        b2.T = max( b2.T, bm.T );
+
+        angmsh = max( angmsh,
+                    fabs( 180.0/PI * GBL.Tmsh[i].GetRadians() ) );
+    }
+
+// Pad: rotation of the far corner, plus kernel and slack
+
+    double	ang = max( GBL.ctx.HFANGDN, GBL.ctx.HFANGPR );
+    int		pad;
+
+    if( GBL.arg.CTR != 999.0 )
+        ang += fabs( GBL.arg.CTR - 180.0/PI * GBL.Tab.GetRadians() );
+
+    ang = max( ang, angmsh );
+
+    if( ang > 90.0 )
+        ang = 90.0;
+
+    pad = int(0.5 * sqrt( double(w*w + h*h) ) * sin( ang * PI/180.0 ))
+            + OLAPROIPAD;
+
+    if( GBL.mch.PXDOG )
+        pad += 3 * GBL.mch.PXDOG_R2;
+
+    if( GBL.ctx.MODE == 'N' )
+        pad += GBL.ctx.LIMXY;
+
+    Ba.L = min( a1.L, a2.L ) - pad;
+    Ba.R = max( a1.R, a2.R ) + pad;
+    Ba.B = min( a1.B, a2.B ) - pad;
+    Ba.T = max( a1.T, a2.T ) + pad;
+
+    Bb.L = min( b1.L, b2.L ) - pad;
+    Bb.R = max( b1.R, b2.R ) + pad;
+    Bb.B = min( b1.B, b2.B ) - pad;
+    Bb.T = max( b1.T, b2.T ) + pad;
+
+    fprintf( stderr,
+    "GetLoadBoxes: pad %d, A [%d %d %d %d], B [%d %d %d %d].\n",
+    pad, Ba.L, Ba.R, Ba.B, Ba.T, Bb.L, Bb.R, Bb.B, Bb.T );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* RunPair ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static int RunPair( int argc, char* argv[] )
 {
     clock_t	t0 = StartTiming();
 
@@ -235,27 +374,53 @@ int main( int argc, char* argv[] )
 /* Parse command line */
 /* ------------------ */
 
-    if( !GBL.SetCmdLine( argc, argv ) )
+    TelemBegin( "ptest", argc, argv );
+
+    if( !GBL.SetCmdLine( argc, argv ) ) {
+        TelemEnd( false );
         return 42;
+    }
+
+    TelemTag( "pair", "%d.%d^%d.%d", GBL.A.z, GBL.A.id, GBL.B.z, GBL.B.id );
+
+/* ------------------------ */
+/* Reuse cached pair result */
+/* ------------------------ */
+
+    if( PairCacheBegin( argc, argv ) ) {
+        StopTiming( stderr, "Total", t0 );
+        TelemCount( "cached" );
+        TelemEnd();
+        return 0;
+    }
 
 /* ---------- */
 /* Get images */
 /* ---------- */
 
     PixPair		px;
+    IBox		Ba, Bb;
     uint16*		rmap	= NULL;
     TAffine*	tfs		= NULL;
     TAffine*	ifs		= NULL;
     int			Ntrans	= 0;
+    bool		done	= false,
+                roi		= GetLoadBoxes( Ba, Bb ),
+                loaded;
 
-    if( !px.Load(
+    {
+        CTelemStage	ts( "Load" );
+
+        loaded = px.Load(
             GBL.A, GBL.B, GBL.idb,
             GBL.mch.PXLENS, GBL.mch.PXRESMSK, GBL.mch.PXBRO,
             GBL.mch.PXDOG, GBL.mch.PXDOG_R1, GBL.mch.PXDOG_R2,
-            stderr, GBL.arg.Transpose ) ) {
+            stderr, GBL.arg.Transpose,
+            (roi ? &Ba : NULL), (roi ? &Bb : NULL) );
+    }
 
+    if( !loaded )
         goto exit;
-    }
 
 /* ------------------- */
 /* Scaling adjustments */
@@ -299,7 +464,13 @@ int main( int argc, char* argv[] )
 /* Call Pipeline */
 /* ------------- */
 
-    CalcTransforms( rmap, Ntrans, tfs, ifs, px );
+    {
+        CTelemStage	ts( "Match" );
+
+        CalcTransforms( rmap, Ntrans, tfs, ifs, px );
+    }
+
+    TelemCount( "transforms", Ntrans );
 
     ReportAveTAffine( Ntrans, tfs );
 
@@ -331,11 +502,99 @@ int main( int argc, char* argv[] )
     if( rmap )
         free( rmap );
 
+    done = true;
+
 exit:
+    PairCacheEnd( done );
     StopTiming( stderr, "Total", t0 );
     VMStats( stderr );
+    TelemEnd( done );
 
     return 0;
 }
 
+/* --------------------------------------------------------------- */
+/* SpoolPair ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Run one pair inside a spool worker, starting from fresh
+// globals but keeping the idb tables if still in same tree.
+//
+static int SpoolPair( int argc, char* argv[] )
+{
+    static string	lastcwd;
+    char			cwd[2048];
+
+    if( getcwd( cwd, sizeof(cwd) ) && lastcwd != cwd ) {
+
+        // idb is found relative to the job dir ("../../")
+
+        string	up = cwd;
+
+        up = up.substr( 0, up.rfind( '/' ) );
+        up = up.substr( 0, up.rfind( '/' ) );
+
+        if( lastcwd.compare( 0, up.size(), up ) )
+            IDBT2ICacheClear();
+
+        lastcwd = cwd;
+    }
+
+    GBL					= CGBL_dmesh();
+    GBL.arg.IDBCache	= true;
+    dbgCor				= false;
+
+    return RunPair( argc, argv );
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Normally, run the one pair given on the command line.
+//
+// With -spool=<dir>, become a long-lived worker that runs
+// pairs from job files in the spool (see Spool.cpp), using
+// these options:
+//
+//	-idle=<sec>		exit after idle this long (default 300)
+//	-rascache=<MB>	decoded image cache size (default 512)
+//
+// Any other options are appended to every pair the worker
+// runs, as EXTRA is appended by the make.same/down rules.
+//
+// With -pcstats [dir ...], print pair cache hit rates for the
+// given block dirs (see PairCache.cpp) and exit.
+//
+int main( int argc, char* argv[] )
+{
+    if( argc > 1 && IsArg( "-pcstats", argv[1] ) )
+        return PairCacheStats( argc - 2, argv + 2 );
+
+    vector<char*>	extra;
+    const char		*spool		= NULL;
+    int				idle		= 300,
+                    rascache	= 512;
+
+    for( int i = 1; i < argc; ++i ) {
+
+        if( GetArgStr( spool, "-spool=", argv[i] ) )
+            ;
+        else if( GetArg( &idle, "-idle=%d", argv[i] ) )
+            ;
+        else if( GetArg( &rascache, "-rascache=%d", argv[i] ) )
+            ;
+        else
+            extra.push_back( argv[i] );
+    }
+
+    if( !spool )
+        return RunPair( argc, argv );
+
+    RasterCacheSetMB( rascache, stderr );
+
+    return SpoolRun( spool, idle, SpoolPair,
+            extra.size(), (extra.size() ? &extra[0] : NULL) );
+}
+
 
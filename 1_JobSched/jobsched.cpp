@@ -0,0 +1,1195 @@
+//
+// Run the alignment pipeline phases on one machine, no grid
+// engine required.
+//
+// > jobsched -z=i,j [options]
+//
+// Run from the workspace (temp) dir. The phases, in order:
+//
+//	tiny	idb/fsub.sht			(only with -tiny)
+//	same	ssub.sht
+//	mon		msub.sht
+//	gather	gathermons.sht
+//	cross	crossgo.sht
+//	scapes	cross_wkspc/subscapes.sht
+//	lowres	cross_wkspc/lowresgo.sht
+//	scaf	cross_wkspc/scafgo.sht
+//	carve	cross_wkspc/carvego.sht
+//	block	cross_wkspc/bsub.sht
+//	down	dsub.sht
+//	stack	stack/runlsq.sht
+//
+// Each phase is driven by the very script a user would run by
+// hand. Scripts that submit cluster jobs are run with our own
+// QSUB_1NODE.sht (and QSUB_MNODE.sht) first on the PATH; those
+// append each job {dir, slots, name, command} to a queue file
+// instead of submitting it, and we run the queued jobs here on
+// a fixed number of local slots.
+//
+// A phase is expanded (its script run) only when the phase
+// before it has finished, because its inputs don't exist until
+// then. Per-layer phases (tiny, same, mon, block, down) expand
+// one layer at a time, so layer z can move on to its montage
+// solve while other layers are still matching.
+//
+// Ready jobs are started in critical path order: earlier phases
+// first (they gate everything downstream), then the layer with
+// the most outstanding work, then the biggest job. Job cost is
+// the count of make targets not yet built, else 1. Failed jobs
+// are retried; make based jobs resume where they stopped.
+//
+// LowRes.xml normally needs review in TrakEM2 before scafgo, so
+// we stop after lowres unless -nobless. Resume with -from=scaf.
+//
+// Blocks with a cost.same (makemontages) get a predicted run
+// time, in sec, or in model units scaled by the sec-per-unit of
+// that phase's finished blocks. Cost orders blocks, and the log
+// compares predicted and actual times. With -spec, when slots
+// would otherwise idle, a block running well past its predicted
+// time gets a helper make on its unbuilt targets, last first.
+// That needs makemontages -spec, whose rules claim each pair so
+// the two makes never run the same one.
+//
+
+
+#include	"Cmdline.h"
+#include	"Disk.h"
+#include	"File.h"
+#include	"PipeFiles.h"
+#include	"Timer.h"
+
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/wait.h>
+#include	<unistd.h>
+
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Constants ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	SPECFAC	1.5		// straggler if run > SPECFAC * predicted
+
+enum JobState {
+    jobWait		= 0,
+    jobRun		= 1,
+    jobDone		= 2,
+    jobFail		= 3
+};
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CPhase {
+public:
+    const char	*name,
+                *dir,		// from temp; "IDB" = the idb dir
+                *script;
+    bool		queue,		// script queues jobs via QSUB_xNODE
+                perz,		// expands one layer at a time
+                zargs;		// script takes args <zmin> <zmax>
+};
+
+class CJob {
+public:
+    string	dir,
+            name,
+            cmd;
+    double	cost,
+            units,		// cost.same model units, or 0
+            pred,		// cost.same sec, or -1
+            t0,
+            dt;
+    int		iph,
+            z,			// layer or -1
+            slots,
+            ntry,
+            state,
+            pid,
+            hpid;		// -spec helper
+    bool	pok,
+            hok;
+public:
+    CJob()
+    : cost(1), units(0), pred(-1), t0(0), dt(0), iph(0), z(-1),
+      slots(1), ntry(0), state(jobWait), pid(0), hpid(0),
+      pok(true), hok(true) {};
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_sch ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_sch {
+
+public:
+    const char	*from,
+                *to;
+    int			zmin,
+                zmax,
+                slots,
+                retries,
+                report;
+    bool		tiny,
+                nobless,
+                spec,
+                dry;
+public:
+    CArgs_sch()
+    : from(NULL), to(NULL),
+      zmin(0), zmax(-1), slots(0), retries(1), report(60),
+      tiny(false), nobless(false), spec(false), dry(false) {};
+
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static const CPhase	gPhs[] = {
+//	name		dir				script				queue	perz	zargs
+    {"tiny",	"IDB",			"fsub.sht",			true,	true,	true},
+    {"same",	".",			"ssub.sht",			true,	true,	true},
+    {"mon",		".",			"msub.sht",			true,	true,	true},
+    {"gather",	".",			"gathermons.sht",	false,	false,	true},
+    {"cross",	".",			"crossgo.sht",		false,	false,	false},
+    {"scapes",	"cross_wkspc",	"subscapes.sht",	true,	false,	false},
+    {"lowres",	"cross_wkspc",	"lowresgo.sht",		false,	false,	false},
+    {"scaf",	"cross_wkspc",	"scafgo.sht",		false,	false,	false},
+    {"carve",	"cross_wkspc",	"carvego.sht",		false,	false,	false},
+    {"block",	"cross_wkspc",	"bsub.sht",			true,	true,	true},
+    {"down",	".",			"dsub.sht",			true,	true,	true},
+    {"stack",	"stack",		"runlsq.sht",		false,	false,	false}
+};
+
+static const int	nphs = sizeof(gPhs) / sizeof(CPhase);
+
+static CArgs_sch	gArgs;
+static FILE*		flog	= NULL;
+static string		gTemp,			// abs workspace path
+                    gIDB,			// abs idb path
+                    gSch;			// abs jobsched dir
+static vector<CJob>	vJ;
+static vector<int>	vExp;			// expanded: [iph*nz + iz]
+static int			iph0, iphN,		// phase range [iph0, iphN)
+                    nz,
+                    nbusy	= 0;	// slots in use
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* PhaseIndex ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static int PhaseIndex( const char *name )
+{
+    for( int i = 0; i < nphs; ++i ) {
+
+        if( !strcmp( name, gPhs[i].name ) )
+            return i;
+    }
+
+    printf( "No such phase [%s].\n", name );
+    exit( 42 );
+}
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_sch::SetCmdLine( int argc, char* argv[] )
+{
+// start log
+
+    flog = FileOpenOrDie( "jobsched.log", "w" );
+
+// log start time
+
+    time_t	t0 = time( NULL );
+    char	atime[32];
+
+    strcpy( atime, ctime( &t0 ) );
+    atime[24] = '\0';	// remove the newline
+
+    fprintf( flog, "Local job scheduler: %s ", atime );
+
+// parse command line args
+
+    if( argc < 2 ) {
+        printf( "Usage: jobsched -z=i,j [options].\n" );
+        exit( 42 );
+    }
+
+    vector<int>	vi;
+
+    for( int i = 1; i < argc; ++i ) {
+
+        // echo to log
+        fprintf( flog, "%s ", argv[i] );
+
+        if( GetArgList( vi, "-z=", argv[i] ) ) {
+
+            if( 2 == vi.size() ) {
+                zmin = vi[0];
+                zmax = vi[1];
+            }
+            else {
+                fprintf( flog,
+                "Bad format in -z [%s].\n", argv[i] );
+                exit( 42 );
+            }
+        }
+        else if( GetArg( &slots, "-slots=%d", argv[i] ) )
+            ;
+        else if( GetArg( &retries, "-retries=%d", argv[i] ) )
+            ;
+        else if( GetArg( &report, "-report=%d", argv[i] ) )
+            ;
+        else if( GetArgStr( from, "-from=", argv[i] ) )
+            ;
+        else if( GetArgStr( to, "-to=", argv[i] ) )
+            ;
+        else if( IsArg( "-tiny", argv[i] ) )
+            tiny = true;
+        else if( IsArg( "-nobless", argv[i] ) )
+            nobless = true;
+        else if( IsArg( "-spec", argv[i] ) )
+            spec = true;
+        else if( IsArg( "-dry", argv[i] ) )
+            dry = true;
+        else {
+            printf( "Did not understand option [%s].\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    fprintf( flog, "\n\n" );
+
+    if( zmax < zmin ) {
+        printf( "Missing or bad -z=i,j.\n" );
+        exit( 42 );
+    }
+
+    if( slots <= 0 )
+        slots = sysconf( _SC_NPROCESSORS_ONLN );
+
+    if( slots <= 0 )
+        slots = 1;
+
+// phase range
+
+    iph0 = (from ? PhaseIndex( from ) : (tiny ? 0 : 1));
+    iphN = (to ? PhaseIndex( to ) : nphs - 1) + 1;
+
+    int	ilr = PhaseIndex( "lowres" );
+
+    if( !nobless && iph0 <= ilr && iphN > ilr + 1 ) {
+
+        iphN = ilr + 1;
+
+        fprintf( flog,
+        "Stopping after lowres for LowRes.xml review"
+        " (-nobless to run on).\n" );
+    }
+
+    if( iph0 >= iphN ) {
+        printf( "Empty phase range.\n" );
+        exit( 42 );
+    }
+
+    nz = zmax - zmin + 1;
+
+    fprintf( flog, "Phases [%s..%s], layers [%d..%d], slots %d.\n",
+    gPhs[iph0].name, gPhs[iphN-1].name, zmin, zmax, slots );
+
+    fflush( flog );
+}
+
+/* --------------------------------------------------------------- */
+/* WriteShim ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Our stand-in for the cluster submit script: append job record
+// "dir<TAB>slots<TAB>name<TAB>command" to the queue file. The
+// queue is named only in the environment of a queue phase's own
+// expand script, so a submit from anywhere else fails loudly
+// rather than landing in a queue nobody will read.
+//
+static void WriteShim( const char *name, int islots, int icmd )
+{
+    char	buf[2048];
+    FILE	*f;
+
+    sprintf( buf, "%s/bin/%s", gSch.c_str(), name );
+    f = FileOpenOrDie( buf, "w", flog );
+
+    fprintf( f, "#!/bin/sh\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "# Purpose:\n" );
+    fprintf( f, "# jobsched stand-in for %s: queue the job locally.\n", name );
+    fprintf( f, "\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "if [ -z \"$ALN_SCHED_QUEUE\" ]\n" );
+    fprintf( f, "then\n" );
+    fprintf( f, "\techo \"%s: no jobsched queue for this phase;"
+                " job not run: $*\" >&2\n", name );
+    fprintf( f, "\texit 1\n" );
+    fprintf( f, "fi\n" );
+    fprintf( f, "\n" );
+    fprintf( f,
+    "printf '%%s\\t%%s\\t%%s\\t%%s\\n' \"$PWD\" \"$%d\" \"$2\" \"$%d\""
+    " >> \"$ALN_SCHED_QUEUE\"\n", islots, icmd );
+    fprintf( f, "\n" );
+
+    fclose( f );
+    FileScriptPerms( buf );
+}
+
+/* --------------------------------------------------------------- */
+/* Setup --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void Setup()
+{
+    char	buf[2048];
+
+    DskAbsPath( buf, sizeof(buf), ".", flog );
+    gTemp = buf;
+
+    gSch = gTemp + "/jobsched";
+    DskCreateDir( gSch.c_str(), flog );
+    DskCreateDir( (gSch + "/bin").c_str(), flog );
+    DskCreateDir( (gSch + "/logs").c_str(), flog );
+
+    WriteShim( "QSUB_1NODE.sht", 5, 6 );
+    WriteShim( "QSUB_MNODE.sht", 4, 5 );
+
+    if( gArgs.tiny ) {
+
+        string	idb;
+
+        IDBFromTemp( idb, ".", flog );
+
+        if( idb.empty() )
+            exit( 42 );
+
+        DskAbsPath( buf, sizeof(buf), idb.c_str(), flog );
+        gIDB = buf;
+    }
+
+// Shims ahead of the real ones
+
+    const char	*path = getenv( "PATH" );
+
+    sprintf( buf, "%s/bin:%s", gSch.c_str(), (path ? path : "") );
+    setenv( "PATH", buf, 1 );
+
+    vExp.assign( nphs * nz, 0 );
+}
+
+/* --------------------------------------------------------------- */
+/* PhaseDir ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static string PhaseDir( int iph )
+{
+    const char	*d = gPhs[iph].dir;
+
+    if( !strcmp( d, "IDB" ) )
+        return gIDB;
+
+    if( !strcmp( d, "." ) )
+        return gTemp;
+
+    return gTemp + "/" + d;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeTargets --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// If cmd runs "make -f mkfile", fill vt with its targets (other
+// than 'all') not yet built in dir, set spec if mkfile's rules
+// claim pairs (makemontages -spec), and return true.
+//
+static bool MakeTargets(
+    vector<string>	&vt,
+    bool			&spec,
+    const string	&dir,
+    const string	&cmd )
+{
+    char	mk[2048];
+    size_t	at = cmd.find( "make -f " );
+
+    vt.clear();
+    spec = false;
+
+    if( at == string::npos ||
+        1 != sscanf( cmd.c_str() + at + 8, "%s", mk ) ) {
+
+        return false;
+    }
+
+    FILE	*f = fopen( (dir + "/" + mk).c_str(), "r" );
+
+    if( !f )
+        return false;
+
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        char	*c;
+
+        if( !strncmp( LS.line, "# spec", 6 ) )
+            spec = true;
+
+        if( LS.line[0] == '\t' || LS.line[0] == '#' ||
+            !(c = strchr( LS.line, ':' )) ||
+            !strncmp( LS.line, "all:", 4 ) ) {
+
+            continue;
+        }
+
+        *c = 0;
+
+        if( !DskExists( (dir + "/" + LS.line).c_str() ) )
+            vt.push_back( LS.line );
+    }
+
+    fclose( f );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* JobCost ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Set job's cost: for make jobs, its count of unbuilt targets,
+// else 1. If dir has a makemontages cost.same, also set units or
+// pred, and weight cost by that block's cost per pair.
+//
+static void JobCost( CJob &J )
+{
+    vector<string>	vt;
+    bool			spec;
+
+    MakeTargets( vt, spec, J.dir, J.cmd );
+
+    J.cost = (vt.size() ? vt.size() : 1);
+
+    FILE	*f = fopen( (J.dir + "/cost.same").c_str(), "r" );
+
+    if( !f )
+        return;
+
+    double	c;
+    int		np, insec;
+
+    if( 3 == fscanf( f, "COST %d %lf %d", &np, &c, &insec ) && np > 0 ) {
+
+        if( insec )
+            J.pred = c;
+        else
+            J.units = c;
+
+        J.cost *= c / np;
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* Expand -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Run phase script (for layer z if perz) and append its jobs.
+// Plain scripts are themselves the one job.
+//
+static void Expand( int iph, int z )
+{
+    const CPhase	&P = gPhs[iph];
+    string			dir = PhaseDir( iph );
+    char			args[64] = "";
+    int				j0 = vJ.size();
+
+    if( P.perz )
+        sprintf( args, " %d %d", z, z );
+    else if( P.zargs )
+        sprintf( args, " %d %d", gArgs.zmin, gArgs.zmax );
+
+    if( !DskExists( (dir + "/" + P.script).c_str() ) ) {
+
+        fprintf( flog, "Expand: No [%s/%s]; phase %s empty.\n",
+        dir.c_str(), P.script, P.name );
+        return;
+    }
+
+    if( !P.queue ) {
+
+        CJob	J;
+
+        J.dir	= dir;
+        J.name	= P.name;
+        J.cmd	= string( "./" ) + P.script + args;
+        J.iph	= iph;
+        J.z		= z;
+
+        vJ.push_back( J );
+    }
+    else {
+
+        char	qpath[2048], cmd[4096];
+
+        sprintf( qpath, "%s/queue_%s_%d.txt", gSch.c_str(), P.name, z );
+        remove( qpath );
+
+        sprintf( cmd,
+        "cd '%s' && ALN_SCHED_QUEUE='%s' ./%s%s > /dev/null",
+        dir.c_str(), qpath, P.script, args );
+
+        if( system( cmd ) ) {
+            fprintf( flog, "Expand: [%s] returned error.\n", cmd );
+        }
+
+        FILE	*f = fopen( qpath, "r" );
+
+        if( f ) {
+
+            CLineScan	LS;
+
+            while( LS.Get( f ) > 0 ) {
+
+                char	*t[4];
+                int		nt = 0;
+
+                t[0] = LS.line;
+
+                for( char *c = LS.line; *c && nt < 3; ++c ) {
+
+                    if( *c == '\t' ) {
+                        *c = 0;
+                        t[++nt] = c + 1;
+                    }
+                }
+
+                if( nt < 3 )
+                    continue;
+
+                char	*e = t[3] + strlen( t[3] );
+
+                while( e > t[3] && (e[-1] == '\n' || e[-1] == '\r') )
+                    *--e = 0;
+
+                CJob	J;
+
+                J.dir	= t[0];
+                J.slots	= max( 1, min( atoi( t[1] ), gArgs.slots ) );
+                J.name	= t[2];
+                J.cmd	= t[3];
+                J.iph	= iph;
+                J.z		= (P.perz ? z : -1);
+
+                JobCost( J );
+                vJ.push_back( J );
+            }
+
+            fclose( f );
+        }
+    }
+
+    double	cost = 0;
+
+    for( int i = j0, n = vJ.size(); i < n; ++i )
+        cost += vJ[i].cost;
+
+    fprintf( flog, "Expand: Phase %s z=%d: %d jobs, cost %g.\n",
+    P.name, z, (int)vJ.size() - j0, cost );
+    fflush( flog );
+}
+
+/* --------------------------------------------------------------- */
+/* GroupDone ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// For phase iph (layer z, or all layers if z < 0): return true if
+// every part is expanded and all its jobs are done; set nfail.
+//
+static bool GroupDone( int iph, int z, int &nfail )
+{
+    bool	done = true;
+
+    nfail = 0;
+
+    for( int iz = 0; iz < nz; ++iz ) {
+
+        if( (z < 0 || iz + gArgs.zmin == z) && !vExp[iph*nz + iz] )
+            done = false;
+
+        if( !gPhs[iph].perz )
+            break;
+    }
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        const CJob	&J = vJ[i];
+
+        if( J.iph != iph || (z >= 0 && J.z >= 0 && J.z != z) )
+            continue;
+
+        if( J.state == jobFail )
+            ++nfail;
+        else if( J.state != jobDone )
+            done = false;
+    }
+
+    return done;
+}
+
+/* --------------------------------------------------------------- */
+/* ExpandReady --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Expand each phase part whose predecessor has finished cleanly.
+//
+static void ExpandReady()
+{
+    for( int iph = iph0; iph < iphN; ++iph ) {
+
+        const CPhase	&P = gPhs[iph];
+        int				niz = (P.perz ? nz : 1);
+
+        for( int iz = 0; iz < niz; ++iz ) {
+
+            int	&x = vExp[iph*nz + iz],
+                z = (P.perz ? gArgs.zmin + iz : -1),
+                nfail;
+
+            if( x )
+                continue;
+
+            if( iph > iph0 ) {
+
+                int	zp = (P.perz && gPhs[iph-1].perz ? z : -1);
+
+                if( !GroupDone( iph - 1, zp, nfail ) || nfail )
+                    continue;
+            }
+
+            x = 1;
+            Expand( iph, z );
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* PickNext ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Return index of best waiting job that fits in free slots, or -1.
+//
+// Order: earliest phase, then layer with most outstanding cost,
+// then largest job.
+//
+static int PickNext( int free )
+{
+    int	nj = vJ.size(), best = -1;
+
+    vector<double>	left( nphs * (nz + 1), 0.0 );
+
+    for( int i = 0; i < nj; ++i ) {
+
+        const CJob	&J = vJ[i];
+
+        if( J.state == jobWait || J.state == jobRun )
+            left[J.iph*(nz+1) + (J.z < 0 ? nz : J.z - gArgs.zmin)] += J.cost;
+    }
+
+    double	bleft = 0;
+
+    for( int i = 0; i < nj; ++i ) {
+
+        const CJob	&J = vJ[i];
+
+        if( J.state != jobWait || J.slots > free )
+            continue;
+
+        double	l = left[J.iph*(nz+1) + (J.z < 0 ? nz : J.z - gArgs.zmin)];
+
+        if( best < 0 ||
+            J.iph < vJ[best].iph ||
+            (J.iph == vJ[best].iph &&
+                (l > bleft || (l == bleft && J.cost > vJ[best].cost))) ) {
+
+            best	= i;
+            bleft	= l;
+        }
+    }
+
+    return best;
+}
+
+/* --------------------------------------------------------------- */
+/* NWaiting ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static int NWaiting()
+{
+    int	nw = 0;
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        if( vJ[i].state == jobWait )
+            ++nw;
+    }
+
+    return nw;
+}
+
+/* --------------------------------------------------------------- */
+/* Predicted ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return job's predicted run sec, or -1 if unknown.
+//
+// Model units are converted by the sec-per-unit of the finished
+// jobs of that phase.
+//
+static double Predicted( const CJob &J )
+{
+    if( J.pred >= 0 )
+        return J.pred;
+
+    if( J.units <= 0 )
+        return -1;
+
+    double	su = 0, ss = 0;
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        const CJob	&I = vJ[i];
+
+        if( I.iph == J.iph && I.state == jobDone && I.units > 0 ) {
+            su += I.units;
+            ss += I.dt;
+        }
+    }
+
+    return (su > 0 ? J.units * ss / su : -1);
+}
+
+/* --------------------------------------------------------------- */
+/* Launch -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void Launch( int ij )
+{
+    CJob	&J = vJ[ij];
+    char	out[2048];
+
+    sprintf( out, "%s/logs/%s_%d_%d.log",
+    gSch.c_str(), gPhs[J.iph].name, ij, J.ntry );
+
+    ++J.ntry;
+    J.t0 = WallSec();
+
+    fprintf( flog, "Start [%s] %s (try %d, %d slots) in [%s]: %s\n",
+    gPhs[J.iph].name, J.name.c_str(), J.ntry, J.slots,
+    J.dir.c_str(), J.cmd.c_str() );
+    fflush( flog );
+
+    if( gArgs.dry ) {
+        J.state	= jobDone;
+        J.pid	= 0;
+        return;
+    }
+
+    fflush( stdout );
+    fflush( stderr );
+
+    pid_t	pid = fork();
+
+    if( pid < 0 ) {
+        fprintf( flog, "Launch: fork error %d.\n", errno );
+        exit( 42 );
+    }
+
+    if( !pid ) {
+
+        if( chdir( J.dir.c_str() ) ||
+            !freopen( out, "w", stdout ) ||
+            !freopen( out, "a", stderr ) ) {
+
+            _exit( 42 );
+        }
+
+        execl( "/bin/sh", "sh", "-c", J.cmd.c_str(), (char*)NULL );
+        _exit( 42 );
+    }
+
+    J.pid	= pid;
+    J.pok	= true;
+    J.hok	= true;
+    J.state	= jobRun;
+    nbusy	+= J.slots;
+}
+
+/* --------------------------------------------------------------- */
+/* Speculate ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Called when nothing is waiting and free slots remain: give the
+// worst straggling claim-safe make job a helper make that builds
+// its unbuilt targets in reverse order. Return true if started.
+//
+static bool Speculate( int free )
+{
+    double	now = WallSec(), worst = SPECFAC;
+    int		ij = -1;
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        const CJob	&J = vJ[i];
+
+        if( J.state != jobRun || !J.pid || J.hpid || J.slots > free )
+            continue;
+
+        double	p = Predicted( J ), r;
+
+        if( p <= 0 || (r = (now - J.t0) / p) <= worst )
+            continue;
+
+        worst	= r;
+        ij		= i;
+    }
+
+    if( ij < 0 )
+        return false;
+
+    CJob			&J = vJ[ij];
+    vector<string>	vt;
+    bool			spec;
+
+    if( !MakeTargets( vt, spec, J.dir, J.cmd ) || !spec ||
+        vt.size() < 2 ) {
+
+        J.hpid = -1;	// don't look again
+        return false;
+    }
+
+    string	cmd = J.cmd;
+    char	out[2048];
+
+    for( int i = vt.size() - 1; i >= 0; --i )
+        cmd += " " + vt[i];
+
+    sprintf( out, "%s/logs/%s_%d_spec.log",
+    gSch.c_str(), gPhs[J.iph].name, ij );
+
+    fprintf( flog,
+    "Spec [%s] %s: %.1f sec vs %.1f predicted; helper on %d targets.\n",
+    gPhs[J.iph].name, J.name.c_str(),
+    now - J.t0, Predicted( J ), (int)vt.size() );
+    fflush( flog );
+
+    fflush( stdout );
+    fflush( stderr );
+
+    pid_t	pid = fork();
+
+    if( pid < 0 ) {
+        fprintf( flog, "Speculate: fork error %d.\n", errno );
+        exit( 42 );
+    }
+
+    if( !pid ) {
+
+        if( chdir( J.dir.c_str() ) ||
+            !freopen( out, "w", stdout ) ||
+            !freopen( out, "a", stderr ) ) {
+
+            _exit( 42 );
+        }
+
+        execl( "/bin/sh", "sh", "-c", cmd.c_str(), (char*)NULL );
+        _exit( 42 );
+    }
+
+    J.hpid	= pid;
+    nbusy	+= J.slots;
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* Reap ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Collect any finished children; requeue failures with tries left.
+// Return count reaped.
+//
+static int Reap()
+{
+    int	nr = 0, status;
+    pid_t	pid;
+
+    while( (pid = waitpid( -1, &status, WNOHANG )) > 0 ) {
+
+        for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+            CJob	&J = vJ[i];
+
+            if( J.state != jobRun || (J.pid != pid && J.hpid != pid) )
+                continue;
+
+            bool	ok = WIFEXITED( status ) && !WEXITSTATUS( status );
+
+            nbusy -= J.slots;
+            ++nr;
+
+            if( J.hpid == pid ) {
+                J.hpid	= 0;
+                J.hok	= ok;
+            }
+            else {
+                J.pid	= 0;
+                J.pok	= ok;
+            }
+
+            // Job ends when its helper (if any) does too
+
+            if( J.pid || J.hpid > 0 )
+                break;
+
+            double	p = Predicted( J );
+
+            ok		= J.pok && J.hok;
+            J.dt	+= WallSec() - J.t0;
+            J.hpid	= 0;
+
+            if( ok )
+                J.state = jobDone;
+            else if( J.ntry <= gArgs.retries )
+                J.state = jobWait;
+            else
+                J.state = jobFail;
+
+            fprintf( flog, "%s [%s] %s after %.1f sec (status 0x%x)",
+            (ok ? "Done" : (J.state == jobWait ? "Retry" : "FAIL")),
+            gPhs[J.iph].name, J.name.c_str(),
+            WallSec() - J.t0, status );
+
+            if( p >= 0 )
+                fprintf( flog, ", predicted %.1f", p );
+
+            fprintf( flog, ".\n" );
+            fflush( flog );
+
+            break;
+        }
+    }
+
+    return nr;
+}
+
+/* --------------------------------------------------------------- */
+/* ReportPredicted ----------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// For phase's finished jobs that have predictions, compare their
+// summed and worst predicted vs actual times.
+//
+static void ReportPredicted( FILE *f, int iph )
+{
+    double	sp = 0, sa = 0, worst = 0;
+    int		np = 0, iw = -1;
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        const CJob	&J = vJ[i];
+        double		p;
+
+        if( J.iph != iph || J.state != jobDone ||
+            (p = Predicted( J )) <= 0 ) {
+
+            continue;
+        }
+
+        sp += p;
+        sa += J.dt;
+        ++np;
+
+        if( J.dt / p > worst ) {
+            worst	= J.dt / p;
+            iw		= i;
+        }
+    }
+
+    if( !np )
+        return;
+
+    fprintf( f,
+    "  %-7s predicted %.0f sec, actual %.0f sec over %d blocks;"
+    " worst %s %.2fx\n",
+    gPhs[iph].name, sp, sa, np, vJ[iw].name.c_str(), worst );
+}
+
+/* --------------------------------------------------------------- */
+/* Report -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void Report( FILE *f, double t0, bool final )
+{
+    fprintf( f, "Sched: %.0f sec, slots %d/%d\n",
+    WallSec() - t0, nbusy, gArgs.slots );
+
+    for( int iph = iph0; iph < iphN; ++iph ) {
+
+        int		n[4] = {0,0,0,0};
+        double	dt = 0;
+
+        for( int i = 0, nj = vJ.size(); i < nj; ++i ) {
+
+            if( vJ[i].iph == iph ) {
+                ++n[vJ[i].state];
+                dt += vJ[i].dt;
+            }
+        }
+
+        if( !final && !(n[jobWait] + n[jobRun]) )
+            continue;
+
+        fprintf( f,
+        "  %-7s jobs %4d: done %4d, run %3d, wait %4d, fail %3d;"
+        " %.0f job-sec\n",
+        gPhs[iph].name, n[0] + n[1] + n[2] + n[3],
+        n[jobDone], n[jobRun], n[jobWait], n[jobFail], dt );
+
+        if( final )
+            ReportPredicted( f, iph );
+    }
+
+    fflush( f );
+}
+
+/* --------------------------------------------------------------- */
+/* Run ----------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return count of failed jobs.
+//
+static int Run()
+{
+    double	t0 = WallSec(), trep = t0;
+
+    for(;;) {
+
+        ExpandReady();
+
+        int	ij;
+
+        while( (ij = PickNext( gArgs.slots - nbusy )) >= 0 )
+            Launch( ij );
+
+        if( gArgs.spec && !gArgs.dry && !NWaiting() )
+            Speculate( gArgs.slots - nbusy );
+
+        if( !nbusy ) {
+
+            // Nothing running, nothing startable: either
+            // more to expand, or done (or blocked by failures).
+
+            int	nj = vJ.size();
+
+            ExpandReady();
+
+            if( nj == vJ.size() )
+                break;
+
+            continue;
+        }
+
+        if( !Reap() )
+            Yield_usec( 250000 );
+
+        if( WallSec() - trep >= gArgs.report ) {
+            Report( stdout, t0, false );
+            Report( flog, t0, false );
+            trep = WallSec();
+        }
+    }
+
+    Report( stdout, t0, true );
+    Report( flog, t0, true );
+
+    int	nfail = 0;
+
+    for( int i = 0, n = vJ.size(); i < n; ++i ) {
+
+        if( vJ[i].state == jobFail ) {
+
+            fprintf( flog, "Failed: [%s] %s in [%s]: %s\n",
+            gPhs[vJ[i].iph].name, vJ[i].name.c_str(),
+            vJ[i].dir.c_str(), vJ[i].cmd.c_str() );
+
+            ++nfail;
+        }
+    }
+
+    return nfail;
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+/* ------------------ */
+/* Parse command line */
+/* ------------------ */
+
+    gArgs.SetCmdLine( argc, argv );
+
+/* ----- */
+/* Setup */
+/* ----- */
+
+    Setup();
+
+/* --- */
+/* Run */
+/* --- */
+
+    int	nfail = Run();
+
+    if( nfail ) {
+        printf( "Sched: %d jobs failed; see jobsched.log.\n", nfail );
+        fprintf( flog, "Sched: %d jobs failed.\n", nfail );
+    }
+    else if( iphN < nphs && !strcmp( gPhs[iphN-1].name, "lowres" ) ) {
+        printf( "Sched: Review LowRes.xml, then resume with -from=scaf.\n" );
+    }
+
+/* ---- */
+/* Done */
+/* ---- */
+
+    fprintf( flog, "\n" );
+    fclose( flog );
+
+    return (nfail ? 42 : 0);
+}
+
+
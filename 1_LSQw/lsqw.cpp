@@ -14,6 +14,7 @@
 #include	"Cmdline.h"
 #include	"File.h"
 #include	"Memory.h"
+#include	"Telemetry.h"
 #include	"Timer.h"
 
 #include	<string.h>
@@ -277,6 +278,10 @@ int main( int argc, char **argv )
         exit( 42 );
     }
 
+    TelemBegin( "lsqw", argc, argv );
+    TelemTag( "mode", "%s", gArgs.mode );
+    TelemTag( "worker", "%d", wkid );
+
 /* ------------ */
 /* Initial data */
 /* ------------ */
@@ -291,6 +296,7 @@ int main( int argc, char **argv )
     InitTables( gArgs.zilo, gArgs.zihi );
 
     {
+        CTelemStage	ts( "LoadPoints" );
         CLoadPoints	*LP = new CLoadPoints;
         LP->Load( gArgs.tempdir, gArgs.cachedir );
         delete LP;
@@ -304,7 +310,8 @@ int main( int argc, char **argv )
 
     SetSolveParams( gArgs.regtype, gArgs.Wr, gArgs.Etol );
 
-    XArray	Xevn, Xodd;
+    XArray		Xevn, Xodd;
+    CTelemStage	*ts = new CTelemStage( "Solve" );
 
     if( !strcmp( gArgs.mode, "A2A" ) ) {
 
@@ -357,6 +364,9 @@ int main( int argc, char **argv )
 
     const XArray& Xfinal = ((gArgs.iters & 1) ? Xodd : Xevn);
 
+    delete ts;
+    ts = new CTelemStage( "Post" );
+
 /* ----------- */
 /* Postprocess */
 /* ----------- */
@@ -375,6 +385,8 @@ int main( int argc, char **argv )
             Xfinal.Save();
     }
 
+    delete ts;
+
 /* ------- */
 /* Cleanup */
 /* ------- */
@@ -386,6 +398,7 @@ int main( int argc, char **argv )
 
     MPIExit();
     VMStats( stdout );
+    TelemEnd();
 
     return 0;
 }
@@ -26,6 +26,8 @@
 //
 // - TileToFM and TileToFMD are written by makeIDB but the
 // foldmasks themselves will not exist until 'tiny' runs.
+// Beside each mask png tiny also writes a compact region map
+// (same name, .rgn) that ptest and mos load in its place.
 //
 // - All entries in TileToXXX files are in tile id order.
 //
@@ -8,11 +8,29 @@
 //			folder '0'				// output folder per tile, here '0'
 //			S0_0					// same layer jobs
 //				make.same			// make file for same layer
+//				jobs.same			// (-jobs) spool job list instead
+//				cost.same			// predicted block cost
 //				ThmPair_0^0.txt		// table of thumbnail results
 //			D0_0					// down layer jobs
 //				make.down			// make file for cross layers
 //				ThmPair_0^j.txt		// table of thumbnail results
 //
+// With option -jobs, the S-dirs get a jobs.same list for ptest
+// spool workers (ptest -spool=dir) rather than a make.same, and
+// scripts ssubq.sht and dsubq.sht queue these lists on a spool.
+//
+// Each pair gets a predicted cost: a fixed part plus its overlap
+// area times the product of the two tiles' fold region counts.
+// With -hist=prev, ptest times from the pair logs of an earlier
+// workspace calibrate that model to seconds (measured pairs use
+// their own time). Option -balance then cuts the layer into
+// blocks of near-equal cost rather than equal area, so a few
+// dense blocks don't hold up the whole layer.
+//
+// With -spec, make.same rules claim their pair (a claim_ dir)
+// before running it, so jobsched can safely set a second make
+// on the unbuilt tail of a straggling block.
+//
 
 
 #include	"Cmdline.h"
@@ -22,28 +40,59 @@
 #include	"CTileSet.h"
 #include	"Geometry.h"
 
+#include	<dirent.h>
 #include	<string.h>
 
+#include	<algorithm>
+#include	<map>
+
 
 /* --------------------------------------------------------------- */
 /* Macros -------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+#define	PAIRFIX	0.25	// pair cost (load, setup) beyond overlap work
+
 /* --------------------------------------------------------------- */
 /* Types --------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
 class Pair {
 public:
-    int	a, b;
+    int		a, b;
+    double	cost;	// model units, or sec if calibrated
 public:
-    Pair( int a, int b ) : a(a), b(b) {};
+    Pair( int a, int b, double cost ) : a(a), b(b), cost(cost) {};
 };
 
 
 class Block {
 public:
     vector<Pair>	P;
+public:
+    double Cost() const
+    {
+        double	c = 0;
+        for( int i = 0, n = P.size(); i < n; ++i )
+            c += P[i].cost;
+        return c;
+    };
+};
+
+
+typedef pair<int,int>	IDPair;
+
+
+class SerpKey {
+public:
+    double	key;	// cell walk index + position within cell
+    int		ib, ip;	// block, pair
+public:
+    SerpKey( double key, int ib, int ip )
+    : key(key), ib(ib), ip(ip) {};
+
+    bool operator < ( const SerpKey &rhs ) const
+        {return key < rhs.key;};
 };
 
 
@@ -60,12 +109,15 @@ public:
                     kx, ky,
                     dx, dy,
                     nb;
+    bool			insec;	// costs calibrated to seconds
 
 private:
     void OrientLayer( int is0, int isN );
     void SetDims();
     void PartitionJobs( int is0, int isN );
+    void Calibrate();
     void Consolidate();
+    void Balance();
     void ReportBlocks( int z );
 
 public:
@@ -83,9 +135,13 @@ public:
     string		idb;
     const char	*outdir,
                 *script,
-                *exenam;
+                *exenam,
+                *hist;
     int			zmin,
                 zmax;
+    bool		jobs,
+                balance,
+                spec;
 
 public:
     CArgs_scr()
@@ -93,8 +149,12 @@ public:
         outdir		= "NoSuch";	// prevent overwriting real dir
         script		= NULL;
         exenam		= "ptest";
+        hist		= NULL;
         zmin		= 0;
         zmax		= 32768;
+        jobs		= false;
+        balance		= false;
+        spec		= false;
     };
 
     void SetCmdLine( int argc, char* argv[] );
@@ -111,6 +171,8 @@ static FILE*		flog	= NULL;
 static char			xmlprms[256]	= {0};
 static int			gW		= 0,	// universal pic dims
                     gH		= 0;
+static map<int,int>	gNR;			// layer tile id -> nrgns
+static map<IDPair,double>	gHist;	// layer (ida,idb) -> sec
 
 
 
@@ -163,6 +225,14 @@ void CArgs_scr::SetCmdLine( int argc, char* argv[] )
             idb=pchar;
         else if( GetArgStr( exenam, "-exe=", argv[i] ) )
             ;
+        else if( GetArgStr( hist, "-hist=", argv[i] ) )
+            ;
+        else if( IsArg( "-jobs", argv[i] ) )
+            jobs = true;
+        else if( IsArg( "-balance", argv[i] ) )
+            balance = true;
+        else if( IsArg( "-spec", argv[i] ) )
+            spec = true;
         else if( GetArgList( vi, "-z=", argv[i] ) ) {
 
             if( 2 == vi.size() ) {
@@ -545,6 +615,72 @@ static void WriteDSubNFile()
     FileScriptPerms( buf );
 }
 
+/* --------------------------------------------------------------- */
+/* WriteSubQFiles ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void _WriteSubQFile( const char *path, int SD )
+{
+    const char	*sd = (SD == 'S' ? "same" : "down");
+    FILE		*f = FileOpenOrDie( path, "w", flog );
+
+    fprintf( f, "#!/bin/sh\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "# Purpose:\n" );
+    fprintf( f, "# For layer range, queue all jobs.%s on a ptest spool.\n", sd );
+    fprintf( f, "# Workers started as 'ptest -spool=<spool>' run the queued\n" );
+    fprintf( f, "# pairs in-process, keeping their caches warm between pairs.\n" );
+    fprintf( f, "# Options that make rules take via EXTRA go on the worker\n" );
+    fprintf( f, "# command line instead: 'ptest -spool=<spool> [options]'.\n" );
+    fprintf( f, "#\n" );
+    fprintf( f, "# > ./%ssubq.sht <spool> <zmin> [zmax]\n", (SD == 'S' ? "s" : "d") );
+    fprintf( f, "\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "spool=$1\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "if (($# == 2))\n" );
+    fprintf( f, "then\n" );
+    fprintf( f, "\tlast=$2\n" );
+    fprintf( f, "else\n" );
+    fprintf( f, "\tlast=$3\n" );
+    fprintf( f, "fi\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "mkdir -p $spool/tmp $spool/new\n" );
+    fprintf( f, "\n" );
+    fprintf( f, "for lyr in $(seq $2 $last)\n" );
+    fprintf( f, "do\n" );
+    fprintf( f, "\techo $lyr\n" );
+    fprintf( f, "\tif [ -d \"$lyr\" ]\n" );
+    fprintf( f, "\tthen\n" );
+    fprintf( f, "\t\tfor jb in $(ls -d $lyr/* | grep -E '%c[0-9]{1,}_[0-9]{1,}')\n", SD );
+    fprintf( f, "\t\tdo\n" );
+    fprintf( f, "\t\t\tif [ -e $jb/jobs.%s ]\n", sd );
+    fprintf( f, "\t\t\tthen\n" );
+    fprintf( f, "\t\t\t\tnm=${lyr}_$(basename $jb).%s\n", sd );
+    fprintf( f, "\t\t\t\tcp $jb/jobs.%s $spool/tmp/$nm\n", sd );
+    fprintf( f, "\t\t\t\tmv $spool/tmp/$nm $spool/new/$nm\n" );
+    fprintf( f, "\t\t\tfi\n" );
+    fprintf( f, "\t\tdone\n" );
+    fprintf( f, "\tfi\n" );
+    fprintf( f, "done\n" );
+    fprintf( f, "\n" );
+
+    fclose( f );
+    FileScriptPerms( path );
+}
+
+
+static void WriteSubQFiles()
+{
+    char	buf[2048];
+
+    sprintf( buf, "%s/ssubq.sht", gArgs.outdir );
+    _WriteSubQFile( buf, 'S' );
+
+    sprintf( buf, "%s/dsubq.sht", gArgs.outdir );
+    _WriteSubQFile( buf, 'D' );
+}
+
 /* --------------------------------------------------------------- */
 /* WriteReportFiles ---------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -885,6 +1021,12 @@ static void CreateTileSubdirs( const char *lyrdir, int is0, int isN )
 // Actually write the script to tell ptest to process the pairs
 // of images described by (P).
 //
+// With -spec each rule first claims its pair by creating dir
+// claim_za.ia^zb.ib, and quietly succeeds if another make owns
+// it, so two makes can share one block without running a pair
+// twice (points are appended to pts files). A failed pair drops
+// its claim so a rerun can retry it.
+//
 static void WriteMakeFile(
     const char			*lyrdir,
     int					SD,
@@ -905,6 +1047,9 @@ static void WriteMakeFile(
 
     f = FileOpenOrDie( name, "w", flog );
 
+    if( gArgs.spec )
+        fprintf( f, "# spec: pairs claimed via claim_ dirs\n\n" );
+
 // write 'all' targets line
 
     fprintf( f, "all: " );
@@ -933,18 +1078,243 @@ static void WriteMakeFile(
         "%d/%d.%d.map.tif:\n",
         A.id, B.z, B.id );
 
-        fprintf( f,
-        "\t%s >>%s 2>%s"
-        " %d.%d^%d.%d%s ${EXTRA}\n\n",
-        gArgs.exenam,
-        NamePtsFile( ptsbuf, A.z, B.z ),
-        NameLogFile( logbuf, A.z, A.id, B.z, B.id ),
+        if( !gArgs.spec ) {
+
+            fprintf( f,
+            "\t%s >>%s 2>%s"
+            " %d.%d^%d.%d%s ${EXTRA}\n\n",
+            gArgs.exenam,
+            NamePtsFile( ptsbuf, A.z, B.z ),
+            NameLogFile( logbuf, A.z, A.id, B.z, B.id ),
+            A.z, A.id, B.z, B.id, option_nf );
+        }
+        else {
+
+            char	clm[64];
+
+            sprintf( clm, "claim_%d.%d^%d.%d", A.z, A.id, B.z, B.id );
+
+            fprintf( f,
+            "\tmkdir %s 2>/dev/null || exit 0;"
+            " %s >>%s 2>%s"
+            " %d.%d^%d.%d%s ${EXTRA}"
+            " || { rmdir %s; exit 1; }\n\n",
+            clm,
+            gArgs.exenam,
+            NamePtsFile( ptsbuf, A.z, B.z ),
+            NameLogFile( logbuf, A.z, A.id, B.z, B.id ),
+            A.z, A.id, B.z, B.id, option_nf,
+            clm );
+        }
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* WriteJobsFile ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Like WriteMakeFile, but write a spool job list: the absolute
+// dir followed by one 'za.ia^zb.ib [options]' line per pair.
+// There is no ${EXTRA} here; instead, options given on the spool
+// worker's command line ('ptest -spool=<dir> [options]') are
+// appended to every pair it runs.
+//
+static void WriteJobsFile(
+    const char			*lyrdir,
+    int					ix,
+    int					iy,
+    const vector<Pair>	&P )
+{
+    char	name[2048],
+            dir[2048];
+    FILE	*f;
+    int		np = P.size();
+
+    sprintf( name, "%s/S%d_%d", lyrdir, ix, iy );
+    DskAbsPath( dir, sizeof(dir), name, flog );
+
+    sprintf( name, "%s/S%d_%d/jobs.same", lyrdir, ix, iy );
+    f = FileOpenOrDie( name, "w", flog );
+
+    fprintf( f, "DIR=%s\n", dir );
+
+    const char	*option_nf = (scr.usingfoldmasks ? "" : " -nf");
+
+    for( int i = 0; i < np; ++i ) {
+
+        const CUTile&	A = TS.vtil[P[i].a];
+        const CUTile&	B = TS.vtil[P[i].b];
+
+        fprintf( f, "%d.%d^%d.%d%s\n",
         A.z, A.id, B.z, B.id, option_nf );
     }
 
     fclose( f );
 }
 
+/* --------------------------------------------------------------- */
+/* WriteCostFile ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Record block's predicted cost for schedulers and reports:
+// 'COST npairs cost insec', cost in sec if insec, else in model
+// units.
+//
+static void WriteCostFile(
+    const char		*lyrdir,
+    int				ix,
+    int				iy,
+    const Block		&B,
+    bool			insec )
+{
+    char	name[2048];
+    FILE	*f;
+
+    sprintf( name, "%s/S%d_%d/cost.same", lyrdir, ix, iy );
+    f = FileOpenOrDie( name, "w", flog );
+
+    fprintf( f, "COST %d %.3f %d\n", (int)B.P.size(), B.Cost(), insec );
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* LoadRgnCounts ------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fill gNR with each tile's fold region count for layer z.
+//
+static void LoadRgnCounts( int z )
+{
+    gNR.clear();
+
+    if( !scr.usingfoldmasks )
+        return;
+
+    map<int,int>			m;
+    map<int,int>::iterator	it, nx;
+    int						n = IDBGetIDRgnMap( m, gArgs.idb, z, flog );
+
+// Map values are running region offsets: count is the gap
+
+    for( it = m.begin(); it != m.end(); it = nx ) {
+
+        nx = it;
+        ++nx;
+
+        gNR[it->first] = (nx != m.end() ? nx->second : n) - it->second;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* LoadHistory --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Fill gHist with ptest's own 'Total' time for each pair logged
+// in the S-dirs of layer z in the -hist workspace.
+//
+static void LoadHistory( int z )
+{
+    gHist.clear();
+
+    if( !gArgs.hist )
+        return;
+
+    char	lyr[2048];
+    DIR		*d;
+
+    sprintf( lyr, "%s/%d", gArgs.hist, z );
+
+    if( !(d = opendir( lyr )) ) {
+        fprintf( flog, "LoadHistory: Can't open [%s].\n", lyr );
+        return;
+    }
+
+    dirent	*e;
+
+    while( e = readdir( d ) ) {
+
+        int		ix, iy;
+        char	c;
+
+        if( 2 != sscanf( e->d_name, "S%d_%d%c", &ix, &iy, &c ) )
+            continue;
+
+        char	sdir[2048];
+        DIR		*s;
+
+        sprintf( sdir, "%s/%s", lyr, e->d_name );
+
+        if( !(s = opendir( sdir )) )
+            continue;
+
+        dirent	*p;
+
+        while( p = readdir( s ) ) {
+
+            int		za, ia, zb, ib, n = 0;
+            double	t;
+
+            if( 4 != sscanf( p->d_name, "pair_%d.%d^%d.%d%n",
+                        &za, &ia, &zb, &ib, &n ) ||
+                strcmp( p->d_name + n, ".log" ) ) {
+
+                continue;
+            }
+
+            char	name[2048];
+            FILE	*f;
+
+            sprintf( name, "%s/%s", sdir, p->d_name );
+
+            if( !(f = fopen( name, "r" )) )
+                continue;
+
+            CLineScan	LS;
+
+            while( LS.Get( f ) > 0 ) {
+
+                if( 1 == sscanf( LS.line, "Timer: Total took %lf", &t ) ) {
+                    gHist[IDPair( ia, ib )] = t;
+                    break;
+                }
+            }
+
+            fclose( f );
+        }
+
+        closedir( s );
+    }
+
+    closedir( d );
+
+    fprintf( flog, "LoadHistory: z %d, %d timed pairs.\n",
+    z, (int)gHist.size() );
+}
+
+/* --------------------------------------------------------------- */
+/* PairCost ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static int NRgn( int i )
+{
+    map<int,int>::iterator	it = gNR.find( TS.vtil[i].id );
+
+    return (it != gNR.end() && it->second > 0 ? it->second : 1);
+}
+
+
+// Model cost of matching tiles a, b: fixed load and setup part,
+// plus overlap area (fraction of a tile) worked once for each
+// pairing of their fold regions.
+//
+static double PairCost( int a, int b, double olap )
+{
+    return PAIRFIX + olap * NRgn( a ) * NRgn( b );
+}
+
 /* --------------------------------------------------------------- */
 /* OrientLayer --------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -1056,12 +1426,75 @@ void BlockSet::PartitionJobs( int is0, int isN )
                     continue;
             }
 
-            if( TS.ABOlap( a, b ) > scr.mintileolapfrac )
-                K[ix + kx*iy].P.push_back( Pair( a, b ) );
+            double	olap = TS.ABOlap( a, b );
+
+            if( olap > scr.mintileolapfrac ) {
+                K[ix + kx*iy].P.push_back(
+                    Pair( a, b, PairCost( a, b, olap ) ) );
+            }
         }
     }
 }
 
+/* --------------------------------------------------------------- */
+/* Calibrate ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// If history has times for some pairs, fit one sec-per-unit scale
+// for the layer and convert all pair costs to seconds, using the
+// measured time where there is one.
+//
+void BlockSet::Calibrate()
+{
+    insec = false;
+
+    if( gHist.empty() )
+        return;
+
+    double	su = 0, ss = 0;
+    int		nt = 0, np = 0;
+
+    for( int i = 0; i < nb; ++i ) {
+
+        const vector<Pair>	&P = K[i].P;
+
+        for( int j = 0, n = P.size(); j < n; ++j, ++np ) {
+
+            map<IDPair,double>::iterator	it = gHist.find(
+                IDPair( TS.vtil[P[j].a].id, TS.vtil[P[j].b].id ) );
+
+            if( it != gHist.end() ) {
+                su += P[j].cost;
+                ss += it->second;
+                ++nt;
+            }
+        }
+    }
+
+    if( su <= 0 )
+        return;
+
+    double	k = ss / su;
+
+    for( int i = 0; i < nb; ++i ) {
+
+        vector<Pair>	&P = K[i].P;
+
+        for( int j = 0, n = P.size(); j < n; ++j ) {
+
+            map<IDPair,double>::iterator	it = gHist.find(
+                IDPair( TS.vtil[P[j].a].id, TS.vtil[P[j].b].id ) );
+
+            P[j].cost = (it != gHist.end() ? it->second : k * P[j].cost);
+        }
+    }
+
+    insec = true;
+
+    fprintf( flog, "Calibrate: %d of %d pairs timed, %.3f sec/unit.\n",
+    nt, np, k );
+}
+
 /* --------------------------------------------------------------- */
 /* Consolidate --------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -1135,11 +1568,121 @@ void BlockSet::Consolidate()
     } while( changed );
 }
 
+/* --------------------------------------------------------------- */
+/* Balance ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Replace grid blocks with blocks of near-equal predicted cost.
+//
+// Cells are walked row by row, alternating direction, and pairs
+// ordered along that walk by a-tile center, so consecutive pairs
+// are neighbors. The walk is cut into runs of equal cost; each
+// run is named for the cell where it starts (or the next free
+// cell), keeping blocks compact and the S-dir names unique.
+//
+// Dense cells thus split and sparse ones merge, which replaces
+// Consolidate.
+//
+void BlockSet::Balance()
+{
+    vector<SerpKey>	vk;
+    vector<int>		walk( nb );
+    double			tot	= 0;
+    int				W2	= gW/2,
+                    H2	= gH/2,
+                    nc	= 0;
+
+    for( int iy = 0; iy < ky; ++iy ) {
+
+        for( int jx = 0; jx < kx; ++jx ) {
+
+            int	ix = (iy & 1 ? kx - 1 - jx : jx),
+                is = jx + kx*iy,
+                i  = ix + kx*iy,
+                n  = K[i].P.size();
+
+            walk[is] = i;
+
+            if( !n )
+                continue;
+
+            ++nc;
+
+            for( int j = 0; j < n; ++j ) {
+
+                Point	pa( W2, H2 );
+
+                TS.vtil[K[i].P[j].a].T.Transform( pa );
+
+                double	f = (pa.x - ix * dx) / dx;
+
+                f = fmax( 0.0, fmin( 0.999, f ) );
+
+                if( iy & 1 )
+                    f = 0.999 - f;
+
+                vk.push_back( SerpKey( is + f, i, j ) );
+                tot += K[i].P[j].cost;
+            }
+        }
+    }
+
+    int	np = vk.size();
+
+    if( !np )
+        return;
+
+    sort( vk.begin(), vk.end() );
+
+// Cut into nk runs
+
+    vector<Block>	J( nb );
+    vector<int>		used( nb, 0 );
+    double			acc	= 0,
+                    tgt;
+    int				nk	= min( nc, max( 1, np / (int)klowcount ) ),
+                    k	= 0,
+                    cur	= -1;
+
+    tgt = tot / nk;
+
+    for( int j = 0; j < np; ++j ) {
+
+        const Pair	&P = K[vk[j].ib].P[vk[j].ip];
+
+        if( cur >= 0 && k < nk - 1 && acc + P.cost/2 > (k + 1) * tgt ) {
+            ++k;
+            cur = -1;
+        }
+
+        if( cur < 0 ) {
+
+            int	is = int(vk[j].key);
+
+            while( is < nb && used[walk[is]] )
+                ++is;
+
+            if( is >= nb ) {
+                for( is = 0; used[walk[is]]; ++is )
+                    ;
+            }
+
+            cur = walk[is];
+            used[cur] = 1;
+        }
+
+        J[cur].P.push_back( P );
+        acc += P.cost;
+    }
+
+    K.swap( J );
+}
+
 /* --------------------------------------------------------------- */
 /* ReportBlocks -------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-// Print job count array.
+// Print job count and cost arrays.
 //
 void BlockSet::ReportBlocks( int z )
 {
@@ -1158,6 +1701,31 @@ void BlockSet::ReportBlocks( int z )
     }
 
     fprintf( flog, "Total = %d\n", njobs );
+
+    double	tot = 0, cmax = 0;
+    int		nk = 0;
+
+    fprintf( flog, "Cost(i,j) %s:\n", (insec ? "sec" : "units") );
+
+    for( int i = 0; i < nb; ++i ) {
+
+        int		iy = i / kx,
+                ix = i - kx * iy;
+        double	c  = K[i].Cost();
+
+        fprintf( flog, "%.1f%c", c, (ix == kx - 1 ? '\n' : '\t') );
+
+        if( K[i].P.size() ) {
+            tot += c;
+            cmax = fmax( cmax, c );
+            ++nk;
+        }
+    }
+
+    if( nk ) {
+        fprintf( flog, "Blocks %d, max/mean cost %.2f\n",
+        nk, cmax * nk / tot );
+    }
 }
 
 /* --------------------------------------------------------------- */
@@ -1169,7 +1737,13 @@ void BlockSet::CarveIntoBlocks( int is0, int isN )
     OrientLayer( is0, isN );
     SetDims();
     PartitionJobs( is0, isN );
-    Consolidate();
+    Calibrate();
+
+    if( gArgs.balance )
+        Balance();
+    else
+        Consolidate();
+
     ReportBlocks( TS.vtil[is0].z );
 }
 
@@ -1187,7 +1761,13 @@ void BlockSet::MakeJobs( const char *lyrdir, int z )
                 ix = i - kx * iy;
 
             CreateJobsDir( lyrdir, ix, iy, z, z, flog );
-            WriteMakeFile( lyrdir, 'S', ix, iy, K[i].P );
+
+            if( gArgs.jobs )
+                WriteJobsFile( lyrdir, ix, iy, K[i].P );
+            else
+                WriteMakeFile( lyrdir, 'S', ix, iy, K[i].P );
+
+            WriteCostFile( lyrdir, ix, iy, K[i], insec );
         }
     }
 }
@@ -1215,6 +1795,9 @@ static void ForEachLayer()
         if( scr.createauxdirs )
             CreateTileSubdirs( lyrdir, is0, isN );
 
+        LoadRgnCounts( z );
+        LoadHistory( z );
+
         BS.CarveIntoBlocks( is0, isN );
         BS.MakeJobs( lyrdir, z );
 
@@ -1283,6 +1866,10 @@ int main( int argc, char* argv[] )
     WriteCountsamedirsFile();
     WriteSSubNFile();
     WriteDSubNFile();
+
+    if( gArgs.jobs )
+        WriteSubQFiles();
+
     WriteReportFiles();
     WriteMSubFile();
     WriteMReportFile();
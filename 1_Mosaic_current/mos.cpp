@@ -5,6 +5,7 @@
 #include	"Cmdline.h"
 #include	"Disk.h"
 #include	"File.h"
+#include	"FoldMask.h"
 #include	"PipeFiles.h"
 #include	"LinEqu.h"
 #include	"ImageIO.h"
@@ -1597,67 +1598,62 @@ return -2 - x/y;
 /* FillInHolesInFoldmap ------------------------------------------ */
 /* --------------------------------------------------------------- */
 
-// We consider every 0 in the foldmap, and decide whether to
-// fill it in. We will change each 0 to 255 as we examine it
-// so we only see it once. After we see each hole, we will
-// either fill it in, or add it to the list of 0s to be
-// restored at the end. Basic idea is to expand out through
-// each 0 area, and see what we hit. If we hit only one thing
-// then it's a hole. If one thing and the boundary, also fill
-// it in. Two different things, then it's a gap between two
-// patches; leave it a hole.
+// We consider every 0 area in the foldmap, and decide whether to
+// fill it in. The 0 areas are found by connected-component
+// labelling (one pass over run-lengths, no per-pixel stack),
+// then one more pass over the pixels records what each area
+// touches. If an area hits only one thing then it's a hole.
+// If one thing and the boundary, also fill it in. Two different
+// things, then it's a gap between two patches; leave it a hole.
+// As before, values 255 are ignored as neighbors.
 //
 static void FillInHolesInFoldmap( uint8 *map, uint32 w, uint32 h )
 {
 uint32 np = w*h;  // number of pixels
-int start = 0;
-vector<int> setback;  // pixels we will set back to 0 when we are done
-int nholes = 0;
-for(int i=start; i < np; i++) {
-    if( map[i] == 0 ) {
-    start = i;  // so next time resume here
-    stack<int> st;
-    st.push(i);
-    vector<int> boundary( 257, 0 );	// histogram of what we hit.
-        vector<int> pixels; // 0 valued pixels in this area
-    while( !st.empty() ) {
-        int j = st.top(); st.pop();
-            if( map[j] == 0 ) {
-            map[j] = 255;  // so we won't get it again
-                pixels.push_back(j);
-            int y = j / w;
-            int x = j - w * y;
-            if( x-1 >= 0 ) st.push(j-1); else boundary[256]++;
-            if( x+1 <  w ) st.push(j+1); else boundary[256]++;
-            if( y-1 >= 0 ) st.push(j-w); else boundary[256]++;
-            if( y+1 <  h ) st.push(j+w); else boundary[256]++;
-        }
-            else {// map value is not 0, add what we ran into to the set of boundary values
-        if( map[j] != 255 ) boundary[map[j]]++;
-        }
-        }
-        // how many different things did we hit?  And what was one of them?
-        int howmany = 0, what = 0;
-        for( int k = 0; k < 256; ++k ) {
-        if( boundary[k] != 0 ) {
-            howmany++;
-            what = k;
+vector<int> lbl;  // 0 area id of each pixel, or 0
+int nareas;
+    {
+    vector<uint8> zero( np );
+    for(int i=0; i < np; i++)
+        zero[i] = (map[i] == 0);
+    nareas = LabelConnected( lbl, &zero[0], w, h );
+    }
+// what[k] is the one value area k has hit so far: 0 = none yet, -1 = several
+vector<int> what( nareas + 1, 0 );
+for(int y=0; y < h; y++) {
+    for(int x=0; x < w; x++) {
+    int i = x + w*y;
+    int k = lbl[i];
+    if( !k || what[k] < 0 )
+        continue;
+    int nbr[4], nn = 0;
+    if( x-1 >= 0 ) nbr[nn++] = map[i-1];
+    if( x+1 <  w ) nbr[nn++] = map[i+1];
+    if( y-1 >= 0 ) nbr[nn++] = map[i-w];
+    if( y+1 <  h ) nbr[nn++] = map[i+w];
+    for(int j=0; j < nn; j++) {
+        int v = nbr[j];
+        if( v == 0 || v == 255 )
+        continue;
+        if( !what[k] )
+        what[k] = v;
+        else if( what[k] != v ) {
+        what[k] = -1;
+        break;
         }
         }
-        if( howmany == 1 ) {	// then we have a hole, or a gap starting at a boundary
-        for( int k = 0; k < pixels.size(); ++k )
-            map[pixels[k]] = what;
+    }
+    }
+int nholes = 0;
+for(int k=1; k <= nareas; k++) {
+    if( what[k] > 0 )
         nholes++;
-        }
-    else { // not a pure hole.  record pixel values to set back later
-            for(int k=0; k<pixels.size(); k++)
-        setback.push_back(pixels[k]);
-         }
     }
+for(int i=0; i < np; i++) {
+    int k = lbl[i];
+    if( k && what[k] > 0 )
+        map[i] = what[k];
     }
-// OK, reset all those we decided not to fill in
-for(int k=0; k<setback.size(); k++)
-    map[setback[k]] = 0;
 printf("Filled in %d holes\n", nholes);
 }
 
@@ -3257,7 +3253,7 @@ for(int out_layer = lowest; out_layer <= highest; out_layer++) {  //keep going u
             file_name = string( images[i].GetFName() );
             else
                     file_name = string( gArgs.fold_dir ) + "/" +string(images[i].GetFName());  //pre-pend the fold directory name
-        images[i].foldmap = Raster8FromAny( file_name.c_str(), ww, hh );
+        images[i].foldmap = LoadFoldMask( file_name.c_str(), ww, hh );
                 ImageResize( images[i].foldmap, ww, hh, gArgs.scale );
         FillInHolesInFoldmap( images[i].foldmap, w, h );
         FoldmapRenumber( images[i] );
@@ -0,0 +1,1027 @@
+//
+// Measure what a faster (or just different) matchparams file
+// costs in accuracy: run ptest on a sample of real pairs from a
+// workspace once with each of two parameter files, and compare
+// the results pair by pair.
+//
+// > prmbench temp0 -prmA=matchparams.txt -prmB=fast.txt [options]
+//
+// Required:
+// temp0				;workspace (from makemontages) to sample
+// -prmA=path			;reference matchparams file
+// -prmB=path			;candidate matchparams file
+//
+// Options:
+// -z=i,j				;sample layers i..j, default all
+// -n=20				;number of pairs to sample
+// -seed=1				;same seed, same sample
+// -same				;only same-layer pairs (S-dirs)
+// -down				;only cross-layer pairs (D-dirs)
+// -tol=2				;displacement (px) that counts as a miss
+// -d=prmbench_wk		;scratch dir for the runs
+// -extra="-olaproi"	;added to every ptest call, like ${EXTRA}
+//
+// Pairs come from the make.same, make.down and jobs.same lists
+// under the workspace, with the same ptest options they have
+// there. Each preset gets a ptestx-like scratch workspace under
+// -d (A and B) with the workspace's imageparams.txt and its own
+// matchparams.txt; each pair's points and log stay there.
+//
+// Pairs run one at a time so times are comparable. The preset
+// run first alternates from pair to pair so neither gets all
+// the warm page cache.
+//
+// Per pair and preset we record ptest's own Total time, outcome
+// (ok, nomatch = no points, crash = no normal completion), the
+// CPOINT2 points, thumbnail R ('Approx: Returning') and mesh
+// corr ('STAT: Overall'), and FAIL: reasons. When both presets
+// match, an affine is fit to each one's points per region pair,
+// and the displacement |TA(p) - TB(p)| is taken over the A-side
+// points of both sets: mean and max, in full-res pixels.
+//
+// Writes prmbench.txt (parameters that differ, per pair table,
+// summary) and prmbench.log; prints a one-line summary.
+//
+// Tip: giving the same file twice shows run-to-run time noise.
+//
+
+
+#include	"Cmdline.h"
+#include	"Disk.h"
+#include	"File.h"
+#include	"LinEqu.h"
+#include	"PipeFiles.h"
+#include	"Timer.h"
+
+#include	<dirent.h>
+#include	<math.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<algorithm>
+#include	<map>
+#include	<set>
+#include	<string>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Constants ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+enum { eOK, eNoMatch, eCrash };
+
+static const char	*stName[3] = {"ok", "nomatch", "crash"};
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Point pairs of one region pair (A side, B side)
+
+class RgnPts {
+public:
+    vector<Point>	a, b;
+};
+
+
+// One ptest run
+
+class Run {
+public:
+    map<string,RgnPts>	rgn;	// key "ra-rb"
+    vector<string>		fail;	// FAIL: reasons
+    double				sec, rthm, rmsh;
+    int					st, npts, nthm, nmsh;
+public:
+    Run()
+    : sec(0), rthm(0), rmsh(0),
+      st(eCrash), npts(0), nthm(0), nmsh(0) {};
+};
+
+
+class Pair {
+public:
+    int		za, ia, zb, ib;
+    string	opts;			// ptest options from workspace
+    Run		R[2];			// per preset
+    double	dmean, dmax;	// displacement, -1 = n/a
+public:
+    Pair() : dmean(-1), dmax(-1) {};
+
+    bool operator < ( const Pair &rhs ) const
+        {
+            if( za != rhs.za ) return za < rhs.za;
+            if( zb != rhs.zb ) return zb < rhs.zb;
+            if( ia != rhs.ia ) return ia < rhs.ia;
+            return ib < rhs.ib;
+        };
+
+    string Label() const
+        {
+            char	buf[64];
+            sprintf( buf, "%d.%d^%d.%d", za, ia, zb, ib );
+            return buf;
+        };
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_pbn ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_pbn {
+
+public:
+    char		wk[2048],
+                prm[2][2048],
+                out[2048];
+    const char	*extra;
+    double		tol;
+    int			zlo, zhi,
+                n, seed;
+    bool		same, down;
+
+public:
+    CArgs_pbn()
+    : extra(""), tol(2.0),
+      zlo(0), zhi(-1),
+      n(20), seed(1),
+      same(true), down(true)
+    {
+        wk[0]		= 0;
+        prm[0][0]	= 0;
+        prm[1][0]	= 0;
+        out[0]		= 0;
+    };
+
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static CArgs_pbn	gArgs;
+static FILE*		flog	= NULL;
+static vector<Pair>	vP;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_pbn::SetCmdLine( int argc, char* argv[] )
+{
+// start log
+
+    flog = FileOpenOrDie( "prmbench.log", "w" );
+
+// log start time
+
+    time_t	t0 = time( NULL );
+    char	atime[32];
+
+    strcpy( atime, ctime( &t0 ) );
+    atime[24] = '\0';	// remove the newline
+
+    fprintf( flog, "Start: %s ", atime );
+
+// parse command line args
+
+    if( argc < 4 ) {
+usage:
+        printf( "Usage: prmbench <workspace>"
+        " -prmA=path -prmB=path [options].\n" );
+        exit( 42 );
+    }
+
+    const char	*_arg;
+    vector<int>	vi;
+    bool		onlyS = false, onlyD = false, ok = true;
+
+    for( int i = 1; i < argc; ++i ) {
+
+        // echo to log
+        fprintf( flog, "%s ", argv[i] );
+
+        if( argv[i][0] != '-' )
+            ok = DskAbsPath( wk, sizeof(wk), argv[i], flog );
+        else if( GetArgStr( _arg, "-prmA=", argv[i] ) )
+            ok = DskAbsPath( prm[0], sizeof(prm[0]), _arg, flog );
+        else if( GetArgStr( _arg, "-prmB=", argv[i] ) )
+            ok = DskAbsPath( prm[1], sizeof(prm[1]), _arg, flog );
+        else if( GetArgStr( _arg, "-d=", argv[i] ) )
+            ok = DskAbsPath( out, sizeof(out), _arg, flog );
+        else if( GetArgStr( extra, "-extra=", argv[i] ) )
+            ;
+        else if( GetArgList( vi, "-z=", argv[i] ) ) {
+
+            if( 2 == vi.size() ) {
+                zlo = vi[0];
+                zhi = vi[1];
+            }
+            else {
+                fprintf( flog, "Bad format in -z [%s].\n", argv[i] );
+                exit( 42 );
+            }
+        }
+        else if( GetArg( &n, "-n=%d", argv[i] ) )
+            ;
+        else if( GetArg( &seed, "-seed=%d", argv[i] ) )
+            ;
+        else if( GetArg( &tol, "-tol=%lf", argv[i] ) )
+            ;
+        else if( IsArg( "-same", argv[i] ) )
+            onlyS = true;
+        else if( IsArg( "-down", argv[i] ) )
+            onlyD = true;
+        else {
+            printf( "Did not understand option '%s'.\n", argv[i] );
+            exit( 42 );
+        }
+
+        if( !ok ) {
+            fprintf( flog, "\nBad arg path '%s'.\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    fprintf( flog, "\n\n" );
+
+    if( !wk[0] || !prm[0][0] || !prm[1][0] )
+        goto usage;
+
+    if( !out[0] )
+        DskAbsPath( out, sizeof(out), "prmbench_wk", flog );
+
+    if( onlyS || onlyD ) {
+        same = onlyS;
+        down = onlyD;
+    }
+
+    fflush( flog );
+}
+
+/* --------------------------------------------------------------- */
+/* ParamDiffs ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void ReadPrms( map<string,string> &m, const char *path )
+{
+    FILE		*f = FileOpenOrDie( path, "r", flog );
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        char	kv[256], *e;
+
+        if( LS.line[0] == '#' || 1 != sscanf( LS.line, "%255s", kv ) )
+            continue;
+
+        if( e = strchr( kv, '=' ) ) {
+            *e = 0;
+            m[kv] = e + 1;
+        }
+    }
+
+    fclose( f );
+}
+
+
+// List parameters whose values differ between the presets.
+//
+static void ParamDiffs( FILE *f )
+{
+    map<string,string>	m[2];
+    set<string>			keys;
+
+    for( int ip = 0; ip < 2; ++ip ) {
+
+        ReadPrms( m[ip], gArgs.prm[ip] );
+
+        map<string,string>::iterator	it;
+
+        for( it = m[ip].begin(); it != m[ip].end(); ++it )
+            keys.insert( it->first );
+    }
+
+    fprintf( f, "Preset A: %s\n", gArgs.prm[0] );
+    fprintf( f, "Preset B: %s\n\n", gArgs.prm[1] );
+    fprintf( f, "Parameters that differ (A -> B):\n" );
+
+    int	nd = 0;
+
+    for( set<string>::iterator it = keys.begin(); it != keys.end(); ++it ) {
+
+        const char	*va = "-", *vb = "-";
+
+        if( m[0].count( *it ) )
+            va = m[0][*it].c_str();
+
+        if( m[1].count( *it ) )
+            vb = m[1][*it].c_str();
+
+        if( strcmp( va, vb ) ) {
+            fprintf( f, "\t%-16s %s -> %s\n", it->c_str(), va, vb );
+            ++nd;
+        }
+    }
+
+    if( !nd )
+        fprintf( f, "\tnone\n" );
+
+    fprintf( f, "\n" );
+}
+
+/* --------------------------------------------------------------- */
+/* SamplePairs --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add the pairs listed in a make.same, make.down or jobs.same
+// file. A pair is a word 'za.ia^zb.ib'; the '-' words after it
+// (up to ${EXTRA} or the end) are its ptest options.
+//
+static void ScanList( const char *path )
+{
+    FILE	*f = fopen( path, "r" );
+
+    if( !f )
+        return;
+
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        char	*s = strtok( LS.line, " \t\n" );
+        Pair	P;
+        bool	got = false;
+
+        for( ; s; s = strtok( NULL, " \t\n" ) ) {
+
+            char	c;
+
+            if( !got ) {
+                got = (4 == sscanf( s, "%d.%d^%d.%d%c",
+                        &P.za, &P.ia, &P.zb, &P.ib, &c ));
+            }
+            else if( s[0] == '-' ) {
+                P.opts += ' ';
+                P.opts += s;
+            }
+            else
+                break;
+        }
+
+        if( got )
+            vP.push_back( P );
+    }
+
+    fclose( f );
+}
+
+
+// Collect all pairs in layer range, then keep a seeded random
+// sample of n of them.
+//
+static void SamplePairs()
+{
+    DIR		*d = opendir( gArgs.wk );
+    dirent	*e;
+
+    if( !d ) {
+        fprintf( flog, "SamplePairs: Can't open [%s].\n", gArgs.wk );
+        exit( 42 );
+    }
+
+    while( e = readdir( d ) ) {
+
+        int		z;
+        char	c;
+
+        if( 1 != sscanf( e->d_name, "%d%c", &z, &c ) )
+            continue;
+
+        if( z < gArgs.zlo || (gArgs.zhi >= 0 && z > gArgs.zhi) )
+            continue;
+
+        char	lyr[2048];
+        DIR		*l;
+        dirent	*b;
+
+        sprintf( lyr, "%s/%d", gArgs.wk, z );
+
+        if( !(l = opendir( lyr )) )
+            continue;
+
+        while( b = readdir( l ) ) {
+
+            int		ix, iy;
+            char	name[2048];
+
+            if( 2 != sscanf( b->d_name + 1, "%d_%d%c", &ix, &iy, &c ) )
+                continue;
+
+            if( b->d_name[0] == 'S' && gArgs.same ) {
+                sprintf( name, "%s/%s/make.same", lyr, b->d_name );
+                ScanList( name );
+                sprintf( name, "%s/%s/jobs.same", lyr, b->d_name );
+                ScanList( name );
+            }
+            else if( b->d_name[0] == 'D' && gArgs.down ) {
+                sprintf( name, "%s/%s/make.down", lyr, b->d_name );
+                ScanList( name );
+            }
+        }
+
+        closedir( l );
+    }
+
+    closedir( d );
+
+// Unique, in order, so the seed alone picks the sample
+
+    sort( vP.begin(), vP.end() );
+
+    int	nall = 0;
+
+    for( int i = 0, n = vP.size(); i < n; ++i ) {
+
+        if( !nall || vP[nall - 1] < vP[i] )
+            vP[nall++] = vP[i];
+    }
+
+    vP.resize( nall );
+
+    fprintf( flog, "SamplePairs: %d pairs in range.\n", nall );
+
+    if( !nall ) {
+        printf( "No pairs found under [%s].\n", gArgs.wk );
+        exit( 42 );
+    }
+
+// Partial Fisher-Yates
+
+    int	ns = min( gArgs.n, nall );
+
+    srand( gArgs.seed );
+
+    for( int i = 0; i < ns; ++i )
+        swap( vP[i], vP[i + rand() % (nall - i)] );
+
+    vP.resize( ns );
+    sort( vP.begin(), vP.end() );
+}
+
+/* --------------------------------------------------------------- */
+/* MakeWorkspaces ------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// ptestx-like tree per preset: imageparams.txt, matchparams.txt
+// and for each pair: layer, tile and job dirs with ThmPair file.
+//
+static void MakeWorkspaces()
+{
+    char	buf[4096];
+
+    DskCreateDir( gArgs.out, flog );
+
+    for( int ip = 0; ip < 2; ++ip ) {
+
+        char	top[2048];
+
+        sprintf( top, "%s/%c", gArgs.out, 'A' + ip );
+        sprintf( buf, "rm -rf %s", top );
+        system( buf );
+        DskCreateDir( top, flog );
+
+        sprintf( buf, "cp %s/imageparams.txt %s", gArgs.wk, top );
+        system( buf );
+
+        sprintf( buf, "cp %s %s/matchparams.txt", gArgs.prm[ip], top );
+        system( buf );
+
+        set<pair<int,int> >	made;
+
+        for( int i = 0, n = vP.size(); i < n; ++i ) {
+
+            const Pair	&P = vP[i];
+
+            sprintf( buf, "%s/%d", top, P.za );
+            DskCreateDir( buf, flog );
+
+            if( made.insert( pair<int,int>( P.za, P.zb ) ).second )
+                CreateJobsDir( buf, 0, 0, P.za, P.zb, flog );
+
+            sprintf( buf, "%s/%d/%d", top, P.za, P.ia );
+            DskCreateDir( buf, flog );
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* RunPtest ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void JobDir( char *buf, int ip, const Pair &P )
+{
+    sprintf( buf, "%s/%c/%d/%c0_0",
+        gArgs.out, 'A' + ip, P.za, (P.za == P.zb ? 'S' : 'D') );
+}
+
+
+// Run pair with preset ip and parse its log and points.
+//
+static void RunPtest( Pair &P, int ip )
+{
+    Run		&R = P.R[ip];
+    string	lbl = P.Label();
+    char	dir[2048], buf[4096], name[2048];
+
+    JobDir( dir, ip, P );
+
+    sprintf( buf, "cd %s && ptest >pair_%s.pts 2>pair_%s.log %s%s %s",
+        dir, lbl.c_str(), lbl.c_str(),
+        lbl.c_str(), P.opts.c_str(), gArgs.extra );
+
+    fprintf( flog, "%s\n", buf );
+    fflush( flog );
+
+    double	t0 = WallSec();
+
+    system( buf );
+
+    R.sec = WallSec() - t0;
+
+// Log
+
+    bool	done = false;
+    FILE	*f;
+
+    sprintf( name, "%s/pair_%s.log", dir, lbl.c_str() );
+
+    if( f = fopen( name, "r" ) ) {
+
+        CLineScan	LS;
+
+        while( LS.Get( f ) > 0 ) {
+
+            double	v, a;
+            int		np;
+
+            if( 1 == sscanf( LS.line, "Timer: Total took %lf", &v ) )
+                R.sec = v;
+            else if( 2 == sscanf( LS.line,
+                        "Approx: Returning A=%lf, R=%lf", &a, &v ) ) {
+
+                R.rthm += v;
+                ++R.nthm;
+            }
+            else if( 2 == sscanf( LS.line,
+                        "STAT: Overall %d points, corr %lf", &np, &v ) ) {
+
+                R.rmsh += v;
+                ++R.nmsh;
+            }
+            else if( !strncmp( LS.line, "FAIL: ", 6 ) ) {
+
+                // reason: text up to next ':' or '-'
+
+                string	s = LS.line + 6;
+                int		k = s.find_first_of( ":-\n" );
+
+                if( k != string::npos )
+                    s = s.substr( 0, k );
+
+                while( s.size() && s[s.size() - 1] == ' ' )
+                    s.erase( s.size() - 1 );
+
+                R.fail.push_back( s );
+            }
+            else if( !strncmp( LS.line, "main: Normal completion", 23 ) )
+                done = true;
+        }
+
+        fclose( f );
+    }
+
+    if( R.nthm )
+        R.rthm /= R.nthm;
+
+    if( R.nmsh )
+        R.rmsh /= R.nmsh;
+
+// Points
+
+    sprintf( name, "%s/pair_%s.pts", dir, lbl.c_str() );
+
+    if( f = fopen( name, "r" ) ) {
+
+        CLineScan	LS;
+
+        while( LS.Get( f ) > 0 ) {
+
+            Point	a, b;
+            int		z1, i1, r1, z2, i2, r2;
+
+            if( 10 != sscanf( LS.line,
+                    "CPOINT2 %d.%d-%d %lf %lf %d.%d-%d %lf %lf",
+                    &z1, &i1, &r1, &a.x, &a.y,
+                    &z2, &i2, &r2, &b.x, &b.y ) ) {
+
+                continue;
+            }
+
+            sprintf( buf, "%d-%d", r1, r2 );
+
+            RgnPts	&G = R.rgn[buf];
+
+            G.a.push_back( a );
+            G.b.push_back( b );
+            ++R.npts;
+        }
+
+        fclose( f );
+    }
+
+    R.st = (!done ? eCrash : (R.npts ? eOK : eNoMatch));
+
+    fprintf( flog, "%s %c: %s %.2f s, %d pts.\n",
+        lbl.c_str(), 'A' + ip, stName[R.st], R.sec, R.npts );
+}
+
+/* --------------------------------------------------------------- */
+/* Compare ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Least squares affine a -> b; false if too few points.
+//
+// T is {x: t0 t1 t2, y: t3 t4 t5} about origin (cx,cy) for
+// conditioning; apply with Apply().
+//
+static bool FitAff(
+    double			T[6],
+    Point			&c,
+    const RgnPts	&G )
+{
+    int	n = G.a.size();
+
+    if( n < 3 )
+        return false;
+
+    c = Point( 0, 0 );
+
+    for( int i = 0; i < n; ++i ) {
+        c.x += G.a[i].x;
+        c.y += G.a[i].y;
+    }
+
+    c.x /= n;
+    c.y /= n;
+
+    double	LHS[9], RX[3], RY[3];
+
+    memset( LHS, 0, sizeof(LHS) );
+    memset( RX, 0, sizeof(RX) );
+    memset( RY, 0, sizeof(RY) );
+
+    for( int i = 0; i < n; ++i ) {
+
+        double	v[3] = {G.a[i].x - c.x, G.a[i].y - c.y, 1};
+
+        for( int r = 0; r < 3; ++r ) {
+
+            for( int k = 0; k < 3; ++k )
+                LHS[3*r+k] += v[r] * v[k];
+
+            RX[r] += v[r] * G.b[i].x;
+            RY[r] += v[r] * G.b[i].y;
+        }
+    }
+
+    double	L2[9];
+
+    memcpy( L2, LHS, sizeof(LHS) );
+
+    if( !Solve_Quick( LHS, RX, 3 ) || !Solve_Quick( L2, RY, 3 ) )
+        return false;
+
+    memcpy( T, RX, 3*sizeof(double) );
+    memcpy( T + 3, RY, 3*sizeof(double) );
+
+    return true;
+}
+
+
+static Point Apply( const double T[6], const Point &c, const Point &p )
+{
+    double	u = p.x - c.x, v = p.y - c.y;
+
+    return Point( T[0]*u + T[1]*v + T[2], T[3]*u + T[4]*v + T[5] );
+}
+
+
+// Displacement between the presets' fitted affines, over the
+// A-side points of both, for region pairs both matched.
+//
+static void Compare( Pair &P )
+{
+    const Run	&A = P.R[0], &B = P.R[1];
+
+    if( A.st != eOK || B.st != eOK )
+        return;
+
+    double	sum = 0, big = 0;
+    int		n = 0;
+
+    map<string,RgnPts>::const_iterator	ia, ib;
+
+    for( ia = A.rgn.begin(); ia != A.rgn.end(); ++ia ) {
+
+        if( (ib = B.rgn.find( ia->first )) == B.rgn.end() )
+            continue;
+
+        double	TA[6], TB[6];
+        Point	ca, cb;
+
+        if( !FitAff( TA, ca, ia->second ) || !FitAff( TB, cb, ib->second ) )
+            continue;
+
+        for( int is = 0; is < 2; ++is ) {
+
+            const vector<Point>	&pa =
+                (is ? ib->second.a : ia->second.a);
+
+            for( int i = 0, np = pa.size(); i < np; ++i ) {
+
+                Point	qa = Apply( TA, ca, pa[i] ),
+                        qb = Apply( TB, cb, pa[i] );
+                double	d = qa.Dist( qb );
+
+                sum += d;
+                big = max( big, d );
+                ++n;
+            }
+        }
+    }
+
+    if( n ) {
+        P.dmean	= sum / n;
+        P.dmax	= big;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* Report -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static double Median( vector<double> v )
+{
+    int	n = v.size();
+
+    if( !n )
+        return 0;
+
+    sort( v.begin(), v.end() );
+
+    return (n & 1 ? v[n/2] : 0.5 * (v[n/2 - 1] + v[n/2]));
+}
+
+
+static void Report()
+{
+    FILE	*f = FileOpenOrDie( "prmbench.txt", "w", flog );
+    int		np = vP.size();
+
+    fprintf( f, "Workspace: %s\n", gArgs.wk );
+    ParamDiffs( f );
+
+// Per pair
+
+    fprintf( f,
+    "%-24s %-7s %8s %6s %6s %6s  %-7s %8s %6s %6s %6s %8s %8s\n",
+    "pair",
+    "A", "sec", "pts", "Rthm", "Rmsh",
+    "B", "sec", "pts", "Rthm", "Rmsh",
+    "dmean", "dmax" );
+
+    for( int i = 0; i < np; ++i ) {
+
+        const Pair	&P = vP[i];
+
+        fprintf( f, "%-24s", P.Label().c_str() );
+
+        for( int ip = 0; ip < 2; ++ip ) {
+
+            const Run	&R = P.R[ip];
+
+            fprintf( f, " %-7s %8.2f %6d %6.3f %6.3f ",
+                stName[R.st], R.sec, R.npts, R.rthm, R.rmsh );
+        }
+
+        if( P.dmax >= 0 ) {
+            fprintf( f, "%8.2f %8.2f%s\n", P.dmean, P.dmax,
+                (P.dmax > gArgs.tol ? "  *" : "") );
+        }
+        else
+            fprintf( f, "%8s %8s\n", "-", "-" );
+    }
+
+// Per preset
+
+    vector<double>	sec[2];
+    map<string,int>	why[2];
+    double			tot[2] = {0,0}, rthm[2] = {0,0}, rmsh[2] = {0,0},
+                    pts[2] = {0,0};
+    int				nst[2][3], nthm[2] = {0,0}, nmsh[2] = {0,0};
+
+    memset( nst, 0, sizeof(nst) );
+
+    for( int i = 0; i < np; ++i ) {
+
+        for( int ip = 0; ip < 2; ++ip ) {
+
+            const Run	&R = vP[i].R[ip];
+
+            ++nst[ip][R.st];
+            sec[ip].push_back( R.sec );
+            tot[ip] += R.sec;
+            pts[ip] += R.npts;
+
+            if( R.nthm ) {
+                rthm[ip] += R.rthm;
+                ++nthm[ip];
+            }
+
+            if( R.nmsh ) {
+                rmsh[ip] += R.rmsh;
+                ++nmsh[ip];
+            }
+
+            for( int k = 0, nk = R.fail.size(); k < nk; ++k )
+                ++why[ip][R.fail[k]];
+        }
+    }
+
+    fprintf( f, "\n%-18s %12s %12s\n", "", "A", "B" );
+    fprintf( f, "%-18s %12d %12d\n", "pairs", np, np );
+
+    for( int k = 0; k < 3; ++k ) {
+        fprintf( f, "%-18s %12d %12d\n",
+            stName[k], nst[0][k], nst[1][k] );
+    }
+
+    fprintf( f, "%-18s %12.1f %12.1f\n", "total sec", tot[0], tot[1] );
+    fprintf( f, "%-18s %12.2f %12.2f\n", "median sec",
+        Median( sec[0] ), Median( sec[1] ) );
+    fprintf( f, "%-18s %12.1f %12.1f\n", "mean points",
+        pts[0] / np, pts[1] / np );
+    fprintf( f, "%-18s %12.4f %12.4f\n", "mean R thumb",
+        (nthm[0] ? rthm[0] / nthm[0] : 0),
+        (nthm[1] ? rthm[1] / nthm[1] : 0) );
+    fprintf( f, "%-18s %12.4f %12.4f\n", "mean R mesh",
+        (nmsh[0] ? rmsh[0] / nmsh[0] : 0),
+        (nmsh[1] ? rmsh[1] / nmsh[1] : 0) );
+
+    double	speed = (tot[1] > 0 ? tot[0] / tot[1] : 0);
+
+    fprintf( f, "\nSpeedup B vs A (total time): %.2fx\n", speed );
+
+// Outcomes
+
+    int	both = 0, lost = 0, gain = 0, none = 0;
+
+    for( int i = 0; i < np; ++i ) {
+
+        bool	a = (vP[i].R[0].st == eOK),
+                b = (vP[i].R[1].st == eOK);
+
+        if( a && b )
+            ++both;
+        else if( a )
+            ++lost;
+        else if( b )
+            ++gain;
+        else
+            ++none;
+    }
+
+    fprintf( f,
+    "Matched by both %d, lost by B %d, gained by B %d, neither %d.\n",
+    both, lost, gain, none );
+
+// Displacement
+
+    vector<double>	vmax;
+    double			smean = 0, worst = 0;
+    int				nd = 0, nover = 0, iworst = -1;
+
+    for( int i = 0; i < np; ++i ) {
+
+        const Pair	&P = vP[i];
+
+        if( P.dmax < 0 )
+            continue;
+
+        smean += P.dmean;
+        vmax.push_back( P.dmax );
+        ++nd;
+
+        if( P.dmax > gArgs.tol )
+            ++nover;
+
+        if( P.dmax > worst ) {
+            worst	= P.dmax;
+            iworst	= i;
+        }
+    }
+
+    fprintf( f, "\nDisplacement B vs A (px), %d pairs compared:\n", nd );
+
+    if( nd ) {
+        fprintf( f, "\tmean %.3f, median max %.3f, worst %.3f (%s)\n",
+            smean / nd, Median( vmax ), worst,
+            vP[iworst].Label().c_str() );
+    }
+
+    fprintf( f, "\tpairs with max > tol (%g): %d\n", gArgs.tol, nover );
+
+// Failure reasons
+
+    for( int ip = 0; ip < 2; ++ip ) {
+
+        fprintf( f, "\nFAIL reasons %c:\n", 'A' + ip );
+
+        if( !why[ip].size() )
+            fprintf( f, "\tnone\n" );
+
+        map<string,int>::iterator	it;
+
+        for( it = why[ip].begin(); it != why[ip].end(); ++it )
+            fprintf( f, "\t%5d  %s\n", it->second, it->first.c_str() );
+    }
+
+    fclose( f );
+
+// Summary line
+
+    printf( "prmbench: %d pairs, speedup %.2fx, lost %d, gained %d,"
+    " dmean %.3f px, over tol %d. See prmbench.txt.\n",
+    np, speed, lost, gain, (nd ? smean / nd : 0.0), nover );
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+/* ------------------ */
+/* Parse command line */
+/* ------------------ */
+
+    gArgs.SetCmdLine( argc, argv );
+
+/* ------------- */
+/* Sample, setup */
+/* ------------- */
+
+    SamplePairs();
+    MakeWorkspaces();
+
+/* --- */
+/* Run */
+/* --- */
+
+    for( int i = 0, np = vP.size(); i < np; ++i ) {
+
+        int	first = i & 1;
+
+        RunPtest( vP[i], first );
+        RunPtest( vP[i], !first );
+        Compare( vP[i] );
+
+        printf( "%d/%d %s\n", i + 1, np, vP[i].Label().c_str() );
+        fflush( stdout );
+    }
+
+/* ------ */
+/* Report */
+/* ------ */
+
+    Report();
+
+/* ---- */
+/* Done */
+/* ---- */
+
+    fprintf( flog, "\n" );
+    fclose( flog );
+
+    return 0;
+}
+
+
@@ -13,21 +13,37 @@
 //
 //	-ab -za=%d -zb=%d
 //
+// If aligning a run of consecutive layer pairs...
+//
+//	-mb -ab -zrun=zlo,zhi
+//
+// Each layer in the run is painted once; its montage and strips
+// are cut from that one scape. Each pair still gets its own log
+// scplogs/scp_<zb>.log. With -scache=dir, whole-layer scapes are
+// also kept on disk so other jobs can reuse them.
+//
+// The cache holds whole scapes in memory, so -tiled (or -spill)
+// turns it off: each scape is then painted where needed.
+//
 
 
 #include	"Cmdline.h"
+#include	"Disk.h"
 #include	"File.h"
 #include	"PipeFiles.h"
 #include	"CTileSet.h"
+#include	"CTiledScape.h"
 #include	"CThmScan.h"
 #include	"Geometry.h"
 #include	"Maths.h"
 #include	"ImageIO.h"
+#include	"Telemetry.h"
 #include	"Timer.h"
 #include	"Memory.h"
 #include	"Debug.h"
 
 #include	<string.h>
+#include	<unistd.h>
 
 
 /* --------------------------------------------------------------- */
@@ -53,14 +69,16 @@ public:
     Point	Opts;		// origin of aligned point list
     double	x0, y0;		// scape corner in oriented system
     uint8	*ras;		// scape pixels
-    uint32	ws, hs;		// scape dims
+    CTiledScape	*tsc;	// or tiled scape pixels
+    uint32	ws, hs,		// scape dims
+            key;		// layer tiles + render params hash
     int		is0, isN,	// layer index range
             Bxc, Byc,	// oriented layer center
             Bxw, Byh,	// oriented layer span
             deg;		// rotate this much to orient
 
 public:
-    CSuperscape() : ras(NULL) {};
+    CSuperscape() : ras(NULL), tsc(NULL), key(0) {};
 
     virtual ~CSuperscape()
         {KillRas();};
@@ -71,12 +89,19 @@ public:
                 RasterFree( ras );
                 ras = NULL;
             }
+
+            if( tsc ) {
+                delete tsc;
+                tsc = NULL;
+            }
         };
 
     void DrawRas( const char *name )
         {
             if( ras )
                 Raster8ToPng8( name, ras, ws, hs );
+            else if( tsc )
+                tsc->ToPng8( name );
         };
 
     bool Load( const char *name, FILE* flog )
@@ -88,14 +113,18 @@ public:
 
     void FindLayerIndices( int z );
     void OrientLayer();
+    void SetKey();
 
+    bool Paint( const vector<int> &vid );
+    bool CropFrom( const CSuperscape &W, const vector<int> &vid );
+    bool MakeStrip( const vector<int> &vid );
     bool MakeWholeRaster();
     bool MakeRasV();
     bool MakeRasH();
 
     void WriteMeta( char clbl, int z );
 
-    void MakePoints( vector<double> &v, vector<Point> &p );
+    bool MakePoints( vector<double> &v, vector<Point> &p, int bin );
 };
 
 /* --------------------------------------------------------------- */
@@ -108,13 +137,24 @@ public:
     double		abctr;
     string		idb;
     const char	*srcmons,
-                *script;
+                *script,
+                *spill,
+                *scache;
     int			za,
-                zb;
+                zb,
+                zlo,
+                zhi,
+                legfast,
+                pyr,
+                maxpix;
     bool		ismb,
                 isab,
                 abdbg,
-                abdbgfull;
+                abdbgfull,
+                lores,
+                legerr,
+                tiled,
+                fmellin;
 
 public:
     CArgs_scp()
@@ -122,17 +162,43 @@ public:
         abctr		= 0.0;
         srcmons		= NULL;
         script		= NULL;
+        spill		= NULL;
+        scache		= NULL;
         za			= -1;
         zb			= -1;
+        zlo			= -1;
+        zhi			= -1;
+        legfast		= 0;
+        pyr			= 0;
+        maxpix		= 0;
         ismb		= false;
         isab		= false;
         abdbg		= false;
         abdbgfull	= false;
+        lores		= false;
+        legerr		= false;
+        tiled		= false;
+        fmellin		= false;
     };
 
     void SetCmdLine( int argc, char* argv[] );
 };
 
+/* --------------------------------------------------------------- */
+/* CCacheEnt ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// In-memory whole-layer scape.
+//
+class CCacheEnt {
+
+public:
+    uint8	*ras;
+    uint32	ws, hs,
+            key;
+    double	x0, y0;
+};
+
 /* --------------------------------------------------------------- */
 /* Statics ------------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -145,7 +211,9 @@ static CSuperscape	*gA, *gB;
 static CThmScan		*gS;
 static FILE*		flog	= NULL;
 static int			gW		= 0,	// universal pic dims
-                    gH		= 0;
+                    gH		= 0,
+                    gBin	= 1;	// scape pixels per point
+static vector<CCacheEnt>	vcache;		// whole scapes, newest last
 
 
 
@@ -158,16 +226,19 @@ static int			gW		= 0,	// universal pic dims
 
 void CArgs_scp::SetCmdLine( int argc, char* argv[] )
 {
-// label output by layer b
+// label output by layer b, or first b of a run
 
     for( int i = 1; i < argc; ++i ) {
 
-        if( GetArg( &zb, "-zb=%d", argv[i] ) )
+        if( GetArg( &zb, "-zb=%d", argv[i] ) ||
+            GetArg( &zb, "-zrun=%d", argv[i] ) ) {
+
             break;
+        }
     }
 
     if( zb < 0 ) {
-        printf( "scapeops: Missing -zb option!!\n" );
+        printf( "scapeops: Missing -zb or -zrun option!!\n" );
         exit( 42 );
     }
 
@@ -196,6 +267,7 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
         exit( 42 );
     }
 
+    vector<int>	vi;
     const char	*pchar;
 
     for( int i = 1; i < argc; ++i ) {
@@ -213,6 +285,20 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArg( &zb, "-zb=%d", argv[i] ) )
             ;
+        else if( GetArgList( vi, "-zrun=", argv[i] ) ) {
+
+            if( 2 == vi.size() ) {
+                zlo = vi[0];
+                zhi = vi[1];
+            }
+            else {
+                fprintf( flog,
+                "Bad format in -zrun [%s].\n", argv[i] );
+                exit( 42 );
+            }
+        }
+        else if( GetArgStr( scache, "-scache=", argv[i] ) )
+            ;
         else if( GetArg( &abctr, "-abctr=%lf", argv[i] ) )
             ;
         else if( IsArg( "-mb", argv[i] ) )
@@ -223,6 +309,22 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
             abdbg = true;
         else if( IsArg( "-abdbgfull", argv[i] ) )
             abdbgfull = true;
+        else if( IsArg( "-lores", argv[i] ) )
+            lores = true;
+        else if( GetArg( &legfast, "-legfast=%d", argv[i] ) )
+            ;
+        else if( IsArg( "-legerr", argv[i] ) )
+            legerr = true;
+        else if( IsArg( "-fmellin", argv[i] ) )
+            fmellin = true;
+        else if( GetArg( &pyr, "-pyr=%d", argv[i] ) )
+            ;
+        else if( GetArg( &maxpix, "-maxpix=%d", argv[i] ) )
+            ;
+        else if( IsArg( "-tiled", argv[i] ) )
+            tiled = true;
+        else if( GetArgStr( spill, "-spill=", argv[i] ) )
+            tiled = true;
         else {
             printf( "Did not understand option [%s].\n", argv[i] );
             exit( 42 );
@@ -230,12 +332,24 @@ void CArgs_scp::SetCmdLine( int argc, char* argv[] )
     }
 
     fprintf( flog, "\n" );
+
+    if( legfast > 0 )
+        LegPolySetFast( legfast, legerr, flog );
+
+    if( tiled && (zlo >= 0 || scache) )
+        fprintf( flog, "Scape cache off: -tiled keeps scapes sparse.\n" );
+
     fflush( flog );
 
     if( !ismb && !isab ) {
         fprintf( flog, "No operations specified.\n" );
         exit( 0 );
     }
+
+    if( zlo >= 0 && !isab ) {
+        fprintf( flog, "-zrun requires -ab.\n" );
+        exit( 42 );
+    }
 }
 
 /* --------------------------------------------------------------- */
@@ -304,6 +418,369 @@ void CSuperscape::OrientLayer()
     Byc = int((B.B + B.T)/2.0);
     Bxw = int(B.R - B.L);
     Byh = int(B.T - B.B);
+
+    SetKey();
+}
+
+/* --------------------------------------------------------------- */
+/* SetKey -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Hash everything a whole-layer scape depends upon: the oriented
+// tile transforms and names, and the render parameters, including
+// the fast Legendre flattening settings. A change
+// to the transform table gives the layer a new cache key.
+//
+void CSuperscape::SetKey()
+{
+    string	s;
+    char	buf[256];
+
+    sprintf( buf, "%d %d %d %d %d %d %d %d %d\n",
+    scr.crossscale, scr.legendremaxorder, scr.rendersdevcnts,
+    scr.maskoutresin, gArgs.lores, gArgs.legfast, gArgs.legerr,
+    gW, gH );
+
+    s = buf;
+
+    for( int i = is0; i < isN; ++i ) {
+
+        const CUTile&	U = TS.vtil[i];
+        const double	*t = U.T.t;
+
+        sprintf( buf, "%d %.12g %.12g %.12g %.12g %.12g %.12g ",
+        U.id, t[0], t[1], t[2], t[3], t[4], t[5] );
+
+        s += buf;
+        s += U.name;
+        s += "\n";
+    }
+
+    key = SuperFastHash( s.c_str(), s.size() );
+}
+
+/* --------------------------------------------------------------- */
+/* CacheOn ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Not with -tiled: a cache entry is a whole flat scape, which is
+// the memory -tiled exists to avoid.
+//
+static bool CacheOn()
+{
+    return !gArgs.tiled && (gArgs.zlo >= 0 || gArgs.scache);
+}
+
+/* --------------------------------------------------------------- */
+/* CachePath ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void CachePath(
+    char				*buf,
+    const CSuperscape	&S,
+    const char			*ext )
+{
+    sprintf( buf, "%s/scp_%d_%d_%08x.%s",
+    gArgs.scache, TS.vtil[S.is0].z, scr.crossscale, S.key, ext );
+}
+
+/* --------------------------------------------------------------- */
+/* CacheKeep ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Copy S's whole-layer scape into memory. Two are kept: those of
+// the current pair; a run needs nothing older.
+//
+static void CacheKeep( const CSuperscape &S )
+{
+    CCacheEnt	E;
+    int			np = S.ws * S.hs;
+
+    if( vcache.size() >= 2 ) {
+        RasterFree( vcache[0].ras );
+        vcache.erase( vcache.begin() );
+    }
+
+    E.ras	= (uint8*)RasterAlloc( np );
+    E.ws	= S.ws;
+    E.hs	= S.hs;
+    E.key	= S.key;
+    E.x0	= S.x0;
+    E.y0	= S.y0;
+
+    memcpy( E.ras, S.ras, np );
+
+    vcache.push_back( E );
+}
+
+/* --------------------------------------------------------------- */
+/* CacheGet ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Fill S with its whole-layer scape from memory, else from the
+// -scache dir. Return true if found.
+//
+static bool CacheGet( CSuperscape &S )
+{
+    if( !CacheOn() )
+        return false;
+
+    int	z = TS.vtil[S.is0].z;
+
+// Memory
+
+    for( int i = 0, n = vcache.size(); i < n; ++i ) {
+
+        const CCacheEnt&	E = vcache[i];
+
+        if( E.key != S.key )
+            continue;
+
+        int	np = E.ws * E.hs;
+
+        S.ras	= (uint8*)RasterAlloc( np );
+        S.ws	= E.ws;
+        S.hs	= E.hs;
+        S.x0	= E.x0;
+        S.y0	= E.y0;
+
+        memcpy( S.ras, E.ras, np );
+
+        fprintf( flog, "Scape cache: z=%d from memory.\n", z );
+        return true;
+    }
+
+// Disk
+
+    if( !gArgs.scache )
+        return false;
+
+    char	name[2048];
+    FILE	*f;
+    uint32	w, h;
+    int		ok;
+
+    CachePath( name, S, "txt" );
+
+    if( !(f = fopen( name, "r" )) )
+        return false;
+
+    ok = (4 == fscanf( f, "%lf %lf %u %u", &S.x0, &S.y0, &S.ws, &S.hs ));
+    fclose( f );
+
+    CachePath( name, S, "png" );
+
+    if( !ok || !DskExists( name ) )
+        return false;
+
+    S.ras = Raster8FromPng( name, w, h, flog );
+
+    if( w != S.ws || h != S.hs ) {
+        RasterFree( S.ras );
+        S.ras = NULL;
+    }
+
+    if( !S.ras )
+        return false;
+
+    fprintf( flog, "Scape cache: z=%d from [%s].\n", z, name );
+
+    CacheKeep( S );
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* CachePut ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Keep S's freshly painted whole-layer scape in memory, and if
+// -scache, on disk. Files are written under temp names and then
+// renamed, so concurrent jobs never see partial ones.
+//
+static void CachePut( const CSuperscape &S )
+{
+    CacheKeep( S );
+
+    if( !gArgs.scache )
+        return;
+
+    char	name[2048], tmp[2048];
+    FILE	*f;
+
+    DskCreateDir( gArgs.scache, flog );
+
+    CachePath( name, S, "png" );
+    sprintf( tmp, "%s.%d.tmp", name, getpid() );
+    Raster8ToPng8( tmp, S.ras, S.ws, S.hs, flog );
+    rename( tmp, name );
+
+    CachePath( name, S, "txt" );
+    sprintf( tmp, "%s.%d.tmp", name, getpid() );
+    f = FileOpenOrDie( tmp, "w", flog );
+    fprintf( f, "%.12g %.12g %u %u\n", S.x0, S.y0, S.ws, S.hs );
+    fclose( f );
+    rename( tmp, name );
+}
+
+/* --------------------------------------------------------------- */
+/* Paint --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Paint listed tiles into ras, or with -tiled, into tsc.
+//
+bool CSuperscape::Paint( const vector<int> &vid )
+{
+    if( !gArgs.tiled ) {
+
+        ras = TS.Scape( ws, hs, x0, y0,
+                vid, inv_scl, 1, 0,
+                scr.legendremaxorder, scr.rendersdevcnts,
+                scr.maskoutresin, scr.stripslots, gArgs.lores );
+
+        return (ras != NULL);
+    }
+
+    tsc = new CTiledScape;
+
+    if( !TS.ScapeTiled( *tsc, x0, y0,
+            vid, inv_scl, 1, 0,
+            scr.legendremaxorder, scr.rendersdevcnts,
+            scr.maskoutresin, scr.stripslots, gArgs.lores,
+            gArgs.spill ) ) {
+
+        KillRas();
+        return false;
+    }
+
+    ws = tsc->ws;
+    hs = tsc->hs;
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* CropFrom ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Cut the scape of tiles vid from whole-layer scape W instead of
+// painting it. Bounds are those Scape would give, snapped to W's
+// pixel grid, and pixels no listed tile covers get background.
+//
+// A pixel is taken from W if a listed tile covers it under the
+// painter's clip: inside the tile's downsampled image, less its
+// last row and column. A crop differs from a fresh paint only
+// in that (1) the crop grid may be offset from the fresh one by
+// up to half a pixel, and (2) where a listed tile overlaps an
+// unlisted one, the pixel is whichever tile won in W, which may
+// be the unlisted tile.
+//
+bool CSuperscape::CropFrom( const CSuperscape &W, const vector<int> &vid )
+{
+    if( !vid.size() ) {
+        fprintf( flog, "Scape: Empty tile list.\n" );
+        return false;
+    }
+
+    double	sx0, sy0;
+    int		dx, dy, bkval = (scr.rendersdevcnts > 0 ? 127 : 0);
+
+    TS.ScapeBounds( ws, hs, sx0, sy0, vid, inv_scl, 1 );
+
+    dx = ROUND( sx0 - W.x0 );
+    dy = ROUND( sy0 - W.y0 );
+    x0 = W.x0 + dx;
+    y0 = W.y0 + dy;
+
+    if( !(ras = (uint8*)RasterAlloc( ws * hs )) ) {
+        fprintf( flog, "Scape: Alloc failed (%d x %d).\n", ws, hs );
+        return false;
+    }
+
+    memset( ras, bkval, ws * hs );
+
+    vector<Point>	cnr;
+    TAffine			A;
+    int				iscl	= int(1/inv_scl);
+    double			wL		= (gW + iscl - 1) / iscl - 1,
+                    hL		= (gH + iscl - 1) / iscl - 1;
+
+    Set4Corners( cnr, gW, gH );
+    A.NUSetScl( inv_scl );
+
+    for( int i = 0, nt = vid.size(); i < nt; ++i ) {
+
+        // tile -> strip pixels, and inverse to
+        // downsampled tile pixels as painter does
+
+        TAffine	T, I, D;
+        DBox	bb;
+
+        T = A * TS.vtil[vid[i]].T;
+        T.AddXY( -x0, -y0 );
+        I.InverseOf( T );
+        D.NUSetScl( 1.0/iscl );
+        I = D * I;
+
+        vector<Point>	c( 4 );
+        memcpy( &c[0], &cnr[0], 4*sizeof(Point) );
+        T.Transform( c );
+        BBoxFromPoints( bb, c );
+
+        int	xL = max( 0, (int)floor( bb.L ) ),
+            xR = min( (int)ws - 1, (int)ceil( bb.R ) ),
+            yB = max( 0, (int)floor( bb.B ) ),
+            yT = min( (int)hs - 1, (int)ceil( bb.T ) );
+
+        for( int iy = yB; iy <= yT; ++iy ) {
+
+            int	wy = iy + dy;
+
+            if( wy < 0 || wy >= (int)W.hs )
+                continue;
+
+            for( int ix = xL; ix <= xR; ++ix ) {
+
+                int		wx = ix + dx;
+                Point	p( ix, iy );
+
+                if( wx < 0 || wx >= (int)W.ws )
+                    continue;
+
+                I.Transform( p );
+
+                if( p.x >= 0 && p.x < wL && p.y >= 0 && p.y < hL )
+                    ras[ix + ws*iy] = W.ras[wx + W.ws*wy];
+            }
+        }
+    }
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeStrip ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Paint the scape of tiles vid, or in cache mode, cut it from the
+// (cached) whole-layer scape.
+//
+bool CSuperscape::MakeStrip( const vector<int> &vid )
+{
+    if( !CacheOn() )
+        return Paint( vid );
+
+    CSuperscape	W = *this;
+    bool		ok;
+
+    W.ras = NULL;
+    W.tsc = NULL;
+
+    ok = W.MakeWholeRaster() && CropFrom( W, vid );
+
+    W.KillRas();
+
+    return ok;
 }
 
 /* --------------------------------------------------------------- */
@@ -312,17 +789,21 @@ void CSuperscape::OrientLayer()
 
 bool CSuperscape::MakeWholeRaster()
 {
+    if( CacheGet( *this ) )
+        return true;
+
     vector<int>	vid( isN - is0 );
 
     for( int i = is0; i < isN; ++i )
         vid[i - is0] = i;
 
-    ras = TS.Scape( ws, hs, x0, y0,
-            vid, inv_scl, 1, 0,
-            scr.legendremaxorder, scr.rendersdevcnts,
-            scr.maskoutresin, scr.stripslots );
+    if( !Paint( vid ) )
+        return false;
 
-    return (ras != NULL);
+    if( CacheOn() )
+        CachePut( *this );
+
+    return true;
 }
 
 /* --------------------------------------------------------------- */
@@ -355,12 +836,7 @@ bool CSuperscape::MakeRasV()
         }
     }
 
-    ras = TS.Scape( ws, hs, x0, y0,
-            vid, inv_scl, 1, 0,
-            scr.legendremaxorder, scr.rendersdevcnts,
-            scr.maskoutresin, scr.stripslots );
-
-    return (ras != NULL);
+    return MakeStrip( vid );
 }
 
 /* --------------------------------------------------------------- */
@@ -393,12 +869,7 @@ bool CSuperscape::MakeRasH()
         }
     }
 
-    ras = TS.Scape( ws, hs, x0, y0,
-            vid, inv_scl, 1, 0,
-            scr.legendremaxorder, scr.rendersdevcnts,
-            scr.maskoutresin, scr.stripslots );
-
-    return (ras != NULL);
+    return MakeStrip( vid );
 }
 
 /* --------------------------------------------------------------- */
@@ -419,27 +890,65 @@ void CSuperscape::WriteMeta( char clbl, int z )
 /* MakePoints ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-void CSuperscape::MakePoints( vector<double> &v, vector<Point> &p )
+// Collect the nonzero pixels as correlator points, averaged over
+// bin x bin blocks (bin = 1 keeps every pixel). Rows are visited
+// in order, so a tiled scape is read one row at a time and never
+// flattened. Opts is in scape pixels; point coords are in bins.
+//
+// Return false (logged) if the scape is blank, so a run can go on
+// to its next pair.
+//
+bool CSuperscape::MakePoints( vector<double> &v, vector<Point> &p, int bin )
 {
 // collect point and value lists
 
-    int		np = ws * hs;
+    int				bw = (ws + bin - 1) / bin,
+                    bh = (hs + bin - 1) / bin,
+                    np;
+    vector<uint8>	row( ws );
+    vector<double>	sum( bw );
+    vector<int>		cnt( bw );
 
-    for( int i = 0; i < np; ++i ) {
+    for( int by = 0; by < bh; ++by ) {
+
+        int	yL = min( (int)hs, (by + 1) * bin );
+
+        sum.assign( bw, 0.0 );
+        cnt.assign( bw, 0 );
 
-        if( ras[i] ) {
+        for( int iy = by * bin; iy < yL; ++iy ) {
 
-            int	iy = i / ws,
-                ix = i - ws * iy;
+            const uint8	*R;
 
-            v.push_back( ras[i] );
-            p.push_back( Point( ix, iy ) );
+            if( tsc ) {
+                tsc->GetRow( &row[0], iy );
+                R = &row[0];
+            }
+            else
+                R = ras + ws * iy;
+
+            for( int ix = 0; ix < (int)ws; ++ix ) {
+
+                if( R[ix] ) {
+                    sum[ix / bin] += R[ix];
+                    ++cnt[ix / bin];
+                }
+            }
+        }
+
+        for( int bx = 0; bx < bw; ++bx ) {
+
+            if( cnt[bx] ) {
+                v.push_back( sum[bx] / cnt[bx] );
+                p.push_back( Point( bx, by ) );
+            }
         }
     }
 
     if( !(np = p.size()) ) {
         fprintf( flog, "FAIL: Block has no non-zero pixels.\n" );
-        exit( 42 );
+        KillRas();
+        return false;
     }
 
 // get points origin and translate to zero
@@ -447,22 +956,63 @@ void CSuperscape::MakePoints( vector<double> &v, vector<Point> &p )
     DBox	bb;
 
     BBoxFromPoints( bb, p );
-    Opts = Point( bb.L, bb.B );
 
     for( int i = 0; i < np; ++i ) {
 
-        p[i].x -= Opts.x;
-        p[i].y -= Opts.y;
+        p[i].x -= bb.L;
+        p[i].y -= bb.B;
     }
 
+    // bin centers in scape pixels
+
+    Opts = Point( bin * bb.L + (bin - 1) / 2.0,
+                  bin * bb.B + (bin - 1) / 2.0 );
+
 // normalize values
 
     if( !Normalize( v ) ) {
         fprintf( flog, "FAIL: Scape stdev = 0.\n" );
-        exit( 42 );
+        KillRas();
+        return false;
     }
 
     KillRas();
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* PointsBin ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return the smallest power of 2 binning that brings both scapes
+// within -maxpix megapixels, so the point lists and correlator
+// FFTs stay bounded however large the section. Return 1 if there
+// is no cap.
+//
+static int PointsBin( const CSuperscape &A, const CSuperscape &B )
+{
+    int	bin = 1;
+
+    if( gArgs.maxpix <= 0 )
+        return bin;
+
+    double	cap = gArgs.maxpix * 1e6;
+
+    for(;;) {
+
+        double	na = double((A.ws + bin - 1) / bin) * ((A.hs + bin - 1) / bin),
+                nb = double((B.ws + bin - 1) / bin) * ((B.hs + bin - 1) / bin);
+
+        if( max( na, nb ) <= cap )
+            break;
+
+        bin *= 2;
+    }
+
+    fprintf( flog, "Points: Binning scapes by %d.\n", bin );
+
+    return bin;
 }
 
 /* --------------------------------------------------------------- */
@@ -471,7 +1021,8 @@ void CSuperscape::MakePoints( vector<double> &v, vector<Point> &p )
 
 // At any given angle the corners of A and B strip coincide
 // and are at (0,0) in B-system. (Ox,Oy) brings center of A
-// coincident with center of B, so, Oxy = Bc - Rot(Ac).
+// coincident with center of B, so, Oxy = Bc - Rot(Ac). All in
+// point (binned) units, gBin scape pixels each.
 //
 static void StripAngProc(
     int		&Ox,
@@ -484,10 +1035,10 @@ static void StripAngProc(
             c  = cos( r ),
             s  = sin( r );
 
-    Ox = int(gB->ws - (c*gA->ws - s*gA->hs))/2;
-    Oy = int(gB->hs - (s*gA->ws + c*gA->hs))/2;
-    Rx = int(gA->ws * 0.25);
-    Ry = int(gB->hs * 0.25);
+    Ox = int(gB->ws - (c*gA->ws - s*gA->hs))/(2 * gBin);
+    Oy = int(gB->hs - (s*gA->ws + c*gA->hs))/(2 * gBin);
+    Rx = int(gA->ws * 0.25) / gBin;
+    Ry = int(gB->hs * 0.25) / gBin;
 }
 
 /* --------------------------------------------------------------- */
@@ -521,16 +1072,21 @@ static int AlignWithStrips(
 
     t0 = StopTiming( flog, "MakeStrips", t0 );
 
-    A.MakePoints( thm.av, thm.ap );
+    thm.scl	= gBin = PointsBin( A, B );
+
+    if( !A.MakePoints( thm.av, thm.ap, thm.scl ) )
+        return false;
+
     A.WriteMeta( 'A', gArgs.za );
 
-    B.MakePoints( thm.bv, thm.bp );
+    if( !B.MakePoints( thm.bv, thm.bp, thm.scl ) )
+        return false;
+
     B.WriteMeta( 'B', gArgs.zb );
 
     thm.ftc.clear();
-    thm.reqArea	= int(gW * gH * inv_scl * inv_scl);
-    thm.olap1D	= int(gW * inv_scl * 0.5);
-    thm.scl		= 1;
+    thm.reqArea	= int(gW * gH * inv_scl * inv_scl / (thm.scl * thm.scl));
+    thm.olap1D	= int(gW * inv_scl * 0.5 / thm.scl);
 
     S.Initialize( flog, best );
     S.SetRThresh( scr.stripmincorr );
@@ -538,6 +1094,7 @@ static int AlignWithStrips(
     S.SetSweepConstXY( false );
     S.SetSweepPretweak( true );
     S.SetSweepNThreads( scr.stripslots );
+    S.SetSweepFMellin( gArgs.fmellin );
     S.SetUseCorrR( true );
     S.SetNewAngProc( StripAngProc );
 
@@ -567,6 +1124,9 @@ static int AlignWithStrips(
 
         if( ok = best.R >= scr.stripmincorr ) {
 
+            best.X *= thm.scl;
+            best.Y *= thm.scl;
+
             best.T.Apply_R_Part( A.Opts );
 
             best.X += B.Opts.x - A.Opts.x;
@@ -590,7 +1150,9 @@ static int AlignWithStrips(
 /* AlignFull ----------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-static void AlignFull(
+// Return false if either scape has no usable points.
+//
+static bool AlignFull(
     CSuperscape	&A,
     CSuperscape	&B,
     CSuperscape	&M,
@@ -620,16 +1182,21 @@ static void AlignFull(
 
     t0 = StopTiming( flog, "MakeFull", t0 );
 
-    A.MakePoints( thm.av, thm.ap );
+    thm.scl	= gBin = PointsBin( A, B );
+
+    if( !A.MakePoints( thm.av, thm.ap, thm.scl ) )
+        return false;
+
     A.WriteMeta( 'A', gArgs.za );
 
-    B.MakePoints( thm.bv, thm.bp );
+    if( !B.MakePoints( thm.bv, thm.bp, thm.scl ) )
+        return false;
+
     B.WriteMeta( 'B', gArgs.zb );
 
     thm.ftc.clear();
-    thm.reqArea	= int(gW * gH * inv_scl * inv_scl);
-    thm.olap1D	= int(gW * inv_scl);
-    thm.scl		= 1;
+    thm.reqArea	= int(gW * gH * inv_scl * inv_scl / (thm.scl * thm.scl));
+    thm.olap1D	= int(gW * inv_scl / thm.scl);
 
     S.Initialize( flog, best );
     S.SetRThresh( 0.02 );
@@ -637,6 +1204,7 @@ static void AlignFull(
     S.SetSweepConstXY( false );
     S.SetSweepPretweak( true );
     S.SetSweepNThreads( scr.stripslots );
+    S.SetSweepFMellin( gArgs.fmellin );
     S.SetUseCorrR( true );
     S.SetDisc( 0, 0, -1, -1 );
 
@@ -655,15 +1223,18 @@ static void AlignFull(
 
         if( scr.stripsweepspan && scr.stripsweepstep ) {
 
-            S.DenovoBestAngle( best,
+            S.PyramidBestAngle( best,
                 0, scr.stripsweepspan / 2, scr.stripsweepstep,
-                thm, true );
+                thm, gArgs.pyr, false, true );
         }
         else {
             best.A = 0;
             S.PeakHunt( best, 0, thm );
         }
 
+        best.X *= thm.scl;
+        best.Y *= thm.scl;
+
         best.T.Apply_R_Part( A.Opts );
 
         best.X += B.Opts.x - A.Opts.x;
@@ -678,6 +1249,8 @@ static void AlignFull(
     }
 
     t0 = StopTiming( flog, "Full", t0 );
+
+    return true;
 }
 
 /* --------------------------------------------------------------- */
@@ -715,13 +1288,19 @@ static void AlignFull(
 //	Rbi.NUSetRot( -B.deg*PI/180 );
 //	best.T = Rbi * t;
 //
-static void ScapeStuff()
+// In a run, caller has already found and oriented A and B.
+//
+// Return false if the pair could not be aligned.
+//
+static bool ScapeStuff( CSuperscape &A, CSuperscape &B, bool oriented )
 {
     clock_t		t0 = StartTiming();
-    CSuperscape	A, B, M;
+    CSuperscape	M;
 
-    B.FindLayerIndices( gArgs.zb );
-    B.OrientLayer();
+    if( !oriented ) {
+        B.FindLayerIndices( gArgs.zb );
+        B.OrientLayer();
+    }
 
     if( gArgs.ismb ) {
 
@@ -739,17 +1318,109 @@ static void ScapeStuff()
     }
 
     if( !gArgs.isab )
-        return;
+        return true;
 
-    A.FindLayerIndices( gArgs.za );
-    A.OrientLayer();
+    if( !oriented ) {
+        A.FindLayerIndices( gArgs.za );
+        A.OrientLayer();
+    }
 
     if( gArgs.abdbgfull ||
         scr.stripwidth <= 0 ||
         !AlignWithStrips( A, B, t0 ) ) {
 
-        AlignFull( A, B, M, t0 );
+        return AlignFull( A, B, M, t0 );
+    }
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* RunLog -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Switch to log of pair (za, zb) so downstream readers find each
+// pair's results where a single-pair job would have put them.
+//
+static void RunLog()
+{
+    char	buf[256];
+
+    fclose( flog );
+    sprintf( buf, "scplogs/scp_%d.log", gArgs.zb );
+    flog = FileOpenOrDie( buf, "w" );
+    TS.SetLogFile( flog );
+
+    if( gArgs.legfast > 0 )
+        LegPolySetFast( gArgs.legfast, gArgs.legerr, flog );
+}
+
+/* --------------------------------------------------------------- */
+/* ScapeRun ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Align each consecutive pair of layers present in [zlo, zhi].
+// Each layer is oriented once and serves as A for one pair and
+// then as B for the next; the scape cache ensures it is painted
+// once as well.
+//
+// A pair that fails (blank scape) is logged, leaving its scp log
+// without a transform as a failed single-pair job would, and the
+// run goes on. Return false if any pair failed.
+//
+static bool ScapeRun()
+{
+    vector<int>	vz;
+    int			is0, isN, nfail = 0;
+
+    for( TS.GetLayerLimits( is0 = 0, isN );
+         isN != -1;
+         TS.GetLayerLimits( is0 = isN, isN ) ) {
+
+        vz.push_back( TS.vtil[is0].z );
     }
+
+    int	nz = vz.size();
+
+    if( nz < 2 ) {
+        fprintf( flog, "Run: Fewer than two layers.\n" );
+        return true;
+    }
+
+    CSuperscape	S[2];
+
+    for( int k = 0; k < nz - 1; ++k ) {
+
+        CSuperscape	&B = S[k & 1],
+                    &A = S[(k + 1) & 1];
+
+        gArgs.zb = vz[k];
+        gArgs.za = vz[k + 1];
+
+        if( gArgs.zb != gArgs.zlo || k )
+            RunLog();
+
+        fprintf( flog, "\n---- Run pair za=%d zb=%d ----\n",
+        gArgs.za, gArgs.zb );
+
+        if( !k ) {
+            B.FindLayerIndices( gArgs.zb );
+            B.OrientLayer();
+        }
+
+        A.KillRas();
+        A.FindLayerIndices( gArgs.za );
+        A.OrientLayer();
+
+        if( !ScapeStuff( A, B, true ) ) {
+            fprintf( flog, "Run: Pair za=%d zb=%d failed.\n",
+            gArgs.za, gArgs.zb );
+            TelemCount( "pairs_failed" );
+            ++nfail;
+        }
+    }
+
+    return !nfail;
 }
 
 /* --------------------------------------------------------------- */
@@ -759,6 +1430,7 @@ static void ScapeStuff()
 int main( int argc, char* argv[] )
 {
     clock_t		t0 = StartTiming();
+    bool		ok = true;
 
 /* ------------------ */
 /* Parse command line */
@@ -766,6 +1438,13 @@ int main( int argc, char* argv[] )
 
     gArgs.SetCmdLine( argc, argv );
 
+    TelemBegin( "scapeops", argc, argv );
+
+    if( gArgs.zlo >= 0 )
+        TelemTag( "z", "%d,%d", gArgs.zlo, gArgs.zhi );
+    else
+        TelemTag( "z", "%d", gArgs.zb );
+
     TS.SetLogFile( flog );
 
     if( !ReadScriptParams( scr, gArgs.script, flog ) )
@@ -777,12 +1456,18 @@ int main( int argc, char* argv[] )
 /* Read source data */
 /* ---------------- */
 
-    if( gArgs.zb >= 0 && gArgs.za < 0 )
-        gArgs.za = gArgs.zb;
+    if( gArgs.zlo >= 0 )
+        TS.FillFromRgns( gArgs.srcmons, gArgs.idb, gArgs.zlo, gArgs.zhi );
+    else {
 
-    TS.FillFromRgns( gArgs.srcmons, gArgs.idb, gArgs.zb, gArgs.za );
+        if( gArgs.zb >= 0 && gArgs.za < 0 )
+            gArgs.za = gArgs.zb;
+
+        TS.FillFromRgns( gArgs.srcmons, gArgs.idb, gArgs.zb, gArgs.za );
+    }
 
     fprintf( flog, "Got %d images.\n", (int)TS.vtil.size() );
+    TelemCount( "tiles", TS.vtil.size() );
 
     if( !TS.vtil.size() )
         goto exit;
@@ -802,7 +1487,12 @@ int main( int argc, char* argv[] )
 /* Stuff */
 /* ----- */
 
-    ScapeStuff();
+    if( gArgs.zlo >= 0 )
+        ok = ScapeRun();
+    else {
+        CSuperscape	A, B;
+        ok = ScapeStuff( A, B, false );
+    }
 
 /* ---- */
 /* Done */
@@ -812,8 +1502,9 @@ exit:
     fprintf( flog, "\n" );
     VMStats( flog );
     fclose( flog );
+    TelemEnd( ok );
 
-    return 0;
+    return (ok ? 0 : 42);
 }
 
 
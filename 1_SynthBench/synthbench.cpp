@@ -0,0 +1,1018 @@
+//
+// Synthesize an EM-like tiled dataset with known ground truth,
+// and score pipeline results against that truth. The driver
+// benchgo.sht uses both to time and check the pipeline on one
+// machine.
+//
+// Make a dataset:
+//
+// > synthbench outdir -nx=4 -ny=4 -nz=3 [options]
+//
+// Options:
+// -wh=2048,2048	;tile size
+// -olap=0.1		;tile overlap fraction
+// -jitter=8		;sd of tile offset from stage grid (px)
+// -deg=0.3			;sd of tile rotation (deg)
+// -persp=0			;sd of tile perspective terms (1/px)
+// -drift=40		;sd of layer offset (px)
+// -twist=0.5		;sd of layer rotation (deg)
+// -folds=0			;fraction of tiles given a fold
+// -seed=1			;same seed, same dataset
+// -nthr=1			;render threads
+//
+// Writes:
+//
+//	outdir/img/z/z.id.tif	// 8-bit tiles
+//	outdir/layout.txt		// billfile with stage grid tforms
+//	outdir/truth.txt		// z id fold t0..t7 (THmgphy) per tile
+//
+// The tissue is a section through slowly drifting Voronoi cells
+// (dark membranes, shaded interiors), so adjacent layers differ
+// a little yet still correlate. A tile's true tform maps its
+// pixels to tissue coords. Stage tforms leave out the jitter,
+// rotation, perspective and layer drift, which the pipeline must
+// recover. A fold is a dark band across a tile; it hides content
+// but doesn't move it, so both sides keep the tile's true tform.
+//
+// Score results, printing one line "CHECK,n,err,max" to stdout:
+//
+// > synthbench -truth=path -idb=idbpath -z=i,j <check>
+//
+// -tforms=path	;X_A/X_H_{BIN,TXT} solution; '%d' in path is
+//				;replaced by z. Each rgn is sampled on a 3x3
+//				;grid; n = rgns, err/max = rms/max px after one
+//				;best global affine maps solution to truth.
+// -layers		;(with -tforms) a separate affine per layer.
+// -pts=same	;CPOINT2 pairs in z/S*/pts.same under cwd (or
+//				;down: z/D*/pts.down); n = pairs, err/max =
+//				;rms/max px between the pair's true positions.
+// -fm			;n = tiles, err = fraction whose fold state tiny
+//				;got wrong (one rgn vs several), max = count.
+//
+// Details go to synthbench.log, appended.
+//
+
+
+#include	"Cmdline.h"
+#include	"Disk.h"
+#include	"EZThreads.h"
+#include	"File.h"
+#include	"ImageIO.h"
+#include	"Maths.h"
+#include	"PipeFiles.h"
+#include	"THmgphy.h"
+
+#include	<dirent.h>
+#include	<math.h>
+#include	<string.h>
+
+using namespace ns_pipergns;
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	CELL	64.0	// Voronoi seed spacing (px)
+#define	MEMB	3.0		// membrane half-width (px)
+#define	WOBL	0.15	// seed wobble amplitude (cells)
+#define	FOLDW	24.0	// fold band width (px)
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+typedef pair<int,int>	ZID;
+
+class CTile {
+public:
+    THmgphy	H;		// tile -> tissue
+    Point	f0;		// fold line point
+    double	fc, fs;	// fold line normal
+    int		z, id, col, row;
+    bool	fold;
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_syn ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_syn {
+
+public:
+    string		idb;
+    const char	*outdir,
+                *truth,
+                *tforms,
+                *pts;
+    double		olap,
+                jitter,
+                deg,
+                persp,
+                drift,
+                twist,
+                folds;
+    int			nx,
+                ny,
+                nz,
+                w,
+                h,
+                seed,
+                nthr,
+                zilo,
+                zihi;
+    bool		layers,
+                chkfolds;
+
+public:
+    CArgs_syn()
+    {
+        outdir		= NULL;
+        truth		= NULL;
+        tforms		= NULL;
+        pts			= NULL;
+        olap		= 0.1;
+        jitter		= 8.0;
+        deg			= 0.3;
+        persp		= 0.0;
+        drift		= 40.0;
+        twist		= 0.5;
+        folds		= 0.0;
+        nx			= 4;
+        ny			= 4;
+        nz			= 3;
+        w			= 2048;
+        h			= 2048;
+        seed		= 1;
+        nthr		= 1;
+        zilo		= 0;
+        zihi		= 32768;
+        layers		= false;
+        chkfolds	= false;
+    };
+
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static CArgs_syn		gArgs;
+static FILE*			flog	= NULL;
+static vector<CTile>	vT;
+static map<ZID,int>		mT;		// (z,id) -> vT index
+static string			gOut;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_syn::SetCmdLine( int argc, char* argv[] )
+{
+// start log
+
+    flog = FileOpenOrDie( "synthbench.log", "a" );
+
+// log start time
+
+    time_t	t0 = time( NULL );
+    char	atime[32];
+
+    strcpy( atime, ctime( &t0 ) );
+    atime[24] = '\0';	// remove the newline
+
+    fprintf( flog, "Synthbench start: %s ", atime );
+
+// parse command line args
+
+    if( argc < 2 ) {
+        printf(
+        "Usage: synthbench outdir -nx=i -ny=j -nz=k [options], or\n"
+        "       synthbench -truth=path -idb=path -z=i,j <check>.\n" );
+        exit( 42 );
+    }
+
+    vector<int>	vi;
+    const char	*pchar;
+
+    for( int i = 1; i < argc; ++i ) {
+
+        // echo to log
+        fprintf( flog, "%s ", argv[i] );
+
+        if( argv[i][0] != '-' )
+            outdir = argv[i];
+        else if( GetArg( &nx, "-nx=%d", argv[i] ) )
+            ;
+        else if( GetArg( &ny, "-ny=%d", argv[i] ) )
+            ;
+        else if( GetArg( &nz, "-nz=%d", argv[i] ) )
+            ;
+        else if( GetArgList( vi, "-wh=", argv[i] ) ) {
+
+            if( 2 == vi.size() ) {
+                w = vi[0];
+                h = vi[1];
+            }
+            else {
+                fprintf( flog,
+                "Bad format in -wh [%s].\n", argv[i] );
+                exit( 42 );
+            }
+        }
+        else if( GetArg( &olap, "-olap=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &jitter, "-jitter=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &deg, "-deg=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &persp, "-persp=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &drift, "-drift=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &twist, "-twist=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &folds, "-folds=%lf", argv[i] ) )
+            ;
+        else if( GetArg( &seed, "-seed=%d", argv[i] ) )
+            ;
+        else if( GetArg( &nthr, "-nthr=%d", argv[i] ) )
+            ;
+        else if( GetArgStr( truth, "-truth=", argv[i] ) )
+            ;
+        else if( GetArgStr( pchar, "-idb=", argv[i] ) )
+            idb = pchar;
+        else if( GetArgList( vi, "-z=", argv[i] ) ) {
+
+            if( 2 == vi.size() ) {
+                zilo = vi[0];
+                zihi = vi[1];
+            }
+            else {
+                fprintf( flog,
+                "Bad format in -z [%s].\n", argv[i] );
+                exit( 42 );
+            }
+        }
+        else if( GetArgStr( tforms, "-tforms=", argv[i] ) )
+            ;
+        else if( GetArgStr( pts, "-pts=", argv[i] ) )
+            ;
+        else if( IsArg( "-layers", argv[i] ) )
+            layers = true;
+        else if( IsArg( "-fm", argv[i] ) )
+            chkfolds = true;
+        else {
+            printf( "Did not understand option [%s].\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    fprintf( flog, "\n\n" );
+    fflush( flog );
+
+    if( !outdir && !truth ) {
+        printf( "synthbench: Need outdir or -truth.\n" );
+        exit( 42 );
+    }
+
+    if( nthr < 1 )
+        nthr = 1;
+}
+
+/* --------------------------------------------------------------- */
+/* Hash ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Uniform [0,1) value fixed by integers (a,b,c).
+//
+static inline double Hash( int a, int b, int c )
+{
+    uint32	k = a * 73856093u ^ b * 19349663u ^ c * 83492791u;
+
+    k ^= k >> 13;
+    k *= 0x5bd1e995u;
+    k ^= k >> 15;
+    k *= 0x27d4eb2du;
+    k ^= k >> 16;
+
+    return k / 4294967296.0;
+}
+
+/* --------------------------------------------------------------- */
+/* Gauss --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Normal deviate, sd = 1 (Box-Muller).
+//
+static double Gauss()
+{
+    double	u = 1.0 - drand48(), v = drand48();
+
+    return sqrt( -2.0 * log( u ) ) * cos( 2.0 * PI * v );
+}
+
+/* --------------------------------------------------------------- */
+/* Noise --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Smooth value noise in [0,1), lattice spacing 1.
+//
+static double Noise( double x, double y, int z )
+{
+    int		ix = (int)floor( x ),
+            iy = (int)floor( y );
+    double	fx = x - ix,
+            fy = y - iy;
+
+    fx = fx * fx * (3 - 2 * fx);
+    fy = fy * fy * (3 - 2 * fy);
+
+    double	a = Hash( ix,   iy,   z ),
+            b = Hash( ix+1, iy,   z ),
+            c = Hash( ix,   iy+1, z ),
+            d = Hash( ix+1, iy+1, z );
+
+    return a + (b - a) * fx + (c - a) * fy + (a - b - c + d) * fx * fy;
+}
+
+/* --------------------------------------------------------------- */
+/* Tissue -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Intensity of layer z at tissue point (x,y).
+//
+// Each cell's seed sits at a fixed random spot in its lattice
+// square, wobbling by up to WOBL cell as z advances, so seeds
+// never leave the square and the 3x3 neighborhood always holds
+// the two nearest.
+//
+static double Tissue( double x, double y, int z )
+{
+    int		cx = (int)floor( x / CELL ),
+            cy = (int)floor( y / CELL ),
+            kx = cx,
+            ky = cy;
+    double	d1 = 1e30,
+            d2 = 1e30;
+
+    for( int j = cy - 1; j <= cy + 1; ++j ) {
+
+        for( int i = cx - 1; i <= cx + 1; ++i ) {
+
+            double	ph = 2 * PI * Hash( i, j, 3 ),
+                    om = 0.2 + 0.3 * Hash( i, j, 4 ),
+                    sx = (i + WOBL + (1 - 4*WOBL) * Hash( i, j, 1 )
+                            + WOBL * sin( om * z + ph )) * CELL,
+                    sy = (j + WOBL + (1 - 4*WOBL) * Hash( i, j, 2 )
+                            + WOBL * cos( om * z + ph )) * CELL,
+                    d  = (x - sx)*(x - sx) + (y - sy)*(y - sy);
+
+            if( d < d1 ) {
+                d2 = d1;
+                d1 = d;
+                kx = i;
+                ky = j;
+            }
+            else if( d < d2 )
+                d2 = d;
+        }
+    }
+
+// Interior: per-cell tone plus texture
+
+    double	v = 160 + 40 * (Hash( kx, ky, 5 ) - 0.5)
+                + 24 * (Noise( x / 9, y / 9, z ) - 0.5);
+
+// Membrane: darken near the bisector of nearest two seeds
+
+    double	e = 0.5 * (sqrt( d2 ) - sqrt( d1 ));
+
+    if( e < MEMB ) {
+        e /= MEMB;
+        v = 70 + (v - 70) * e * e;
+    }
+
+    return v;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeTruth ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Homography for affine elements {a..f}.
+//
+static THmgphy Aff( double a, double b, double c,
+                    double d, double e, double f )
+{
+    return THmgphy( a, b, c, d, e, f, 0, 0 );
+}
+
+
+// Draw every tile's true tform and fold, in fixed order so the
+// seed alone decides the dataset.
+//
+static void MakeTruth()
+{
+    double	sx = gArgs.w * (1 - gArgs.olap),
+            sy = gArgs.h * (1 - gArgs.olap);
+    Point	sc( (sx * (gArgs.nx - 1) + gArgs.w) / 2,
+                (sy * (gArgs.ny - 1) + gArgs.h) / 2 ),
+            tc( gArgs.w / 2.0, gArgs.h / 2.0 );
+
+    srand48( gArgs.seed );
+
+    for( int z = 0; z < gArgs.nz; ++z ) {
+
+        // Layer: rotate about section center, then offset
+
+        double	r = gArgs.twist * Gauss() * PI / 180,
+                c = cos( r ), s = sin( r );
+        THmgphy	L = Aff( c, -s, sc.x - c*sc.x + s*sc.y + gArgs.drift * Gauss(),
+                         s,  c, sc.y - s*sc.x - c*sc.y + gArgs.drift * Gauss() );
+
+        for( int row = 0; row < gArgs.ny; ++row ) {
+
+            for( int col = 0; col < gArgs.nx; ++col ) {
+
+                CTile	T;
+
+                T.z		= z;
+                T.id	= col + gArgs.nx * row;
+                T.col	= col;
+                T.row	= row;
+
+                // Tile: perspective and rotation about its
+                // center, then stage position plus jitter.
+
+                r = gArgs.deg * Gauss() * PI / 180;
+                c = cos( r );
+                s = sin( r );
+
+                THmgphy	A = Aff( c, -s,
+                            col * sx + gArgs.jitter * Gauss()
+                                + tc.x - c*tc.x + s*tc.y,
+                            s,  c,
+                            row * sy + gArgs.jitter * Gauss()
+                                + tc.y - s*tc.x - c*tc.y ),
+                        P = THmgphy( 1, 0, 0, 0, 1, 0,
+                                gArgs.persp * Gauss(),
+                                gArgs.persp * Gauss() );
+
+                P = Aff( 1, 0, tc.x, 0, 1, tc.y ) * P
+                    * Aff( 1, 0, -tc.x, 0, 1, -tc.y );
+
+                T.H = L * A * P;
+
+                // Fold: a line near the center, any angle
+
+                T.fold	= drand48() < gArgs.folds;
+                r		= PI * drand48();
+                T.fc	= cos( r );
+                T.fs	= sin( r );
+                T.f0	= Point( tc.x + gArgs.w * (drand48() - 0.5) / 3,
+                                 tc.y + gArgs.h * (drand48() - 0.5) / 3 );
+
+                vT.push_back( T );
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* WriteTruth ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void WriteTruth()
+{
+    char	buf[2048];
+    FILE	*f;
+    int		nt = vT.size();
+
+// layout: stage grid only
+
+    sprintf( buf, "%s/layout.txt", gOut.c_str() );
+    f = FileOpenOrDie( buf, "w", flog );
+
+    for( int i = 0; i < nt; ++i ) {
+
+        const CTile	&T = vT[i];
+
+        fprintf( f,
+        "%d\t%d\t1\t0\t%f\t0\t1\t%f\t%d\t%d\t0\t%s/img/%d/%d.%d.tif\n",
+        T.z, T.id,
+        T.col * gArgs.w * (1 - gArgs.olap),
+        T.row * gArgs.h * (1 - gArgs.olap),
+        T.col, T.row, gOut.c_str(), T.z, T.z, T.id );
+    }
+
+    fclose( f );
+
+// truth
+
+    sprintf( buf, "%s/truth.txt", gOut.c_str() );
+    f = FileOpenOrDie( buf, "w", flog );
+
+    for( int i = 0; i < nt; ++i ) {
+
+        const CTile	&T = vT[i];
+
+        fprintf( f, "%d\t%d\t%d", T.z, T.id, T.fold );
+
+        for( int k = 0; k < 8; ++k )
+            fprintf( f, "\t%.12g", T.H.t[k] );
+
+        fprintf( f, "\n" );
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* _Render ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void* _Render( void* ithr )
+{
+    int				w = gArgs.w, h = gArgs.h;
+    vector<uint8>	ras( w * h );
+
+    for( int it = (long)ithr, nt = vT.size(); it < nt; it += gArgs.nthr ) {
+
+        const CTile	&T = vT[it];
+
+        for( int y = 0; y < h; ++y ) {
+
+            for( int x = 0; x < w; ++x ) {
+
+                double	v;
+
+                if( T.fold &&
+                    fabs( (x - T.f0.x) * T.fc + (y - T.f0.y) * T.fs )
+                    < FOLDW / 2 ) {
+
+                    v = 2;
+                }
+                else {
+
+                    Point	p( x, y );
+
+                    T.H.Transform( p );
+
+                    // tissue plus sensor noise
+
+                    v = Tissue( p.x, p.y, T.z )
+                        + 12 * (Hash( x, y, T.z * 65536 + T.id ) - 0.5);
+
+                    v = max( 25.0, min( 250.0, v ) );
+                }
+
+                ras[x + w*y] = (uint8)(v + 0.5);
+            }
+        }
+
+        char	buf[2048];
+
+        sprintf( buf, "%s/img/%d/%d.%d.tif",
+            gOut.c_str(), T.z, T.z, T.id );
+
+        Raster8ToTif8( buf, &ras[0], w, h, flog );
+    }
+
+    return NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeData ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void MakeData()
+{
+    char	buf[2048];
+
+    DskCreateDir( gArgs.outdir, flog );
+    DskAbsPath( buf, sizeof(buf), gArgs.outdir, flog );
+    gOut = buf;
+
+    sprintf( buf, "%s/img", gOut.c_str() );
+    DskCreateDir( buf, flog );
+
+    for( int z = 0; z < gArgs.nz; ++z ) {
+        sprintf( buf, "%s/img/%d", gOut.c_str(), z );
+        DskCreateDir( buf, flog );
+    }
+
+    MakeTruth();
+    WriteTruth();
+
+    if( !EZThreads( _Render, gArgs.nthr, 1, "_Render", flog ) )
+        exit( 42 );
+
+    int	nf = 0;
+
+    for( int i = 0, n = vT.size(); i < n; ++i )
+        nf += vT[i].fold;
+
+    fprintf( flog,
+    "Made %d layers of %d x %d tiles (%d x %d px), %d folded.\n",
+    gArgs.nz, gArgs.nx, gArgs.ny, gArgs.w, gArgs.h, nf );
+}
+
+/* --------------------------------------------------------------- */
+/* ReadTruth ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void ReadTruth()
+{
+    FILE		*f = FileOpenOrDie( gArgs.truth, "r", flog );
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        CTile	T;
+        int		fold;
+
+        if( 11 != sscanf( LS.line,
+            "%d%d%d%lf%lf%lf%lf%lf%lf%lf%lf",
+            &T.z, &T.id, &fold,
+            &T.H.t[0], &T.H.t[1], &T.H.t[2], &T.H.t[3],
+            &T.H.t[4], &T.H.t[5], &T.H.t[6], &T.H.t[7] ) ) {
+
+            continue;
+        }
+
+        T.fold = fold;
+        mT[ZID( T.z, T.id )] = vT.size();
+        vT.push_back( T );
+    }
+
+    fclose( f );
+
+    fprintf( flog, "Truth: %d tiles.\n", (int)vT.size() );
+}
+
+/* --------------------------------------------------------------- */
+/* Report -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void Report( const char *what, int n, double err, double emax )
+{
+    fprintf( flog, "%s: n %d, err %.4f, max %.4f\n",
+    what, n, err, emax );
+
+    printf( "CHECK,%d,%.4f,%.4f\n", n, err, emax );
+}
+
+/* --------------------------------------------------------------- */
+/* AffResid ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Fit affine A minimizing sum |A(s)-t|^2, then add each squared
+// residual to sum and return max residual (px).
+//
+static double AffResid(
+    double					&sum,
+    const vector<Point>		&s,
+    const vector<Point>		&t )
+{
+    int		n = s.size();
+    Point	sm, tm;
+
+    if( n < 3 )
+        return 0;
+
+// Center both sets for conditioning
+
+    for( int i = 0; i < n; ++i ) {
+        sm.x += s[i].x;
+        sm.y += s[i].y;
+        tm.x += t[i].x;
+        tm.y += t[i].y;
+    }
+
+    sm.x /= n;
+    sm.y /= n;
+    tm.x /= n;
+    tm.y /= n;
+
+// Normal equations, shared by x and y rows
+
+    double	M[3][3] = {{0,0,0},{0,0,0},{0,0,0}},
+            I[3][3],
+            bx[3] = {0,0,0},
+            by[3] = {0,0,0};
+
+    for( int i = 0; i < n; ++i ) {
+
+        double	v[3] = {s[i].x - sm.x, s[i].y - sm.y, 1};
+
+        for( int r = 0; r < 3; ++r ) {
+
+            for( int c = 0; c < 3; ++c )
+                M[r][c] += v[r] * v[c];
+
+            bx[r] += v[r] * (t[i].x - tm.x);
+            by[r] += v[r] * (t[i].y - tm.y);
+        }
+    }
+
+    Invert3x3Matrix( I, M );
+
+    double	ax[3] = {0,0,0},
+            ay[3] = {0,0,0};
+
+    for( int r = 0; r < 3; ++r ) {
+
+        for( int c = 0; c < 3; ++c ) {
+            ax[r] += I[r][c] * bx[c];
+            ay[r] += I[r][c] * by[c];
+        }
+    }
+
+// Residuals
+
+    double	emax = 0;
+
+    for( int i = 0; i < n; ++i ) {
+
+        double	u  = s[i].x - sm.x,
+                v  = s[i].y - sm.y,
+                dx = ax[0]*u + ax[1]*v + ax[2] - (t[i].x - tm.x),
+                dy = ay[0]*u + ay[1]*v + ay[2] - (t[i].y - tm.y),
+                e2 = dx*dx + dy*dy;
+
+        sum += e2;
+        emax = max( emax, sqrt( e2 ) );
+    }
+
+    return emax;
+}
+
+/* --------------------------------------------------------------- */
+/* CheckTForms --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void CheckTForms()
+{
+    vector<Point>	s, t;
+    double			sum = 0, emax = 0;
+    int				nr = 0, ndead = 0, ns = 0;
+
+    for( int z = gArgs.zilo; z <= gArgs.zihi; ++z ) {
+
+        char	path[2048];
+        Rgns	R;
+
+        sprintf( path, gArgs.tforms, z );
+
+        if( !R.Init( gArgs.idb, z, flog ) )
+            continue;
+
+        if( !DskExists( path ) || !R.Load( path ) ) {
+            fprintf( flog, "No tforms z=%d [%s].\n", z, path );
+            ndead += R.nr;
+            continue;
+        }
+
+        map<int,int>::iterator	mi, en = R.m.end();
+
+        for( mi = R.m.begin(); mi != en; ) {
+
+            int	id		= mi->first,
+                j0		= mi->second,
+                jlim	= (++mi == en ? R.nr : mi->second);
+
+            map<ZID,int>::iterator	ti = mT.find( ZID( z, id ) );
+
+            if( ti == mT.end() )
+                continue;
+
+            const THmgphy	&H = vT[ti->second].H;
+
+            for( int j = j0; j < jlim; ++j ) {
+
+                if( !FLAG_ISUSED( R.flag[j] ) ) {
+                    ++ndead;
+                    continue;
+                }
+
+                ++nr;
+
+                for( int k = 0; k < 9; ++k ) {
+
+                    Point	p( gArgs.w * (0.1 + 0.4 * (k % 3)),
+                               gArgs.h * (0.1 + 0.4 * (k / 3)) ),
+                            q = p;
+
+                    if( R.NE == 6 )
+                        X_AS_AFF( R.x, j ).Transform( p );
+                    else
+                        X_AS_HMY( R.x, j ).Transform( p );
+
+                    H.Transform( q );
+
+                    s.push_back( p );
+                    t.push_back( q );
+                }
+            }
+        }
+
+        if( gArgs.layers ) {
+            ns	+= s.size();
+            emax = max( emax, AffResid( sum, s, t ) );
+            s.clear();
+            t.clear();
+        }
+    }
+
+    if( !gArgs.layers ) {
+        ns	= s.size();
+        emax = AffResid( sum, s, t );
+    }
+
+    fprintf( flog, "TForms [%s]: %d rgns scored, %d dropped.\n",
+    gArgs.tforms, nr, ndead );
+
+    Report( "TForms", nr, (ns ? sqrt( sum / ns ) : 0), emax );
+}
+
+/* --------------------------------------------------------------- */
+/* CheckPts ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void CheckPtsFile( double &sum, double &emax, int &n, const char *path )
+{
+    FILE	*f = fopen( path, "r" );
+
+    if( !f )
+        return;
+
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        Point	a, b;
+        int		za, ia, ra, zb, ib, rb;
+
+        if( 10 != sscanf( LS.line,
+            "CPOINT2 %d.%d-%d %lf %lf %d.%d-%d %lf %lf",
+            &za, &ia, &ra, &a.x, &a.y,
+            &zb, &ib, &rb, &b.x, &b.y ) ) {
+
+            continue;
+        }
+
+        map<ZID,int>::iterator	A = mT.find( ZID( za, ia ) ),
+                                B = mT.find( ZID( zb, ib ) );
+
+        if( A == mT.end() || B == mT.end() )
+            continue;
+
+        vT[A->second].H.Transform( a );
+        vT[B->second].H.Transform( b );
+
+        double	d = a.Dist( b );
+
+        sum += d * d;
+        emax = max( emax, d );
+        ++n;
+    }
+
+    fclose( f );
+}
+
+
+static void CheckPts()
+{
+    bool	same = !strcmp( gArgs.pts, "same" );
+    double	sum = 0, emax = 0;
+    int		n = 0;
+
+    for( int z = gArgs.zilo; z <= gArgs.zihi; ++z ) {
+
+        char	buf[2048];
+        DIR		*dir;
+        dirent	*e;
+
+        sprintf( buf, "%d", z );
+
+        if( !(dir = opendir( buf )) )
+            continue;
+
+        while( e = readdir( dir ) ) {
+
+            int	x, y;
+
+            if( e->d_name[0] != (same ? 'S' : 'D') ||
+                2 != sscanf( e->d_name + 1, "%d_%d", &x, &y ) ) {
+
+                continue;
+            }
+
+            sprintf( buf, "%d/%s/pts.%s",
+                z, e->d_name, (same ? "same" : "down") );
+
+            CheckPtsFile( sum, emax, n, buf );
+        }
+
+        closedir( dir );
+    }
+
+    Report( (same ? "Pts.same" : "Pts.down"),
+        n, (n ? sqrt( sum / n ) : 0), emax );
+}
+
+/* --------------------------------------------------------------- */
+/* CheckFolds ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void CheckFolds()
+{
+    int	n = 0, nbad = 0;
+
+    for( int z = gArgs.zilo; z <= gArgs.zihi; ++z ) {
+
+        map<int,int>			m;
+        map<int,int>::iterator	it, nx;
+        int						nr = IDBGetIDRgnMap( m, gArgs.idb, z, flog );
+
+        for( it = m.begin(); it != m.end(); it = nx ) {
+
+            nx = it;
+            ++nx;
+
+            map<ZID,int>::iterator	ti = mT.find( ZID( z, it->first ) );
+
+            if( ti == mT.end() )
+                continue;
+
+            bool	split = (nx != m.end() ? nx->second : nr)
+                                - it->second > 1;
+
+            ++n;
+
+            if( split != vT[ti->second].fold ) {
+
+                fprintf( flog, "Fold %s: %d.%d\n",
+                (split ? "false" : "missed"), z, it->first );
+
+                ++nbad;
+            }
+        }
+    }
+
+    Report( "Folds", n, (n ? double(nbad) / n : 0), nbad );
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+/* ------------------ */
+/* Parse command line */
+/* ------------------ */
+
+    gArgs.SetCmdLine( argc, argv );
+
+/* ---- */
+/* Make */
+/* ---- */
+
+    if( gArgs.outdir )
+        MakeData();
+
+/* ----- */
+/* Check */
+/* ----- */
+
+    else {
+
+        ReadTruth();
+
+        if( gArgs.tforms )
+            CheckTForms();
+        else if( gArgs.pts )
+            CheckPts();
+        else if( gArgs.chkfolds )
+            CheckFolds();
+    }
+
+/* ---- */
+/* Done */
+/* ---- */
+
+    fprintf( flog, "\n" );
+    fclose( flog );
+
+    return 0;
+}
+
+
@@ -0,0 +1,695 @@
+//
+// Summarize the telemetry (see 0_GEN/Telemetry.cpp) that pipeline
+// tools leave as 'telem*.jsonl' files (one per process), one JSON
+// line per job.
+//
+// > telemreport [dir | file.jsonl ...] [-ws=temp0] [-top=20]
+//
+// Directories are searched recursively for telem*.jsonl files;
+// default is the current dir (the $ALN_TELEM dir or file).
+// Job dirs are classified relative to -ws, default the searched
+// dir itself.
+// Writes 'telemreport.txt' with totals by phase, stage, layer
+// and the slowest blocks:
+//
+//	phase	tool name, with /same or /down if run in an Sx_y or
+//			Dx_y block dir.
+//	layer	first all-digit component of the job dir below the
+//			searched dir, else the job's 'z' tag.
+//	block	job dir path through its Sx_y or Dx_y component.
+//
+// Hours are summed over jobs, so cpu-h is what a cluster charged
+// and wall-h what the jobs occupied.
+//
+
+
+#include	"Cmdline.h"
+#include	"File.h"
+
+#include	<dirent.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/stat.h>
+
+#include	<algorithm>
+#include	<map>
+#include	<string>
+#include	<vector>
+using namespace std;
+
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Minimal JSON value: enough for our own records
+
+class JVal {
+public:
+    enum { jNull, jNum, jStr, jObj };
+    int							kind;
+    double						num;
+    string						str;
+    vector<pair<string,JVal> >	obj;
+public:
+    JVal() : kind(jNull), num(0) {};
+
+    const JVal* Get( const char *key ) const;
+    double Num( const char *key, double dflt = 0 ) const;
+    string Str( const char *key ) const;
+};
+
+
+class CAgg {
+public:
+    int		n, nfail, nexit;
+    double	wall, cpu, wmax, rss, rd, wr;
+public:
+    CAgg()
+    : n(0), nfail(0), nexit(0),
+      wall(0), cpu(0), wmax(0), rss(0), rd(0), wr(0) {};
+
+    void Add( const JVal &J );
+};
+
+
+class CStg {
+public:
+    double	n, wall, cpu;
+public:
+    CStg() : n(0), wall(0), cpu(0) {};
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_tlm ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_tlm {
+
+public:
+    vector<const char*>	src;
+    const char			*ws;
+    int					top;
+
+public:
+    CArgs_tlm() : ws(NULL), top(20) {};
+
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static CArgs_tlm					gArgs;
+static FILE*						flog	= NULL;
+static CAgg							gAll;
+static map<string,CAgg>				mPhs,
+                                    mLyr,
+                                    mBlk;
+static map<string,string>			mBlkPhs;
+static map<string,map<string,CStg> >	mStg;
+static int							nfiles	= 0,
+                                    nbad	= 0;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_tlm::SetCmdLine( int argc, char* argv[] )
+{
+// start log
+
+    flog = FileOpenOrDie( "telemreport.txt", "w" );
+
+// parse command line args
+
+    for( int i = 1; i < argc; ++i ) {
+
+        if( argv[i][0] != '-' )
+            src.push_back( argv[i] );
+        else if( GetArgStr( ws, "-ws=", argv[i] ) )
+            ;
+        else if( GetArg( &top, "-top=%d", argv[i] ) )
+            ;
+        else {
+            printf( "Did not understand option [%s].\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    if( !src.size() )
+        src.push_back( "." );
+}
+
+/* --------------------------------------------------------------- */
+/* JVal ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+const JVal* JVal::Get( const char *key ) const
+{
+    for( int i = 0, n = obj.size(); i < n; ++i ) {
+
+        if( obj[i].first == key )
+            return &obj[i].second;
+    }
+
+    return NULL;
+}
+
+
+double JVal::Num( const char *key, double dflt ) const
+{
+    const JVal	*v = Get( key );
+
+    return (v && v->kind == jNum ? v->num : dflt);
+}
+
+
+string JVal::Str( const char *key ) const
+{
+    const JVal	*v = Get( key );
+
+    return (v && v->kind == jStr ? v->str : string());
+}
+
+/* --------------------------------------------------------------- */
+/* Parse --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void SkipWS( const char* &c )
+{
+    while( *c == ' ' || *c == '\t' || *c == '\r' || *c == '\n' )
+        ++c;
+}
+
+
+static bool ParseStr( string &s, const char* &c )
+{
+    if( *c++ != '"' )
+        return false;
+
+    s.clear();
+
+    for( ; *c && *c != '"'; ++c ) {
+
+        if( *c == '\\' && c[1] )
+            ++c;
+
+        s += *c;
+    }
+
+    return *c++ == '"';
+}
+
+
+// Parse objects, strings and numbers; arrays, true, false and
+// null are accepted and read as null.
+//
+static bool Parse( JVal &v, const char* &c )
+{
+    SkipWS( c );
+
+    if( *c == '{' ) {
+
+        v.kind = JVal::jObj;
+        ++c;
+        SkipWS( c );
+
+        if( *c == '}' ) {
+            ++c;
+            return true;
+        }
+
+        for(;;) {
+
+            pair<string,JVal>	kv;
+
+            SkipWS( c );
+
+            if( !ParseStr( kv.first, c ) )
+                return false;
+
+            SkipWS( c );
+
+            if( *c++ != ':' || !Parse( kv.second, c ) )
+                return false;
+
+            v.obj.push_back( kv );
+            SkipWS( c );
+
+            if( *c == ',' )
+                ++c;
+            else if( *c == '}' ) {
+                ++c;
+                return true;
+            }
+            else
+                return false;
+        }
+    }
+    else if( *c == '"' ) {
+        v.kind = JVal::jStr;
+        return ParseStr( v.str, c );
+    }
+    else if( *c == '[' ) {
+
+        int	depth = 0;
+
+        do {
+            if( *c == '[' )
+                ++depth;
+            else if( *c == ']' )
+                --depth;
+        } while( *c++ && depth );
+
+        return !depth;
+    }
+    else if( isalpha( *c ) ) {
+
+        while( isalpha( *c ) )
+            ++c;
+
+        return true;
+    }
+    else {
+
+        char	*e;
+
+        v.num = strtod( c, &e );
+
+        if( e == c )
+            return false;
+
+        v.kind = JVal::jNum;
+        c = e;
+        return true;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* CAgg::Add ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CAgg::Add( const JVal &J )
+{
+    string	st = J.Str( "status" );
+    double	w  = J.Num( "wall" );
+
+    ++n;
+
+    if( st == "fail" )
+        ++nfail;
+    else if( st == "exit" )
+        ++nexit;
+
+    wall	+= w;
+    cpu		+= J.Num( "cpu" );
+    wmax	= max( wmax, w );
+    rss		= max( rss, J.Num( "maxrss_mb" ) );
+    rd		+= J.Num( "rd_mb" );
+    wr		+= J.Num( "wr_mb" );
+}
+
+/* --------------------------------------------------------------- */
+/* Classify ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// From job dir relative to searched root, get phase, layer and
+// block names (block empty if none).
+//
+static void Classify(
+    string			&phase,
+    string			&layer,
+    string			&block,
+    const JVal		&J,
+    const string	&rel )
+{
+    phase = J.Str( "tool" );
+    layer.clear();
+    block.clear();
+
+    if( phase.empty() )
+        phase = "?";
+
+    size_t	i0 = 0;
+
+    while( i0 < rel.size() ) {
+
+        size_t	i1 = rel.find( '/', i0 );
+
+        if( i1 == string::npos )
+            i1 = rel.size();
+
+        string	c = rel.substr( i0, i1 - i0 );
+        int		ix, iy;
+        char	x;
+
+        if( layer.empty() && !c.empty() &&
+            c.find_first_not_of( "0123456789" ) == string::npos ) {
+
+            layer = c;
+        }
+        else if( block.empty() && c.size() > 1 &&
+            (c[0] == 'S' || c[0] == 'D') &&
+            2 == sscanf( c.c_str() + 1, "%d_%d%c", &ix, &iy, &x ) ) {
+
+            block = rel.substr( 0, i1 );
+            phase += (c[0] == 'S' ? "/same" : "/down");
+        }
+
+        i0 = i1 + 1;
+    }
+
+    if( layer.empty() ) {
+
+        const JVal	*t = J.Get( "tags" );
+
+        if( t )
+            layer = t->Str( "z" );
+
+        if( layer.empty() )
+            layer = "-";
+    }
+
+    if( block.empty() ) {
+
+        const JVal	*t = J.Get( "tags" );
+
+        if( t && !t->Str( "block" ).empty() )
+            block = rel + (rel.empty() ? "" : "/") + t->Str( "block" );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* ReadFile ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Tally each record in telemetry file path. Job dirs are made
+// relative to root; a record whose dir lies elsewhere (tree was
+// moved) is placed by the file's own dir instead.
+//
+static void ReadFile( const string &path, const string &root )
+{
+    FILE	*f = fopen( path.c_str(), "r" );
+
+    if( !f ) {
+        fprintf( flog, "Can't open [%s].\n", path.c_str() );
+        return;
+    }
+
+    ++nfiles;
+
+    string		fdir = path.substr( 0, path.rfind( '/' ) + 1 );
+    CLineScan	LS;
+
+    while( LS.Get( f ) > 0 ) {
+
+        JVal		J;
+        const char	*c = LS.line;
+
+        if( !Parse( J, c ) || J.kind != JVal::jObj ) {
+            ++nbad;
+            continue;
+        }
+
+        string	dir = J.Str( "dir" ) + "/", rel;
+
+        if( dir.compare( 0, root.size(), root ) )
+            dir = fdir;
+
+        if( !dir.compare( 0, root.size(), root ) )
+            rel = dir.substr( root.size() );
+
+        while( !rel.empty() && rel[rel.size()-1] == '/' )
+            rel.erase( rel.size() - 1 );
+
+        string	phase, layer, block;
+
+        Classify( phase, layer, block, J, rel );
+
+        gAll.Add( J );
+        mPhs[phase].Add( J );
+        mLyr[layer].Add( J );
+
+        if( !block.empty() ) {
+            mBlk[block].Add( J );
+            mBlkPhs[block] = phase;
+        }
+
+        const JVal	*S = J.Get( "stages" );
+
+        if( S ) {
+
+            for( int i = 0, n = S->obj.size(); i < n; ++i ) {
+
+                const JVal	&s = S->obj[i].second;
+                CStg		&G = mStg[phase][S->obj[i].first];
+
+                G.n		+= s.Num( "n" );
+                G.wall	+= s.Num( "wall" );
+                G.cpu	+= s.Num( "cpu" );
+            }
+        }
+    }
+
+    fclose( f );
+}
+
+/* --------------------------------------------------------------- */
+/* Walk ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Name is telem*.jsonl: the per-process files, or a shared
+// telem.jsonl from an older build.
+//
+static bool IsTelemFile( const char *name )
+{
+    int	n = strlen( name );
+
+    return  !strncmp( name, "telem", 5 ) &&
+            n >= 11 && !strcmp( name + n - 6, ".jsonl" );
+}
+
+
+static void Walk( const string &dir, const string &root )
+{
+    DIR	*d = opendir( dir.c_str() );
+
+    if( !d )
+        return;
+
+    vector<string>	vsub;
+    dirent			*e;
+
+    while( e = readdir( d ) ) {
+
+        if( e->d_name[0] == '.' )
+            continue;
+
+        string		path = dir + "/" + e->d_name;
+        struct stat	st;
+
+        if( lstat( path.c_str(), &st ) )
+            continue;
+
+        if( S_ISDIR( st.st_mode ) )
+            vsub.push_back( path );
+        else if( IsTelemFile( e->d_name ) )
+            ReadFile( path, root );
+    }
+
+    closedir( d );
+
+    for( int i = 0, n = vsub.size(); i < n; ++i )
+        Walk( vsub[i], root );
+}
+
+/* --------------------------------------------------------------- */
+/* Report -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void PrintAgg( const char *name, const CAgg &A )
+{
+    fprintf( flog,
+    "%-20s %6d %5d %9.2f %9.2f %8.1f %8.1f %7.0f %7.2f %7.2f\n",
+    name, A.n, A.nfail + A.nexit, A.wall / 3600, A.cpu / 3600,
+    A.wall / A.n, A.wmax, A.rss, A.rd / 1024, A.wr / 1024 );
+}
+
+
+static void PrintHdr( const char *first )
+{
+    fprintf( flog,
+    "%-20s %6s %5s %9s %9s %8s %8s %7s %7s %7s\n",
+    first, "jobs", "fail", "wall-h", "cpu-h", "mean-s", "max-s",
+    "rss-MB", "rd-GB", "wr-GB" );
+}
+
+
+class CBlkSort {
+public:
+    string	name;
+    double	wall;
+public:
+    CBlkSort( const string &name, double wall )
+    : name(name), wall(wall) {};
+
+    bool operator < ( const CBlkSort &rhs ) const
+        {return wall > rhs.wall;};
+};
+
+
+static void Report()
+{
+    fprintf( flog,
+    "Telemetry: %d jobs in %d files (%d bad lines).\n"
+    "Wall %.2f h, cpu %.2f h; %d failed, %d exited early.\n\n",
+    gAll.n, nfiles, nbad, gAll.wall / 3600, gAll.cpu / 3600,
+    gAll.nfail, gAll.nexit );
+
+    if( !gAll.n )
+        return;
+
+// Phases
+
+    map<string,CAgg>::iterator	it;
+
+    fprintf( flog, "By phase:\n" );
+    PrintHdr( "phase" );
+
+    for( it = mPhs.begin(); it != mPhs.end(); ++it )
+        PrintAgg( it->first.c_str(), it->second );
+
+// Stages
+
+    fprintf( flog, "\nStages by phase (%% of phase wall):\n" );
+    fprintf( flog, "%-20s %-20s %8s %9s %9s %6s\n",
+    "phase", "stage", "n", "wall-h", "cpu-h", "%" );
+
+    map<string,map<string,CStg> >::iterator	ip;
+
+    for( ip = mStg.begin(); ip != mStg.end(); ++ip ) {
+
+        double	pw = mPhs[ip->first].wall;
+
+        map<string,CStg>::iterator	is;
+
+        for( is = ip->second.begin(); is != ip->second.end(); ++is ) {
+
+            const CStg	&G = is->second;
+
+            fprintf( flog, "%-20s %-20s %8.0f %9.2f %9.2f %6.1f\n",
+            ip->first.c_str(), is->first.c_str(), G.n,
+            G.wall / 3600, G.cpu / 3600,
+            (pw > 0 ? 100 * G.wall / pw : 0) );
+        }
+    }
+
+// Layers
+
+    fprintf( flog, "\nBy layer:\n" );
+    PrintHdr( "layer" );
+
+    for( it = mLyr.begin(); it != mLyr.end(); ++it )
+        PrintAgg( it->first.c_str(), it->second );
+
+// Slowest blocks
+
+    if( !mBlk.size() )
+        return;
+
+    vector<CBlkSort>	vb;
+
+    for( it = mBlk.begin(); it != mBlk.end(); ++it )
+        vb.push_back( CBlkSort( it->first, it->second.wall ) );
+
+    sort( vb.begin(), vb.end() );
+
+    int	nb = min( (int)vb.size(), gArgs.top );
+
+    fprintf( flog, "\nSlowest %d of %d blocks:\n", nb, (int)vb.size() );
+    PrintHdr( "block" );
+
+    for( int i = 0; i < nb; ++i ) {
+
+        PrintAgg( vb[i].name.c_str(), mBlk[vb[i].name] );
+        fprintf( flog, "%20s (%s)\n", "", mBlkPhs[vb[i].name].c_str() );
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+/* ------------------ */
+/* Parse command line */
+/* ------------------ */
+
+    gArgs.SetCmdLine( argc, argv );
+
+/* ------------ */
+/* Read sources */
+/* ------------ */
+
+    string	wsroot;
+
+    if( gArgs.ws ) {
+
+        char	buf[4096];
+
+        if( !realpath( gArgs.ws, buf ) ) {
+            fprintf( flog, "No such workspace [%s].\n", gArgs.ws );
+            exit( 42 );
+        }
+
+        wsroot = string( buf ) + "/";
+    }
+
+    for( int i = 0, n = gArgs.src.size(); i < n; ++i ) {
+
+        char		buf[4096];
+        struct stat	st;
+
+        if( !realpath( gArgs.src[i], buf ) || stat( buf, &st ) ) {
+            fprintf( flog, "No such source [%s].\n", gArgs.src[i] );
+            continue;
+        }
+
+        string	root = buf;
+
+        if( S_ISDIR( st.st_mode ) )
+            Walk( root, gArgs.ws ? wsroot : root + "/" );
+        else {
+            ReadFile( root, gArgs.ws ? wsroot :
+                root.substr( 0, root.rfind( '/' ) + 1 ) );
+        }
+    }
+
+/* ------ */
+/* Report */
+/* ------ */
+
+    Report();
+
+    printf( "Telemetry: %d jobs, wall %.2f h, cpu %.2f h;"
+    " see telemreport.txt.\n",
+    gAll.n, gAll.wall / 3600, gAll.cpu / 3600 );
+
+/* ---- */
+/* Done */
+/* ---- */
+
+    fclose( flog );
+
+    return 0;
+}
+
+
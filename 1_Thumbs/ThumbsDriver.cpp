@@ -82,6 +82,7 @@ int main( int argc, char* argv[] )
         clock_t				t1 = StartTiming();
         uint8				*fold_mask_a, *fold_mask_b;
         vector<ConnRegion>	Acr, Bcr;
+        vector<RgnMapEntry>	rgn_a, rgn_b;
 
         printf( "\n---- Foldmaps ----\n" );
 
@@ -96,7 +97,7 @@ int main( int argc, char* argv[] )
                 px.resmska, pCM,
                 px.wf, px.hf,
                 false, GBL.arg.Transpose,
-                GBL.arg.SingleFold );
+                GBL.arg.SingleFold, stdout, &rgn_a );
 
         fold_mask_b =
             GetFoldMask(
@@ -104,7 +105,7 @@ int main( int argc, char* argv[] )
                 px.resmskb, pCM,
                 px.wf, px.hf,
                 false, GBL.arg.Transpose,
-                GBL.arg.SingleFold );
+                GBL.arg.SingleFold, stdout, &rgn_b );
 
         /* ----------------------- */
         /* Convert to Conn regions */
@@ -117,11 +118,11 @@ int main( int argc, char* argv[] )
 
         ConnRgnsFromFoldMask( Acr, fold_mask_a,
             px.wf, px.hf, px.scl,
-            GBL.ctx.OLAP2D );
+            GBL.ctx.OLAP2D, stdout, &rgn_a );
 
         ConnRgnsFromFoldMask( Bcr, fold_mask_b,
             px.wf, px.hf, px.scl,
-            GBL.ctx.OLAP2D );
+            GBL.ctx.OLAP2D, stdout, &rgn_b );
 
         StopTiming( stdout, "Conn regions", t1 );
 
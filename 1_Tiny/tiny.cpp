@@ -8,6 +8,7 @@
 #include	"Geometry.h"
 #include	"CPicBase.h"
 #include	"Memory.h"
+#include	"Telemetry.h"
 
 #include	"numerical_recipes.h"
 
@@ -27,7 +28,8 @@ public:
     int			Z,
                 ID,
                 D,
-                minarea;
+                minarea,
+                nthr;
     bool		nomasks,
                 oneregion,
                 transpose,
@@ -45,6 +47,7 @@ public:
         ID				= -1;
         D				= -1;
         minarea			= 90000;
+        nthr			= 1;
         nomasks			= false;
         oneregion		= false;
         transpose		= false;
@@ -107,6 +110,8 @@ void CArgs_tiny::SetCmdLine( int argc, char* argv[] )
         }
         else if( GetArg( &minarea, "-minarea=%d", argv[i] ) )
             ;
+        else if( GetArg( &nthr, "-nthr=%d", argv[i] ) )
+            ;
         else if( IsArg( "-nf", argv[i] ) ) {
 
             nomasks = true;
@@ -698,7 +703,8 @@ static int ImageToFoldMap(
 
     SelectThreshAndD( thresh, D, mean, std, SAT );
 
-// Make normalized images
+// Make normalized images (global mean and std; no Legendre
+// flatten here, so ptest's -legfast does not apply).
 
     vector<double>	v(npixels);
 
@@ -716,25 +722,49 @@ static int ImageToFoldMap(
 
     Widen( v, w, h, thresh, D );
 
-// Propagate connected regions
+// Label connected regions
 
     vector<ConnRegion>	cr;
+    vector<int>			lbl;
+    int					nlbl;
+
+    {
+        vector<uint8>	msk( npixels );
 
-    for( int i = 0; i < npixels; ++i ) {
+        for( int i = 0; i < npixels; ++i )
+            msk[i] = (v[i] > -thresh);
 
-        if( v[i] > -thresh ) {
+        nlbl = LabelConnected( lbl, &msk[0], w, h, gArgs.nthr );
+    }
 
-            ConnRegion	c;
-            int			npts;
+// Report areas and keep the big ones
 
-            npts = Propagate( c.pts, v, w, h, i,
-                    -thresh, -thresh - 1.0 );
+    vector<int>	area( nlbl + 1, 0 ),
+                icr( nlbl + 1, -1 );
 
-            printf(
-            "ImageToFoldMap: ConnRegion with %d pixels\n", npts );
+    for( int i = 0; i < npixels; ++i )
+        ++area[lbl[i]];
 
-            if( npts > gArgs.minarea )
-                cr.push_back( c );
+    for( int k = 1; k <= nlbl; ++k ) {
+
+        printf(
+        "ImageToFoldMap: ConnRegion with %d pixels\n", area[k] );
+
+        if( area[k] > gArgs.minarea ) {
+            icr[k] = cr.size();
+            cr.push_back( ConnRegion() );
+            cr[icr[k]].pts.reserve( area[k] );
+        }
+    }
+
+    for( int y = 0, i = 0; y < h; ++y ) {
+
+        for( int x = 0; x < w; ++x, ++i ) {
+
+            int	k = icr[lbl[i]];
+
+            if( k >= 0 )
+                cr[k].pts.push_back( Point( x, y ) );
         }
     }
 
@@ -866,13 +896,19 @@ int main( int argc, char **argv )
 
     gArgs.SetCmdLine( argc, argv );
 
+    TelemBegin( "tiny", argc, argv );
+    TelemTag( "tile", "%d.%d", gArgs.Z, gArgs.ID );
+
 /* -------- */
 /* Load src */
 /* -------- */
 
     PicBase	p;
 
-    p.LoadOriginal( gArgs.infile, stdout, gArgs.transpose );
+    {
+        CTelemStage	ts( "Load" );
+        p.LoadOriginal( gArgs.infile, stdout, gArgs.transpose );
+    }
 
 /* ---------------- */
 /* Save src as nmrc */
@@ -887,6 +923,7 @@ int main( int argc, char **argv )
 
     if( gArgs.nomasks ) {
         WriteFOLDMAP2Entry( 1 );
+        TelemEnd();
         return 0;
     }
 
@@ -911,25 +948,39 @@ int main( int argc, char **argv )
 
         // Otherwise, calculate real foldmasks
 
+        CTelemStage	ts( "FoldMap" );
+
         ncr = ImageToFoldMap( FoldMaskAlign, p, true );
 
         if( gArgs.fmd )
             FoldMaskDraw = MakeDrawingMask( p, FoldMaskAlign, np );
     }
 
+    TelemCount( "regions", ncr );
+
 /* ------------------------------- */
 /* Write masks and FOLDMAP entries */
 /* ------------------------------- */
 
-    if( gArgs.fm )
+// Each mask gets a compact region map beside it (see WriteRgnMap)
+// that consumers load in preference to the image.
+
+    if( gArgs.fm ) {
         Raster8ToPng8( gArgs.fm, FoldMaskAlign, p.w, p.h );
+        WriteRgnMap( RgnMapPath( gArgs.fm ).c_str(),
+            FoldMaskAlign, p.w, p.h );
+    }
 
-    if( gArgs.fmd )
+    if( gArgs.fmd ) {
         Raster8ToPng8( gArgs.fmd, FoldMaskDraw, p.w, p.h );
+        WriteRgnMap( RgnMapPath( gArgs.fmd ).c_str(),
+            FoldMaskDraw, p.w, p.h );
+    }
 
     WriteFOLDMAP2Entry( ncr );
 
     VMStats( stdout );
+    TelemEnd();
     return 0;
 }
 
@@ -189,6 +189,9 @@ static void Write_mongo()
     fprintf( f, "#\n" );
     fprintf( f, "# Options:\n" );
     fprintf( f, "# -exe=ptestalt\t\t\t;exe other than 'ptest'\n" );
+    fprintf( f, "# -balance\t\t\t\t;blocks of equal predicted cost\n" );
+    fprintf( f, "# -hist=temp0\t\t\t;calibrate cost from old pair logs\n" );
+    fprintf( f, "# -spec\t\t\t\t\t;make.same claims pairs (jobsched -spec)\n" );
     fprintf( f, "\n" );
     fprintf( f, "\n" );
     fprintf( f, "wrk=temp0\n" );
@@ -7,7 +7,9 @@
 #include	"Cmdline.h"
 #include	"Disk.h"
 #include	"File.h"
+#include	"CTifReader.h"
 #include	"ImageIO.h"
+#include	"IntensOps.h"
 #include	"Maths.h"
 #include	"TAffine.h"
 #include	"CMask.h"
@@ -48,16 +50,13 @@ static char		tifdir[2048],
                 mskdir[2048],
                 rick[2048];
 static double	gscale		= 1.0;
-static uint16*	ffras[4]	= {NULL,NULL,NULL,NULL};
-static double	ffave[4]	= {0,0,0,0};
-static double	ffstd[4]	= {0,0,0,0};
-static int		fford[4]	= {0,0,0,0};	// leg poly order
-static int		ffoff[4]	= {0,0,0,0};	// use vals <= mode+offset
+static CFlatField	ff[4];
 static int		ischn[4]	= {0,0,0,0};
 static int		useT[4]		= {0,0,0,0};
 static TAffine	gT[4];
 static uint32	gW			= 0,
                 gH			= 0;	// universal pic dims
+static CRasterPool	pool( 1 );				// recycled tile raster
 static int		gped		= 0,
                 gmchn		= -1;
 
@@ -191,7 +190,7 @@ static void ReadParams()
     while( LS.Get( f ) > 0 ) {
 
         double	A[6];
-        int		chan, np;
+        int		chan;
         char	cUse;
 
         // scan parameters
@@ -215,37 +214,10 @@ static void ReadParams()
 
         // determine FF method
 
-        if( 4 == sscanf( buf, "LEG:%d:%d:%lf:%lf",
-            &fford[chan], &ffoff[chan],
-            &ffave[chan], &ffstd[chan] ) ) {
+        fprintf( flog, "ff chan %d: ", chan );
 
-            fprintf( flog, "ff chan %d using LEG [%d,%d,%f,%f].\n",
-            chan,
-            fford[chan], ffoff[chan],
-            ffave[chan], ffstd[chan] );
-
-        }
-        else {
-
-            // external file: compute FF average
-
-            ffras[chan] = Raster16FromTif16( buf, gW, gH, flog );
-
-            np = gW * gH;
-
-            for( int i = 0; i < np; ++i ) {
-
-                if( ffras[chan][i] >= gped )
-                    ffras[chan][i] -= gped;
-
-                if( ffras[chan][i] == 0 )
-                    ffras[chan][i] = 1;
-
-                ffave[chan] += ffras[chan][i];
-            }
-
-            ffave[chan] /= np;
-        }
+        if( !ff[chan].Set( buf, gped, gW, gH, flog ) )
+            exit( 42 );
 
         // compute gT
 
@@ -258,58 +230,6 @@ static void ReadParams()
     fclose( f );
 }
 
-/* --------------------------------------------------------------- */
-/* FFChannel ----------------------------------------------------- */
-/* --------------------------------------------------------------- */
-
-static void FFChannel( uint16* ras, int chan )
-{
-    int	np = gW * gH;
-
-    if( ffras[chan] ) {
-
-        // external file
-
-        for( int i = 0; i < np; ++i ) {
-
-            if( ras[i] >= gped )
-                ras[i] -= gped;
-
-            ras[i] = uint16(ras[i]*ffave[chan]/ffras[chan][i]);
-        }
-    }
-    else {
-
-        // ped subtract
-
-        for( int i = 0; i < np; ++i ) {
-
-            if( ras[i] >= gped )
-                ras[i] -= gped;
-        }
-
-        // Legendre polys
-
-        vector<double>	V;
-
-        LegPolyFlatten( V, ras, gW, gH, fford[chan], ffoff[chan] );
-
-        // rescale to given mean, stddev
-
-        for( int i = 0; i < np; ++i ) {
-
-            int	pix = int(ffave[chan] + V[i] * ffstd[chan]);
-
-            if( pix < 0 )
-                pix = 0;
-            else if( pix > 65535 )
-                pix = 65535;
-
-            ras[i] = pix;
-        }
-    }
-}
-
 /* --------------------------------------------------------------- */
 /* MagChannel ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -384,7 +304,7 @@ static void DoChannel( FILE* fout, int &z, int chan )
 
         // Read the image
         sprintf( path, "%s/%s", tifdir, name );
-        uint16*	ras = Raster16FromTif16( path, gW, gH, flog );
+        uint16*	ras = Raster16FromTif16Pooled( path, gW, gH, &pool, 1, flog );
 
         if( !ras ) {
             fprintf( flog, "Missing image=[%s]\n", path );
@@ -392,7 +312,7 @@ static void DoChannel( FILE* fout, int &z, int chan )
         }
 
         // Flat-field the image
-        FFChannel( ras, chan );
+        ff[chan].Apply( ras, gW, gH, gped );
 
         // Apply TForm
         if( useT[chan] )
@@ -415,7 +335,7 @@ static void DoChannel( FILE* fout, int &z, int chan )
             Mask.MaskFromImage( path, ras, gW, gH );
         }
 
-        RasterFree( ras );
+        pool.Put( ras, gW * gH * sizeof(uint16) );
     }
 
     fclose( frick );
@@ -523,9 +443,6 @@ int main( int argc, char* argv[] )
 
     ChannelLoop();
 
-    for( int i = 0; i < 4; ++i )
-        RasterFree( ffras[i] );
-
     fprintf( flog, "\n" );
     fclose( flog );
 
@@ -0,0 +1,873 @@
+//
+// For 1 layer, stream each 16-bit tile once through a chain of
+// intensity operations and write only the final products:
+//
+// tag
+// z layer
+// -ped=i
+// -ff=chn,spec		;flatfield (repeatable)
+// -gray=chn,pct	;GraRan1Lyr scale entry
+// -heq=chn,pct		;HEQ1Lyr 8-bit log image
+// -R=chn,pct		;RGBM1Lyr color merge
+// -G=chn,pct
+// -B=chn,pct
+// -spanRGB=LLL
+// -lrbt
+// -nthr=i
+// -keepmb=i
+//
+// Channel chn names the source file for each tile by replacing
+// the character before ".tif" in the xml path, as GraRan1Lyr
+// does; chn = -1 takes the xml path as is.
+//
+// Flatfield spec is either LEG:order:offset:mean:std or the path
+// of a flatfield tif, as in FFTomos param files. Scaling rules are
+// those of GraRan1Lyr, HEQ1Lyr and RGBM1Lyr, applied to the
+// flatfielded values.
+//
+// Outputs go to folder '<tile-folder>_tag':
+// HEQ:	<chan-file-name>.tag.tif
+// RGB:	<xml-file-name>.tag.rgb.tif
+//
+// Layer-wide scales need a histogram pass before any output can
+// be written. Flatfielded tiles are held in memory between the
+// passes, up to -keepmb, so that normally each tile is decoded
+// and flattened only once.
+//
+
+
+#include	"Cmdline.h"
+#include	"Disk.h"
+#include	"File.h"
+#include	"TrakEM2_UTL.h"
+#include	"CTifReader.h"
+#include	"EZThreads.h"
+#include	"ImageIO.h"
+#include	"IntensOps.h"
+#include	"Maths.h"
+#include	"TAffine.h"
+#include	"Telemetry.h"
+#include	"Timer.h"
+
+
+/* --------------------------------------------------------------- */
+/* Macros -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+#define	NSLOT	5	// channels -1..3
+#define	NBINS	65536
+
+/* --------------------------------------------------------------- */
+/* Types --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class Picture {
+public:
+    string	fname;
+    TAffine	T;
+    bool	inroi;
+public:
+    Picture( const TiXmlElement* ptch );
+};
+
+/* --------------------------------------------------------------- */
+/* CArgs_fuse ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+class CArgs_fuse {
+
+public:
+    IBox		roi;
+    double		grypct,
+                heqpct,
+                pct[3];
+    const char	*infile,
+                *tag,
+                *span;
+    int			z, ped,
+                gry, heq,
+                RGB[3],
+                nthr,
+                keepmb;
+    bool		isgry, isheq;
+
+public:
+    CArgs_fuse()
+    {
+        roi.L	= roi.R = 0;
+        grypct	= 99.5;
+        heqpct	= 99.5;
+        pct[0]	= 99.5;
+        pct[1]	= 99.5;
+        pct[2]	= 99.5;
+        infile	= NULL;
+        tag		= NULL;
+        span	= "LLL";
+        z		= 0;
+        ped		= 0;
+        gry		= -1;
+        heq		= -1;
+        RGB[0]	= -2;
+        RGB[1]	= -2;
+        RGB[2]	= -2;
+        nthr	= 1;
+        keepmb	= 2048;
+        isgry	= false;
+        isheq	= false;
+    };
+
+    bool ScanChan( int &chn, double &pct, const char *pat, char *argv );
+    bool ScanFF( char *argv );
+    void SetCmdLine( int argc, char* argv[] );
+};
+
+/* --------------------------------------------------------------- */
+/* Statics ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static CArgs_fuse		gArgs;
+static FILE*			flog = NULL;
+static uint32			gW = 0,	gH = 0;		// universal pic dims
+static CRasterPool		pool( 8 );			// recycled tile rasters
+static CFlatField		ff[NSLOT];
+static bool				isff[NSLOT]		= {0,0,0,0,0},
+                        isout[NSLOT]	= {0,0,0,0,0},	// read for output
+                        islyr[NSLOT]	= {0,0,0,0,0};	// layer hist
+static vector<double>	lbins[NSLOT];		// layer histograms
+static vector<uint8>	heqlut,				// layer scale maps
+                        rgblut[3];
+static vector<Picture>	vp;
+static vector<uint16*>	vkeep;				// [tile*NSLOT+slot]
+static bool				keep	= false;
+static int				ntile	= 0,		// tiles decoded
+                        nwrite	= 0;		// images written
+static pthread_mutex_t	mutex_fuse = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+
+
+/* --------------------------------------------------------------- */
+/* ScanChan ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+// Scan channel/pct arguments like:
+// -R=0[,95.5]
+//
+bool CArgs_fuse::ScanChan(
+    int			&chn,
+    double		&pct,
+    const char	*pat,
+    char		*argv )
+{
+    int	c;
+
+    if( 1 == sscanf( argv, pat, &c ) && c >= -1 && c <= 3 ) {
+
+        const char	*s = strchr( argv, ',' );
+        double		p;
+
+        chn = c;
+
+        if( s && 1 == sscanf( s + 1, "%lf", &p ) )
+            pct = p;
+
+        return true;
+    }
+
+    return false;
+}
+
+/* --------------------------------------------------------------- */
+/* ScanFF -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Scan flatfield arguments like:
+// -ff=0,LEG:2:100:1000:100
+// -ff=1,path/ff1.tif
+//
+// Pedestal (-ped) must precede any -ff.
+//
+bool CArgs_fuse::ScanFF( char *argv )
+{
+    const char	*s;
+    int			c;
+
+    if( 1 != sscanf( argv, "-ff=%d", &c ) || c < -1 || c > 3 )
+        return false;
+
+    if( !(s = strchr( argv, ',' )) )
+        return false;
+
+    uint32	w, h;
+
+    fprintf( flog, "\nff chan %d: ", c );
+
+    if( !ff[c+1].Set( s + 1, ped, w, h, flog ) )
+        return false;
+
+    isff[c+1] = true;
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* SetCmdLine ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+void CArgs_fuse::SetCmdLine( int argc, char* argv[] )
+{
+// start log
+
+    flog = FileOpenOrDie( "Fuse1Lyr.log", "w" );
+
+// log start time
+
+    time_t	t0 = time( NULL );
+    char	atime[32];
+
+    strcpy( atime, ctime( &t0 ) );
+    atime[24] = '\0';	// remove the newline
+
+    fprintf( flog, "Start: %s ", atime );
+
+// parse command line args
+
+    if( argc < 4 ) {
+        printf( "Usage: Fuse1Lyr <xml-file> <tag> -z=i [options].\n" );
+        exit( 42 );
+    }
+
+    for( int i = 1; i < argc; ++i ) {
+
+        vector<int>	vi;
+
+        // echo to log
+        fprintf( flog, "%s ", argv[i] );
+
+        if( argv[i][0] != '-' ) {
+
+            if( !infile )
+                infile = argv[i];
+            else
+                tag = argv[i];
+        }
+        else if( GetArg( &z, "-z=%d", argv[i] ) )
+            ;
+        else if( GetArg( &ped, "-ped=%d", argv[i] ) )
+            ;
+        else if( ScanFF( argv[i] ) )
+            ;
+        else if( ScanChan( gry, grypct, "-gray=%d", argv[i] ) )
+            isgry = true;
+        else if( ScanChan( heq, heqpct, "-heq=%d", argv[i] ) )
+            isheq = true;
+        else if( ScanChan( RGB[0], pct[0], "-R=%d", argv[i] ) )
+            ;
+        else if( ScanChan( RGB[1], pct[1], "-G=%d", argv[i] ) )
+            ;
+        else if( ScanChan( RGB[2], pct[2], "-B=%d", argv[i] ) )
+            ;
+        else if( GetArgStr( span, "-spanRGB=", argv[i] )
+            && (span[0] == 'L' || span[0] == 'T')
+            && (span[1] == 'L' || span[1] == 'T')
+            && (span[2] == 'L' || span[2] == 'T') )
+            ;
+        else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
+            memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArg( &nthr, "-nthr=%d", argv[i] ) )
+            ;
+        else if( GetArg( &keepmb, "-keepmb=%d", argv[i] ) )
+            ;
+        else {
+            printf( "Did not understand option '%s'.\n", argv[i] );
+            exit( 42 );
+        }
+    }
+
+    fprintf( flog, "\n\n" );
+    fflush( flog );
+
+    if( !isgry && !isheq &&
+        RGB[0] < -1 && RGB[1] < -1 && RGB[2] < -1 ) {
+
+        printf( "Fuse1Lyr: No operations requested.\n" );
+        exit( 42 );
+    }
+
+    if( nthr < 1 )
+        nthr = 1;
+}
+
+/* --------------------------------------------------------------- */
+/* Picture::Picture ---------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+Picture::Picture( const TiXmlElement* ptch )
+{
+    fname = ptch->Attribute( "file_path" );
+    T.ScanTrackEM2( ptch->Attribute( "transform" ) );
+    inroi = true;
+}
+
+/* --------------------------------------------------------------- */
+/* GetTiles ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static void GetTiles( TiXmlElement* layer )
+{
+    TiXmlElement*	ptch = layer->FirstChildElement( "t2_patch" );
+
+    if( ptch && !gW ) {
+        gW = atoi( ptch->Attribute( "width" ) );
+        gH = atoi( ptch->Attribute( "height" ) );
+    }
+
+    for( ; ptch; ptch = ptch->NextSiblingElement() )
+        vp.push_back( Picture( ptch ) );
+}
+
+/* --------------------------------------------------------------- */
+/* ParseTrakEM2 -------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void ParseTrakEM2()
+{
+/* ---- */
+/* Open */
+/* ---- */
+
+    XML_TKEM		xml( gArgs.infile, flog );
+    TiXmlElement*	layer	= xml.GetFirstLayer();
+
+/* -------------- */
+/* For each layer */
+/* -------------- */
+
+    for( ; layer; layer = layer->NextSiblingElement() ) {
+
+        /* ----------------- */
+        /* Layer-level stuff */
+        /* ----------------- */
+
+        int	z = atoi( layer->Attribute( "z" ) );
+
+        if( z < gArgs.z )
+            continue;
+
+        GetTiles( layer );
+        break;
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* InROI --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static bool InROI( const Picture &p )
+{
+    if( gArgs.roi.L == gArgs.roi.R )
+        return true;
+
+    const double xolap = gW * 0.8;
+    const double yolap = gH * 0.8;
+
+    Point	c1, c2( gW, gH );
+    double	t;
+
+    p.T.Transform( c1 );
+    p.T.Transform( c2 );
+
+    if( c2.x < c1.x ) {
+        t    = c1.x;
+        c1.x = c2.x;
+        c2.x = t;
+    }
+
+    if( c2.y < c1.y ) {
+        t    = c1.y;
+        c1.y = c2.y;
+        c2.y = t;
+    }
+
+    if( c2.x < gArgs.roi.L + xolap )
+        return false;
+
+    if( c1.x > gArgs.roi.R - xolap )
+        return false;
+
+    if( c2.y < gArgs.roi.B + yolap )
+        return false;
+
+    if( c1.y > gArgs.roi.T - yolap )
+        return false;
+
+    return true;
+}
+
+/* --------------------------------------------------------------- */
+/* Plan ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Decide which channel slots are read for output, which need a
+// layer histogram, and whether pass-1 rasters can be kept.
+//
+static void Plan()
+{
+    if( gArgs.isgry )
+        islyr[gArgs.gry+1] = true;
+
+    if( gArgs.isheq ) {
+        isout[gArgs.heq+1] = true;
+        islyr[gArgs.heq+1] = true;
+    }
+
+    for( int c = 0; c < 3; ++c ) {
+
+        if( gArgs.RGB[c] >= -1 ) {
+
+            isout[gArgs.RGB[c]+1] = true;
+
+            if( gArgs.span[c] == 'L' )
+                islyr[gArgs.RGB[c]+1] = true;
+        }
+    }
+
+// Keep pass-1 rasters that pass 2 needs, if they fit
+
+    int		np = vp.size(), nroi = 0, nk = 0;
+
+    for( int i = 0; i < np; ++i ) {
+
+        if( vp[i].inroi = InROI( vp[i] ) )
+            ++nroi;
+    }
+
+    for( int is = 0; is < NSLOT; ++is ) {
+
+        if( islyr[is] ) {
+
+            lbins[is].resize( NBINS, 0.0 );
+
+            if( isout[is] )
+                ++nk;
+        }
+    }
+
+    keep = nk &&
+        double(nroi) * nk * gW * gH * sizeof(uint16)
+        <= gArgs.keepmb * 1024.0 * 1024.0;
+
+    if( keep )
+        vkeep.resize( np * NSLOT, NULL );
+
+    fprintf( flog, "Plan: %d tiles in ROI, keep pass-1 rasters %c.\n",
+    nroi, (keep ? 'Y' : 'N') );
+}
+
+/* --------------------------------------------------------------- */
+/* Any ----------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static bool Any( const bool *slots )
+{
+    for( int is = 0; is < NSLOT; ++is ) {
+
+        if( slots[is] )
+            return true;
+    }
+
+    return false;
+}
+
+/* --------------------------------------------------------------- */
+/* ChanName ------------------------------------------------------ */
+/* --------------------------------------------------------------- */
+
+static char *ChanName( char *buf, const Picture &p, int is )
+{
+    int	len = sprintf( buf, "%s", p.fname.c_str() );
+
+    if( is )
+        buf[len - 5] = '0' + is - 1;
+
+    return buf;
+}
+
+/* --------------------------------------------------------------- */
+/* LoadFF -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Return decoded and flatfielded slot-is raster for tile i, or
+// NULL if missing. Return with pool.Put().
+//
+static uint16* LoadFF( int i, int is )
+{
+    char	buf[2048];
+    uint32	w, h;
+    uint16*	ras;
+
+    if( !DskExists( ChanName( buf, vp[i], is ) ) ) {
+        fprintf( flog, "Missing image=[%s]\n", buf );
+        return NULL;
+    }
+
+    ras = Raster16FromTif16Pooled( buf, w, h, &pool, 1, flog );
+
+    if( isff[is] )
+        ff[is].Apply( ras, w, h, gArgs.ped );
+
+    pthread_mutex_lock( &mutex_fuse );
+    ++ntile;
+    pthread_mutex_unlock( &mutex_fuse );
+
+    return ras;
+}
+
+/* --------------------------------------------------------------- */
+/* _Pass1 -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Accumulate layer histograms over ROI tiles.
+//
+void* _Pass1( void* ithr )
+{
+    vector<double>	bins[NSLOT];
+    int				np = vp.size();
+
+    for( int is = 0; is < NSLOT; ++is ) {
+
+        if( islyr[is] )
+            bins[is].resize( NBINS, 0.0 );
+    }
+
+    for( int i = (long)ithr; i < np; i += gArgs.nthr ) {
+
+        if( !vp[i].inroi )
+            continue;
+
+        for( int is = 0; is < NSLOT; ++is ) {
+
+            if( !islyr[is] )
+                continue;
+
+            uint16*	ras = LoadFF( i, is );
+            double	uflo = 0.0, oflo = 0.0;
+
+            if( !ras )
+                continue;
+
+            Histogram( uflo, oflo, &bins[is][0], NBINS,
+                0.0, NBINS, ras, gW * gH, false );
+
+            if( keep && isout[is] )
+                vkeep[i*NSLOT+is] = ras;
+            else
+                pool.Put( ras, gW * gH * sizeof(uint16) );
+        }
+    }
+
+    pthread_mutex_lock( &mutex_fuse );
+
+    for( int is = 0; is < NSLOT; ++is ) {
+
+        if( islyr[is] ) {
+
+            for( int j = 0; j < NBINS; ++j )
+                lbins[is][j] += bins[is][j];
+        }
+    }
+
+    pthread_mutex_unlock( &mutex_fuse );
+
+    return NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* LayerScales --------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void LayerScales()
+{
+    int	mn, mx;
+
+    if( gArgs.isgry ) {
+
+        char	buf[2048];
+
+        IntensScaleFromHist( mn, mx,
+            &lbins[gArgs.gry+1][0], gArgs.grypct );
+
+        DskCreateDir( "GRTemp", flog );
+
+        sprintf( buf, "GRTemp/z_%d.txt", gArgs.z );
+        FILE *f = FileOpenOrDie( buf, "w", flog );
+
+        fprintf( f, "%d\t%d\n", mn, mx );
+        fclose( f );
+
+        fprintf( flog, "Gray: [%d, %d].\n", mn, mx );
+    }
+
+    if( gArgs.isheq ) {
+
+        IntensScaleFromHist( mn, mx,
+            &lbins[gArgs.heq+1][0], gArgs.heqpct );
+
+        heqlut.resize( NBINS );
+        IntensHEQLUT( &heqlut[0], mn, mx );
+
+        fprintf( flog, "HEQ: [%d, %d].\n", mn, mx );
+    }
+
+    for( int c = 0; c < 3; ++c ) {
+
+        if( gArgs.RGB[c] >= -1 && gArgs.span[c] == 'L' ) {
+
+            IntensScaleFromHist( mn, mx,
+                &lbins[gArgs.RGB[c]+1][0], gArgs.pct[c] );
+
+            rgblut[c].resize( NBINS );
+            IntensLinLUT( &rgblut[c][0], mn, mx );
+
+            fprintf( flog, "%c: [%d, %d].\n", "RGB"[c], mn, mx );
+        }
+    }
+}
+
+/* --------------------------------------------------------------- */
+/* OutName ------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Path in folder '<tile-folder>_tag' for src with ext appended
+// to its file-name stem.
+//
+static char *OutName( char *buf, const char *src, const char *ext )
+{
+    const char	*p2 = strrchr( src, '/' );
+    const char	*p3 = FileDotPtr( p2 );
+
+    sprintf( buf,
+        "%.*s_%s"
+        "%.*s.%s%s.tif",
+        int(p2 - src), src, gArgs.tag,
+        int(p3 - p2), p2, gArgs.tag, ext );
+
+    return buf;
+}
+
+/* --------------------------------------------------------------- */
+/* MakeFolder ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+static void MakeFolder( const Picture &p )
+{
+    char		buf[2048];
+    const char	*p1, *p2;
+
+// folder path
+
+    p1 = p.fname.c_str();
+    p2 = strrchr( p1, '/' );
+    sprintf( buf, "%.*s_%s", int(p2 - p1), p1, gArgs.tag );
+
+// make dir
+
+    DskCreateDir( buf, flog );
+}
+
+/* --------------------------------------------------------------- */
+/* _Pass2 -------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Map each tile's channels through their scales and write the
+// requested products.
+//
+void* _Pass2( void* ithr )
+{
+    int				np	= vp.size(),
+                    npx	= gW * gH;
+    vector<uint8>	i8, tlut;
+    vector<uint32>	RGB;
+    bool			isrgb = gArgs.RGB[0] >= -1
+                        || gArgs.RGB[1] >= -1
+                        || gArgs.RGB[2] >= -1;
+
+    if( gArgs.isheq )
+        i8.resize( npx );
+
+    for( int i = (long)ithr; i < np; i += gArgs.nthr ) {
+
+        const Picture	&p = vp[i];
+        char			buf[2048], src[2048];
+
+        MakeFolder( p );
+
+        if( isrgb )
+            RGB.assign( npx, 0xFF000000 );
+
+        for( int is = 0; is < NSLOT; ++is ) {
+
+            if( !isout[is] )
+                continue;
+
+            uint16*	ras;
+
+            if( keep && vkeep[i*NSLOT+is] )
+                ras = vkeep[i*NSLOT+is];
+            else if( !(ras = LoadFF( i, is )) )
+                continue;
+
+            // HEQ
+
+            if( gArgs.isheq && gArgs.heq + 1 == is ) {
+
+                const uint8	*lut = &heqlut[0];
+
+                for( int k = 0; k < npx; ++k )
+                    i8[k] = lut[ras[k]];
+
+                Raster8ToTif8( OutName( buf, ChanName( src, p, is ), "" ),
+                    &i8[0], gW, gH, flog );
+
+                pthread_mutex_lock( &mutex_fuse );
+                ++nwrite;
+                pthread_mutex_unlock( &mutex_fuse );
+            }
+
+            // Colors from this channel
+
+            for( int c = 0; c < 3; ++c ) {
+
+                if( gArgs.RGB[c] + 1 != is )
+                    continue;
+
+                const uint8	*lut;
+
+                if( gArgs.span[c] == 'L' )
+                    lut = &rgblut[c][0];
+                else {
+
+                    vector<double>	bins( NBINS, 0.0 );
+                    double			uflo = 0.0, oflo = 0.0;
+                    int				mn, mx;
+
+                    Histogram( uflo, oflo, &bins[0], NBINS,
+                        0.0, NBINS, ras, npx, false );
+
+                    IntensScaleFromHist( mn, mx, &bins[0], gArgs.pct[c] );
+
+                    tlut.resize( NBINS );
+                    IntensLinLUT( &tlut[0], mn, mx );
+                    lut = &tlut[0];
+                }
+
+                for( int k = 0; k < npx; ++k )
+                    RGB[k] |= (uint32(lut[ras[k]]) << (8 * c));
+            }
+
+            pool.Put( ras, npx * sizeof(uint16) );
+
+            if( keep )
+                vkeep[i*NSLOT+is] = NULL;
+        }
+
+        if( isrgb ) {
+
+            Raster32ToTifRGBA( OutName( buf, p.fname.c_str(), ".rgb" ),
+                &RGB[0], gW, gH, flog );
+
+            pthread_mutex_lock( &mutex_fuse );
+            ++nwrite;
+            pthread_mutex_unlock( &mutex_fuse );
+        }
+    }
+
+    return NULL;
+}
+
+/* --------------------------------------------------------------- */
+/* main ---------------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+    clock_t	T0 = StartTiming();
+
+/* ------------------ */
+/* Parse command line */
+/* ------------------ */
+
+    gArgs.SetCmdLine( argc, argv );
+
+    TelemBegin( "Fuse1Lyr", argc, argv );
+    TelemTag( "z", "%d", gArgs.z );
+
+/* ---------------- */
+/* Read source file */
+/* ---------------- */
+
+    ParseTrakEM2();
+
+    fprintf( flog, "Got %d images.\n", (int)vp.size() );
+
+    if( !vp.size() )
+        goto exit;
+
+/* ---- */
+/* Plan */
+/* ---- */
+
+    Plan();
+
+/* ----------------------------- */
+/* Pass 1: layer-wide histograms */
+/* ----------------------------- */
+
+    if( Any( islyr ) ) {
+
+        CTelemStage	ts( "Pass1" );
+
+        if( gArgs.nthr == 1 )
+            _Pass1( 0 );
+        else if( !EZThreads( _Pass1, gArgs.nthr, 1, "_Pass1", flog ) )
+            exit( 42 );
+
+        LayerScales();
+    }
+
+/* ------------------------- */
+/* Pass 2: map and write out */
+/* ------------------------- */
+
+    if( Any( isout ) ) {
+
+        CTelemStage	ts( "Pass2" );
+
+        if( gArgs.nthr == 1 )
+            _Pass2( 0 );
+        else if( !EZThreads( _Pass2, gArgs.nthr, 1, "_Pass2", flog ) )
+            exit( 42 );
+    }
+
+    fprintf( flog, "Decoded %d tile-channels, wrote %d images.\n",
+    ntile, nwrite );
+
+    TelemCount( "tiles", ntile );
+    TelemCount( "writes", nwrite );
+
+/* ---- */
+/* Done */
+/* ---- */
+
+exit:
+    fprintf( flog, "\n" );
+    fclose( flog );
+    StopTiming( stdout, "Fuse1Lyr", T0 );
+    TelemEnd();
+
+    return 0;
+}
+
+
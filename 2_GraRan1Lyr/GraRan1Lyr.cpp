@@ -13,8 +13,11 @@
 #include	"File.h"
 #include	"TrakEM2_UTL.h"
 #include	"ImageIO.h"
+#include	"IntensOps.h"
 #include	"Maths.h"
 #include	"TAffine.h"
+#include	"Telemetry.h"
+#include	"TileHist.h"
 #include	"Timer.h"
 
 
@@ -44,6 +47,7 @@ public:
     IBox	roi;
     double	pct;
     char	*infile;
+    const char	*hcache;
     int		z, chn;
 
 public:
@@ -52,6 +56,7 @@ public:
         roi.L	= roi.R = 0;
         pct		= 99.5;
         infile	= NULL;
+        hcache	= NULL;
         z		= 0;
         chn		= -1;
     };
@@ -116,6 +121,8 @@ void CArgs_gray::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -267,68 +274,22 @@ static void ScaleLayer( const vector<Picture> &vp )
 {
     const int		nbins = 65536;	// also max val
     vector<double>	bins( nbins, 0.0 );
-    double			uflo = 0.0,
-                    oflo = 0.0;
     int				np   = vp.size(),
-                    T, imin, smin, smax;
+                    smin, smax;
 
-// histogram whole layer
+// histogram whole layer (cached per-tile if -hcache)
 
     for( int i = 0; i < np; ++i ) {
 
         if( !InROI( vp[i] ) )
             continue;
 
-        if( !DskExists( vp[i].fname.c_str() ) )
-            continue;
-
-        uint32	w, h;
-        uint16*	ras = Raster16FromTif16(
-                        vp[i].fname.c_str(),
-                        w, h, flog );
-
-        Histogram( uflo, oflo, &bins[0], nbins,
-            0.0, nbins, ras, w * h, false );
-
-        RasterFree( ras );
+        TileHistAccum( &bins[0], vp[i].fname.c_str(), NULL, 1, flog );
     }
 
-// smin is between lowest val and 2 sdev below mode
-// Omit highest bins to avoid detector saturation
-
-    imin = IndexOfMaxVal( &bins[0], nbins - 100 );
-    T	 = int(2.0 * sqrt( imin ));
-    smax = imin - T;
-    smin = FirstNonzero( &bins[0], nbins );
-
-    if( smax < 0 )
-        smax = 0;
-
-    if( smin < 0 )
-        smin = 0;
-
-    smin = (smin + smax) / 2;
+// scale from layer histogram
 
-// Get threshold for bkg-frg segmentation using Otsu method,
-// but exclude values lower than imin + 2 sdev or higher than
-// 98% of the object intensities.
-
-    imin += T;
-    smax  = imin + PercentileBin( &bins[imin], nbins - imin, 0.98 );
-
-    T = int(OtsuThresh( &bins[imin], smax - imin, imin, smax ));
-
-// Now, we aren't going to find objects with the Otsu threshold,
-// however, we are going to set the scale maximum as pct% of the
-// foreground counts.
-
-    if( gArgs.pct < 100.0 ) {
-
-        smax = T +
-        PercentileBin( &bins[T], nbins - T, gArgs.pct/100.0 );
-    }
-    else
-        smax = T + int((nbins - T) * gArgs.pct/100.0);
+    IntensScaleFromHist( smin, smax, &bins[0], gArgs.pct );
 
     WriteScaleEntry( smin, smax );
 }
@@ -347,6 +308,10 @@ int main( int argc, char* argv[] )
 /* ------------------ */
 
     gArgs.SetCmdLine( argc, argv );
+    TileHistSetDir( gArgs.hcache, flog );
+
+    TelemBegin( "GraRan1Lyr", argc, argv );
+    TelemTag( "z", "%d", gArgs.z );
 
 /* ---------------- */
 /* Read source file */
@@ -355,6 +320,7 @@ int main( int argc, char* argv[] )
     ParseTrakEM2( vp );
 
     fprintf( flog, "Got %d images.\n", (int)vp.size() );
+    TelemCount( "tiles", vp.size() );
 
     if( !vp.size() )
         goto exit;
@@ -363,7 +329,10 @@ int main( int argc, char* argv[] )
 /* Calculate scaling */
 /* ----------------- */
 
-    ScaleLayer( vp );
+    {
+        CTelemStage	ts( "ScaleLayer" );
+        ScaleLayer( vp );
+    }
 
 /* ---- */
 /* Done */
@@ -373,6 +342,7 @@ exit:
     fprintf( flog, "\n" );
     fclose( flog );
     StopTiming( stdout, "GraRan1Lyr", T0 );
+    TelemEnd();
 
     return 0;
 }
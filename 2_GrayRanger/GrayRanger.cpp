@@ -35,6 +35,7 @@ public:
     IBox	roi;
     double	pct;
     char	*infile;
+    const char	*hcache;
     int		zmin,
             zmax,
             chn;
@@ -45,6 +46,7 @@ public:
         roi.L	= roi.R = 0;
         pct		= 99.5;
         infile	= NULL;
+        hcache	= NULL;
         zmin	= 0;
         zmax	= 32768;
         chn		= -1;
@@ -111,6 +113,8 @@ void CArgs_gray::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -164,7 +168,7 @@ static void WriteScript( vector<int> &zlist )
 {
 // compose common argument string
 
-    char	sopt[256];
+    char	sopt[2048];
     int		pos = 0;
 
     if( gArgs.chn >= 0 )
@@ -179,6 +183,9 @@ static void WriteScript( vector<int> &zlist )
                 gArgs.roi.B, gArgs.roi.T );
     }
 
+    if( gArgs.hcache )
+        pos += sprintf( sopt + pos, "-hcache=%s ", gArgs.hcache );
+
 // open file
 
     FILE	*f = FileOpenOrDie( "make.scales.sht", "w", flog );
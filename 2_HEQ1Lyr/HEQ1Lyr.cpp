@@ -11,9 +11,14 @@
 #include	"Disk.h"
 #include	"File.h"
 #include	"TrakEM2_UTL.h"
+#include	"CTifReader.h"
+#include	"EZThreads.h"
 #include	"ImageIO.h"
+#include	"IntensOps.h"
 #include	"Maths.h"
 #include	"TAffine.h"
+#include	"Telemetry.h"
+#include	"TileHist.h"
 #include	"Timer.h"
 
 
@@ -21,10 +26,18 @@
 /* Macros -------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+#define	NWRSLOT	2	// mapped tiles awaiting write
+
 /* --------------------------------------------------------------- */
 /* Types --------------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
+class CWrSlot {
+public:
+    string			name;
+    vector<uint8>	i8;
+};
+
 class Picture {
 public:
     string	fname;
@@ -44,7 +57,9 @@ public:
     double	pct;
     char	*infile,
             *tag;
-    int		z;
+    const char	*hcache;
+    int		z,
+            nthr;
 
 public:
     CArgs_heq()
@@ -53,7 +68,9 @@ public:
         pct		= 99.5;
         infile	= NULL;
         tag		= NULL;
+        hcache	= NULL;
         z		= 0;
+        nthr	= 1;
     };
 
     void SetCmdLine( int argc, char* argv[] );
@@ -66,6 +83,16 @@ public:
 static CArgs_heq	gArgs;
 static FILE*		flog = NULL;
 static uint32		gW = 0,	gH = 0;		// universal pic dims
+static CRasterPool	pool( 1 );			// recycled tile raster
+static const vector<Picture>	*gvp;
+static vector<uint8>	heqlut;				// layer log mapping
+static vector<CWrSlot>	vwr( NWRSLOT );		// write-behind ring
+static int				nwrfull	= 0,
+                        ntile	= 0;
+static double			inMB	= 0.0;
+static bool				wrdone	= false;
+static pthread_mutex_t	mutex_wr	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	cond_wr		= PTHREAD_COND_INITIALIZER;
 
 
 
@@ -117,8 +144,12 @@ void CArgs_heq::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArg( &pct, "-pct=%lf", argv[i] ) )
             ;
+        else if( GetArg( &nthr, "-nthr=%d", argv[i] ) )
+            ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -276,17 +307,20 @@ static char *OutName( char *buf, const Picture &p )
 }
 
 /* --------------------------------------------------------------- */
-/* WriteImages --------------------------------------------------- */
+/* MapTiles ------------------------------------------------------ */
 /* --------------------------------------------------------------- */
 
-static void WriteImages(
-    const vector<Picture>	&vp,
-    int						smin,
-    int						smax )
+// Decode each tile and map it through heqlut into the next free
+// write slot, which WriteTiles then encodes and writes while we
+// go on to the next tile.
+//
+static void MapTiles()
 {
-    double	scale	= 255.0 / log((double)smax - smin);
-    int		np		= vp.size(),
-            npx		= gW * gH;
+    const vector<Picture>	&vp		= *gvp;
+    const uint8				*lut	= &heqlut[0];
+    int						np		= vp.size(),
+                            npx		= gW * gH,
+                            iw		= 0;
 
     for( int i = 0; i < np; ++i ) {
 
@@ -298,104 +332,163 @@ static void WriteImages(
 
         MakeFolder( p );
 
+        // await free slot
+
+        pthread_mutex_lock( &mutex_wr );
+
+        while( nwrfull == NWRSLOT )
+            pthread_cond_wait( &cond_wr, &mutex_wr );
+
+        pthread_mutex_unlock( &mutex_wr );
+
+        // fill it
+
+        CWrSlot	&S = vwr[iw];
         uint32	w, h;
-        uint16*	ras = Raster16FromTif16(
+        uint16*	ras = Raster16FromTif16Pooled(
                         p.fname.c_str(),
-                        w, h, flog );
+                        w, h, &pool, gArgs.nthr, flog );
 
-        vector<uint8>	i8( npx );
+        S.i8.resize( npx );
 
-        for( int i = 0; i < npx; ++i ) {
+        uint8	*i8 = &S.i8[0];
 
-            if( ras[i] <= smin )
-                i8[i] = 0;
-            else {
+        for( int k = 0; k < npx; ++k )
+            i8[k] = lut[ras[k]];
 
-                double	pix = log(ras[i] - (double)smin) * scale;
+        pool.Put( ras, w * h * sizeof(uint16) );
 
-                if( pix > 255 )
-                    pix = 255;
+        S.name = OutName( buf, p );
 
-                i8[i] = (uint8)pix;
-            }
-        }
+        ++ntile;
+        inMB += w * h * sizeof(uint16) / (1024.0 * 1024.0);
+
+        // hand to writer
 
-        RasterFree( ras );
+        pthread_mutex_lock( &mutex_wr );
+        ++nwrfull;
+        pthread_cond_signal( &cond_wr );
+        pthread_mutex_unlock( &mutex_wr );
 
-        Raster8ToTif8( OutName( buf, p ), &i8[0], gW, gH );
+        iw = (iw + 1) % NWRSLOT;
     }
+
+    pthread_mutex_lock( &mutex_wr );
+    wrdone = true;
+    pthread_cond_signal( &cond_wr );
+    pthread_mutex_unlock( &mutex_wr );
 }
 
 /* --------------------------------------------------------------- */
-/* ScaleLayer ---------------------------------------------------- */
+/* WriteTiles ---------------------------------------------------- */
 /* --------------------------------------------------------------- */
 
-static void ScaleLayer( const vector<Picture> &vp )
+// Write filled slots in order until MapTiles is done.
+//
+static void WriteTiles()
 {
-    const int		nbins = 65536;	// also max val
-    vector<double>	bins( nbins, 0.0 );
-    double			uflo = 0.0,
-                    oflo = 0.0;
-    int				np   = vp.size(),
-                    T, imin, smin, smax;
+    for( int ir = 0;; ir = (ir + 1) % NWRSLOT ) {
 
-// histogram whole layer
+        int	n;
 
-    for( int i = 0; i < np; ++i ) {
+        pthread_mutex_lock( &mutex_wr );
 
-        if( !InROI( vp[i] ) )
-            continue;
+        while( !nwrfull && !wrdone )
+            pthread_cond_wait( &cond_wr, &mutex_wr );
 
-        if( !DskExists( vp[i].fname.c_str() ) )
-            continue;
+        n = nwrfull;
 
-        uint32	w, h;
-        uint16*	ras = Raster16FromTif16(
-                        vp[i].fname.c_str(),
-                        w, h, flog );
+        pthread_mutex_unlock( &mutex_wr );
+
+        if( !n )
+            break;
+
+        CWrSlot	&S = vwr[ir];
 
-        Histogram( uflo, oflo, &bins[0], nbins,
-            0.0, nbins, ras, w * h, false );
+        Raster8ToTif8( S.name.c_str(), &S.i8[0], gW, gH );
 
-        RasterFree( ras );
+        pthread_mutex_lock( &mutex_wr );
+        --nwrfull;
+        pthread_cond_signal( &cond_wr );
+        pthread_mutex_unlock( &mutex_wr );
     }
+}
+
+/* --------------------------------------------------------------- */
+/* _Pipe --------------------------------------------------------- */
+/* --------------------------------------------------------------- */
 
-// smin is between lowest val and 2 sdev below mode
-// Omit highest bins to avoid detector saturation
+void* _Pipe( void* ithr )
+{
+    if( (long)ithr )
+        WriteTiles();
+    else
+        MapTiles();
 
-    imin = IndexOfMaxVal( &bins[0], nbins - 100 );
-    T	 = int(2.0 * sqrt( imin ));
-    smax = imin - T;
-    smin = FirstNonzero( &bins[0], nbins );
+    return NULL;
+}
 
-    if( smax < 0 )
-        smax = 0;
+/* --------------------------------------------------------------- */
+/* WriteImages --------------------------------------------------- */
+/* --------------------------------------------------------------- */
 
-    if( smin < 0 )
-        smin = 0;
+// Map each pixel v > smin to log(v - smin) * 255 / log(smax - smin)
+// using a table built once for the layer, and overlap tif encoding
+// with decode and mapping of the next tile.
+//
+static void WriteImages(
+    const vector<Picture>	&vp,
+    int						smin,
+    int						smax )
+{
+    clock_t	t0 = StartTiming();
 
-    smin = (smin + smax) / 2;
+    heqlut.resize( 65536 );
+    IntensHEQLUT( &heqlut[0], smin, smax );
 
-// Get threshold for bkg-frg segmentation using Otsu method,
-// but exclude values lower than imin + 2 sdev or higher than
-// 98% of the object intensities.
+    gvp = &vp;
 
-    imin += T;
-    smax  = imin + PercentileBin( &bins[imin], nbins - imin, 0.98 );
+    if( !EZThreads( _Pipe, 2, 0, "_Pipe", flog ) )
+        exit( 42 );
 
-    T = int(OtsuThresh( &bins[imin], smax - imin, imin, smax ));
+// throughput
 
-// Now, we aren't going to find objects with the Otsu threshold,
-// however, we are going to set the scale maximum as pct% of the
-// foreground counts.
+    double	sec = DeltaSeconds( t0 );
 
-    if( gArgs.pct < 100.0 ) {
+    if( sec <= 0.0 )
+        sec = 0.001;
+
+    fprintf( flog,
+    "Throughput: %d tiles, %.1f MB in %.2f sec:"
+    " %.2f tiles/sec, %.2f MB/sec.\n",
+    ntile, inMB, sec, ntile / sec, inMB / sec );
+}
+
+/* --------------------------------------------------------------- */
+/* ScaleLayer ---------------------------------------------------- */
+/* --------------------------------------------------------------- */
 
-        smax = T +
-        PercentileBin( &bins[T], nbins - T, gArgs.pct/100.0 );
+static void ScaleLayer( const vector<Picture> &vp )
+{
+    const int		nbins = 65536;	// also max val
+    vector<double>	bins( nbins, 0.0 );
+    int				np   = vp.size(),
+                    smin, smax;
+
+// histogram whole layer (cached per-tile if -hcache)
+
+    for( int i = 0; i < np; ++i ) {
+
+        if( !InROI( vp[i] ) )
+            continue;
+
+        TileHistAccum( &bins[0], vp[i].fname.c_str(),
+            &pool, gArgs.nthr, flog );
     }
-    else
-        smax = T + int((nbins - T) * gArgs.pct/100.0);
+
+// scale from layer histogram
+
+    IntensScaleFromHist( smin, smax, &bins[0], gArgs.pct );
 
     WriteImages( vp, smin, smax );
 }
@@ -414,6 +507,10 @@ int main( int argc, char* argv[] )
 /* ------------------ */
 
     gArgs.SetCmdLine( argc, argv );
+    TileHistSetDir( gArgs.hcache, flog );
+
+    TelemBegin( "HEQ1Lyr", argc, argv );
+    TelemTag( "z", "%d", gArgs.z );
 
 /* ---------------- */
 /* Read source file */
@@ -422,6 +519,7 @@ int main( int argc, char* argv[] )
     ParseTrakEM2( vp );
 
     fprintf( flog, "Got %d images.\n", (int)vp.size() );
+    TelemCount( "tiles", vp.size() );
 
     if( !vp.size() )
         goto exit;
@@ -430,7 +528,10 @@ int main( int argc, char* argv[] )
 /* Calculate scaling */
 /* ----------------- */
 
-    ScaleLayer( vp );
+    {
+        CTelemStage	ts( "ScaleLayer" );
+        ScaleLayer( vp );
+    }
 
 /* ---- */
 /* Done */
@@ -440,6 +541,7 @@ exit:
     fprintf( flog, "\n" );
     fclose( flog );
     StopTiming( stdout, "HEQ1Lyr", T0 );
+    TelemEnd();
 
     return 0;
 }
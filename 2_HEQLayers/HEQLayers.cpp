@@ -35,6 +35,7 @@ public:
     double	pct;
     char	*infile,
             *tag;
+    const char	*hcache;
     int		zmin,
             zmax;
 
@@ -45,6 +46,7 @@ public:
         pct		= 99.5;
         infile	= NULL;
         tag		= NULL;
+        hcache	= NULL;
         zmin	= 0;
         zmax	= 32768;
     };
@@ -113,6 +115,8 @@ void CArgs_gray::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -166,11 +170,14 @@ static void WriteScript( vector<int> &zlist )
 {
 // compose common argument string
 
-    char	sopt[256];
+    char	sopt[2048];
     int		pos = 0;
 
     pos += sprintf( sopt + pos, "-pct=%g ", gArgs.pct );
 
+// decode with the 4 slots each job reserves
+    pos += sprintf( sopt + pos, "-nthr=4 " );
+
     if( gArgs.roi.L != gArgs.roi.R ) {
 
         pos += sprintf( sopt + pos, "-lrbt=%d,%d,%d,%d ",
@@ -178,6 +185,9 @@ static void WriteScript( vector<int> &zlist )
                 gArgs.roi.B, gArgs.roi.T );
     }
 
+    if( gArgs.hcache )
+        pos += sprintf( sopt + pos, "-hcache=%s ", gArgs.hcache );
+
 // open file
 
     FILE	*f = FileOpenOrDie( "make.heq.sht", "w", flog );
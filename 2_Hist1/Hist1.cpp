@@ -2,10 +2,13 @@
 // Get one binary histogram file from
 // one 16-bit gray image.
 //
+// With -hcache=<dir> the per-tile histogram is also left in
+// (or taken from) the shared TileHist cache.
+//
 
+#include	"Cmdline.h"
 #include	"File.h"
-#include	"ImageIO.h"
-#include	"Maths.h"
+#include	"TileHist.h"
 
 #include	<string.h>
 
@@ -24,9 +27,10 @@
 
 class CArgs_hist1 {
 public:
-    char	*img, *hst;
+    char		*img, *hst;
+    const char	*hcache;
 public:
-    CArgs_hist1() : img(NULL), hst(NULL) {};
+    CArgs_hist1() : img(NULL), hst(NULL), hcache(NULL) {};
 
     void SetCmdLine( int argc, char* argv[] );
 };
@@ -66,7 +70,7 @@ void CArgs_hist1::SetCmdLine( int argc, char* argv[] )
 // parse command line args
 
     if( argc < 3 ) {
-        printf( "Usage: Hist1 <img-file> <hst_file>.\n" );
+        printf( "Usage: Hist1 <img-file> <hst_file> [options].\n" );
         exit( 42 );
     }
 
@@ -77,6 +81,15 @@ void CArgs_hist1::SetCmdLine( int argc, char* argv[] )
 
         // echo to log
         fprintf( flog, "%s ", argv[i] );
+
+        if( i < 3 )
+            ;
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
+        else {
+            printf( "Did not understand option '%s'.\n", argv[i] );
+            exit( 42 );
+        }
     }
 
     fprintf( flog, "\n\n" );
@@ -93,17 +106,11 @@ static void Hist()
 
     const int		nbins = 65536;	// also max val
     vector<double>	bins( nbins, 0.0 );
-    double			uflo = 0.0,
-                    oflo = 0.0;
-    uint32			w, h;
-    uint16*			ras;
-
-    ras = Raster16FromTif16( gArgs.img, w, h, flog );
+    double			uflo = 0.0,		// 16-bit data can't
+                    oflo = 0.0;		// fall outside bins
 
-    Histogram( uflo, oflo, &bins[0], nbins,
-        0.0, nbins, ras, w * h, false );
-
-    RasterFree( ras );
+    if( !TileHistAccum( &bins[0], gArgs.img, NULL, 1, flog ) )
+        exit( 42 );
 
 // write binary hist file
 
@@ -128,6 +135,7 @@ int main( int argc, char* argv[] )
 /* ------------------ */
 
     gArgs.SetCmdLine( argc, argv );
+    TileHistSetDir( gArgs.hcache, flog );
 
 /* --------- */
 /* Histogram */
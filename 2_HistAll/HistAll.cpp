@@ -43,6 +43,7 @@ class CArgs_hsta {
 
 public:
     char		*infile;
+    const char	*hcache;
     int			zmin,
                 zmax;
     vector<int>	chn;
@@ -51,6 +52,7 @@ public:
     CArgs_hsta()
     {
         infile	= NULL;
+        hcache	= NULL;
         zmin	= 0;
         zmax	= 32768;
     };
@@ -110,6 +112,8 @@ void CArgs_hsta::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( chn, "-chan=", argv[i] ) )
             ;
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -208,6 +212,13 @@ static void WriteScript( const vector<Picture> &vp )
 
     FILE	*f = FileOpenOrDie( "HST/make.hst.sht", "w", flog );
 
+// shared per-tile histogram cache
+
+    char	hopt[2048] = "";
+
+    if( gArgs.hcache )
+        sprintf( hopt, " -hcache=%s", gArgs.hcache );
+
 // write
 
     int		np = vp.size(),
@@ -226,9 +237,9 @@ static void WriteScript( const vector<Picture> &vp )
 
             fprintf( f,
             "QSUB_1NODE.sht 33 \"hst-%d-%d\" \"out.txt\" 0 1"
-            " \"Hist1 '%s_%d.tif' 'HST_%d_%d_%d.bin'\"\n",
+            " \"Hist1 '%s_%d.tif' 'HST_%d_%d_%d.bin'%s\"\n",
             ip*nc+ic, np*nc,
-            P.fname.c_str(), chn, P.z, P.id, chn );
+            P.fname.c_str(), chn, P.z, P.id, chn, hopt );
         }
     }
 
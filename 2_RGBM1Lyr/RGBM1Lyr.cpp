@@ -20,9 +20,13 @@
 #include	"Disk.h"
 #include	"File.h"
 #include	"TrakEM2_UTL.h"
+#include	"CTifReader.h"
 #include	"ImageIO.h"
+#include	"IntensOps.h"
 #include	"Maths.h"
 #include	"TAffine.h"
+#include	"Telemetry.h"
+#include	"TileHist.h"
 #include	"Timer.h"
 
 
@@ -61,8 +65,10 @@ public:
     double		pct[3];
     const char	*infile,
                 *tag,
-                *span;
-    int			z, RGB[3];
+                *span,
+                *hcache;
+    int			z, RGB[3],
+                nthr;
 
 public:
     CArgs_rgbm()
@@ -74,10 +80,12 @@ public:
         infile	= NULL;
         tag		= NULL;
         span	= "LLL";
+        hcache	= NULL;
         z		= 0;
         RGB[0]	= -1;
         RGB[1]	= -1;
         RGB[2]	= -1;
+        nthr	= 1;
     };
 
     bool ScanChan( int chn, const char *pat, char *argv );
@@ -91,6 +99,7 @@ public:
 static CArgs_rgbm	gArgs;
 static FILE*		flog = NULL;
 static uint32		gW = 0,	gH = 0;		// universal pic dims
+static CRasterPool	pool( 1 );			// recycled tile raster
 
 
 
@@ -181,6 +190,10 @@ void CArgs_rgbm::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArg( &nthr, "-nthr=%d", argv[i] ) )
+            ;
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -336,11 +349,25 @@ static bool GetRas16( uint16* &ras, const Picture &p, int chn )
     if( !DskExists( ChanName( buf, p, chn ) ) )
         return false;
 
-    ras = Raster16FromTif16( buf, w, h, flog );
+    ras = Raster16FromTif16Pooled( buf, w, h, &pool, gArgs.nthr, flog );
 
     return true;
 }
 
+/* --------------------------------------------------------------- */
+/* AddHist16 ----------------------------------------------------- */
+/* --------------------------------------------------------------- */
+
+// Add channel histogram to bins, from -hcache if possible.
+//
+static bool AddHist16( double *bins, const Picture &p, int chn )
+{
+    char	buf[2048];
+
+    return TileHistAccum( bins, ChanName( buf, p, chn ),
+            &pool, gArgs.nthr, flog );
+}
+
 /* --------------------------------------------------------------- */
 /* Scale1Clr ----------------------------------------------------- */
 /* --------------------------------------------------------------- */
@@ -354,10 +381,7 @@ static void Scale1Clr(
 {
     const int		nbins = 65536;	// also max val
     vector<double>	bins( nbins, 0.0 );
-    double			uflo = 0.0,
-                    oflo = 0.0;
-    int				np   = vp.size(),
-                    T, imin;
+    int				np   = vp.size();
 
 // collect histogram
 
@@ -365,20 +389,12 @@ static void Scale1Clr(
 
         // tile ip
 
-        uint16*	ras;
-
-        if( !GetRas16( ras, vp[ip], gArgs.RGB[rgb] ) ) {
+        if( !AddHist16( &bins[0], vp[ip], gArgs.RGB[rgb] ) ) {
 
             mn	= 0;
             mx	= 65536;
             return;
         }
-
-        Histogram( uflo, oflo, &bins[0], nbins,
-            0.0, nbins, ras, gW * gH, false );
-
-        RasterFree( ras );
-
     }
     else {
 
@@ -386,57 +402,14 @@ static void Scale1Clr(
 
         for( int i = 0; i < np; ++i ) {
 
-            uint16*	ras;
-
-            if( !InROI( vp[i] ) )
-                continue;
-
-            if( !GetRas16( ras, vp[i], gArgs.RGB[rgb] ) )
-                continue;
-
-            Histogram( uflo, oflo, &bins[0], nbins,
-                0.0, nbins, ras, gW * gH, false );
-
-            RasterFree( ras );
+            if( InROI( vp[i] ) )
+                AddHist16( &bins[0], vp[i], gArgs.RGB[rgb] );
         }
     }
 
-// mn is between lowest val and 2 sdev below mode
-// Omit highest bins to avoid detector saturation
-
-    imin = IndexOfMaxVal( &bins[0], nbins - 100 );
-    T	 = int(2.0 * sqrt( imin ));
-    mx   = imin - T;
-    mn   = FirstNonzero( &bins[0], nbins );
-
-    if( mx < 0 )
-        mx = 0;
-
-    if( mn < 0 )
-        mn = 0;
-
-    mn = (mn + mx) / 2;
-
-// Get threshold for bkg-frg segmentation using Otsu method,
-// but exclude values lower than imin + 2 sdev or higher than
-// 98% of the object intensities.
+// scale from histogram
 
-    imin += T;
-    mx = imin + PercentileBin( &bins[imin], nbins - imin, 0.98 );
-
-    T = int(OtsuThresh( &bins[imin], mx - imin, imin, mx ));
-
-// Now, we aren't going to find objects with the Otsu threshold,
-// however, we are going to set the scale maximum as pct% of the
-// foreground counts.
-
-    if( gArgs.pct[rgb] < 100.0 ) {
-
-        mx = T +
-        PercentileBin( &bins[T], nbins - T, gArgs.pct[rgb]/100.0 );
-    }
-    else
-        mx = T + int((nbins - T) * gArgs.pct[rgb]/100.0);
+    IntensScaleFromHist( mn, mx, &bins[0], gArgs.pct[rgb] );
 }
 
 /* --------------------------------------------------------------- */
@@ -482,7 +455,7 @@ static void AddChn(
             RGB[i] |= (pix << shf);
         }
 
-        RasterFree( ras );
+        pool.Put( ras, gW * gH * sizeof(uint16) );
     }
 }
 
@@ -557,6 +530,10 @@ int main( int argc, char* argv[] )
 /* ------------------ */
 
     gArgs.SetCmdLine( argc, argv );
+    TileHistSetDir( gArgs.hcache, flog );
+
+    TelemBegin( "RGBM1Lyr", argc, argv );
+    TelemTag( "z", "%d", gArgs.z );
 
 /* ---------------- */
 /* Read source file */
@@ -565,6 +542,7 @@ int main( int argc, char* argv[] )
     ParseTrakEM2( vp );
 
     fprintf( flog, "Got %d images.\n", (int)vp.size() );
+    TelemCount( "tiles", vp.size() );
 
     if( !vp.size() )
         goto exit;
@@ -573,7 +551,10 @@ int main( int argc, char* argv[] )
 /* Calculate scaling */
 /* ----------------- */
 
-    ScaleLayer( vp );
+    {
+        CTelemStage	ts( "ScaleLayer" );
+        ScaleLayer( vp );
+    }
 
 /* ---- */
 /* Done */
@@ -583,6 +564,7 @@ exit:
     fprintf( flog, "\n" );
     fclose( flog );
     StopTiming( stdout, "RGBM1Lyr", T0 );
+    TelemEnd();
 
     return 0;
 }
@@ -42,7 +42,8 @@ public:
     double		pct[3];
     const char	*infile,
                 *tag,
-                *span;
+                *span,
+                *hcache;
     int			zmin, zmax,
                 RGB[3];
 
@@ -56,6 +57,7 @@ public:
         infile	= NULL;
         tag		= NULL;
         span	= "LLL";
+        hcache	= NULL;
         zmin	= 0;
         zmax	= 32768;
         RGB[0]	= -1;
@@ -162,6 +164,8 @@ void CArgs_rgbm::SetCmdLine( int argc, char* argv[] )
             ;
         else if( GetArgList( vi, "-lrbt=", argv[i] ) && vi.size() == 4 )
             memcpy( &roi, &vi[0], 4*sizeof(int) );
+        else if( GetArgStr( hcache, "-hcache=", argv[i] ) )
+            ;
         else {
             printf( "Did not understand option '%s'.\n", argv[i] );
             exit( 42 );
@@ -216,7 +220,7 @@ static void WriteScript( vector<int> &zlist )
 // compose common argument string
 
     const char	*sRGB = "RGB";
-    char		sopt[256];
+    char		sopt[2048];
     int			pos = 0;
 
     for( int i = 0; i < 3; ++i ) {
@@ -229,6 +233,9 @@ static void WriteScript( vector<int> &zlist )
 
     pos += sprintf( sopt + pos, "-spanRGB=%s ", gArgs.span );
 
+// decode with the 4 slots each job reserves
+    pos += sprintf( sopt + pos, "-nthr=4 " );
+
     if( gArgs.roi.L != gArgs.roi.R ) {
 
         pos += sprintf( sopt + pos, "-lrbt=%d,%d,%d,%d ",
@@ -236,6 +243,9 @@ static void WriteScript( vector<int> &zlist )
                 gArgs.roi.B, gArgs.roi.T );
     }
 
+    if( gArgs.hcache )
+        pos += sprintf( sopt + pos, "-hcache=%s ", gArgs.hcache );
+
 // open file
 
     FILE	*f = FileOpenOrDie( "make.merge.sht", "w", flog );